@@ -315,7 +315,7 @@ struct CaiNiaoSystem {
         std::ifstream fs(m_storage_path);
         std::vector<char> data{ std::istreambuf_iterator(fs), std::istreambuf_iterator<char>() };
         auto jv = json::JsonValue();
-        if (!jv.try_deserialize_from_utf8(data)) {
+        if (!jv.try_deserialize_from_utf8_indexed(data)) {
             return false;
         }
         if (!jv.is_object()) {
@@ -1,22 +1,24 @@
 #include "json.h"
 #include <optional>
-#include <format>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <thread>
 
-double npow(double x, int p) {
-    double result = 1;
-    if (p < 0) {
-        p = -p;
-        x = 1 / x;
-    }
-    while (p) {
-        if (p & 1) {
-            result *= x;
-        }
-        x *= x;
-        p >>= 1;
-    }
-    return result;
-}
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JSON_INDEX_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSON_INDEX_SSE2
+#endif
 
 void append_utf8_codepoint_to_string(std::string &str, uint32_t cp) {
     if (cp < 0x80) {
@@ -71,100 +73,113 @@ std::optional<char> try_next_char(std::string_view sv, size_t &rpos) {
     return och;
 }
 
+// Integers without a fraction or exponent that fit keep their exact value
+using JsonNumber = std::variant<int64_t, uint64_t, double>;
+
 // NOTE: Caller must manually skip leading whitespaces
 // NOTE: Numbers are implicitly terminated (finishes parsing as soon
 //       as an invalid character is read)
-double read_number(std::string_view sv, size_t &rpos) {
-    double int_num = 0, frac_num = 0;
-    double frac_factor = 10;
-    int exp_pow = 0;
-    bool neg_exp_pow = false;
+JsonNumber read_number(std::string_view sv, size_t &rpos) {
+    // Every power of ten up to 1e22 is exact in a double
+    static constexpr double exact_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
     size_t cur_rpos = rpos;
     bool neg_sign = false;
-    enum {
-        Started, InInteger, InPoint, InFraction, InExponentSign, InExponent,
-    } cur_state = Started;
     if (look_ahead(sv, cur_rpos) == '-') {
         neg_sign = true;
         cur_rpos++;
     }
-    while (true) {
-        auto och = try_look_ahead(sv, cur_rpos);
-        if (!och) {
-            // Found end of stream, stop parsing
-            break;
-        }
-        char ch = *och;
-        if (std::isdigit(ch)) {
-            int digit = ch - '0';
-            switch (cur_state) {
-            case Started:
-            case InInteger:
-                cur_state = InInteger;
-                int_num = int_num * 10 + digit;
-                break;
-            case InPoint:
-            case InFraction:
-                cur_state = InFraction;
-                frac_num += digit / frac_factor;
-                frac_factor *= 10;
-                break;
-            case InExponentSign:
-            case InExponent:
-                cur_state = InExponent;
-                exp_pow = exp_pow * 10 + digit;
-                break;
-            default:
-                throw std::runtime_error("State machine corrupted while parsing number");
-            }
-        }
-        else if (ch == '.') {
-            if (cur_state == InInteger) {
-                cur_state = InPoint;
+    size_t digits_begin = cur_rpos;
+    // The first 19 significant digits always fit into a uint64_t, a 20th one if it stays
+    // in range; the value is mantissa * 10^exp10 unless digits had to be dropped
+    uint64_t mantissa = 0;
+    int significant_digits = 0;
+    int64_t exp10 = 0;
+    bool truncated = false;
+    auto read_digits = [&](bool fraction) {
+        size_t begin = cur_rpos;
+        for (; cur_rpos < sv.size() && sv[cur_rpos] >= '0' && sv[cur_rpos] <= '9'; cur_rpos++) {
+            uint64_t digit = sv[cur_rpos] - '0';
+            if (significant_digits < 19 || (significant_digits == 19 && mantissa <= (UINT64_MAX - digit) / 10)) {
+                mantissa = mantissa * 10 + digit;
+                significant_digits += mantissa != 0;
+                exp10 -= fraction;
             }
             else {
-                // Found invalid dot, stop parsing
-                break;
+                truncated = true;
+                exp10 += !fraction;
             }
         }
-        else if (ch == 'e' || ch == 'E') {
-            if (cur_state == InInteger || cur_state == InFraction) {
-                cur_state = InExponentSign;
-                // Hack: Temporarily update read pos
-                cur_rpos++;
-                ch = look_ahead(sv, cur_rpos);
-                cur_rpos--;
-                if (ch == '+') {
-                    cur_rpos++;
-                }
-                else if (ch == '-') {
-                    neg_exp_pow = true;
-                    cur_rpos++;
-                }
-            }
-            else {
-                // Found invalid exponent sign, stop parsing
-                break;
+        if (cur_rpos == begin) {
+            throw std::runtime_error("Found invalid number while parsing");
+        }
+    };
+    read_digits(false);
+    size_t integer_end = cur_rpos;
+    if (cur_rpos < sv.size() && sv[cur_rpos] == '.') {
+        cur_rpos++;
+        read_digits(true);
+    }
+    if (cur_rpos < sv.size() && (sv[cur_rpos] == 'e' || sv[cur_rpos] == 'E')) {
+        cur_rpos++;
+        char ch = look_ahead(sv, cur_rpos);
+        bool neg_exp_pow = ch == '-';
+        if (ch == '+' || ch == '-') {
+            cur_rpos++;
+        }
+        size_t exp_begin = cur_rpos;
+        int64_t exp_pow = 0;
+        for (; cur_rpos < sv.size() && sv[cur_rpos] >= '0' && sv[cur_rpos] <= '9'; cur_rpos++) {
+            // Saturates far outside the range of double
+            exp_pow = std::min<int64_t>(exp_pow * 10 + (sv[cur_rpos] - '0'), 1000000);
+        }
+        if (cur_rpos == exp_begin) {
+            throw std::runtime_error("Found invalid number while parsing");
+        }
+        exp10 += neg_exp_pow ? -exp_pow : exp_pow;
+    }
+
+    // -0 stays a double to keep its sign
+    if (cur_rpos == integer_end && !truncated && mantissa != 0) {
+        if (!neg_sign) {
+            rpos = cur_rpos;
+            if (mantissa <= static_cast<uint64_t>(INT64_MAX)) {
+                return static_cast<int64_t>(mantissa);
             }
+            return mantissa;
         }
-        else {
-            // Found invalid character, stop parsing
-            break;
+        if (mantissa <= static_cast<uint64_t>(INT64_MAX) + 1) {
+            rpos = cur_rpos;
+            return static_cast<int64_t>(0 - mantissa);
         }
-        // Current iteration succeeded, advance pointer
-        cur_rpos++;
     }
-    // Validate state
-    switch (cur_state) {
-    case InInteger:
-    case InFraction:
-    case InExponent:
-        break;
-    default:
-        throw std::runtime_error("Found invalid number while parsing");
+    double value;
+    if (mantissa == 0) {
+        value = 0;
+    }
+    else if (!truncated && exp10 == 0) {
+        // Integers out of the range of int64_t: converting rounds correctly
+        value = static_cast<double>(mantissa);
+    }
+    else if (!truncated && mantissa <= (uint64_t{ 1 } << 53) && exp10 >= -22 && exp10 <= 22) {
+        // Both operands are exact, so the only rounding is that of the result
+        value = static_cast<double>(mantissa);
+        value = exp10 < 0 ? value / exact_pow10[-exp10] : value * exact_pow10[exp10];
+    }
+    else {
+        // The standard library parses the rest correctly rounded as well
+        auto [ptr, ec] = std::from_chars(sv.data() + digits_begin, sv.data() + cur_rpos, value);
+        if (ec == std::errc::result_out_of_range) {
+            value = significant_digits + exp10 > 0 ? HUGE_VAL : 0.0;
+        }
+        else if (ec != std::errc{} || ptr != sv.data() + cur_rpos) {
+            throw std::runtime_error("Found invalid number while parsing");
+        }
     }
     rpos = cur_rpos;
-    return (neg_sign ? -1 : 1) * (int_num + frac_num) * npow(10, (neg_exp_pow ? -1 : 1) * exp_pow);
+    return neg_sign ? -value : value;
 }
 
 // NOTE: Caller must manually skip leading whitespaces
@@ -228,6 +243,33 @@ std::string read_string(std::string_view sv, size_t &rpos) {
     return result;
 }
 
+// Throws like read_string on invalid escape sequences in the content of a string,
+// but leaves decoding them to later
+void check_escapes(std::string_view content) {
+    for (size_t i = content.find('\\'); i != std::string_view::npos; i = content.find('\\', i)) {
+        // The closing quote is never escaped, so a character follows
+        switch (content[++i]) {
+        case '"':   case '\\':  case '/':   case 'b':
+        case 'f':   case 'n':   case 'r':   case 't':
+            i++;
+            break;
+        case 'u':
+            if (content.size() - i < 5) {
+                throw std::runtime_error("Found invalid hex digit while parsing string");
+            }
+            for (size_t j = 1; j <= 4; j++) {
+                if (!std::isxdigit(static_cast<unsigned char>(content[i + j]))) {
+                    throw std::runtime_error("Found invalid hex digit while parsing string");
+                }
+            }
+            i += 5;
+            break;
+        default:
+            throw std::runtime_error("Found invalid escape character while parsing string");
+        }
+    }
+}
+
 bool read_boolean(std::string_view sv, size_t &rpos) {
     size_t cur_rpos = rpos;
     bool final_value, failed = false;
@@ -269,7 +311,165 @@ void read_null(std::string_view sv, size_t &rpos) {
     rpos = cur_rpos;
 }
 
+// Stage 1 of the indexed parser: classifies 64 bytes at a time into bitmasks
+// (bit i stands for block[i]) and keeps only the positions stage 2 has to look at
+struct BlockMasks {
+    uint64_t quote, backslash, op, whitespace;
+};
+
+BlockMasks classify_block(const char* block) {
+    BlockMasks m{};
+#if defined(JSON_INDEX_AVX2)
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+        auto mask = [](__m256i cmp) -> uint64_t {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(cmp));
+        };
+        // `[` / `{` and `]` / `}` only differ in bit 5
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+                _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        // '\t' to '\r' and ' ', as accepted by std::isspace
+        __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+        __m256i ws = _mm256_or_si256(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        m.quote |= mask(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << (32 * i);
+        m.backslash |= mask(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << (32 * i);
+        m.op |= mask(op) << (32 * i);
+        m.whitespace |= mask(ws) << (32 * i);
+    }
+#elif defined(JSON_INDEX_SSE2)
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        auto mask = [](__m128i cmp) -> uint64_t {
+            return static_cast<uint16_t>(_mm_movemask_epi8(cmp));
+        };
+        // `[` / `{` and `]` / `}` only differ in bit 5
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        // '\t' to '\r' and ' ', as accepted by std::isspace
+        __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        __m128i ws = _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        m.quote |= mask(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << (16 * i);
+        m.backslash |= mask(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << (16 * i);
+        m.op |= mask(op) << (16 * i);
+        m.whitespace |= mask(ws) << (16 * i);
+    }
+#else
+    enum : uint8_t { Quote = 1, Backslash = 2, Op = 4, Whitespace = 8 };
+    static constexpr auto char_class = [] {
+        std::array<uint8_t, 256> table{};
+        table['"'] = Quote;
+        table['\\'] = Backslash;
+        for (char ch : { '{', '}', '[', ']', ':', ',' }) {
+            table[static_cast<uint8_t>(ch)] = Op;
+        }
+        for (char ch : { ' ', '\t', '\n', '\v', '\f', '\r' }) {
+            table[static_cast<uint8_t>(ch)] = Whitespace;
+        }
+        return table;
+    }();
+    for (int i = 0; i < 64; i++) {
+        uint8_t cls = char_class[static_cast<uint8_t>(block[i])];
+        m.quote |= static_cast<uint64_t>((cls & Quote) != 0) << i;
+        m.backslash |= static_cast<uint64_t>((cls & Backslash) != 0) << i;
+        m.op |= static_cast<uint64_t>((cls & Op) != 0) << i;
+        m.whitespace |= static_cast<uint64_t>((cls & Whitespace) != 0) << i;
+    }
+#endif
+    return m;
+}
+
+// Marks the characters escaped by a backslash, i.e. those following an odd-length
+// run of backslashes. `prev_escaped` carries a run across the block boundary.
+uint64_t find_escaped(uint64_t backslash, uint64_t &prev_escaped) {
+    constexpr uint64_t even_bits = 0x5555555555555555;
+    constexpr uint64_t odd_bits = ~even_bits;
+    uint64_t start_edges = backslash & ~(backslash << 1);
+    // A run continued from the previous block behaves as if it started one bit earlier
+    uint64_t even_start_mask = even_bits ^ prev_escaped;
+    uint64_t even_starts = start_edges & even_start_mask;
+    uint64_t odd_starts = start_edges & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    bool ends_odd = odd_carries < backslash;
+    odd_carries |= prev_escaped;
+    prev_escaped = ends_odd ? 1 : 0;
+    uint64_t even_carry_ends = even_carries & ~backslash;
+    uint64_t odd_carry_ends = odd_carries & ~backslash;
+    return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+}
+
+// Bit i is set if an odd number of bits at or below i are set in `x`
+uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
 namespace json {
+    std::vector<uint32_t> details::build_structural_index(std::string_view sv) {
+        if (sv.size() >= UINT32_MAX) {
+            throw std::runtime_error("Input is too large for the structural index");
+        }
+        std::vector<uint32_t> index;
+        index.reserve(sv.size() / 4 + 2);
+        uint64_t prev_escaped = 0;
+        // All ones if the previous block ended inside a string
+        uint64_t prev_in_string = 0;
+        // 1 if the previous block ended inside a scalar
+        uint64_t prev_scalar = 0;
+        char tail[64];
+        for (size_t base = 0; base < sv.size(); base += 64) {
+            const char* block = sv.data() + base;
+            if (sv.size() - base < 64) {
+                // Whitespace does not change the meaning of anything before it
+                std::memset(tail, ' ', sizeof tail);
+                std::memcpy(tail, block, sv.size() - base);
+                block = tail;
+            }
+            BlockMasks m = classify_block(block);
+            uint64_t quote = m.quote & ~find_escaped(m.backslash, prev_escaped);
+            // Includes the opening quote but not the closing one
+            uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+            prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+            uint64_t op = m.op & ~in_string;
+            // Literals and numbers are runs of any other characters; only their first
+            // character is indexed
+            uint64_t scalar = ~(m.op | m.whitespace | quote | in_string);
+            uint64_t scalar_start = scalar & ~((scalar << 1) | prev_scalar);
+            prev_scalar = scalar >> 63;
+
+            uint64_t structural = op | quote | scalar_start;
+            size_t old_size = index.size();
+            index.resize(old_size + std::popcount(structural));
+            uint32_t* out = index.data() + old_size;
+            while (structural) {
+                *out++ = static_cast<uint32_t>(base + std::countr_zero(structural));
+                structural &= structural - 1;
+            }
+        }
+        if (prev_in_string) {
+            throw std::runtime_error("Found unterminated string while parsing");
+        }
+        // Two sentinels, so that a string's closing quote may always be looked up
+        index.push_back(static_cast<uint32_t>(sv.size()));
+        index.push_back(static_cast<uint32_t>(sv.size()));
+        return index;
+    }
+
     struct JsonHelper {
         static JsonObject parse_jobject(std::string_view sv, size_t &rpos) {
             size_t cur_rpos = rpos;
@@ -332,84 +532,919 @@ namespace json {
             case 't':
             case 'f':       result_value = read_boolean(sv, cur_rpos);      break;
             case 'n':       read_null(sv, cur_rpos);                        break;
-            default:        result_value = read_number(sv, cur_rpos);       break;
+            default:        result_value = to_jvalue(read_number(sv, cur_rpos));   break;
             }
             skip_whitespace(sv, cur_rpos);
             rpos = cur_rpos;
             return result_value;
         }
 
-        static std::string to_string(const JsonValue& jv) {
-            std::string tmpstr;
+        // Stage 2 of the indexed parser: `ipos` is the position in the structural index
+        // (see details::build_structural_index) of the next token
+        static char indexed_char(std::string_view sv, uint32_t pos) {
+            return pos < sv.size() ? sv[pos] : '\0';
+        }
+        static std::string read_indexed_string(std::string_view sv, const uint32_t* index, size_t &ipos) {
+            // Stage 1 guarantees that the next position is the closing quote
+            uint32_t open = index[ipos], close = index[ipos + 1];
+            std::string_view content = sv.substr(open + 1, close - open - 1);
+            ipos += 2;
+            if (content.find('\\') == std::string_view::npos) {
+                return std::string{ content };
+            }
+            size_t rpos = open;
+            return read_string(sv, rpos);
+        }
+        // Containers are filled in place, as moving a JsonObject touches all of its buckets
+        static void parse_indexed_jobject(std::string_view sv, const uint32_t* index, size_t &ipos, JsonObject& result_jo) {
+            ipos++;
+            if (indexed_char(sv, index[ipos]) == '}') {
+                ipos++;
+                return;
+            }
+            while (true) {
+                if (indexed_char(sv, index[ipos]) != '"') {
+                    throw std::runtime_error("Found invalid key while parsing object");
+                }
+                std::string key = read_indexed_string(sv, index, ipos);
+                if (indexed_char(sv, index[ipos++]) != ':') {
+                    throw std::runtime_error("Found invalid key-value separator while parsing object");
+                }
+                parse_indexed_jvalue(sv, index, ipos, result_jo[key]);
+                char ch = indexed_char(sv, index[ipos++]);
+                if (ch == '}') {
+                    break;
+                }
+                if (ch != ',') {
+                    throw std::runtime_error("Found invalid separator while parsing object");
+                }
+            }
+        }
+        static void parse_indexed_jarray(std::string_view sv, const uint32_t* index, size_t &ipos, JsonArray& result_ja) {
+            ipos++;
+            if (indexed_char(sv, index[ipos]) == ']') {
+                ipos++;
+                return;
+            }
+            while (true) {
+                parse_indexed_jvalue(sv, index, ipos, result_ja.m_vec.emplace_back());
+                char ch = indexed_char(sv, index[ipos++]);
+                if (ch == ']') {
+                    break;
+                }
+                if (ch != ',') {
+                    throw std::runtime_error("Found invalid separator while parsing array");
+                }
+            }
+        }
+        static void parse_indexed_jvalue(std::string_view sv, const uint32_t* index, size_t &ipos, JsonValue& result_value) {
+            switch (indexed_char(sv, index[ipos])) {
+            case '"': {
+                // Short strings go straight into the value
+                uint32_t open = index[ipos], close = index[ipos + 1];
+                std::string_view content = sv.substr(open + 1, close - open - 1);
+                if (content.find('\\') == std::string_view::npos) {
+                    ipos += 2;
+                    result_value = JsonValue{ content };
+                }
+                else {
+                    result_value = JsonValue{ read_indexed_string(sv, index, ipos) };
+                }
+                return;
+            }
+            case '{':
+                parse_indexed_jobject(sv, index, ipos, result_value.emplace<JsonObject>());
+                return;
+            case '[':
+                parse_indexed_jarray(sv, index, ipos, result_value.emplace<JsonArray>());
+                return;
+            default:
+                read_indexed_scalar(sv, index, ipos, result_value);
+                return;
+            }
+        }
+        static JsonValue to_jvalue(JsonNumber v) {
+            return std::visit([](auto n) { return JsonValue{ n }; }, v);
+        }
+        // Exact order of an integer and a double
+        template<typename Integer>
+        static int compare_numbers(Integer i, double d) {
+            // Rounding keeps the order, so a different double decides it
+            double rounded = static_cast<double>(i);
+            if (rounded != d) {
+                return rounded < d ? -1 : 1;
+            }
+            // d is integral now, and in range unless i rounded up to the bound
+            if (d >= (std::is_signed_v<Integer> ? 0x1p63 : 0x1p64)) {
+                return -1;
+            }
+            auto j = static_cast<Integer>(d);
+            return i < j ? -1 : i > j ? 1 : 0;
+        }
+        // Exact order of two numbers, whatever their representation
+        static int compare_numbers(const JsonValue& a, const JsonValue& b) {
+            using Tag = JsonValue::Tag;
+            auto order = [](auto x, auto y) { return x < y ? -1 : x > y ? 1 : 0; };
+            if (a.m_tag == Tag::Double && b.m_tag == Tag::Double) {
+                return order(a.load<double>(), b.load<double>());
+            }
+            if (a.m_tag == Tag::Double || (a.m_tag == Tag::Unsigned && b.m_tag == Tag::Integer)) {
+                return -compare_numbers(b, a);
+            }
+            if (b.m_tag == Tag::Double) {
+                return a.m_tag == Tag::Integer ? compare_numbers(a.load<int64_t>(), b.load<double>()) :
+                    compare_numbers(a.load<uint64_t>(), b.load<double>());
+            }
+            if (a.m_tag == Tag::Integer && b.m_tag == Tag::Unsigned) {
+                int64_t i = a.load<int64_t>();
+                return i < 0 ? -1 : order(static_cast<uint64_t>(i), b.load<uint64_t>());
+            }
+            return a.m_tag == Tag::Integer ? order(a.load<int64_t>(), b.load<int64_t>()) :
+                order(a.load<uint64_t>(), b.load<uint64_t>());
+        }
+        // Stores a bool, number or nullptr
+        template<typename T>
+        static void set_scalar(JsonValue& value, T v) {
+            value = JsonValue{ v };
+        }
+        static void set_scalar(JsonValue& value, JsonNumber v) {
+            value = to_jvalue(v);
+        }
+        template<typename T>
+        static void set_scalar(JsonNode& node, T v) {
+            if constexpr (std::is_same_v<T, std::nullptr_t>) {
+                node.m_var = std::monostate{};
+            }
+            else if constexpr (std::is_same_v<T, JsonNumber>) {
+                std::visit([&](auto n) { node.m_var = n; }, v);
+            }
+            else {
+                node.m_var = v;
+            }
+        }
+        // Reads a literal or number into a JsonValue or JsonNode
+        template<typename Value>
+        static void read_indexed_scalar(std::string_view sv, const uint32_t* index, size_t &ipos, Value& result_value) {
+            size_t rpos = index[ipos];
+            switch (indexed_char(sv, index[ipos])) {
+            case 't':
+            case 'f':       set_scalar(result_value, read_boolean(sv, rpos));         break;
+            case 'n':       read_null(sv, rpos); set_scalar(result_value, nullptr);   break;
+            default:        set_scalar(result_value, read_number(sv, rpos));          break;
+            }
+            // The scalar has to span its whole run of characters
+            ipos++;
+            if (rpos != index[ipos] && !std::isspace(static_cast<unsigned char>(sv[rpos]))) {
+                throw std::runtime_error("Found unexpected character after value");
+            }
+        }
+
+        // Same as above, but builds a JsonDocument: strings stay in the input
+        static JsonString read_indexed_jstring(std::string_view sv, const uint32_t* index, size_t &ipos,
+            std::pmr::memory_resource* arena)
+        {
+            uint32_t open = index[ipos], close = index[ipos + 1];
+            JsonString result;
+            result.m_data = sv.data() + open + 1;
+            result.m_size = close - open - 1;
+            ipos += 2;
+            if (std::string_view{ result.m_data, result.m_size }.find('\\') != std::string_view::npos) {
+                check_escapes({ result.m_data, result.m_size });
+                result.m_arena = arena;
+            }
+            return result;
+        }
+        // Containers are collected on the scratch stacks first, and moved into the arena
+        // once their size is known
+        static_assert(std::is_trivially_copyable_v<JsonNode> && std::is_trivially_destructible_v<JsonNode>);
+        struct DocumentBuilder {
+            std::pmr::memory_resource* arena;
+            std::vector<JsonNode> elements{};
+            std::vector<JsonMember> members{};
+
+            template<typename T>
+            const T* finish(std::vector<T>& stack, size_t first) {
+                size_t count = stack.size() - first;
+                if (count == 0) {
+                    return nullptr;
+                }
+                T* data = static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+                std::uninitialized_copy(stack.begin() + first, stack.end(), data);
+                stack.resize(first);
+                return data;
+            }
+        };
+        static JsonNode parse_indexed_jnode(std::string_view sv, const uint32_t* index, size_t &ipos,
+            DocumentBuilder& builder)
+        {
+            JsonNode result_node;
+            char ch;
+            switch (indexed_char(sv, index[ipos])) {
+            case '"':
+                result_node.m_var = read_indexed_jstring(sv, index, ipos, builder.arena);
+                break;
+            case '{': {
+                size_t first = builder.members.size();
+                ipos++;
+                if (indexed_char(sv, index[ipos]) == '}') {
+                    ipos++;
+                    result_node.m_var = JsonNode::MemberRange{};
+                    break;
+                }
+                do {
+                    if (indexed_char(sv, index[ipos]) != '"') {
+                        throw std::runtime_error("Found invalid key while parsing object");
+                    }
+                    JsonString key = read_indexed_jstring(sv, index, ipos, builder.arena);
+                    if (indexed_char(sv, index[ipos++]) != ':') {
+                        throw std::runtime_error("Found invalid key-value separator while parsing object");
+                    }
+                    JsonNode value = parse_indexed_jnode(sv, index, ipos, builder);
+                    builder.members.push_back({ key, value });
+                    ch = indexed_char(sv, index[ipos++]);
+                } while (ch == ',');
+                if (ch != '}') {
+                    throw std::runtime_error("Found invalid separator while parsing object");
+                }
+                size_t count = builder.members.size() - first;
+                result_node.m_var = JsonNode::MemberRange{ builder.finish(builder.members, first), count };
+                break;
+            }
+            case '[': {
+                size_t first = builder.elements.size();
+                ipos++;
+                if (indexed_char(sv, index[ipos]) == ']') {
+                    ipos++;
+                    result_node.m_var = JsonNode::ElementRange{};
+                    break;
+                }
+                do {
+                    builder.elements.push_back(parse_indexed_jnode(sv, index, ipos, builder));
+                    ch = indexed_char(sv, index[ipos++]);
+                } while (ch == ',');
+                if (ch != ']') {
+                    throw std::runtime_error("Found invalid separator while parsing array");
+                }
+                size_t count = builder.elements.size() - first;
+                result_node.m_var = JsonNode::ElementRange{ builder.finish(builder.elements, first), count };
+                break;
+            }
+            default:
+                read_indexed_scalar(sv, index, ipos, result_node);
+                break;
+            }
+            return result_node;
+        }
+
+        // Parallel parsing cuts the input into chunks of whole elements of the root array,
+        // or of whole lines, and gives each one a structural index of its own. Chunks of
+        // at most 1 GiB also lift the 4 GiB limit of the index.
+        static constexpr size_t min_chunk_size = 1 << 18;
+        static constexpr size_t max_chunk_size = 1 << 30;
+
+        static unsigned thread_count(unsigned threads) {
+            return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        }
+        // Targets one chunk per thread, or more if they would be too large
+        static size_t chunk_count(size_t len, unsigned threads) {
+            size_t count = std::max<size_t>(thread_count(threads), len / max_chunk_size + 1);
+            return std::clamp<size_t>(len / min_chunk_size, 1, count);
+        }
+        // Calls fn(i) for all chunks on up to `threads` threads including the calling
+        // one, which takes the chunks in order. `fn` must not throw.
+        template<typename Fn>
+        static void run_chunks(size_t count, unsigned threads, const Fn& fn) {
+            std::atomic<size_t> next{ 0 };
+            auto work = [&] {
+                for (size_t i; (i = next.fetch_add(1)) < count;) {
+                    fn(i);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (size_t i = 1; i < std::min<size_t>(count, thread_count(threads)); i++) {
+                try {
+                    workers.emplace_back(work);
+                }
+                catch (const std::system_error&) {
+                    break;
+                }
+            }
+            work();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        // Offset after the first `,` in [pos, limit) that looks like the end of an
+        // element and the start of the next one, as the first element at `first` would:
+        // e.g. `},{"kind":` for objects; npos if there is none. Whether a guess is right
+        // only shows when parsing the chunk before it.
+        static size_t guess_element_start(std::string_view sv, size_t first, size_t pos, size_t limit) {
+            char open = sv[first];
+            char close = open == '{' ? '}' : open == '[' ? ']' : open == '"' ? '"' : '\0';
+            std::string_view start = sv.substr(first, close ? 1 : 0);
+            size_t colon = sv.find(':', first);
+            if (open == '{' && colon != std::string_view::npos && colon - first < 64) {
+                start = sv.substr(first, colon + 1 - first);
+            }
+            for (; (pos = sv.find(',', pos)) < limit; pos++) {
+                size_t prev = pos, next = pos + 1;
+                while (prev > first && std::isspace(static_cast<unsigned char>(sv[prev - 1]))) {
+                    prev--;
+                }
+                skip_whitespace(sv, next);
+                if ((!close || sv[prev - 1] == close) && sv.substr(next, start.size()) == start) {
+                    return pos + 1;
+                }
+            }
+            return std::string_view::npos;
+        }
+        // Guessed element starts near each of `count - 1` equally spaced targets, after
+        // `first`
+        static std::vector<size_t> guess_element_starts(std::string_view sv, size_t first, size_t count) {
+            std::vector<size_t> starts{ first };
+            for (size_t i = 1; i < count; i++) {
+                size_t pos = std::max(starts.back(), sv.size() / count * i);
+                size_t limit = std::min(sv.size() / count * (i + 1), pos + min_chunk_size);
+                size_t start = guess_element_start(sv, first, pos, limit);
+                if (start != std::string_view::npos) {
+                    starts.push_back(start);
+                }
+            }
+            return starts;
+        }
+        // Offsets after a line break near each of `count - 1` equally spaced targets
+        static std::vector<size_t> line_starts(std::string_view sv, size_t count) {
+            std::vector<size_t> starts{ 0 };
+            for (size_t i = 1; i < count; i++) {
+                size_t pos = sv.find('\n', std::max(starts.back(), sv.size() / count * i));
+                if (pos == std::string_view::npos) {
+                    break;
+                }
+                starts.push_back(pos + 1);
+            }
+            return starts;
+        }
+
+        // Parses the elements in `chunk`, which ends with the `,` after the last one, or
+        // with the `]` of the root array and whitespace if `last`
+        template<typename ParseValue>
+        static void parse_element_chunk(std::string_view chunk, bool last, const ParseValue& parse_value) {
+            std::vector<uint32_t> index = details::build_structural_index(chunk);
+            size_t ipos = 0;
+            while (true) {
+                parse_value(chunk, index.data(), ipos);
+                char ch = indexed_char(chunk, index[ipos++]);
+                if (ch == ',') {
+                    if (!last && index[ipos] == chunk.size()) {
+                        return;
+                    }
+                    continue;
+                }
+                if (ch != ']' || !last) {
+                    throw std::runtime_error("Found invalid separator while parsing array");
+                }
+                if (index[ipos] != chunk.size()) {
+                    throw std::runtime_error("Found unexpected non-whitespace character after value");
+                }
+                return;
+            }
+        }
+        // Parses the values on the lines of `chunk`, which ends after a line break or at
+        // the end of the input
+        template<typename ParseValue>
+        static void parse_line_chunk(std::string_view chunk, const ParseValue& parse_value) {
+            std::vector<uint32_t> index = details::build_structural_index(chunk);
+            size_t ipos = 0;
+            while (index[ipos] != chunk.size()) {
+                size_t line_end = std::min(chunk.find('\n', index[ipos]), chunk.size());
+                parse_value(chunk, index.data(), ipos);
+                // The value has to end on its line, and the next one to start on another
+                if (index[ipos - 1] > line_end || index[ipos] < line_end) {
+                    throw std::runtime_error("Found unexpected character after value");
+                }
+            }
+        }
+
+        // Has parse_chunk(output, chunk, last) parse the chunks of the root array of `sv`
+        // into `outputs`, which it resizes. A wrong guess of where a chunk starts makes
+        // the chunk before fail; the rest of the input is then parsed again on the
+        // calling thread. Returns false, with nothing parsed, if the root is no array or
+        // too small.
+        template<typename Output, typename ParseChunk>
+        static bool parse_array_chunks(std::string_view sv, unsigned threads, std::vector<Output>& outputs,
+            const ParseChunk& parse_chunk)
+        {
+            size_t count = chunk_count(sv.size(), threads), first = 0;
+            skip_whitespace(sv, first);
+            if (count < 2 || first == sv.size() || sv[first] != '[') {
+                return false;
+            }
+            first++;
+            skip_whitespace(sv, first);
+            if (first == sv.size() || sv[first] == ']') {
+                return false;
+            }
+            std::vector<size_t> starts = guess_element_starts(sv, first, count);
+            starts.push_back(sv.size());
+            count = starts.size() - 1;
+            outputs.resize(count);
+            std::vector<char> failed(count);
+            run_chunks(count, threads, [&](size_t i) {
+                try {
+                    parse_chunk(outputs[i], sv.substr(starts[i], starts[i + 1] - starts[i]), i + 1 == count);
+                }
+                catch (...) {
+                    failed[i] = true;
+                }
+            });
+            // Each chunk that is parsed whole starts the next one at an element
+            size_t i = std::find(failed.begin(), failed.end(), true) - failed.begin();
+            if (i != count) {
+                outputs.resize(i);
+                parse_remaining_chunks(sv, first, starts[i], outputs, parse_chunk);
+            }
+            return true;
+        }
+        // Parses the elements from `begin` one chunk after another. Each one ends at a
+        // guess about max_chunk_size further, or is extended to the next guess if it
+        // fails, until it is too large for the structural index.
+        template<typename Output, typename ParseChunk>
+        static void parse_remaining_chunks(std::string_view sv, size_t first, size_t begin,
+            std::vector<Output>& outputs, const ParseChunk& parse_chunk)
+        {
+            size_t end = begin;
+            while (begin != sv.size()) {
+                end = sv.size() - end > max_chunk_size ?
+                    guess_element_start(sv, first, end + max_chunk_size, sv.size()) : sv.size();
+                end = std::min(end, sv.size());
+                if (end - begin >= UINT32_MAX) {
+                    throw std::runtime_error("Input is too large for the structural index");
+                }
+                Output output;
+                try {
+                    parse_chunk(output, sv.substr(begin, end - begin), end == sv.size());
+                }
+                catch (...) {
+                    if (end == sv.size()) {
+                        throw;
+                    }
+                    continue;
+                }
+                outputs.push_back(std::move(output));
+                begin = end;
+            }
+        }
+        template<typename Output, typename ParseChunk>
+        static void parse_line_chunks(std::string_view sv, unsigned threads, std::vector<Output>& outputs,
+            const ParseChunk& parse_chunk)
+        {
+            std::vector<size_t> starts = line_starts(sv, chunk_count(sv.size(), threads));
+            starts.push_back(sv.size());
+            size_t count = starts.size() - 1;
+            outputs.resize(count);
+            std::vector<std::exception_ptr> errors(count);
+            run_chunks(count, threads, [&](size_t i) {
+                try {
+                    parse_chunk(outputs[i], sv.substr(starts[i], starts[i + 1] - starts[i]));
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+            for (const auto& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+
+        // Parses a document into `result` in chunks; false if it has to be parsed whole
+        static bool parse_jvalue_chunks(std::string_view sv, unsigned threads, bool lines, JsonValue& result) {
+            std::vector<JsonArray> chunks;
+            auto parse_value = [](JsonArray& chunk) {
+                return [&chunk](std::string_view sv, const uint32_t* index, size_t &ipos) {
+                    parse_indexed_jvalue(sv, index, ipos, chunk.m_vec.emplace_back());
+                };
+            };
+            if (lines) {
+                parse_line_chunks(sv, threads, chunks, [&](JsonArray& chunk, std::string_view text) {
+                    parse_line_chunk(text, parse_value(chunk));
+                });
+            }
+            else if (!parse_array_chunks(sv, threads, chunks, [&](JsonArray& chunk, std::string_view text, bool last) {
+                parse_element_chunk(text, last, parse_value(chunk));
+            })) {
+                return false;
+            }
+            JsonArray& ja = result.emplace<JsonArray>();
+            size_t size = 0;
+            for (const auto& chunk : chunks) {
+                size += chunk.size();
+            }
+            ja.reserve(size);
+            for (auto& chunk : chunks) {
+                std::move(chunk.begin(), chunk.end(), std::back_inserter(ja.m_vec));
+            }
+            return true;
+        }
+        struct DocumentChunk {
+            std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+            std::vector<JsonNode> values;
+        };
+        // Parses the input of `doc` into it in chunks; false if it has to be parsed whole
+        static bool parse_jnode_chunks(JsonDocument& doc, unsigned threads, bool lines) {
+            std::string_view sv{ doc.m_input.data(), doc.m_input.size() };
+            std::vector<DocumentChunk> chunks;
+            auto parse_value = [](DocumentChunk& chunk, DocumentBuilder& builder) {
+                chunk.arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+                builder.arena = chunk.arena.get();
+                return [&chunk, &builder](std::string_view sv, const uint32_t* index, size_t &ipos) {
+                    chunk.values.push_back(parse_indexed_jnode(sv, index, ipos, builder));
+                };
+            };
+            if (lines) {
+                parse_line_chunks(sv, threads, chunks, [&](DocumentChunk& chunk, std::string_view text) {
+                    DocumentBuilder builder;
+                    parse_line_chunk(text, parse_value(chunk, builder));
+                });
+            }
+            else if (!parse_array_chunks(sv, threads, chunks, [&](DocumentChunk& chunk, std::string_view text, bool last) {
+                DocumentBuilder builder;
+                parse_element_chunk(text, last, parse_value(chunk, builder));
+            })) {
+                return false;
+            }
+            // The root's elements go to the arena of the first chunk
+            DocumentBuilder builder{ chunks[0].arena.get() };
+            for (auto& chunk : chunks) {
+                builder.elements.insert(builder.elements.end(), chunk.values.begin(), chunk.values.end());
+                doc.m_arenas.push_back(std::move(chunk.arena));
+            }
+            size_t size = builder.elements.size();
+            doc.m_root.m_var = JsonNode::ElementRange{ builder.finish(builder.elements, 0), size };
+            return true;
+        }
+
+        // Integral values are printed exactly, everything else in the shortest form
+        // that reads back as the same double
+        static void append_number(std::string& out, double v) {
+            char buf[32];
+            std::to_chars_result result;
+            if (v >= -0x1p63 && v < 0x1p63 && v == static_cast<double>(static_cast<int64_t>(v)) &&
+                !(v == 0 && std::signbit(v)))
+            {
+                result = std::to_chars(buf, std::end(buf), static_cast<int64_t>(v));
+            }
+            else {
+                result = std::to_chars(buf, std::end(buf), v);
+            }
+            out.append(buf, result.ptr);
+        }
+        static void append_string(std::string& out, std::string_view str) {
+            out += '"';
+            for (auto ch : str) {
+                switch (ch) {
+                case '"':       out += "\\\"";          break;
+                case '\\':      out += "\\\\";          break;
+                case '/':       out += "\\/";           break;
+                case '\b':      out += "\\b";           break;
+                case '\f':      out += "\\f";           break;
+                case '\n':      out += "\\n";           break;
+                case '\r':      out += "\\r";           break;
+                case '\t':      out += "\\t";           break;
+                default:        out += ch;              break;
+                }
+            }
+            out += '"';
+        }
+        static void append_jvalue(std::string& out, const JsonValue& jv) {
             bool first = true;
-            switch (jv.m_kind) {
+            switch (jv.kind()) {
             case JsonValueKind::Null:
-                return "null";
+                out += "null";
+                break;
             case JsonValueKind::Boolean:
-                return jv.get<bool>() ? "true" : "false";
+                out += jv.get<bool>() ? "true" : "false";
+                break;
             case JsonValueKind::Number:
-                return std::format("{}", jv.get<double>());
-            case JsonValueKind::String:
-                tmpstr += '"';
-                for (auto ch : jv.get<std::string>()) {
-                    switch (ch) {
-                    case '"':       tmpstr += "\\\"";       break;
-                    case '\\':      tmpstr += "\\\\";       break;
-                    case '/':       tmpstr += "\\/";        break;
-                    case '\b':      tmpstr += "\\b";        break;
-                    case '\f':      tmpstr += "\\f";        break;
-                    case '\n':      tmpstr += "\\n";        break;
-                    case '\r':      tmpstr += "\\r";        break;
-                    case '\t':      tmpstr += "\\t";        break;
-                    default:        tmpstr += ch;           break;
-                    }
+                if (jv.m_tag == JsonValue::Tag::Integer) {
+                    char buf[24];
+                    out.append(buf, std::to_chars(buf, std::end(buf), jv.load<int64_t>()).ptr);
+                }
+                else if (jv.m_tag == JsonValue::Tag::Unsigned) {
+                    char buf[24];
+                    out.append(buf, std::to_chars(buf, std::end(buf), jv.load<uint64_t>()).ptr);
+                }
+                else {
+                    append_number(out, jv.get<double>());
                 }
-                tmpstr += '"';
-                return tmpstr;
+                break;
+            case JsonValueKind::String:
+                append_string(out, jv.get<std::string_view>());
+                break;
             case JsonValueKind::Object:
-                tmpstr += '{';
+                out += '{';
                 for (const auto& i : jv.get<JsonObject>()) {
                     if (!first) {
-                        tmpstr += ',';
+                        out += ',';
                     }
-                    tmpstr += to_string(i.first);
-                    tmpstr += ':';
-                    tmpstr += to_string(i.second);
+                    append_string(out, i.first);
+                    out += ':';
+                    append_jvalue(out, i.second);
                     first = false;
                 }
-                tmpstr += '}';
-                return tmpstr;
+                out += '}';
+                break;
             case JsonValueKind::Array:
-                tmpstr += '[';
+                out += '[';
                 for (const auto& i : jv.get<JsonArray>()) {
                     if (!first) {
-                        tmpstr += ',';
+                        out += ',';
                     }
-                    tmpstr += to_string(i);
+                    append_jvalue(out, i);
                     first = false;
                 }
-                tmpstr += ']';
-                return tmpstr;
+                out += ']';
+                break;
             default:
                 throw std::runtime_error("Invalid JsonValue");
             }
         }
-    };
 
-    auto JsonArray::erase(iterator pos) noexcept -> iterator { return m_vec.erase(pos); }
-    bool JsonArray::operator==(const JsonArray& rhs) const {
-        return m_vec == rhs.m_vec;
-    }
+        // On-demand reading of a JsonLazyDocument. Skipping checks everything that
+        // parse_indexed_jvalue would, without recursion and without decoding.
+        static void skip_indexed_string(std::string_view sv, const uint32_t* index, size_t &ipos) {
+            uint32_t open = index[ipos], close = index[ipos + 1];
+            check_escapes(sv.substr(open + 1, close - open - 1));
+            ipos += 2;
+        }
+        // A key and the `:` after it
+        static void skip_indexed_key(std::string_view sv, const uint32_t* index, size_t &ipos) {
+            if (indexed_char(sv, index[ipos]) != '"') {
+                throw std::runtime_error("Found invalid key while parsing object");
+            }
+            skip_indexed_string(sv, index, ipos);
+            if (indexed_char(sv, index[ipos++]) != ':') {
+                throw std::runtime_error("Found invalid key-value separator while parsing object");
+            }
+        }
+        // `stack` holds the closing characters of the containers being skipped
+        static void skip_indexed_value(std::string_view sv, const uint32_t* index, size_t &ipos, std::string& stack) {
+            stack.clear();
+            while (true) {
+                switch (indexed_char(sv, index[ipos])) {
+                case '"':
+                    skip_indexed_string(sv, index, ipos);
+                    break;
+                case '{':
+                    if (indexed_char(sv, index[++ipos]) == '}') {
+                        ipos++;
+                        break;
+                    }
+                    stack += '}';
+                    skip_indexed_key(sv, index, ipos);
+                    continue;
+                case '[':
+                    if (indexed_char(sv, index[++ipos]) == ']') {
+                        ipos++;
+                        break;
+                    }
+                    stack += ']';
+                    continue;
+                default: {
+                    JsonNode scalar;
+                    read_indexed_scalar(sv, index, ipos, scalar);
+                    break;
+                }
+                }
+                // Close containers until the next value
+                while (true) {
+                    if (stack.empty()) {
+                        return;
+                    }
+                    char ch = indexed_char(sv, index[ipos++]);
+                    if (ch == stack.back()) {
+                        stack.pop_back();
+                        continue;
+                    }
+                    if (ch != ',') {
+                        throw std::runtime_error(stack.back() == '}' ? "Found invalid separator while parsing object" :
+                            "Found invalid separator while parsing array");
+                    }
+                    if (stack.back() == '}') {
+                        skip_indexed_key(sv, index, ipos);
+                    }
+                    break;
+                }
+            }
+        }
 
-    JsonValue& JsonObject::operator[](std::string_view sv) {
-        auto iter = m_map.find(std::string{ sv });
-        if (iter != m_map.end()) {
-            return iter->second;
+        static std::string_view lazy_input(const JsonLazyDocument& doc) {
+            return { doc.m_input.data(), doc.m_input.size() };
         }
-        else {
-            return m_map.insert(std::pair{ std::string(sv), JsonValue{} }).first->second;
+        static char lazy_char(const JsonLazyDocument& doc, size_t ipos) {
+            return indexed_char(lazy_input(doc), doc.m_index[ipos]);
         }
-    }
+        static void lazy_skip_value(JsonLazyDocument& doc) {
+            skip_indexed_value(lazy_input(doc), doc.m_index.data(), doc.m_ipos, doc.m_skip_stack);
+        }
+        // The document is inside a container either at the start of a member, at the
+        // value of a member, at an element, or after a value; the token before tells
+        // which. Moves to the start of the next member or element, or to the closing
+        // character. Unless `skip_element`, an element counts as the next one.
+        static void lazy_next_item(JsonLazyDocument& doc, char close, bool skip_element = true) {
+            char prev = lazy_char(doc, doc.m_ipos - 1);
+            bool at_element = close == ']' && (prev == ',' || (prev == '[' && lazy_char(doc, doc.m_ipos) != ']'));
+            if (prev == ':' || (at_element && skip_element)) {
+                lazy_skip_value(doc);
+            }
+            else if (prev == '{' || prev == '[' || prev == ',') {
+                return;
+            }
+            char ch = lazy_char(doc, doc.m_ipos);
+            if (ch == ',') {
+                doc.m_ipos++;
+            }
+            else if (ch != close) {
+                throw std::runtime_error(close == '}' ? "Found invalid separator while parsing object" :
+                    "Found invalid separator while parsing array");
+            }
+        }
+        // Whether the document is at the closing character of its innermost container
+        static bool lazy_at_close(const JsonLazyDocument& doc, char close) {
+            return lazy_char(doc, doc.m_ipos) == close && lazy_char(doc, doc.m_ipos - 1) != ',';
+        }
+        // Skips the rest of the containers the document is inside, down to `level`
+        static void lazy_leave_to(JsonLazyDocument& doc, size_t level) {
+            while (doc.m_open.size() > level) {
+                char close = lazy_char(doc, doc.m_open.back()) == '{' ? '}' : ']';
+                while (true) {
+                    lazy_next_item(doc, close);
+                    if (lazy_at_close(doc, close)) {
+                        break;
+                    }
+                    if (close == '}') {
+                        skip_indexed_key(lazy_input(doc), doc.m_index.data(), doc.m_ipos);
+                    }
+                    lazy_skip_value(doc);
+                }
+                doc.m_ipos++;
+                doc.m_open.pop_back();
+            }
+        }
+        // Makes the container current again, or throws if the document has left it
+        template<typename Container>
+        static void lazy_enter(const Container& container) {
+            JsonLazyDocument& doc = *container.m_doc;
+            if (doc.m_open.size() < container.m_level || doc.m_open[container.m_level - 1] != container.m_begin) {
+                throw std::runtime_error("Container was already read");
+            }
+            lazy_leave_to(doc, container.m_level);
+        }
+        // Reading a value requires the document to be at it
+        static void lazy_check_at(const JsonLazyValue& value) {
+            if (value.m_doc->m_ipos != value.m_ipos) {
+                throw std::runtime_error("Value was already read or skipped");
+            }
+        }
+        static JsonNode lazy_read_scalar(const JsonLazyValue& value) {
+            lazy_check_at(value);
+            JsonNode result;
+            switch (lazy_char(*value.m_doc, value.m_ipos)) {
+            case '"':
+            case '{':
+            case '[':
+                return result;
+            }
+            read_indexed_scalar(lazy_input(*value.m_doc), value.m_doc->m_index.data(), value.m_doc->m_ipos, result);
+            return result;
+        }
+        static std::string lazy_read_string(const JsonLazyValue& value) {
+            lazy_check_at(value);
+            if (lazy_char(*value.m_doc, value.m_ipos) != '"') {
+                throw std::runtime_error("Value is not a string");
+            }
+            return read_indexed_string(lazy_input(*value.m_doc), value.m_doc->m_index.data(), value.m_doc->m_ipos);
+        }
+        static JsonValue lazy_read_value(const JsonLazyValue& value) {
+            lazy_check_at(value);
+            JsonValue result;
+            parse_indexed_jvalue(lazy_input(*value.m_doc), value.m_doc->m_index.data(), value.m_doc->m_ipos, result);
+            return result;
+        }
+        // Enters the container at `value`, or finds it among the open ones
+        template<typename Container>
+        static Container lazy_open(const JsonLazyValue& value, char open) {
+            JsonLazyDocument& doc = *value.m_doc;
+            if (doc.m_ipos == value.m_ipos && lazy_char(doc, doc.m_ipos) == open) {
+                doc.m_open.push_back(doc.m_ipos++);
+                return { &doc, value.m_ipos, doc.m_open.size() };
+            }
+            auto iter = std::find(doc.m_open.begin(), doc.m_open.end(), value.m_ipos);
+            if (iter != doc.m_open.end()) {
+                return { &doc, value.m_ipos, static_cast<size_t>(iter - doc.m_open.begin() + 1) };
+            }
+            lazy_check_at(value);
+            throw std::runtime_error(open == '{' ? "Value is not an object" : "Value is not an array");
+        }
+        // Reads the key at the document's position
+        static std::string lazy_read_key(JsonLazyDocument& doc) {
+            if (lazy_char(doc, doc.m_ipos) != '"') {
+                throw std::runtime_error("Found invalid key while parsing object");
+            }
+            std::string key = read_indexed_string(lazy_input(doc), doc.m_index.data(), doc.m_ipos);
+            if (lazy_char(doc, doc.m_ipos++) != ':') {
+                throw std::runtime_error("Found invalid key-value separator while parsing object");
+            }
+            return key;
+        }
+        // Moves the iterator to the next member, or leaves the object at its end
+        static void lazy_next_member(JsonLazyObject::iterator& iter) {
+            JsonLazyDocument& doc = *iter.m_object->m_doc;
+            lazy_enter(*iter.m_object);
+            lazy_next_item(doc, '}');
+            if (lazy_at_close(doc, '}')) {
+                doc.m_ipos++;
+                doc.m_open.pop_back();
+                iter.m_member.reset();
+                return;
+            }
+            std::string key = lazy_read_key(doc);
+            iter.m_member.emplace(JsonLazyMember{ std::move(key), JsonLazyValue{ &doc, doc.m_ipos } });
+        }
+        // `first` keeps the element the document is at, if any
+        static void lazy_next_element(JsonLazyArray::iterator& iter, bool first) {
+            JsonLazyDocument& doc = *iter.m_array->m_doc;
+            lazy_enter(*iter.m_array);
+            lazy_next_item(doc, ']', !first);
+            if (lazy_at_close(doc, ']')) {
+                doc.m_ipos++;
+                doc.m_open.pop_back();
+                iter.m_element.reset();
+                return;
+            }
+            iter.m_element.emplace(JsonLazyValue{ &doc, doc.m_ipos });
+        }
+        static std::optional<JsonLazyValue> lazy_find(const JsonLazyObject& object, std::string_view key) {
+            JsonLazyDocument& doc = *object.m_doc;
+            std::string_view sv = lazy_input(doc);
+            lazy_enter(object);
+            lazy_next_item(doc, '}');
+            size_t start = doc.m_ipos;
+            bool wrapped = false;
+            while (true) {
+                if (lazy_at_close(doc, '}')) {
+                    // Continue from the first member, unless the search began there
+                    if (wrapped || start == object.m_begin + 1) {
+                        return std::nullopt;
+                    }
+                    doc.m_ipos = object.m_begin + 1;
+                    wrapped = true;
+                }
+                if (wrapped && doc.m_ipos == start) {
+                    return std::nullopt;
+                }
+                if (lazy_char(doc, doc.m_ipos) != '"') {
+                    throw std::runtime_error("Found invalid key while parsing object");
+                }
+                // Keys are only decoded if they contain escapes
+                uint32_t open = doc.m_index[doc.m_ipos], close = doc.m_index[doc.m_ipos + 1];
+                std::string_view raw = sv.substr(open + 1, close - open - 1);
+                bool found;
+                if (raw.find('\\') == std::string_view::npos) {
+                    found = raw == key;
+                    doc.m_ipos += 2;
+                }
+                else {
+                    found = read_indexed_string(sv, doc.m_index.data(), doc.m_ipos) == key;
+                }
+                if (lazy_char(doc, doc.m_ipos++) != ':') {
+                    throw std::runtime_error("Found invalid key-value separator while parsing object");
+                }
+                if (found) {
+                    return JsonLazyValue{ &doc, doc.m_ipos };
+                }
+                lazy_skip_value(doc);
+                lazy_next_item(doc, '}');
+            }
+        }
+    };
+
+    auto JsonArray::erase(iterator pos) noexcept -> iterator { return m_vec.erase(pos); }
+    bool JsonArray::operator==(const JsonArray& rhs) const {
+        return m_vec == rhs.m_vec;
+    }
+
+    JsonValue& JsonObject::operator[](std::string_view sv) {
+        auto iter = m_map.find(std::string{ sv });
+        if (iter != m_map.end()) {
+            return iter->second;
+        }
+        else {
+            return m_map.insert(std::pair{ std::string(sv), JsonValue{} }).first->second;
+        }
+    }
     bool JsonObject::operator==(const JsonObject& rhs) const {
         return m_map == rhs.m_map;
     }
@@ -418,6 +1453,31 @@ namespace json {
         swap(a.m_map, b.m_map);
     }
 
+    JsonValue::JsonValue(const JsonValue& other) : m_tag(other.m_tag) {
+        switch (other.m_tag) {
+        case Tag::String:   store(new std::string(*other.load<std::string*>()));   break;
+        case Tag::Array:    store(new JsonArray(*other.load<JsonArray*>()));       break;
+        case Tag::Object:   store(new JsonObject(*other.load<JsonObject*>()));     break;
+        default:            std::memcpy(m_bytes, other.m_bytes, sizeof m_bytes);    break;
+        }
+    }
+    bool JsonValue::operator==(const JsonValue& rhs) const {
+        if (is_number() && rhs.is_number()) {
+            return JsonHelper::compare_numbers(*this, rhs) == 0;
+        }
+        if (is_string() && rhs.is_string()) {
+            return string_value() == rhs.string_value();
+        }
+        if (m_tag != rhs.m_tag) {
+            return false;
+        }
+        switch (m_tag) {
+        case Tag::Boolean:  return load<bool>() == rhs.load<bool>();
+        case Tag::Array:    return *load<JsonArray*>() == *rhs.load<JsonArray*>();
+        case Tag::Object:   return *load<JsonObject*>() == *rhs.load<JsonObject*>();
+        default:            return true;
+        }
+    }
     bool JsonValue::try_deserialize_from_utf8(const char* data, size_t len) {
         try {
             size_t rpos = 0;
@@ -432,8 +1492,1054 @@ namespace json {
             return false;
         }
     }
+    bool JsonValue::try_deserialize_from_utf8_indexed(const char* data, size_t len) {
+        try {
+            std::string_view sv{ data, len };
+            std::vector<uint32_t> index = details::build_structural_index(sv);
+            size_t ipos = 0;
+            JsonValue result;
+            JsonHelper::parse_indexed_jvalue(sv, index.data(), ipos, result);
+            if (index[ipos] != len) {
+                throw std::runtime_error("Found unexpected non-whitespace character after value");
+            }
+            swap(*this, result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+    bool JsonValue::try_deserialize_from_utf8_parallel(const char* data, size_t len, unsigned threads) {
+        try {
+            JsonValue result;
+            if (!JsonHelper::parse_jvalue_chunks({ data, len }, threads, false, result)) {
+                return try_deserialize_from_utf8_indexed(data, len);
+            }
+            swap(*this, result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+    bool JsonValue::try_deserialize_ndjson(const char* data, size_t len, unsigned threads) {
+        try {
+            JsonValue result;
+            JsonHelper::parse_jvalue_chunks({ data, len }, threads, true, result);
+            swap(*this, result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
     std::vector<char> JsonValue::serialize_into_utf8(void) const {
-        std::string str = JsonHelper::to_string(*this);
+        std::string str;
+        JsonHelper::append_jvalue(str, *this);
         return { str.begin(), str.end() };
     }
+
+    void JsonString::decode(void) const {
+        // The quotes are still around the content in the input
+        size_t rpos = 0;
+        std::string decoded = read_string({ m_data - 1, m_size + 2 }, rpos);
+        char* buf = static_cast<char*>(m_arena->allocate(decoded.size(), 1));
+        std::memcpy(buf, decoded.data(), decoded.size());
+        m_data = buf;
+        m_size = decoded.size();
+        m_arena = nullptr;
+    }
+
+    const JsonNode& JsonNode::at(size_t idx) const {
+        return get<JsonArray>().at(idx);
+    }
+    const JsonNode& JsonNode::at(std::string_view key) const {
+        return get<JsonObject>().at(key);
+    }
+    const JsonNode* JsonNode::find(std::string_view key) const {
+        auto jo = get<JsonObject>();
+        auto iter = jo.find(key);
+        return iter != jo.end() ? &iter->value : nullptr;
+    }
+    JsonValue JsonNode::to_value(void) const {
+        switch (kind()) {
+        case JsonValueKind::Null:
+            return nullptr;
+        case JsonValueKind::Boolean:
+            return get<bool>();
+        case JsonValueKind::Number:
+            if (std::holds_alternative<int64_t>(m_var)) {
+                return std::get<int64_t>(m_var);
+            }
+            if (std::holds_alternative<uint64_t>(m_var)) {
+                return std::get<uint64_t>(m_var);
+            }
+            return get<double>();
+        case JsonValueKind::String:
+            return get<std::string_view>();
+        case JsonValueKind::Array: {
+            JsonArray ja;
+            ja.reserve(size());
+            for (const auto& i : elements()) {
+                ja.push_back(i.to_value());
+            }
+            return ja;
+        }
+        case JsonValueKind::Object: {
+            JsonObject jo;
+            for (const auto& i : members()) {
+                jo[i.key] = i.value.to_value();
+            }
+            return jo;
+        }
+        default:
+            throw std::runtime_error("Invalid JsonNode");
+        }
+    }
+
+    auto JsonArrayView::at(size_type pos) const -> const_reference {
+        if (pos >= m_elements.size()) {
+            throw std::out_of_range("Index out of range in JsonArrayView");
+        }
+        return m_elements[pos];
+    }
+
+    const JsonNode& JsonObjectView::at(std::string_view key) const {
+        auto iter = find(key);
+        if (iter == end()) {
+            throw std::out_of_range("Key not found in JsonObjectView");
+        }
+        return iter->value;
+    }
+    auto JsonObjectView::find(std::string_view key) const -> const_iterator {
+        for (auto iter = end(); iter != begin();) {
+            --iter;
+            if (iter->key == key) {
+                return iter;
+            }
+        }
+        return end();
+    }
+
+    bool JsonDocument::try_parse(std::vector<char> data) {
+        try {
+            JsonDocument result;
+            result.m_input = std::move(data);
+            result.m_arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>());
+            std::string_view sv{ result.m_input.data(), result.m_input.size() };
+            std::vector<uint32_t> index = details::build_structural_index(sv);
+            size_t ipos = 0;
+            JsonHelper::DocumentBuilder builder{ result.m_arenas[0].get() };
+            result.m_root = JsonHelper::parse_indexed_jnode(sv, index.data(), ipos, builder);
+            if (index[ipos] != sv.size()) {
+                throw std::runtime_error("Found unexpected non-whitespace character after value");
+            }
+            *this = std::move(result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+    bool JsonDocument::try_parse_parallel(std::vector<char> data, unsigned threads) {
+        try {
+            JsonDocument result;
+            result.m_input = std::move(data);
+            if (!JsonHelper::parse_jnode_chunks(result, threads, false)) {
+                return try_parse(std::move(result.m_input));
+            }
+            *this = std::move(result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+    bool JsonDocument::try_parse_ndjson(std::vector<char> data, unsigned threads) {
+        try {
+            JsonDocument result;
+            result.m_input = std::move(data);
+            JsonHelper::parse_jnode_chunks(result, threads, true);
+            *this = std::move(result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+
+    JsonValueKind JsonLazyValue::kind(void) const {
+        switch (JsonHelper::lazy_char(*m_doc, m_ipos)) {
+        case 'n':   return JsonValueKind::Null;
+        case 't':
+        case 'f':   return JsonValueKind::Boolean;
+        case '[':   return JsonValueKind::Array;
+        case '"':   return JsonValueKind::String;
+        case '{':   return JsonValueKind::Object;
+        default:    return JsonValueKind::Number;
+        }
+    }
+    bool JsonLazyValue::get_bool(void) {
+        JsonNode node = JsonHelper::lazy_read_scalar(*this);
+        if (!node.is_bool()) {
+            throw std::runtime_error("Value is not a boolean");
+        }
+        return node.get<bool>();
+    }
+    double JsonLazyValue::get_double(void) {
+        return read_number().get<double>();
+    }
+    JsonNode JsonLazyValue::read_number(void) {
+        JsonNode node = JsonHelper::lazy_read_scalar(*this);
+        if (!node.is_number()) {
+            throw std::runtime_error("Value is not a number");
+        }
+        return node;
+    }
+    std::string JsonLazyValue::get_string(void) {
+        return JsonHelper::lazy_read_string(*this);
+    }
+    JsonLazyObject JsonLazyValue::get_object(void) {
+        return JsonHelper::lazy_open<JsonLazyObject>(*this, '{');
+    }
+    JsonLazyArray JsonLazyValue::get_array(void) {
+        return JsonHelper::lazy_open<JsonLazyArray>(*this, '[');
+    }
+    JsonLazyValue JsonLazyValue::operator[](std::string_view key) {
+        return get_object().at(key);
+    }
+    JsonValue JsonLazyValue::to_value(void) {
+        return JsonHelper::lazy_read_value(*this);
+    }
+
+    std::optional<JsonLazyValue> JsonLazyObject::find(std::string_view key) {
+        return JsonHelper::lazy_find(*this, key);
+    }
+    JsonLazyValue JsonLazyObject::at(std::string_view key) {
+        auto value = find(key);
+        if (!value) {
+            throw std::runtime_error("Key not found in object");
+        }
+        return *value;
+    }
+    JsonLazyObject::iterator JsonLazyObject::begin(void) {
+        iterator result{ this };
+        JsonHelper::lazy_next_member(result);
+        return result;
+    }
+    JsonLazyObject::iterator& JsonLazyObject::iterator::operator++(void) {
+        JsonHelper::lazy_next_member(*this);
+        return *this;
+    }
+
+    JsonLazyArray::iterator JsonLazyArray::begin(void) {
+        iterator result{ this };
+        JsonHelper::lazy_next_element(result, true);
+        return result;
+    }
+    JsonLazyArray::iterator& JsonLazyArray::iterator::operator++(void) {
+        JsonHelper::lazy_next_element(*this, false);
+        return *this;
+    }
+
+    void JsonLazyDocument::finish(void) {
+        JsonHelper::lazy_leave_to(*this, 0);
+        if (m_ipos == 0) {
+            JsonHelper::lazy_skip_value(*this);
+        }
+        if (m_index[m_ipos] != m_input.size()) {
+            throw std::runtime_error("Found unexpected non-whitespace character after value");
+        }
+    }
+    bool JsonLazyDocument::try_parse(std::vector<char> data) {
+        try {
+            JsonLazyDocument result;
+            result.m_input = std::move(data);
+            result.m_index = details::build_structural_index({ result.m_input.data(), result.m_input.size() });
+            if (result.m_index[0] == result.m_input.size()) {
+                throw std::runtime_error("Unexpected end of stream while parsing JSON");
+            }
+            *this = std::move(result);
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+
+    bool JsonPushParser::feed(const char* data, size_t len) {
+        if (m_error) {
+            return false;
+        }
+        size_t pos = 0;
+        while (pos < len) {
+            if (m_state >= State::String) {
+                pos = continue_token(data, len, pos);
+                if (m_error) {
+                    return false;
+                }
+                continue;
+            }
+            char ch = data[pos];
+            if (std::isspace(static_cast<unsigned char>(ch))) {
+                pos++;
+                continue;
+            }
+            switch (m_state) {
+            case State::Done:
+                return fail("Found unexpected non-whitespace character after value", data, pos);
+            case State::Colon:
+                if (ch != ':') {
+                    return fail("Found invalid key-value separator while parsing object", data, pos);
+                }
+                m_state = State::Value;
+                pos++;
+                break;
+            case State::CommaOrEnd: {
+                bool in_object = m_stack.back() == '{';
+                if (ch == ',') {
+                    m_state = in_object ? State::Key : State::Value;
+                }
+                else if (ch == (in_object ? '}' : ']')) {
+                    close_container();
+                }
+                else {
+                    return fail(in_object ? "Found invalid separator while parsing object" :
+                        "Found invalid separator while parsing array", data, pos);
+                }
+                pos++;
+                break;
+            }
+            case State::KeyOrObjectEnd:
+                if (ch == '}') {
+                    close_container();
+                    pos++;
+                    break;
+                }
+                [[fallthrough]];
+            case State::Key:
+                if (ch != '"') {
+                    return fail("String did not begin with `\"`", data, pos);
+                }
+                m_token_is_key = true;
+                m_state = State::String;
+                pos++;
+                break;
+            case State::ValueOrArrayEnd:
+                if (ch == ']') {
+                    close_container();
+                    pos++;
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                pos = begin_value(data, pos);
+                if (m_error) {
+                    return false;
+                }
+                break;
+            }
+        }
+        // Keep the line count up to date for error positions in later chunks
+        for (auto p = static_cast<const char*>(std::memchr(data, '\n', len)); p;
+            p = static_cast<const char*>(std::memchr(p + 1, '\n', data + len - p - 1)))
+        {
+            m_line++;
+            m_line_start = m_offset + (p - data) + 1;
+        }
+        m_offset += len;
+        return true;
+    }
+
+    size_t JsonPushParser::begin_value(const char* data, size_t pos) {
+        switch (data[pos]) {
+        case '{':
+            m_handler->on_object_start();
+            m_stack.push_back('{');
+            m_state = State::KeyOrObjectEnd;
+            return pos + 1;
+        case '[':
+            m_handler->on_array_start();
+            m_stack.push_back('[');
+            m_state = State::ValueOrArrayEnd;
+            return pos + 1;
+        case '"':
+            m_token_is_key = false;
+            m_state = State::String;
+            return pos + 1;
+        // Literals and numbers are matched from their first character on
+        case 't':   m_literal = "true";     break;
+        case 'f':   m_literal = "false";    break;
+        case 'n':   m_literal = "null";     break;
+        default:
+            if (data[pos] != '-' && !(data[pos] >= '0' && data[pos] <= '9')) {
+                fail("Found invalid number while parsing", data, pos);
+                return pos;
+            }
+            m_state = State::Number;
+            return pos;
+        }
+        m_literal_kind = data[pos];
+        m_state = State::Literal;
+        return pos;
+    }
+
+    size_t JsonPushParser::continue_token(const char* data, size_t len, size_t pos) {
+        switch (m_state) {
+        case State::String: {
+            size_t begin = pos;
+            while (pos < len && data[pos] != '"' && data[pos] != '\\') {
+                pos++;
+            }
+            if (pos == len) {
+                m_token.append(data + begin, pos - begin);
+                return pos;
+            }
+            if (data[pos] == '\\') {
+                m_token.append(data + begin, pos - begin);
+                m_state = State::StringEscape;
+                return pos + 1;
+            }
+            // Escapes always leave something in m_token, so an empty one means that the
+            // whole string is in this chunk
+            std::string_view str{ data + begin, pos - begin };
+            if (!m_token.empty()) {
+                m_token.append(str);
+                str = m_token;
+            }
+            if (m_token_is_key) {
+                m_handler->on_key(str);
+                m_state = State::Colon;
+            }
+            else {
+                m_handler->on_string(str);
+                end_value();
+            }
+            m_token.clear();
+            return pos + 1;
+        }
+        case State::StringEscape:
+            m_state = State::String;
+            switch (data[pos]) {
+            case '"':       m_token += '"';     break;
+            case '\\':      m_token += '\\';    break;
+            case '/':       m_token += '/';     break;
+            case 'b':       m_token += '\b';    break;
+            case 'f':       m_token += '\f';    break;
+            case 'n':       m_token += '\n';    break;
+            case 'r':       m_token += '\r';    break;
+            case 't':       m_token += '\t';    break;
+            case 'u':
+                m_unicode_cp = 0;
+                m_unicode_digits = 0;
+                m_state = State::StringUnicode;
+                break;
+            default:
+                fail("Found invalid escape character while parsing string", data, pos);
+                break;
+            }
+            return pos + 1;
+        case State::StringUnicode:
+            for (; pos < len && m_unicode_digits < 4; pos++, m_unicode_digits++) {
+                char ch = data[pos];
+                uint32_t digit;
+                if (ch >= '0' && ch <= '9') {
+                    digit = ch - '0';
+                }
+                else if ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f') {
+                    digit = (ch | 0x20) - 'a' + 10;
+                }
+                else {
+                    fail("Found invalid hex digit while parsing string", data, pos);
+                    return pos;
+                }
+                m_unicode_cp = m_unicode_cp * 16 + digit;
+            }
+            if (m_unicode_digits == 4) {
+                append_utf8_codepoint_to_string(m_token, m_unicode_cp);
+                m_state = State::String;
+            }
+            return pos;
+        case State::Number: {
+            // Gathers everything that may continue a number; read_number then has to
+            // consume all of it
+            size_t begin = pos;
+            while (pos < len && ((data[pos] >= '0' && data[pos] <= '9') || data[pos] == '.' ||
+                data[pos] == 'e' || data[pos] == 'E' || data[pos] == '+' || data[pos] == '-'))
+            {
+                pos++;
+            }
+            m_token.append(data + begin, pos - begin);
+            if (pos < len) {
+                finish_number(data, pos);
+            }
+            return pos;
+        }
+        default:
+            // State::Literal
+            for (; pos < len && *m_literal; pos++, m_literal++) {
+                if (data[pos] != *m_literal) {
+                    fail(m_literal_kind == 'n' ? "Found invalid null while parsing" :
+                        "Found invalid boolean while parsing", data, pos);
+                    return pos;
+                }
+            }
+            if (!*m_literal) {
+                if (m_literal_kind == 'n') {
+                    m_handler->on_null();
+                }
+                else {
+                    m_handler->on_bool(m_literal_kind == 't');
+                }
+                end_value();
+            }
+            return pos;
+        }
+    }
+
+    bool JsonPushParser::finish_number(const char* data, size_t pos) {
+        size_t rpos = 0;
+        JsonNumber value;
+        try {
+            value = read_number(m_token, rpos);
+        }
+        catch (const std::runtime_error& e) {
+            return fail(e.what(), data, pos);
+        }
+        if (rpos != m_token.size()) {
+            return fail("Found invalid number while parsing", data, pos);
+        }
+        m_token.clear();
+        if (std::holds_alternative<int64_t>(value)) {
+            m_handler->on_integer(std::get<int64_t>(value));
+        }
+        else if (std::holds_alternative<uint64_t>(value)) {
+            m_handler->on_unsigned(std::get<uint64_t>(value));
+        }
+        else {
+            m_handler->on_number(std::get<double>(value));
+        }
+        end_value();
+        return true;
+    }
+
+    void JsonPushParser::close_container(void) {
+        char kind = m_stack.back();
+        m_stack.pop_back();
+        if (kind == '{') {
+            m_handler->on_object_end();
+        }
+        else {
+            m_handler->on_array_end();
+        }
+        end_value();
+    }
+
+    bool JsonPushParser::finish(void) {
+        if (m_error) {
+            return false;
+        }
+        if (m_state == State::Number && !finish_number(nullptr, 0)) {
+            return false;
+        }
+        if (m_state != State::Done) {
+            return fail("Unexpected end of stream while parsing JSON", nullptr, 0);
+        }
+        return true;
+    }
+
+    void JsonPushParser::reset(void) {
+        *this = JsonPushParser(*m_handler);
+    }
+
+    bool JsonPushParser::fail(const char* message, const char* data, size_t pos) {
+        // Lines of the current chunk are only counted once it has been parsed
+        size_t line = m_line, line_start = m_line_start;
+        for (size_t i = 0; i < pos; i++) {
+            if (data[i] == '\n') {
+                line++;
+                line_start = m_offset + i + 1;
+            }
+        }
+        size_t offset = m_offset + pos;
+        m_error = JsonParseError{ message, offset, line, offset - line_start + 1 };
+        return false;
+    }
+
+    JsonPath::JsonPath(std::string_view expression) {
+        std::string_view sv = expression;
+        size_t pos = 0;
+        auto peek = [&] {
+            return pos < sv.size() ? sv[pos] : '\0';
+        };
+        auto skip_spaces = [&] {
+            while (peek() == ' ') {
+                pos++;
+            }
+        };
+        auto expect = [&](char ch) {
+            if (peek() != ch) {
+                throw std::runtime_error(std::string{ "Found invalid character while parsing JSONPath, expected `" } + ch + "`");
+            }
+            pos++;
+        };
+        auto read_name = [&] {
+            size_t begin = pos;
+            while (pos < sv.size() && std::string_view{ ".[ )=!<>" }.find(sv[pos]) == std::string_view::npos) {
+                pos++;
+            }
+            if (pos == begin) {
+                throw std::runtime_error("Found empty name while parsing JSONPath");
+            }
+            return std::string{ sv.substr(begin, pos - begin) };
+        };
+        // JSON strings, or single-quoted ones with backslash escaping the next character
+        auto read_quoted = [&] {
+            if (peek() == '"') {
+                return read_string(sv, pos);
+            }
+            expect('\'');
+            std::string result;
+            while (pos < sv.size() && sv[pos] != '\'') {
+                if (sv[pos] == '\\' && pos + 1 < sv.size()) {
+                    pos++;
+                }
+                result += sv[pos++];
+            }
+            expect('\'');
+            return result;
+        };
+        auto read_index = [&]() -> std::optional<size_t> {
+            if (peek() == '-') {
+                throw std::runtime_error("Found unsupported negative index while parsing JSONPath");
+            }
+            size_t value = 0;
+            auto [ptr, ec] = std::from_chars(sv.data() + pos, sv.data() + sv.size(), value);
+            if (ptr == sv.data() + pos) {
+                return std::nullopt;
+            }
+            if (ec != std::errc{}) {
+                throw std::runtime_error("Found invalid index while parsing JSONPath");
+            }
+            pos = ptr - sv.data();
+            return value;
+        };
+        auto read_filter = [&] {
+            static constexpr std::pair<std::string_view, FilterOp> ops[] = {
+                { "==", FilterOp::Equal }, { "!=", FilterOp::NotEqual }, { "<=", FilterOp::LessEqual },
+                { ">=", FilterOp::GreaterEqual }, { "<", FilterOp::Less }, { ">", FilterOp::Greater },
+            };
+            Filter filter{ {}, FilterOp::Exists, {} };
+            expect('(');
+            skip_spaces();
+            expect('@');
+            while (peek() == '.' || peek() == '[') {
+                if (sv[pos++] == '.') {
+                    filter.path.push_back(read_name());
+                    continue;
+                }
+                skip_spaces();
+                filter.path.push_back(read_quoted());
+                skip_spaces();
+                expect(']');
+            }
+            skip_spaces();
+            for (auto [text, op] : ops) {
+                if (sv.substr(pos, text.size()) == text) {
+                    filter.op = op;
+                    pos += text.size();
+                    break;
+                }
+            }
+            if (filter.op != FilterOp::Exists) {
+                skip_spaces();
+                if (peek() == '"' || peek() == '\'') {
+                    filter.literal = read_quoted();
+                }
+                else if (sv.substr(pos, 4) == "true" || sv.substr(pos, 5) == "false") {
+                    filter.literal = read_boolean(sv, pos);
+                }
+                else if (sv.substr(pos, 4) == "null") {
+                    read_null(sv, pos);
+                }
+                else {
+                    filter.literal = JsonHelper::to_jvalue(read_number(sv, pos));
+                }
+                skip_spaces();
+            }
+            expect(')');
+            return filter;
+        };
+        auto read_bracket = [&](Step& step) {
+            expect('[');
+            skip_spaces();
+            if (peek() == '*') {
+                pos++;
+                step.kind = StepKind::Wildcard;
+            }
+            else if (peek() == '"' || peek() == '\'') {
+                step.kind = StepKind::Name;
+                step.name = read_quoted();
+            }
+            else if (peek() == '?') {
+                pos++;
+                step.kind = StepKind::Filter;
+                step.filter = m_filters.size();
+                m_filters.push_back(read_filter());
+            }
+            else {
+                step.kind = StepKind::Slice;
+                auto start = read_index();
+                skip_spaces();
+                if (peek() == ':') {
+                    pos++;
+                    skip_spaces();
+                    step.start = start.value_or(0);
+                    step.end = read_index().value_or(SIZE_MAX);
+                    step.stride = 1;
+                    skip_spaces();
+                    if (peek() == ':') {
+                        pos++;
+                        skip_spaces();
+                        step.stride = read_index().value_or(1);
+                        if (step.stride == 0) {
+                            throw std::runtime_error("Found invalid slice step while parsing JSONPath");
+                        }
+                    }
+                }
+                else if (start) {
+                    step.start = *start;
+                    step.end = *start + 1;
+                    step.stride = 1;
+                }
+                else {
+                    throw std::runtime_error("Found invalid selector while parsing JSONPath");
+                }
+            }
+            skip_spaces();
+            expect(']');
+        };
+        auto read_member = [&](Step& step) {
+            if (peek() == '*') {
+                pos++;
+                step.kind = StepKind::Wildcard;
+            }
+            else {
+                step.kind = StepKind::Name;
+                step.name = read_name();
+            }
+        };
+
+        if (peek() != '$') {
+            throw std::runtime_error("JSONPath did not begin with `$`");
+        }
+        pos++;
+        while (pos < sv.size()) {
+            Step step{};
+            if (sv.substr(pos, 2) == "..") {
+                pos += 2;
+                step.descendant = true;
+                if (peek() == '[') {
+                    read_bracket(step);
+                }
+                else {
+                    read_member(step);
+                }
+            }
+            else if (peek() == '.') {
+                pos++;
+                read_member(step);
+            }
+            else if (peek() == '[') {
+                read_bracket(step);
+            }
+            else {
+                throw std::runtime_error("Found invalid step while parsing JSONPath");
+            }
+            m_steps.push_back(std::move(step));
+        }
+    }
+
+    bool JsonPath::try_match(const char* data, size_t len, const std::function<void(JsonValue)>& on_match) const {
+        JsonPathMatcher matcher(*this, on_match);
+        JsonPushParser parser(matcher);
+        return parser.feed(data, len) && parser.finish();
+    }
+
+    void JsonPathMatcher::reset(void) {
+        m_depth = 0;
+        m_skip_depth = 0;
+        m_level_count = 0;
+        m_states.clear();
+        m_guards.clear();
+        m_captures.clear();
+    }
+
+    void JsonPathMatcher::on_key(std::string_view key) {
+        for (auto& capture : m_captures) {
+            capture.keys.emplace_back(key);
+        }
+        if (m_skip_depth == 0) {
+            m_levels[m_level_count - 1].key.assign(key);
+        }
+    }
+
+    JsonValue JsonPathMatcher::Scalar::to_value(void) const {
+        switch (kind) {
+        case JsonValueKind::Boolean:    return boolean;
+        case JsonValueKind::Number:     return number;
+        case JsonValueKind::String:     return string;
+        default:                        return nullptr;
+        }
+    }
+
+    void JsonPathMatcher::on_scalar(const Scalar& scalar) {
+        if (m_skip_depth == 0) {
+            begin_value(&scalar);
+        }
+        add_to_captures(scalar);
+        if (m_skip_depth == 0) {
+            end_value();
+        }
+    }
+
+    void JsonPathMatcher::on_container_start(bool is_array) {
+        if (m_skip_depth > 0) {
+            m_skip_depth++;
+        }
+        else {
+            size_t begin = m_states.size();
+            if (begin_value(nullptr) == 0) {
+                m_skip_depth = 1;
+            }
+            else {
+                if (m_level_count == m_levels.size()) {
+                    m_levels.emplace_back();
+                }
+                Level& level = m_levels[m_level_count++];
+                level.is_array = is_array;
+                level.next_index = 0;
+                level.states_begin = begin;
+            }
+        }
+        m_depth++;
+        for (auto& capture : m_captures) {
+            capture.open.push_back(is_array ? JsonValue{ JsonArray{} } : JsonValue{ JsonObject{} });
+        }
+    }
+
+    void JsonPathMatcher::on_container_end(void) {
+        m_depth--;
+        // Captures of this container are finished by end_value
+        for (auto& capture : m_captures) {
+            if (capture.depth < m_depth) {
+                JsonValue value = std::move(capture.open.back());
+                capture.open.pop_back();
+                JsonValue& parent = capture.open.back();
+                if (parent.is_array()) {
+                    parent.get<JsonArray>().push_back(std::move(value));
+                }
+                else {
+                    parent[capture.keys.back()] = std::move(value);
+                    capture.keys.pop_back();
+                }
+            }
+        }
+        if (m_skip_depth > 1) {
+            m_skip_depth--;
+            return;
+        }
+        if (m_skip_depth == 1) {
+            m_skip_depth = 0;
+        }
+        else {
+            m_states.resize(m_levels[--m_level_count].states_begin);
+        }
+        end_value();
+    }
+
+    void JsonPathMatcher::push_state(size_t begin, State state) {
+        // Descendant steps reach the same state on several ways
+        for (size_t i = begin; i < m_states.size(); i++) {
+            if (m_states[i].step == state.step && m_states[i].guard == state.guard &&
+                m_states[i].in_filter == state.in_filter)
+            {
+                return;
+            }
+        }
+        m_states.push_back(state);
+    }
+
+    size_t JsonPathMatcher::begin_value(const Scalar* scalar) {
+        const auto& steps = m_path->m_steps;
+        bool container = scalar == nullptr;
+        size_t begin = m_states.size();
+        bool unconditional = false;
+        if (m_level_count == 0) {
+            if (steps.empty()) {
+                unconditional = true;
+            }
+            else if (container) {
+                m_states.push_back({ 0, no_guard, false });
+            }
+        }
+        else {
+            Level& parent = m_levels[m_level_count - 1];
+            size_t index = parent.is_array ? parent.next_index++ : 0;
+            for (size_t i = parent.states_begin; i < begin; i++) {
+                State state = m_states[i];
+                if (state.in_filter) {
+                    Guard& guard = m_guards[state.guard];
+                    const auto& path = guard.filter->path;
+                    if (parent.is_array || parent.key != path[state.step]) {
+                        continue;
+                    }
+                    if (state.step + 1 == path.size()) {
+                        guard.result = guard.result || test_filter(*guard.filter, scalar);
+                    }
+                    else if (container) {
+                        push_state(begin, { state.step + 1, state.guard, true });
+                    }
+                    continue;
+                }
+                const JsonPath::Step& step = steps[state.step];
+                if (step.descendant && container) {
+                    push_state(begin, state);
+                }
+                bool selected = true;
+                if (step.kind == JsonPath::StepKind::Name) {
+                    selected = !parent.is_array && parent.key == step.name;
+                }
+                else if (step.kind == JsonPath::StepKind::Slice) {
+                    selected = parent.is_array && index >= step.start && index < step.end &&
+                        (index - step.start) % step.stride == 0;
+                }
+                if (!selected) {
+                    continue;
+                }
+                uint32_t guard = state.guard;
+                if (step.kind == JsonPath::StepKind::Filter) {
+                    // Filters on the value itself, and any on scalars, are decided here;
+                    // others wait for the members of the value
+                    const auto& filter = m_path->m_filters[step.filter];
+                    if (filter.path.empty() || !container) {
+                        if (!(filter.path.empty() && test_filter(filter, scalar))) {
+                            continue;
+                        }
+                    }
+                    else {
+                        guard = static_cast<uint32_t>(m_guards.size());
+                        m_guards.push_back({ &filter, state.guard, m_depth, false, {} });
+                        push_state(begin, { 0, guard, true });
+                    }
+                }
+                if (state.step + 1 < steps.size()) {
+                    if (container) {
+                        push_state(begin, { state.step + 1, guard, false });
+                    }
+                }
+                else if (guard == no_guard) {
+                    unconditional = true;
+                }
+                else {
+                    m_match_guards.push_back(guard);
+                }
+            }
+        }
+        if (unconditional || !m_match_guards.empty()) {
+            Capture capture{ m_depth, {}, {}, unconditional, m_match_guards };
+            m_match_guards.clear();
+            if (scalar) {
+                finish_capture(scalar->to_value(), capture);
+            }
+            else {
+                m_captures.push_back(std::move(capture));
+            }
+        }
+        return m_states.size() - begin;
+    }
+
+    void JsonPathMatcher::end_value(void) {
+        while (!m_captures.empty() && m_captures.back().depth == m_depth) {
+            Capture capture = std::move(m_captures.back());
+            m_captures.pop_back();
+            finish_capture(std::move(capture.open.back()), capture);
+        }
+        while (!m_guards.empty() && m_guards.back().depth == m_depth) {
+            Guard guard = std::move(m_guards.back());
+            m_guards.pop_back();
+            if (guard.result) {
+                for (const auto& match : guard.matches) {
+                    report(match, guard.parent);
+                }
+            }
+        }
+    }
+
+    void JsonPathMatcher::add_to_captures(const Scalar& scalar) {
+        for (auto& capture : m_captures) {
+            JsonValue& parent = capture.open.back();
+            if (parent.is_array()) {
+                parent.get<JsonArray>().push_back(scalar.to_value());
+            }
+            else {
+                parent[capture.keys.back()] = scalar.to_value();
+                capture.keys.pop_back();
+            }
+        }
+    }
+
+    void JsonPathMatcher::finish_capture(JsonValue value, Capture& capture) {
+        if (capture.unconditional) {
+            m_on_match(std::move(value));
+            return;
+        }
+        auto match = std::make_shared<Match>(Match{ std::move(value), false });
+        for (uint32_t guard : capture.guards) {
+            m_guards[guard].matches.push_back(match);
+        }
+    }
+
+    void JsonPathMatcher::report(const std::shared_ptr<Match>& match, uint32_t guard) {
+        if (guard != no_guard) {
+            m_guards[guard].matches.push_back(match);
+        }
+        else if (!match->reported) {
+            match->reported = true;
+            m_on_match(std::move(match->value));
+        }
+    }
+
+    bool JsonPathMatcher::test_filter(const JsonPath::Filter& filter, const Scalar* value) {
+        using Op = JsonPath::FilterOp;
+        if (filter.op == Op::Exists) {
+            return true;
+        }
+        // Containers are only unequal to every literal
+        if (!value) {
+            return filter.op == Op::NotEqual;
+        }
+        const JsonValue& literal = filter.literal;
+        int order;
+        if (value->kind == JsonValueKind::Number && literal.is_number()) {
+            order = JsonHelper::compare_numbers(value->number, literal);
+        }
+        else if (value->kind == JsonValueKind::String && literal.is_string()) {
+            order = value->string.compare(literal.get<std::string_view>());
+        }
+        else {
+            // Other values are only equal or not
+            bool equal = (value->kind == JsonValueKind::Null && literal.is_null()) ||
+                (value->kind == JsonValueKind::Boolean && literal.is_bool() && value->boolean == literal.get<bool>());
+            return filter.op == Op::Equal ? equal : filter.op == Op::NotEqual && !equal;
+        }
+        switch (filter.op) {
+        case Op::Equal:         return order == 0;
+        case Op::NotEqual:      return order != 0;
+        case Op::Less:          return order < 0;
+        case Op::LessEqual:     return order <= 0;
+        case Op::Greater:       return order > 0;
+        default:                return order >= 0;
+        }
+    }
 }
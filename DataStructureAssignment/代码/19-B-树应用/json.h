@@ -2,6 +2,13 @@
 
 #include <variant>
 #include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include "hashmap.h"
 #include <string_view>
 
@@ -9,10 +16,17 @@ namespace json {
     class JsonValue;
     class JsonObject;
     class JsonArray;
+    class JsonNode;
+    struct JsonMember;
 
     namespace details {
         template<typename T>
         struct dependent_false_type : std::false_type {};
+
+        // Positions of all structural characters (`{}[]:,`), unescaped quotes and first
+        // characters of other scalars in `sv`, followed by two entries equal to
+        // sv.size(). Throws on unterminated strings.
+        std::vector<uint32_t> build_structural_index(std::string_view sv);
     }
 
     enum class JsonValueKind {
@@ -155,24 +169,26 @@ namespace json {
         Container m_map;
     };
 
+    // 16 bytes: a tag, and a scalar, a string of up to 14 bytes or a pointer to a longer
+    // string or a container. Integers stay exact as int64_t, or uint64_t above INT64_MAX,
+    // other numbers are doubles; all are JsonValueKind::Number and compare by value.
     class JsonValue {
     public:
-        JsonValue() : m_kind(JsonValueKind::Null), m_var(std::monostate{}) {}
-        JsonValue(std::nullptr_t) : m_kind(JsonValueKind::Null), m_var(std::monostate{}) {}
-        JsonValue(bool v) : m_kind(JsonValueKind::Boolean), m_var(v) {}
-        JsonValue(const JsonArray& v) : m_kind(JsonValueKind::Array), m_var(v) {}
-        JsonValue(JsonArray&& v) : m_kind(JsonValueKind::Array), m_var(std::move(v)) {}
-        //JsonValue(double v) : m_kind(JsonValueKind::Number), m_var(v) {}
+        JsonValue() noexcept {}
+        JsonValue(std::nullptr_t) noexcept {}
+        JsonValue(bool v) noexcept : m_tag(Tag::Boolean) { store(v); }
+        JsonValue(const JsonArray& v) { emplace<JsonArray>(v); }
+        JsonValue(JsonArray&& v) { emplace<JsonArray>(std::move(v)); }
         template<typename T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>, int> = 0>
-        JsonValue(T v) : m_kind(JsonValueKind::Number), m_var(static_cast<double>(v)) {}
-        JsonValue(const char* v) : m_kind(JsonValueKind::String), m_var(std::string{ v }) {}
-        JsonValue(std::string_view v) : m_kind(JsonValueKind::String), m_var(std::string{ v }) {}
+        JsonValue(T v) noexcept { set_number(v); }
+        JsonValue(const char* v) : JsonValue(std::string_view{ v }) {}
+        JsonValue(std::string_view v) { set_string(v); }
         JsonValue(const std::string& v) : JsonValue(std::string_view{ v }) {}
-        JsonValue(std::string&& v) : m_kind(JsonValueKind::String), m_var(std::move(v)) {}
-        JsonValue(const JsonObject& v) : m_kind(JsonValueKind::Object), m_var(v) {}
-        JsonValue(JsonObject&& v) : m_kind(JsonValueKind::Object), m_var(std::move(v)) {}
-        ~JsonValue() = default;
-        JsonValue(const JsonValue& other) : m_kind(other.m_kind), m_var(other.m_var) {}
+        JsonValue(std::string&& v) { set_string(std::move(v)); }
+        JsonValue(const JsonObject& v) { emplace<JsonObject>(v); }
+        JsonValue(JsonObject&& v) { emplace<JsonObject>(std::move(v)); }
+        ~JsonValue() { destroy(); }
+        JsonValue(const JsonValue& other);
         JsonValue(JsonValue&& other) noexcept : JsonValue() { swap(*this, other); }
         JsonValue& operator=(JsonValue other) noexcept { swap(*this, other); return *this; }
 
@@ -180,23 +196,82 @@ namespace json {
         bool try_deserialize_from_utf8(const std::vector<char>& data) {
             return try_deserialize_from_utf8(data.data(), data.size());
         }
+        // Same result as try_deserialize_from_utf8, but locates the structure of the
+        // whole input with SIMD first (scalar code on CPUs without SSE2)
+        bool try_deserialize_from_utf8_indexed(const char* data, size_t len);
+        bool try_deserialize_from_utf8_indexed(const std::vector<char>& data) {
+            return try_deserialize_from_utf8_indexed(data.data(), data.size());
+        }
+        // Same result as try_deserialize_from_utf8, but an array at the root is cut into
+        // chunks of elements that are parsed on up to `threads` threads (0: one per core).
+        // Other and small documents are parsed on the calling thread.
+        bool try_deserialize_from_utf8_parallel(const char* data, size_t len, unsigned threads = 0);
+        bool try_deserialize_from_utf8_parallel(const std::vector<char>& data, unsigned threads = 0) {
+            return try_deserialize_from_utf8_parallel(data.data(), data.size(), threads);
+        }
+        // Newline-delimited JSON: an array of the values of all non-blank lines, each of
+        // which has to hold one value. Chunks of lines are parsed in parallel as above.
+        bool try_deserialize_ndjson(const char* data, size_t len, unsigned threads = 0);
+        bool try_deserialize_ndjson(const std::vector<char>& data, unsigned threads = 0) {
+            return try_deserialize_ndjson(data.data(), data.size(), threads);
+        }
         std::vector<char> serialize_into_utf8(void) const;
 
-        bool is_null(void) const { return m_kind == JsonValueKind::Null; }
-        bool is_bool(void) const { return m_kind == JsonValueKind::Boolean; }
-        bool is_array(void) const { return m_kind == JsonValueKind::Array; }
-        bool is_number(void) const { return m_kind == JsonValueKind::Number; }
-        bool is_string(void) const { return m_kind == JsonValueKind::String; }
-        bool is_object(void) const { return m_kind == JsonValueKind::Object; }
+        JsonValueKind kind(void) const {
+            static constexpr JsonValueKind kinds[] = {
+                JsonValueKind::Null, JsonValueKind::Boolean, JsonValueKind::Number, JsonValueKind::Number,
+                JsonValueKind::Number, JsonValueKind::String, JsonValueKind::String, JsonValueKind::Array, JsonValueKind::Object,
+            };
+            return kinds[static_cast<size_t>(m_tag)];
+        }
+        bool is_null(void) const { return m_tag == Tag::Null; }
+        bool is_bool(void) const { return m_tag == Tag::Boolean; }
+        bool is_array(void) const { return m_tag == Tag::Array; }
+        bool is_number(void) const { return m_tag == Tag::Integer || m_tag == Tag::Unsigned || m_tag == Tag::Double; }
+        bool is_string(void) const { return m_tag == Tag::ShortString || m_tag == Tag::String; }
+        bool is_object(void) const { return m_tag == Tag::Object; }
 
-        // TODO: Add proxy support for integral types ?
+        // Containers by reference; bool, double, std::string and std::string_view by value,
+        // as numbers and short strings are not stored as such. Throws
+        // std::bad_variant_access for values of another kind.
         template<typename T>
-        T& get(void) {
-            return std::get<T>(m_var);
+        decltype(auto) get(void) {
+            if constexpr (std::is_same_v<T, JsonArray> || std::is_same_v<T, JsonObject>) {
+                return *container<T>();
+            }
+            else {
+                return static_cast<const JsonValue&>(*this).get<T>();
+            }
         }
         template<typename T>
-        const T& get(void) const {
-            return std::get<T>(m_var);
+        decltype(auto) get(void) const {
+            if constexpr (std::is_same_v<T, JsonArray> || std::is_same_v<T, JsonObject>) {
+                return static_cast<const T&>(*container<T>());
+            }
+            else if constexpr (std::is_same_v<T, bool>) {
+                check(Tag::Boolean);
+                return load<bool>();
+            }
+            else if constexpr (std::is_same_v<T, double>) {
+                if (m_tag == Tag::Integer) {
+                    return static_cast<double>(load<int64_t>());
+                }
+                if (m_tag == Tag::Unsigned) {
+                    return static_cast<double>(load<uint64_t>());
+                }
+                check(Tag::Double);
+                return load<double>();
+            }
+            else if constexpr (std::is_same_v<T, std::string>) {
+                // Const, so that modifying the copy does not compile
+                return static_cast<const std::string>(string_value());
+            }
+            else if constexpr (std::is_same_v<T, std::string_view>) {
+                return string_value();
+            }
+            else {
+                static_assert(details::dependent_false_type<T>::value, "Invalid get type for JsonValue");
+            }
         }
         JsonValue& operator[](size_t idx) {
             return this->get<JsonArray>()[idx];
@@ -222,10 +297,12 @@ namespace json {
         template<typename T>
         T get_value(void) const {
             if constexpr ((std::is_integral_v<T> || std::is_enum_v<T>) && !std::is_same_v<T, bool>) {
-                return static_cast<T>(std::get<double>(m_var));
+                // Exact for integers
+                return m_tag == Tag::Integer ? static_cast<T>(load<int64_t>()) :
+                    m_tag == Tag::Unsigned ? static_cast<T>(load<uint64_t>()) : static_cast<T>(get<double>());
             }
             else {
-                return std::get<T>(m_var);
+                return get<T>();
             }
         }
         template<typename T>
@@ -235,63 +312,753 @@ namespace json {
             constexpr bool valid_string = std::is_convertible_v<T, std::string>;
             static_assert(valid_number || valid_string, "Invalid set_value type for JsonValue");
             if constexpr (valid_number) {
-                m_var = static_cast<double>(v);
-                m_kind = JsonValueKind::Number;
+                *this = JsonValue{ v };
             }
             else {  // if constexpr (valid_string)
-                m_var = std::string{ v };
-                m_kind = JsonValueKind::String;
+                *this = JsonValue{ std::string{ v } };
             }
         }
         template<>
         void set_value(const bool& v) {
-            m_var = v;
-            m_kind = JsonValueKind::Boolean;
+            *this = JsonValue{ v };
         }
         template<>
         void set_value(const JsonArray& v) {
-            m_var = v;
-            m_kind = JsonValueKind::Array;
+            *this = JsonValue{ v };
         }
         template<>
         void set_value(const JsonObject& v) {
-            m_var = v;
-            m_kind = JsonValueKind::Object;
+            *this = JsonValue{ v };
         }
         template<>
         void set_value(const std::nullptr_t&) {
-            m_var = std::monostate{};
-            m_kind = JsonValueKind::Null;
+            *this = JsonValue{};
         }
         void set_value(JsonArray&& v) {
-            m_var = std::move(v);
-            m_kind = JsonValueKind::Array;
+            *this = JsonValue{ std::move(v) };
         }
         void set_value(JsonObject&& v) {
-            m_var = std::move(v);
-            m_kind = JsonValueKind::Object;
+            *this = JsonValue{ std::move(v) };
         }
         void set_value(std::string&& v) {
-            m_var = std::move(v);
-            m_kind = JsonValueKind::String;
+            *this = JsonValue{ std::move(v) };
         }
 
-        bool operator==(const JsonValue& rhs) const {
-            return m_kind == rhs.m_kind && m_var == rhs.m_var;
-        }
+        bool operator==(const JsonValue& rhs) const;
         bool operator!=(const JsonValue& rhs) const {
             return !operator==(rhs);
         }
 
         friend void swap(JsonValue& a, JsonValue& b) noexcept {
             using std::swap;
-            swap(a.m_kind, b.m_kind);
-            swap(a.m_var, b.m_var);
+            swap(a.m_bytes, b.m_bytes);
+            swap(a.m_tag, b.m_tag);
+        }
+
+        friend struct JsonHelper;
+    private:
+        // Numbers and strings have two representations each; see kind()
+        enum class Tag : uint8_t {
+            Null, Boolean, Integer, Unsigned, Double, ShortString, String, Array, Object,
+        };
+        // Short strings keep their size in the last byte
+        static constexpr size_t short_string_capacity = 14;
+
+        template<typename T>
+        T load(void) const noexcept {
+            T v;
+            std::memcpy(&v, m_bytes, sizeof v);
+            return v;
+        }
+        template<typename T>
+        void store(T v) noexcept {
+            std::memcpy(m_bytes, &v, sizeof v);
+        }
+        void check(Tag tag) const {
+            if (m_tag != tag) {
+                throw std::bad_variant_access();
+            }
+        }
+        template<typename T>
+        T* container(void) const {
+            check(std::is_same_v<T, JsonArray> ? Tag::Array : Tag::Object);
+            return load<T*>();
+        }
+        // Replaces the value with a new container
+        template<typename T, typename... Args>
+        T& emplace(Args&&... args) {
+            T* container = new T(std::forward<Args>(args)...);
+            destroy();
+            store(container);
+            m_tag = std::is_same_v<T, JsonArray> ? Tag::Array : Tag::Object;
+            return *container;
+        }
+        template<typename T>
+        void set_number(T v) noexcept {
+            if constexpr (std::is_enum_v<T>) {
+                set_number(static_cast<std::underlying_type_t<T>>(v));
+            }
+            else if constexpr (std::is_integral_v<T> && !(std::is_unsigned_v<T> && sizeof(T) >= sizeof(int64_t))) {
+                store(static_cast<int64_t>(v));
+                m_tag = Tag::Integer;
+            }
+            else if constexpr (std::is_integral_v<T>) {
+                if (v <= static_cast<uint64_t>(INT64_MAX)) {
+                    store(static_cast<int64_t>(v));
+                    m_tag = Tag::Integer;
+                    return;
+                }
+                store(static_cast<uint64_t>(v));
+                m_tag = Tag::Unsigned;
+            }
+            else {
+                store(static_cast<double>(v));
+                m_tag = Tag::Double;
+            }
+        }
+        void set_string(std::string_view v) {
+            if (v.size() > short_string_capacity) {
+                store(new std::string(v));
+                m_tag = Tag::String;
+                return;
+            }
+            std::memcpy(m_bytes, v.data(), v.size());
+            m_bytes[short_string_capacity] = static_cast<char>(v.size());
+            m_tag = Tag::ShortString;
+        }
+        void set_string(std::string&& v) {
+            if (v.size() > short_string_capacity) {
+                store(new std::string(std::move(v)));
+                m_tag = Tag::String;
+                return;
+            }
+            set_string(std::string_view{ v });
+        }
+        std::string_view string_value(void) const {
+            if (m_tag == Tag::ShortString) {
+                return { m_bytes, static_cast<size_t>(m_bytes[short_string_capacity]) };
+            }
+            check(Tag::String);
+            return *load<std::string*>();
+        }
+        void destroy(void) noexcept {
+            switch (m_tag) {
+            case Tag::String:   delete load<std::string*>();    break;
+            case Tag::Array:    delete load<JsonArray*>();      break;
+            case Tag::Object:   delete load<JsonObject*>();     break;
+            default:                                            break;
+            }
+        }
+
+        alignas(8) char m_bytes[15]{};
+        Tag m_tag{ Tag::Null };
+    };
+    static_assert(sizeof(JsonValue) == 16);
+
+    // String or object key of a JsonDocument. Points into the document's input; strings
+    // with escape sequences are decoded into the document's arena on first access.
+    // NOTE: Decoding writes to the document, so concurrent readers must access every
+    //       escaped string once beforehand
+    class JsonString {
+    public:
+        std::string_view view(void) const {
+            if (m_arena) {
+                decode();
+            }
+            return { m_data, m_size };
+        }
+        operator std::string_view() const { return view(); }
+
+        bool operator==(std::string_view rhs) const { return view() == rhs; }
+        bool operator!=(std::string_view rhs) const { return view() != rhs; }
+
+        friend struct JsonHelper;
+    private:
+        void decode(void) const;
+
+        mutable const char* m_data{};
+        mutable size_t m_size{};
+        // Set while the string still has to be decoded
+        mutable std::pmr::memory_resource* m_arena{};
+    };
+
+    class JsonArrayView;
+    class JsonObjectView;
+
+    // Read-only value of a JsonDocument, with the accessors of JsonValue. Nodes and the
+    // arrays of them live in the document's arena and need no destruction.
+    class JsonNode {
+    public:
+        JsonValueKind kind(void) const {
+            return m_var.index() > 5 ? JsonValueKind::Number : static_cast<JsonValueKind>(m_var.index());
+        }
+        bool is_null(void) const { return kind() == JsonValueKind::Null; }
+        bool is_bool(void) const { return kind() == JsonValueKind::Boolean; }
+        bool is_array(void) const { return kind() == JsonValueKind::Array; }
+        bool is_number(void) const { return kind() == JsonValueKind::Number; }
+        bool is_string(void) const { return kind() == JsonValueKind::String; }
+        bool is_object(void) const { return kind() == JsonValueKind::Object; }
+
+        // Same types as JsonValue::get, but by value: JsonArray and JsonObject give a
+        // JsonArrayView and JsonObjectView, std::string gives a std::string_view
+        template<typename T>
+        auto get(void) const;
+        // T may be bool, an arithmetic or enum type, std::string_view or std::string
+        template<typename T>
+        T get_value(void) const {
+            if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+                return T{ std::get<JsonString>(m_var).view() };
+            }
+            else if constexpr ((std::is_arithmetic_v<T> || std::is_enum_v<T>) && !std::is_same_v<T, bool>) {
+                // Exact for integers
+                if (auto integer = std::get_if<int64_t>(&m_var)) {
+                    return static_cast<T>(*integer);
+                }
+                if (auto integer = std::get_if<uint64_t>(&m_var)) {
+                    return static_cast<T>(*integer);
+                }
+                return static_cast<T>(std::get<double>(m_var));
+            }
+            else {
+                return std::get<T>(m_var);
+            }
+        }
+        std::span<const JsonNode> elements(void) const {
+            auto range = std::get<ElementRange>(m_var);
+            return { range.data, range.size };
+        }
+        std::span<const JsonMember> members(void) const;
+        // Number of elements or members
+        size_t size(void) const {
+            return is_object() ? std::get<MemberRange>(m_var).size : std::get<ElementRange>(m_var).size;
+        }
+        const JsonNode& operator[](size_t idx) const { return elements()[idx]; }
+        const JsonNode& at(size_t idx) const;
+        const JsonNode& operator[](std::string_view key) const { return at(key); }
+        // Duplicate keys resolve to the last one, as in JsonObject
+        const JsonNode& at(std::string_view key) const;
+        const JsonNode* find(std::string_view key) const;
+        bool contains(std::string_view key) const { return find(key) != nullptr; }
+
+        JsonValue to_value(void) const;
+
+        friend struct JsonHelper;
+    private:
+        struct ElementRange {
+            const JsonNode* data;
+            size_t size;
+        };
+        struct MemberRange {
+            const JsonMember* data;
+            size_t size;
+        };
+        // Alternatives in the order of JsonValueKind, then exact integers
+        std::variant<std::monostate, bool, ElementRange, double, JsonString, MemberRange, int64_t, uint64_t> m_var;
+    };
+
+    struct JsonMember {
+        JsonString key;
+        JsonNode value;
+    };
+
+    inline std::span<const JsonMember> JsonNode::members(void) const {
+        auto range = std::get<MemberRange>(m_var);
+        return { range.data, range.size };
+    }
+
+    class JsonArrayView {
+    public:
+        using value_type = JsonNode;
+        using size_type = size_t;
+        using const_reference = const JsonNode&;
+        using const_iterator = const JsonNode*;
+        using iterator = const_iterator;
+
+        JsonArrayView(std::span<const JsonNode> elements) : m_elements(elements) {}
+
+        const_reference at(size_type pos) const;
+        const_reference operator[](size_type pos) const noexcept { return m_elements[pos]; }
+        const_reference front() const noexcept { return m_elements.front(); }
+        const_reference back() const noexcept { return m_elements.back(); }
+        const_iterator begin() const noexcept { return m_elements.data(); }
+        const_iterator end() const noexcept { return m_elements.data() + m_elements.size(); }
+        bool empty() const noexcept { return m_elements.empty(); }
+        size_type size() const noexcept { return m_elements.size(); }
+
+    private:
+        std::span<const JsonNode> m_elements;
+    };
+
+    class JsonObjectView {
+    public:
+        using value_type = JsonMember;
+        using size_type = size_t;
+        using const_reference = const JsonMember&;
+        using const_iterator = const JsonMember*;
+        using iterator = const_iterator;
+
+        JsonObjectView(std::span<const JsonMember> members) : m_members(members) {}
+
+        const JsonNode& at(std::string_view key) const;
+        const_iterator begin() const noexcept { return m_members.data(); }
+        const_iterator end() const noexcept { return m_members.data() + m_members.size(); }
+        bool empty() const noexcept { return m_members.empty(); }
+        size_type size() const noexcept { return m_members.size(); }
+        // Last member with the key, or end()
+        const_iterator find(std::string_view key) const;
+        size_type count(std::string_view key) const { return find(key) != end(); }
+        bool contains(std::string_view key) const { return find(key) != end(); }
+
+    private:
+        std::span<const JsonMember> m_members;
+    };
+
+    template<typename T>
+    auto JsonNode::get(void) const {
+        if constexpr (std::is_same_v<T, JsonArray>) {
+            return JsonArrayView{ elements() };
+        }
+        else if constexpr (std::is_same_v<T, JsonObject>) {
+            return JsonObjectView{ members() };
+        }
+        else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            return std::get<JsonString>(m_var).view();
+        }
+        else if constexpr (std::is_same_v<T, double>) {
+            return get_value<double>();
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            return std::get<T>(m_var);
+        }
+        else {
+            static_assert(details::dependent_false_type<T>::value, "Invalid get type for JsonNode");
+        }
+    }
+
+    // Parses without copying strings: the document owns the input, which strings and
+    // keys refer to, and arenas that hold all nodes and decoded escaped strings.
+    // Destroying it releases the arena blocks without visiting any node.
+    class JsonDocument {
+    public:
+        JsonDocument() = default;
+        JsonDocument(const JsonDocument&) = delete;
+        JsonDocument(JsonDocument&&) noexcept = default;
+        JsonDocument& operator=(const JsonDocument&) = delete;
+        JsonDocument& operator=(JsonDocument&&) noexcept = default;
+
+        // Accepts the same input as JsonValue::try_deserialize_from_utf8
+        bool try_parse(std::vector<char> data);
+        bool try_parse(const char* data, size_t len) {
+            return try_parse(std::vector<char>(data, data + len));
+        }
+        // Same as try_parse and try_parse_ndjson, with the chunks of
+        // JsonValue::try_deserialize_from_utf8_parallel and try_deserialize_ndjson.
+        // Each chunk is parsed into an arena of its own.
+        bool try_parse_parallel(std::vector<char> data, unsigned threads = 0);
+        bool try_parse_ndjson(std::vector<char> data, unsigned threads = 0);
+        const JsonNode& root(void) const { return m_root; }
+
+        friend struct JsonHelper;
+    private:
+        std::vector<char> m_input;
+        // One per chunk; the first one also holds the elements of the root
+        std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> m_arenas;
+        JsonNode m_root;
+    };
+
+    // Receives the events of a JsonPushParser. Strings and keys are only valid during
+    // the call.
+    class JsonHandler {
+    public:
+        virtual ~JsonHandler() = default;
+        virtual void on_null(void) {}
+        virtual void on_bool(bool) {}
+        virtual void on_number(double) {}
+        // Numbers without a fraction or exponent that fit, exactly
+        virtual void on_integer(int64_t v) { on_number(static_cast<double>(v)); }
+        // Integers above INT64_MAX that fit a uint64_t
+        virtual void on_unsigned(uint64_t v) { on_number(static_cast<double>(v)); }
+        virtual void on_string(std::string_view) {}
+        // Precedes the value of each object member
+        virtual void on_key(std::string_view) {}
+        virtual void on_object_start(void) {}
+        virtual void on_object_end(void) {}
+        virtual void on_array_start(void) {}
+        virtual void on_array_end(void) {}
+    };
+
+    struct JsonParseError {
+        std::string message;
+        size_t offset;
+        // Both 1-based; columns count bytes
+        size_t line;
+        size_t column;
+    };
+
+    // Event-based parser taking the input in chunks of any size. Accepts the same
+    // documents as JsonValue::try_deserialize_from_utf8; memory use is bounded by the
+    // nesting depth and the longest string or number that spans chunks.
+    class JsonPushParser {
+    public:
+        explicit JsonPushParser(JsonHandler& handler) : m_handler(&handler) {}
+
+        // Parses the next piece of input, continuing where the previous one ended.
+        // Returns false once an error has been found.
+        bool feed(const char* data, size_t len);
+        bool feed(std::string_view chunk) { return feed(chunk.data(), chunk.size()); }
+        // Ends the input, which has to hold exactly one value
+        bool finish(void);
+        // Starts over with the next document, keeping the handler
+        void reset(void);
+
+        const std::optional<JsonParseError>& error(void) const { return m_error; }
+
+    private:
+        enum class State : uint8_t {
+            // Between tokens
+            Value, ValueOrArrayEnd, Key, KeyOrObjectEnd, Colon, CommaOrEnd, Done,
+            // Inside tokens
+            String, StringEscape, StringUnicode, Number, Literal,
+        };
+
+        size_t begin_value(const char* data, size_t pos);
+        size_t continue_token(const char* data, size_t len, size_t pos);
+        bool finish_number(const char* data, size_t pos);
+        void end_value(void) { m_state = m_stack.empty() ? State::Done : State::CommaOrEnd; }
+        void close_container(void);
+        bool fail(const char* message, const char* data, size_t pos);
+
+        JsonHandler* m_handler;
+        State m_state{ State::Value };
+        // '{' or '[' for every open container
+        std::vector<char> m_stack;
+        // Decoded part of the current string or number, if it spans chunks or has escapes
+        std::string m_token;
+        bool m_token_is_key{};
+        uint32_t m_unicode_cp{};
+        int m_unicode_digits{};
+        // Rest of the literal being matched, and its first character
+        const char* m_literal{};
+        char m_literal_kind{};
+        // Position of the current chunk in the whole input
+        size_t m_offset{};
+        size_t m_line{ 1 };
+        size_t m_line_start{};
+        std::optional<JsonParseError> m_error;
+    };
+
+    class JsonLazyDocument;
+    class JsonLazyObject;
+    class JsonLazyArray;
+
+    // Value of a JsonLazyDocument. Reading it moves the document past it, so it can
+    // be read once; reading a value the document has already moved past, or as the
+    // wrong type, throws runtime_error.
+    class JsonLazyValue {
+    public:
+        // Looks at the first character only
+        JsonValueKind kind(void) const;
+        bool is_null(void) const { return kind() == JsonValueKind::Null; }
+        bool is_bool(void) const { return kind() == JsonValueKind::Boolean; }
+        bool is_array(void) const { return kind() == JsonValueKind::Array; }
+        bool is_number(void) const { return kind() == JsonValueKind::Number; }
+        bool is_string(void) const { return kind() == JsonValueKind::String; }
+        bool is_object(void) const { return kind() == JsonValueKind::Object; }
+
+        bool get_bool(void);
+        double get_double(void);
+        std::string get_string(void);
+        template<typename T>
+        T get_value(void) {
+            if constexpr (std::is_same_v<T, bool>) {
+                return get_bool();
+            }
+            else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+                // Exact for integers
+                return read_number().get_value<T>();
+            }
+            else {
+                return get_string();
+            }
+        }
+        // Containers may be asked for again while the document is inside them
+        JsonLazyObject get_object(void);
+        JsonLazyArray get_array(void);
+        JsonLazyValue operator[](std::string_view key);
+        // Decodes the whole value
+        JsonValue to_value(void);
+
+    private:
+        friend struct JsonHelper;
+        friend class JsonLazyDocument;
+        JsonLazyValue(JsonLazyDocument* doc, size_t ipos) : m_doc(doc), m_ipos(ipos) {}
+        JsonNode read_number(void);
+
+        JsonLazyDocument* m_doc;
+        // Position of the value in the structural index
+        size_t m_ipos;
+    };
+
+    struct JsonLazyMember {
+        std::string key;
+        JsonLazyValue value;
+    };
+
+    class JsonLazyObject {
+    public:
+        class iterator {
+        public:
+            JsonLazyMember& operator*(void) { return *m_member; }
+            JsonLazyMember* operator->(void) { return &*m_member; }
+            iterator& operator++(void);
+            bool operator==(const iterator& rhs) const { return m_member.has_value() == rhs.m_member.has_value(); }
+            bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+
+        private:
+            friend struct JsonHelper;
+            friend class JsonLazyObject;
+            iterator(const JsonLazyObject* object) : m_object(object) {}
+
+            const JsonLazyObject* m_object;
+            // Empty at the end
+            std::optional<JsonLazyMember> m_member;
+        };
+
+        // Looks for the key from the document's position to the end of the object, and
+        // then from its start
+        std::optional<JsonLazyValue> find(std::string_view key);
+        // Throws if the key is missing
+        JsonLazyValue at(std::string_view key);
+        JsonLazyValue operator[](std::string_view key) { return at(key); }
+        // Iterates the members from the document's position on, and leaves the object
+        iterator begin(void);
+        iterator end(void) { return { this }; }
+
+    private:
+        friend struct JsonHelper;
+        JsonLazyObject(JsonLazyDocument* doc, size_t begin, size_t level) :
+            m_doc(doc), m_begin(begin), m_level(level) {}
+
+        JsonLazyDocument* m_doc;
+        // Position of the `{` in the structural index
+        size_t m_begin;
+        // Number of containers the document is inside while in this one
+        size_t m_level;
+    };
+
+    class JsonLazyArray {
+    public:
+        class iterator {
+        public:
+            JsonLazyValue operator*(void) const { return *m_element; }
+            iterator& operator++(void);
+            bool operator==(const iterator& rhs) const { return m_element.has_value() == rhs.m_element.has_value(); }
+            bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+
+        private:
+            friend struct JsonHelper;
+            friend class JsonLazyArray;
+            iterator(const JsonLazyArray* array) : m_array(array) {}
+
+            const JsonLazyArray* m_array;
+            // Empty at the end
+            std::optional<JsonLazyValue> m_element;
+        };
+
+        // Iterates the elements from the document's position on, and leaves the array
+        iterator begin(void);
+        iterator end(void) { return { this }; }
+
+    private:
+        friend struct JsonHelper;
+        JsonLazyArray(JsonLazyDocument* doc, size_t begin, size_t level) :
+            m_doc(doc), m_begin(begin), m_level(level) {}
+
+        JsonLazyDocument* m_doc;
+        size_t m_begin;
+        size_t m_level;
+    };
+
+    // Document read on demand and in order: parsing only locates its structure, and
+    // values are decoded when they are read. Values passed over on the way are skipped
+    // over the structural index without being decoded, but are still checked, so
+    // reading a few fields of a large document costs little more than locating them.
+    // Input after the last value read or skipped is not checked until finish().
+    class JsonLazyDocument {
+    public:
+        JsonLazyDocument() = default;
+        JsonLazyDocument(const JsonLazyDocument&) = delete;
+        JsonLazyDocument(JsonLazyDocument&&) noexcept = default;
+        JsonLazyDocument& operator=(const JsonLazyDocument&) = delete;
+        JsonLazyDocument& operator=(JsonLazyDocument&&) noexcept = default;
+
+        // Fails on empty input and unterminated strings only; everything else is found
+        // while reading
+        bool try_parse(std::vector<char> data);
+        bool try_parse(const char* data, size_t len) {
+            return try_parse(std::vector<char>(data, data + len));
+        }
+        JsonLazyValue root(void) { return { this, 0 }; }
+        JsonLazyValue operator[](std::string_view key) { return root()[key]; }
+        // Skips what is left of the document, checking it like try_deserialize_from_utf8
+        // would; throws on errors
+        void finish(void);
+        // Starts reading from the beginning again
+        void rewind(void) {
+            m_ipos = 0;
+            m_open.clear();
         }
 
+    private:
         friend struct JsonHelper;
+
+        std::vector<char> m_input;
+        std::vector<uint32_t> m_index;
+        // Position in m_index of the next token to read
+        size_t m_ipos{};
+        // Positions in m_index of the containers the document is inside, outermost first
+        std::vector<size_t> m_open;
+        // Scratch stack for skipping values
+        std::string m_skip_stack;
+    };
+
+    // Compiled JSONPath query, for pulling values out of documents without building
+    // them. Supports:
+    //     $.name  $['name']       member
+    //     $.*  $[*]               all members or elements
+    //     $[2]  $[1:5]  $[::2]    element or slice (counted from the start only)
+    //     $..name  $..*  $..[0]   the same at any depth
+    //     $[?(@.a.b >= 1)]        members or elements where the value at a relative path
+    //                             exists or compares (== != < <= > >=) to a literal
+    class JsonPath {
+    public:
+        // Throws runtime_error on invalid or unsupported expressions
+        explicit JsonPath(std::string_view expression);
+
+        // Reports every matching value once, when it ends; a container thus comes after
+        // the matches inside it. Returns false on invalid JSON, after reporting the
+        // matches before the error.
+        bool try_match(const char* data, size_t len, const std::function<void(JsonValue)>& on_match) const;
+
     private:
-        JsonValueKind m_kind;
-        std::variant<std::monostate, bool, JsonArray, double, std::string, JsonObject> m_var;
+        friend class JsonPathMatcher;
+
+        enum class StepKind : uint8_t { Name, Wildcard, Slice, Filter };
+        enum class FilterOp : uint8_t { Exists, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+        struct Filter {
+            std::vector<std::string> path;
+            FilterOp op;
+            JsonValue literal;
+        };
+        struct Step {
+            StepKind kind;
+            // Also applies below the children
+            bool descendant;
+            std::string name;
+            size_t start, end, stride;
+            size_t filter;
+        };
+
+        std::vector<Step> m_steps;
+        std::vector<Filter> m_filters;
+    };
+
+    // Runs a JsonPath as a JsonPushParser handler. The path is followed with a set of
+    // states per open container, and containers no state applies to are skipped over,
+    // so only matches are built into values. The path has to outlive the matcher.
+    class JsonPathMatcher : public JsonHandler {
+    public:
+        JsonPathMatcher(const JsonPath& path, std::function<void(JsonValue)> on_match) :
+            m_path(&path), m_on_match(std::move(on_match)) {}
+
+        // Forgets an unfinished document
+        void reset(void);
+
+        void on_null(void) override { if (tracking()) { on_scalar({ JsonValueKind::Null }); } }
+        void on_bool(bool v) override { if (tracking()) { on_scalar({ JsonValueKind::Boolean, v }); } }
+        void on_number(double v) override { if (tracking()) { on_scalar({ JsonValueKind::Number, false, v }); } }
+        void on_integer(int64_t v) override { if (tracking()) { on_scalar({ JsonValueKind::Number, false, v }); } }
+        void on_unsigned(uint64_t v) override { if (tracking()) { on_scalar({ JsonValueKind::Number, false, v }); } }
+        void on_string(std::string_view v) override { if (tracking()) { on_scalar({ JsonValueKind::String, false, {}, v }); } }
+        void on_key(std::string_view key) override;
+        void on_object_start(void) override { on_container_start(false); }
+        void on_object_end(void) override { on_container_end(); }
+        void on_array_start(void) override { on_container_start(true); }
+        void on_array_end(void) override { on_container_end(); }
+
+    private:
+        static constexpr uint32_t no_guard = UINT32_MAX;
+        // Only matches are turned into a JsonValue
+        struct Scalar {
+            JsonValueKind kind;
+            bool boolean{};
+            JsonValue number{};
+            std::string_view string{};
+
+            JsonValue to_value(void) const;
+        };
+        // A step of the path reached under `guard`, or a step of the relative path of
+        // the filter of `guard`
+        struct State {
+            uint32_t step;
+            uint32_t guard;
+            bool in_filter;
+        };
+        struct Level {
+            bool is_array;
+            size_t next_index;
+            std::string key;
+            // Start of the states for the children in m_states
+            size_t states_begin;
+        };
+        struct Match {
+            JsonValue value;
+            bool reported;
+        };
+        // Matches below a filter wait for the end of the value it tested
+        struct Guard {
+            const JsonPath::Filter* filter;
+            uint32_t parent;
+            size_t depth;
+            bool result;
+            std::vector<std::shared_ptr<Match>> matches;
+        };
+        // Value of a match being built
+        struct Capture {
+            size_t depth;
+            std::vector<JsonValue> open;
+            std::vector<std::string> keys;
+            bool unconditional;
+            std::vector<uint32_t> guards;
+        };
+
+        // Scalars in skipped containers matter only to captures
+        bool tracking(void) const { return m_skip_depth == 0 || !m_captures.empty(); }
+        void on_scalar(const Scalar& scalar);
+        void on_container_start(bool is_array);
+        void on_container_end(void);
+        // Applies the states of the parent to the value starting, which is a container
+        // unless `scalar` is given. Returns the number of states for its children.
+        size_t begin_value(const Scalar* scalar);
+        void end_value(void);
+        void push_state(size_t begin, State state);
+        void add_to_captures(const Scalar& scalar);
+        void finish_capture(JsonValue value, Capture& capture);
+        void report(const std::shared_ptr<Match>& match, uint32_t guard);
+        static bool test_filter(const JsonPath::Filter& filter, const Scalar* value);
+
+        const JsonPath* m_path;
+        std::function<void(JsonValue)> m_on_match;
+        // Open containers, and those of them below the last one with states
+        size_t m_depth{};
+        size_t m_skip_depth{};
+        // Only grows, so that keys keep their buffers
+        std::vector<Level> m_levels;
+        size_t m_level_count{};
+        std::vector<State> m_states;
+        std::vector<Guard> m_guards;
+        std::vector<Capture> m_captures;
+        // Scratch list of the guards a value matched under
+        std::vector<uint32_t> m_match_guards;
     };
 }
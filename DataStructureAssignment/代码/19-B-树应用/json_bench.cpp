@@ -0,0 +1,1102 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.h"
+
+// Differential check and throughput benchmark of the JSON parsers:
+//
+//     json_bench [--fuzz N] [file.json]...
+//
+// First parses N (default: 20000) randomly generated and corrupted documents with
+// every parser, which all have to accept the same documents and produce the same
+// values as try_deserialize_from_utf8, checks error positions of the push parser,
+// compares N random JSONPath queries with a direct evaluation and round-trips B-tree
+// keys, and checks that chunked parsing on several threads agrees with parsing on one.
+// Then reports the throughput and number of allocations of each parser, of a few queries
+// and of serialization on the given files, or on a generated B-tree and station
+// document and the scaling of chunked parsing if there are none.
+
+namespace {
+    std::atomic<size_t> allocation_count{};
+    // Only sized deletes are subtracted, which containers and strings use
+    std::atomic<size_t> allocated_bytes{};
+}
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t size) noexcept {
+    allocated_bytes.fetch_sub(size, std::memory_order_relaxed);
+    std::free(p);
+}
+// Arenas allocate with alignment; the block from malloc is stored before the result
+void* operator new(size_t size, std::align_val_t align) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    if (void* block = std::malloc(size + alignment + sizeof(void*))) {
+        auto p = (reinterpret_cast<uintptr_t>(block) + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+        reinterpret_cast<void**>(p)[-1] = block;
+        return reinterpret_cast<void*>(p);
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    if (p) {
+        std::free(static_cast<void**>(p)[-1]);
+    }
+}
+void operator delete(void* p, size_t size, std::align_val_t align) noexcept {
+    allocated_bytes.fetch_sub(size, std::memory_order_relaxed);
+    operator delete(p, align);
+}
+
+namespace {
+    using Rng = std::mt19937_64;
+
+    size_t random_below(Rng& rng, size_t n) {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    // Random JSON text that exercises the corners of the grammar: odd whitespace,
+    // escape runs across 64-byte blocks, every number syntax and deep nesting
+    struct Generator {
+        Rng& rng;
+
+        void whitespace(std::string& out) {
+            static constexpr char ws[] = { ' ', ' ', ' ', '\n', '\t', '\r', '\v', '\f' };
+            while (random_below(rng, 3) == 0) {
+                out += ws[random_below(rng, sizeof ws)];
+            }
+        }
+        void string(std::string& out) {
+            static const char* const pieces[] = {
+                "a", "key", "0", " ", "\\\"", "\\\\", "\\/", "\\n", "\\t", "\\b", "\\f", "\\r",
+                "\\u00e9", "\\u4e2D", "\xe8\x8f\x9c", "{", "}", "[", "]", ":", ",",
+                "\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\"", "0123456789abcdefghijklmnopqrstuvwxyz",
+            };
+            out += '"';
+            size_t n = random_below(rng, 4) == 0 ? random_below(rng, 40) : random_below(rng, 6);
+            for (size_t i = 0; i < n; i++) {
+                out += pieces[random_below(rng, std::size(pieces))];
+            }
+            out += '"';
+        }
+        void number(std::string& out) {
+            if (random_below(rng, 2)) {
+                out += '-';
+            }
+            out += std::to_string(random_below(rng, 4) == 0 ? rng() >> random_below(rng, 64) : random_below(rng, 100));
+            if (random_below(rng, 3) == 0) {
+                out += '.';
+                out += std::to_string(random_below(rng, 1000000));
+            }
+            if (random_below(rng, 4) == 0) {
+                out += "eE"[random_below(rng, 2)];
+                out += std::string_view("+-")
+                    .substr(0, random_below(rng, 3) == 0 ? 1 : 0);
+                out += std::to_string(random_below(rng, 40));
+            }
+        }
+        void value(std::string& out, int depth) {
+            whitespace(out);
+            switch (random_below(rng, depth > 12 ? 6 : 8)) {
+            case 0: out += "null"; break;
+            case 1: out += random_below(rng, 2) ? "true" : "false"; break;
+            case 2: case 3: number(out); break;
+            case 4: case 5: string(out); break;
+            case 6:
+                out += '[';
+                whitespace(out);
+                for (size_t i = 0, n = random_below(rng, 6); i < n; i++) {
+                    if (i) { out += ','; }
+                    value(out, depth + 1);
+                }
+                out += ']';
+                break;
+            case 7:
+                out += '{';
+                whitespace(out);
+                for (size_t i = 0, n = random_below(rng, 6); i < n; i++) {
+                    if (i) { out += ','; }
+                    whitespace(out);
+                    string(out);
+                    whitespace(out);
+                    out += ':';
+                    value(out, depth + 1);
+                }
+                out += '}';
+                break;
+            }
+            whitespace(out);
+        }
+        void corrupt(std::string& doc) {
+            static constexpr char interesting[] = "\"\\{}[]:, \t\v0123456789.eE+-tfnul\x80";
+            size_t pos = doc.empty() ? 0 : random_below(rng, doc.size());
+            switch (random_below(rng, 4)) {
+            case 0:
+                if (pos < doc.size()) {
+                    doc[pos] = interesting[random_below(rng, sizeof interesting - 1)];
+                }
+                break;
+            case 1:
+                doc.insert(doc.begin() + pos, interesting[random_below(rng, sizeof interesting - 1)]);
+                break;
+            case 2:
+                if (pos < doc.size()) {
+                    doc.erase(pos, 1);
+                }
+                break;
+            case 3:
+                doc.resize(pos);
+                break;
+            }
+        }
+    };
+
+    // Rebuilds the value from the events of a JsonPushParser
+    struct ValueBuilder : json::JsonHandler {
+        void on_null(void) override { add(nullptr); }
+        void on_bool(bool v) override { add(v); }
+        void on_number(double v) override { add(v); }
+        void on_integer(int64_t v) override { add(v); }
+        void on_unsigned(uint64_t v) override { add(v); }
+        void on_string(std::string_view v) override { add(v); }
+        void on_key(std::string_view key) override { keys.emplace_back(key); }
+        void on_object_start(void) override { open.emplace_back(json::JsonObject{}); }
+        void on_object_end(void) override { close(); }
+        void on_array_start(void) override { open.emplace_back(json::JsonArray{}); }
+        void on_array_end(void) override { close(); }
+
+        void add(json::JsonValue value) {
+            if (open.empty()) {
+                result = std::move(value);
+            }
+            else if (open.back().is_array()) {
+                open.back().get<json::JsonArray>().push_back(std::move(value));
+            }
+            else {
+                open.back()[keys.back()] = std::move(value);
+                keys.pop_back();
+            }
+        }
+        void close(void) {
+            json::JsonValue value = std::move(open.back());
+            open.pop_back();
+            add(std::move(value));
+        }
+
+        json::JsonValue result;
+        std::vector<json::JsonValue> open;
+        std::vector<std::string> keys;
+    };
+    struct CountingHandler : json::JsonHandler {
+        void on_null(void) override { events++; }
+        void on_bool(bool) override { events++; }
+        void on_number(double) override { events++; }
+        void on_string(std::string_view) override { events++; }
+        void on_key(std::string_view) override { events++; }
+        void on_object_start(void) override { events++; }
+        void on_object_end(void) override { events++; }
+        void on_array_start(void) override { events++; }
+        void on_array_end(void) override { events++; }
+
+        size_t events{};
+    };
+
+    // Feeds `s` in pieces of `chunk_size`, or of varying small sizes if that is 0
+    bool push_parse(json::JsonPushParser& parser, std::string_view s, size_t chunk_size) {
+        static constexpr size_t small_sizes[] = { 1, 2, 3, 7, 16, 61 };
+        for (size_t pos = 0, i = 0; pos < s.size(); i++) {
+            size_t n = std::min(chunk_size ? chunk_size : small_sizes[i % std::size(small_sizes)], s.size() - pos);
+            if (!parser.feed(s.substr(pos, n))) {
+                return false;
+            }
+            pos += n;
+        }
+        return parser.finish();
+    }
+
+    // Rebuilds the value through the on-demand API
+    json::JsonValue lazy_walk(json::JsonLazyValue value) {
+        switch (value.kind()) {
+        case json::JsonValueKind::Object: {
+            json::JsonObject jo;
+            for (auto& member : value.get_object()) {
+                jo[member.key] = lazy_walk(member.value);
+            }
+            return jo;
+        }
+        case json::JsonValueKind::Array: {
+            json::JsonArray ja;
+            for (auto element : value.get_array()) {
+                ja.push_back(lazy_walk(element));
+            }
+            return ja;
+        }
+        case json::JsonValueKind::Boolean:  return value.get_bool();
+        case json::JsonValueKind::Number:   return value.to_value();
+        case json::JsonValueKind::String:   return value.get_string();
+        default:                            return value.to_value();
+        }
+    }
+
+    struct Parser {
+        const char* name;
+        // Stores the result into `out` if given
+        std::function<bool(const std::string&, json::JsonValue* out)> parse;
+    };
+
+    const std::vector<Parser>& parsers(void) {
+        static const std::vector<Parser> list{
+            { "scalar", [](const std::string& s, json::JsonValue* out) {
+                json::JsonValue jv;
+                bool ok = jv.try_deserialize_from_utf8(s.data(), s.size());
+                if (out) { *out = std::move(jv); }
+                return ok;
+            } },
+            { "indexed", [](const std::string& s, json::JsonValue* out) {
+                json::JsonValue jv;
+                bool ok = jv.try_deserialize_from_utf8_indexed(s.data(), s.size());
+                if (out) { *out = std::move(jv); }
+                return ok;
+            } },
+            { "document", [](const std::string& s, json::JsonValue* out) {
+                json::JsonDocument doc;
+                bool ok = doc.try_parse(s.data(), s.size());
+                if (ok && out) { *out = doc.root().to_value(); }
+                return ok;
+            } },
+            // Without `out`, skips the whole document
+            { "lazy", [](const std::string& s, json::JsonValue* out) {
+                json::JsonLazyDocument doc;
+                try {
+                    if (!doc.try_parse(s.data(), s.size())) {
+                        return false;
+                    }
+                    json::JsonValue jv = out ? lazy_walk(doc.root()) : json::JsonValue{};
+                    doc.finish();
+                    if (out) { *out = std::move(jv); }
+                    return true;
+                }
+                catch (const std::runtime_error&) {
+                    return false;
+                }
+            } },
+            { "push", [](const std::string& s, json::JsonValue* out) {
+                if (!out) {
+                    CountingHandler handler;
+                    json::JsonPushParser parser(handler);
+                    return push_parse(parser, s, 1 << 16);
+                }
+                ValueBuilder builder;
+                json::JsonPushParser parser(builder);
+                bool ok = push_parse(parser, s, 0);
+                if (ok) { *out = std::move(builder.result); }
+                return ok;
+            } },
+        };
+        return list;
+    }
+
+    // Looks up the members of an object in hash order rather than input order, which
+    // has the on-demand API search past the end of the object and start over, and
+    // reads every other value
+    bool check_lazy_find(const std::string& s, const json::JsonObject& expected) {
+        json::JsonLazyDocument doc;
+        doc.try_parse(s.data(), s.size());
+        size_t members = 0;
+        for ([[maybe_unused]] auto& member : doc.root().get_object()) {
+            members++;
+        }
+        // Which of several equal keys is found depends on the position
+        bool unique_keys = members == expected.size();
+        doc.rewind();
+        bool read = false;
+        for (const auto& [key, value] : expected) {
+            auto found = doc.root().get_object().find(key);
+            if (!found) {
+                return false;
+            }
+            if ((read = !read) && found->to_value() != value && unique_keys) {
+                return false;
+            }
+        }
+        return !doc.root().get_object().find("\x01missing") && (doc.finish(), true);
+    }
+
+    // Returns the number of mismatches
+    size_t fuzz(size_t iterations) {
+        Rng rng(42);
+        Generator gen{ rng };
+        size_t accepted = 0, mismatches = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            std::string doc;
+            gen.value(doc, 0);
+            for (size_t n = random_below(rng, 3); n > 0; n--) {
+                gen.corrupt(doc);
+            }
+            json::JsonValue expected;
+            bool expected_ok = expected.try_deserialize_from_utf8(doc.data(), doc.size());
+            accepted += expected_ok;
+            for (const auto& parser : parsers()) {
+                json::JsonValue jv;
+                bool ok = parser.parse(doc, &jv);
+                if (ok != expected_ok || (ok && jv != expected) || parser.parse(doc, nullptr) != expected_ok) {
+                    if (mismatches++ < 5) {
+                        printf("MISMATCH (%s, %s): %s\n", parser.name, ok ? "accepted" : "rejected", doc.c_str());
+                    }
+                }
+            }
+            if (expected_ok && expected.is_object() && !check_lazy_find(doc, expected.get<json::JsonObject>())) {
+                if (mismatches++ < 5) {
+                    printf("MISMATCH (lazy find): %s\n", doc.c_str());
+                }
+            }
+        }
+        printf("fuzz: %zu documents, %zu valid, %zu mismatches\n", iterations, accepted, mismatches);
+        return mismatches;
+    }
+
+    // Random JSONPath of the supported subset, kept as steps for evaluating it directly
+    struct PathStep {
+        enum { Name, Wildcard, Slice, Filter } kind;
+        bool descendant;
+        std::string name;
+        size_t start, end, stride;
+        std::vector<std::string> filter_path;
+        std::string op;
+        json::JsonValue literal;
+    };
+    struct RandomPath {
+        std::string text;
+        std::vector<PathStep> steps;
+    };
+    RandomPath random_path(Rng& rng) {
+        static const char* const names[] = { "a", "key", "0", "", "akey" };
+        RandomPath path{ "$", {} };
+        for (size_t i = 0, n = random_below(rng, 4); i < n; i++) {
+            PathStep step{};
+            step.descendant = random_below(rng, 3) == 0;
+            std::string prefix = step.descendant ? ".." : "";
+            switch (random_below(rng, 4)) {
+            case 0:
+                step.kind = PathStep::Name;
+                step.name = names[random_below(rng, std::size(names))];
+                path.text += !step.name.empty() && random_below(rng, 2) ?
+                    (step.descendant ? ".." : ".") + step.name : prefix + "['" + step.name + "']";
+                break;
+            case 1:
+                step.kind = PathStep::Wildcard;
+                path.text += random_below(rng, 2) ? (step.descendant ? "..*" : ".*") : prefix + "[*]";
+                break;
+            case 2:
+                step.kind = PathStep::Slice;
+                step.start = random_below(rng, 3);
+                step.stride = 1;
+                if (random_below(rng, 2)) {
+                    step.end = step.start + 1;
+                    path.text += prefix + std::format("[{}]", step.start);
+                }
+                else {
+                    step.end = random_below(rng, 3) ? step.start + random_below(rng, 4) : SIZE_MAX;
+                    step.stride = 1 + random_below(rng, 2);
+                    path.text += prefix + std::format("[{}:{}:{}]", step.start,
+                        step.end == SIZE_MAX ? "" : std::to_string(step.end), step.stride);
+                }
+                break;
+            case 3: {
+                static const char* const ops[] = { "", "==", "!=", "<", "<=", ">", ">=" };
+                static const char* const literals[] = { "0", "1", "50", "'a'", "\"key\"", "true", "null" };
+                step.kind = PathStep::Filter;
+                std::string at = "@";
+                if (random_below(rng, 3)) {
+                    step.filter_path.push_back(names[random_below(rng, std::size(names))]);
+                    at += step.filter_path.back().empty() ? "['']" : "." + step.filter_path.back();
+                }
+                step.op = ops[random_below(rng, std::size(ops))];
+                std::string literal = literals[random_below(rng, std::size(literals))];
+                if (!step.op.empty()) {
+                    std::string json_literal = literal;
+                    std::replace(json_literal.begin(), json_literal.end(), '\'', '"');
+                    step.literal.try_deserialize_from_utf8(json_literal.data(), json_literal.size());
+                    at += " " + step.op + " " + literal;
+                }
+                path.text += prefix + "[?(" + at + ")]";
+                break;
+            }
+            }
+            path.steps.push_back(std::move(step));
+        }
+        return path;
+    }
+    bool test_filter(const PathStep& step, const json::JsonValue& value) {
+        const json::JsonValue* target = &value;
+        for (const auto& name : step.filter_path) {
+            if (!target->is_object() || !target->get<json::JsonObject>().contains(name)) {
+                return false;
+            }
+            target = &target->at(name);
+        }
+        if (step.op.empty()) {
+            return true;
+        }
+        int order;
+        if (target->is_number() && step.literal.is_number()) {
+            order = target->get<double>() < step.literal.get<double>() ? -1 :
+                target->get<double>() > step.literal.get<double>() ? 1 : 0;
+        }
+        else if (target->is_string() && step.literal.is_string()) {
+            order = target->get<std::string>().compare(step.literal.get<std::string>());
+        }
+        else {
+            return step.op == "==" ? *target == step.literal : step.op == "!=" && *target != step.literal;
+        }
+        return step.op == "==" ? order == 0 : step.op == "!=" ? order != 0 : step.op == "<" ? order < 0 :
+            step.op == "<=" ? order <= 0 : step.op == ">" ? order > 0 : order >= 0;
+    }
+    // Evaluates the path over a whole tree, one step at a time
+    std::vector<const json::JsonValue*> evaluate_path(const RandomPath& path, const json::JsonValue& root) {
+        std::vector<const json::JsonValue*> nodes{ &root };
+        for (const auto& step : path.steps) {
+            std::vector<const json::JsonValue*> next;
+            std::function<void(const json::JsonValue&)> visit = [&](const json::JsonValue& node) {
+                auto select = [&](const json::JsonValue& child, const std::string* key, size_t index) {
+                    bool selected = step.kind == PathStep::Wildcard ||
+                        (step.kind == PathStep::Name && key && *key == step.name) ||
+                        (step.kind == PathStep::Slice && !key && index >= step.start && index < step.end &&
+                            (index - step.start) % step.stride == 0) ||
+                        (step.kind == PathStep::Filter && test_filter(step, child));
+                    if (selected) {
+                        next.push_back(&child);
+                    }
+                    if (step.descendant) {
+                        visit(child);
+                    }
+                };
+                if (node.is_array()) {
+                    size_t index = 0;
+                    for (const auto& child : node.get<json::JsonArray>()) {
+                        select(child, nullptr, index++);
+                    }
+                }
+                else if (node.is_object()) {
+                    for (const auto& [key, child] : node.get<json::JsonObject>()) {
+                        select(child, &key, 0);
+                    }
+                }
+            };
+            for (auto node : nodes) {
+                visit(*node);
+            }
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+            nodes = std::move(next);
+        }
+        return nodes;
+    }
+    // Compares JsonPath with evaluate_path on random paths over valid documents.
+    // Returns the number of mismatches.
+    size_t check_paths(size_t iterations) {
+        Rng rng(5);
+        Generator gen{ rng };
+        size_t matches = 0, mismatches = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            // Serialized again, as the tree keeps only the last of equal keys
+            json::JsonValue root;
+            while (!root.is_array() && !root.is_object()) {
+                std::string text;
+                gen.value(text, 0);
+                root.try_deserialize_from_utf8(text.data(), text.size());
+            }
+            auto data = root.serialize_into_utf8();
+            RandomPath path = random_path(rng);
+            std::vector<std::string> expected, actual;
+            for (auto node : evaluate_path(path, root)) {
+                auto s = node->serialize_into_utf8();
+                expected.emplace_back(s.begin(), s.end());
+            }
+            bool ok = json::JsonPath(path.text).try_match(data.data(), data.size(), [&](json::JsonValue v) {
+                auto s = v.serialize_into_utf8();
+                actual.emplace_back(s.begin(), s.end());
+            });
+            std::sort(expected.begin(), expected.end());
+            std::sort(actual.begin(), actual.end());
+            matches += actual.size();
+            if (!ok || actual != expected) {
+                if (mismatches++ < 5) {
+                    printf("MISMATCH (path %s, %zu vs %zu matches): %s\n", path.text.c_str(), actual.size(),
+                        expected.size(), std::string(data.begin(), data.end()).c_str());
+                }
+            }
+        }
+        printf("paths: %zu queries, %zu matches, %zu mismatches\n", iterations, matches, mismatches);
+        return mismatches;
+    }
+
+    // Errors have to be reported at the same position however the input is split.
+    // Returns the number of mismatches.
+    size_t check_error_positions(void) {
+        struct Case {
+            const char* text;
+            size_t offset, line, column;
+        };
+        static constexpr Case cases[] = {
+            { "", 0, 1, 1 },
+            { "{\"a\": tru e}", 9, 1, 10 },
+            { "[1,\n 2,\n 3 4]", 11, 3, 4 },
+            { "{\n  \"key\":\n  \"\\x\"\n}", 15, 3, 5 },
+            { "[\"\\u12g4\"]", 6, 1, 7 },
+            { "[1.e5]", 5, 1, 6 },
+            { "[0, -]", 5, 1, 6 },
+            { "{\"a\" 1}", 5, 1, 6 },
+            { "{\"a\":1,}", 7, 1, 8 },
+            { "[1]\n\n  x", 7, 3, 3 },
+            { "[[[\n", 4, 2, 1 },
+            { "nul", 3, 1, 4 },
+        };
+        size_t mismatches = 0;
+        for (const auto& c : cases) {
+            for (size_t chunk_size : { size_t{ 1 } << 20, size_t{ 1 }, size_t{ 0 } }) {
+                json::JsonHandler handler;
+                json::JsonPushParser parser(handler);
+                auto error = push_parse(parser, c.text, chunk_size) ? std::nullopt : parser.error();
+                if (!error || error->offset != c.offset || error->line != c.line || error->column != c.column) {
+                    if (mismatches++ < 5) {
+                        printf("MISMATCH (error position): %s\n", c.text);
+                    }
+                }
+            }
+        }
+        printf("errors: %zu positions, %zu mismatches\n", std::size(cases), mismatches);
+        return mismatches;
+    }
+
+    // BTree<uint64_t> in 19-B-树应用 saves its keys as JSON numbers. Checks that the
+    // decimal text of any uint64_t reads back as exactly that key in every parser, and
+    // that serializing the keys gives the same text again. Returns the number of
+    // mismatches.
+    size_t check_key_round_trip(size_t count) {
+        Rng rng(3);
+        std::vector<uint64_t> keys = {
+            0, 1, 9, 10, 99, 4294967295, 9007199254740991, 9007199254740992, 9007199254740993,
+            9007199254740995, 9223372036854775807, 9223372036854775808ull, 9223372036854775809ull,
+            12345678901234567890ull, 18446744073709549568ull, 18446744073709550591ull,
+            18446744073709551614ull, 18446744073709551615ull,
+        };
+        for (size_t i = 0; i < count; i++) {
+            keys.push_back(rng() >> random_below(rng, 64));
+        }
+        json::JsonArray ja_keys;
+        std::string text = "[";
+        size_t mismatches = 0;
+        for (uint64_t key : keys) {
+            auto str = std::to_string(key);
+            text += str + ',';
+            ja_keys.push_back(key);
+            for (const auto& parser : parsers()) {
+                json::JsonValue jv;
+                if (!parser.parse(str, &jv) || jv != json::JsonValue{ key } || jv.get_value<uint64_t>() != key) {
+                    if (mismatches++ < 5) {
+                        printf("MISMATCH (%s): %s\n", parser.name, str.c_str());
+                    }
+                }
+            }
+        }
+        text.back() = ']';
+        auto data = json::JsonValue{ std::move(ja_keys) }.serialize_into_utf8();
+        if (std::string_view(data.data(), data.size()) != text) {
+            mismatches++;
+            printf("MISMATCH (serialize): keys are not printed exactly\n");
+        }
+        for (const auto& parser : parsers()) {
+            json::JsonValue jv;
+            bool ok = parser.parse(text, &jv);
+            data = ok ? jv.serialize_into_utf8() : std::vector<char>{};
+            if (!ok || std::string_view(data.data(), data.size()) != text) {
+                mismatches++;
+                printf("MISMATCH (%s): keys do not round-trip\n", parser.name);
+            }
+        }
+        printf("keys: %zu round-tripped, %zu mismatches\n", keys.size(), mismatches);
+        return mismatches;
+    }
+
+    // Integers without a fraction or exponent that fit an int64_t have to stay exact in
+    // every parser and serialization, and in JSONPath filters, where doubles would
+    // round those beyond 2^53. Returns the number of mismatches.
+    size_t check_integers(void) {
+        static constexpr int64_t values[] = {
+            0, 1, -1, 9007199254740991, 9007199254740992, 9007199254740993, -9007199254740993,
+            123456789012345678, INT64_MAX - 1, INT64_MAX, INT64_MIN + 1, INT64_MIN,
+        };
+        std::string text = "[";
+        json::JsonArray ja;
+        for (int64_t v : values) {
+            text += std::format("{},", v);
+            ja.push_back(v);
+        }
+        text.back() = ']';
+        json::JsonValue expected{ std::move(ja) };
+        size_t mismatches = 0;
+        auto mismatch = [&](const char* name, const char* what) {
+            mismatches++;
+            printf("MISMATCH (%s): %s\n", name, what);
+        };
+        for (const auto& parser : parsers()) {
+            json::JsonValue jv;
+            if (!parser.parse(text, &jv) || jv != expected) {
+                mismatch(parser.name, "integers are not exact");
+                continue;
+            }
+            auto data = jv.serialize_into_utf8();
+            if (std::string_view(data.data(), data.size()) != text) {
+                mismatch(parser.name, "integers do not round-trip");
+            }
+        }
+        json::JsonDocument doc;
+        json::JsonLazyDocument lazy;
+        if (!doc.try_parse(text.data(), text.size()) || !lazy.try_parse(text.data(), text.size())) {
+            mismatch("document", "rejected");
+            return mismatches;
+        }
+        size_t i = 0;
+        for (auto element : lazy.root().get_array()) {
+            if (doc.root()[i].get_value<int64_t>() != values[i] || element.get_value<int64_t>() != values[i]) {
+                mismatch("document", "get_value is not exact");
+            }
+            i++;
+        }
+        // Numbers with a fraction or exponent, and integers out of range, stay doubles
+        for (std::string_view s : { "9007199254740993.0", "9007199254740993e0", "18446744073709551616", "-9223372036854775809", "-0" }) {
+            json::JsonValue jv;
+            jv.try_deserialize_from_utf8(s.data(), s.size());
+            double d;
+            std::from_chars(s.data(), s.data() + s.size(), d);
+            if (!jv.is_number() || jv != json::JsonValue{ d } || std::signbit(jv.get<double>()) != std::signbit(d)) {
+                mismatch("scalar", "doubles are not rounded");
+            }
+        }
+        for (auto [query, count] : { std::pair{ "$[?(@ == 9007199254740993)]", 1 },
+            std::pair{ "$[?(@ > 9007199254740992)]", 4 }, std::pair{ "$[?(@ <= -9007199254740993)]", 3 },
+            std::pair{ "$[?(@ < 18446744073709551615)]", 12 } })
+        {
+            size_t matches = 0;
+            json::JsonPath(query).try_match(text.data(), text.size(), [&](json::JsonValue) { matches++; });
+            if (matches != static_cast<size_t>(count)) {
+                mismatch(query, "wrong number of matches");
+            }
+        }
+        printf("integers: %zu values, %zu mismatches\n", std::size(values), mismatches);
+        return mismatches;
+    }
+
+    // Parses large arrays and NDJSON made of random values on several threads, whole and
+    // corrupted, which has to agree with parsing them on one. Returns the number of
+    // mismatches.
+    size_t check_parallel(void) {
+        Rng rng(5);
+        Generator gen{ rng };
+        size_t documents = 0, mismatches = 0;
+        auto check = [&](const char* name, const std::string& text, bool expected_ok,
+            const json::JsonValue& expected, auto parse)
+        {
+            for (unsigned threads : { 1, 2, 3, 8 }) {
+                json::JsonValue jv;
+                bool ok = parse(text, threads, jv);
+                if (ok != expected_ok || (ok && jv != expected)) {
+                    mismatches++;
+                    printf("MISMATCH (%s, %u threads): %s\n", name, threads, ok ? "different value" :
+                        expected_ok ? "rejected" : "accepted");
+                }
+            }
+            documents++;
+        };
+        for (int round = 0; round < 16; round++) {
+            // Rows of one shape, as in a database export, make most guessed chunk starts
+            // right; random values at the root make many of them wrong
+            std::string array = "[", lines;
+            json::JsonArray values;
+            for (size_t i = 0; array.size() < (2 << 20); i++) {
+                std::string value;
+                if (round % 2 == 0) {
+                    value = std::format("{{\"id\":{},\"value\":", i);
+                    gen.value(value, 0);
+                    value += '}';
+                }
+                else {
+                    gen.value(value, 0);
+                }
+                json::JsonValue jv;
+                if (!jv.try_deserialize_from_utf8(value.data(), value.size())) {
+                    continue;
+                }
+                array += i ? "," : "";
+                array += value;
+                auto line = jv.serialize_into_utf8();
+                lines.append(line.begin(), line.end());
+                lines += random_below(rng, 8) ? "\n" : random_below(rng, 2) ? "\r\n" : "\n \n";
+                values.push_back(std::move(jv));
+            }
+            array += ']';
+            if (round % 4 == 3) {
+                gen.corrupt(array);
+                gen.corrupt(lines);
+            }
+            json::JsonValue expected;
+            bool expected_ok = expected.try_deserialize_from_utf8(array.data(), array.size());
+            check("parallel", array, expected_ok, expected, [](const std::string& s, unsigned threads, json::JsonValue& jv) {
+                return jv.try_deserialize_from_utf8_parallel(s.data(), s.size(), threads);
+            });
+            check("document, parallel", array, expected_ok, expected, [](const std::string& s, unsigned threads, json::JsonValue& jv) {
+                json::JsonDocument doc;
+                bool ok = doc.try_parse_parallel({ s.begin(), s.end() }, threads);
+                if (ok) { jv = doc.root().to_value(); }
+                return ok;
+            });
+            // A corrupted line is rejected on its own or merges with a neighbour; either
+            // way, the sequential result is that of one thread
+            expected_ok = true;
+            if (round % 4 == 3) {
+                expected_ok = expected.try_deserialize_ndjson(lines.data(), lines.size(), 1);
+            }
+            else {
+                expected = std::move(values);
+            }
+            check("ndjson", lines, expected_ok, expected, [](const std::string& s, unsigned threads, json::JsonValue& jv) {
+                return jv.try_deserialize_ndjson(s.data(), s.size(), threads);
+            });
+            check("document, ndjson", lines, expected_ok, expected, [](const std::string& s, unsigned threads, json::JsonValue& jv) {
+                json::JsonDocument doc;
+                bool ok = doc.try_parse_ndjson({ s.begin(), s.end() }, threads);
+                if (ok) { jv = doc.root().to_value(); }
+                return ok;
+            });
+        }
+        printf("parallel: %zu documents, %zu mismatches\n", documents, mismatches);
+        return mismatches;
+    }
+
+    std::string btree_document(size_t target_size) {
+        Rng rng(1);
+        std::string out = "{\"order\":64,\"root\":";
+        std::function<void(int)> node = [&](int depth) {
+            out += "{\"keys\":[";
+            for (int i = 0; i < 63; i++) {
+                out += std::format("{}{}", i ? "," : "", rng() >> 12);
+            }
+            out += "],\"children\":[";
+            for (int i = 0; depth > 0 && i < 64 && out.size() < target_size; i++) {
+                out += i ? "," : "";
+                node(depth - 1);
+            }
+            out += "]}";
+        };
+        node(4);
+        out += '}';
+        return out;
+    }
+    // Station events of about `target_size` bytes in all, each after `separator` but the first
+    std::string station_events(size_t target_size, std::string_view separator) {
+        Rng rng(2);
+        auto name = [&] {
+            std::string s;
+            for (size_t i = 0, n = 3 + random_below(rng, 5); i < n; i++) {
+                s += static_cast<char>('a' + random_below(rng, 26));
+            }
+            return s;
+        };
+        std::string out;
+        for (size_t i = 0; out.size() < target_size; i++) {
+            out += std::format("{}{{\"kind\":\"{}\",\"time\":{},\"pkg_info\":{{\"receiver_name\":\"{}\","
+                "\"receiver_phone\":\"10{:08}\",\"subid\":{},\"size\":{},\"added_time\":{}}}}}",
+                i ? separator : "", random_below(rng, 2) ? "add" : "remove", i, name(),
+                random_below(rng, 100000000), random_below(rng, 500), 1 + random_below(rng, 3), i);
+        }
+        return out;
+    }
+    std::string station_document(size_t target_size) {
+        return "{\"current_time\":1000,\"events\":[\n    " + station_events(target_size, ",\n    ") + "\n]}";
+    }
+
+    // Numbers one by one, without any containers around them
+    void bench_numbers(const std::string& label, const std::vector<std::string>& texts) {
+        std::vector<double> values(texts.size());
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < texts.size(); i++) {
+            json::JsonValue jv;
+            jv.try_deserialize_from_utf8(texts[i].data(), texts[i].size());
+            values[i] = jv.get_value<double>();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        size_t printed = 0;
+        for (double v : values) {
+            printed += json::JsonValue{ v }.serialize_into_utf8().size();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        printf("%-20s %9.2f %10.3f %10.3f\n", label.c_str(), printed / 1e6,
+            texts.size() / std::chrono::duration<double>(t1 - t0).count() / 1e6,
+            texts.size() / std::chrono::duration<double>(t2 - t1).count() / 1e6);
+    }
+
+    std::string read_file(const char* path) {
+        std::ifstream fs(path, std::ios::binary);
+        if (!fs) {
+            throw std::runtime_error(std::format("cannot open `{}`", path));
+        }
+        return { std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>() };
+    }
+
+    struct Measurement {
+        double gbps;
+        size_t allocations;
+    };
+
+    // Best of a few runs, and the number of allocations in one
+    Measurement measure(const std::string& doc, const std::function<void(void)>& fn) {
+        Measurement m{};
+        for (int i = 0; i < 5; i++) {
+            size_t allocations = allocation_count;
+            auto t0 = std::chrono::steady_clock::now();
+            fn();
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            m.gbps = std::max(m.gbps, doc.size() / s / 1e9);
+            m.allocations = allocation_count - allocations;
+        }
+        return m;
+    }
+
+    // Chunked parsing of an array at the root, or of NDJSON if `lines`, on more and more
+    // threads. Beyond the number of cores, the chunks only add their overhead.
+    void bench_parallel(const std::string& label, const std::string& doc, bool lines) {
+        printf("%s (%.2f MB, %u cores)\n", label.c_str(), doc.size() / 1e6, std::thread::hardware_concurrency());
+        for (unsigned threads : { 1, 2, 4, 8 }) {
+            bool ok = true;
+            auto value = measure(doc, [&] {
+                json::JsonValue jv;
+                ok = lines ? jv.try_deserialize_ndjson(doc.data(), doc.size(), threads) :
+                    jv.try_deserialize_from_utf8_parallel(doc.data(), doc.size(), threads);
+            });
+            std::vector<char> data(doc.begin(), doc.end());
+            auto document = measure(doc, [&] {
+                json::JsonDocument jd;
+                ok = ok && (lines ? jd.try_parse_ndjson(data, threads) : jd.try_parse_parallel(data, threads));
+            });
+            if (ok) {
+                printf("    %u threads: value %8.3f GB/s, document %8.3f GB/s\n", threads, value.gbps, document.gbps);
+            }
+            else {
+                printf("    %u threads: FAILED\n", threads);
+            }
+        }
+    }
+
+    // Sum of all numbers in the value
+    double sum_numbers(const json::JsonValue& jv) {
+        double sum = 0;
+        if (jv.is_number()) {
+            sum = jv.get_value<double>();
+        }
+        else if (jv.is_array()) {
+            for (const auto& i : jv.get<json::JsonArray>()) {
+                sum += sum_numbers(i);
+            }
+        }
+        else if (jv.is_object()) {
+            for (const auto& i : jv.get<json::JsonObject>()) {
+                sum += sum_numbers(i.second);
+            }
+        }
+        return sum;
+    }
+    double sum_numbers(const json::JsonNode& node) {
+        double sum = 0;
+        if (node.is_number()) {
+            sum = node.get_value<double>();
+        }
+        else if (node.is_array()) {
+            for (const auto& i : node.elements()) {
+                sum += sum_numbers(i);
+            }
+        }
+        else if (node.is_object()) {
+            for (const auto& i : node.members()) {
+                sum += sum_numbers(i.value);
+            }
+        }
+        return sum;
+    }
+
+    size_t count_numbers(const json::JsonNode& node) {
+        size_t count = node.is_number();
+        if (node.is_array()) {
+            for (const auto& i : node.elements()) {
+                count += count_numbers(i);
+            }
+        }
+        else if (node.is_object()) {
+            for (const auto& i : node.members()) {
+                count += count_numbers(i.value);
+            }
+        }
+        return count;
+    }
+
+    // Memory held by the parsed document and the time to visit all of its numbers, for
+    // inputs that are mostly numbers
+    void bench_footprint(const std::string& label, const std::string& doc) {
+        printf("%s (%.2f MB, sizeof(JsonValue) = %zu)\n", label.c_str(), doc.size() / 1e6, sizeof(json::JsonValue));
+        size_t numbers = 0;
+        auto report = [&](const char* name, size_t bytes, Measurement m, double sum) {
+            printf("    %-10s %9.2f MB %7.1f B/number %8.3f GB/s traversal (sum %g)\n", name, bytes / 1e6,
+                static_cast<double>(bytes) / numbers, m.gbps, sum);
+        };
+        double sum = 0;
+        // Without the input, which the document keeps
+        size_t bytes = allocated_bytes + doc.size();
+        json::JsonDocument jd;
+        if (!jd.try_parse(doc.data(), doc.size())) {
+            printf("    FAILED\n");
+            return;
+        }
+        bytes = allocated_bytes - bytes;
+        numbers = count_numbers(jd.root());
+        auto m = measure(doc, [&] { sum = sum_numbers(jd.root()); });
+        report("document", bytes, m, sum);
+        bytes = allocated_bytes;
+        json::JsonValue jv;
+        jv.try_deserialize_from_utf8(doc.data(), doc.size());
+        bytes = allocated_bytes - bytes;
+        m = measure(doc, [&] { sum = sum_numbers(jv); });
+        report("value", bytes, m, sum);
+    }
+
+    void bench(const std::string& label, const std::string& doc) {
+        printf("%s (%.2f MB)\n", label.c_str(), doc.size() / 1e6);
+        auto report = [](const char* name, Measurement m, bool ok) {
+            if (ok) {
+                printf("    %-18s %8.3f GB/s %12zu allocations\n", name, m.gbps, m.allocations);
+            }
+            else {
+                printf("    %-18s   FAILED\n", name);
+            }
+        };
+        for (const auto& parser : parsers()) {
+            bool ok = true;
+            auto m = measure(doc, [&] { ok = parser.parse(doc, nullptr); });
+            report(parser.name, m, ok);
+        }
+        report("structural index", measure(doc, [&] { json::details::build_structural_index(doc); }), true);
+        // What reading a few fields costs: the first member of the root, if it is an object
+        bool ok = true;
+        auto m = measure(doc, [&] {
+            json::JsonLazyDocument lazy;
+            ok = lazy.try_parse(doc.data(), doc.size());
+            if (ok && lazy.root().is_object()) {
+                for (auto& member : lazy.root().get_object()) {
+                    member.value.to_value();
+                    break;
+                }
+            }
+        });
+        report("lazy, first field", m, ok);
+        // Compare with "push", which produces the events paths run on
+        static const char* const queries[] = {
+            "$..receiver_phone",
+            "$.events[*].pkg_info.receiver_phone",
+            "$.events[?(@.kind == 'add')].time",
+            "$.root.keys[0:4]",
+            "$..keys[?(@ < 1000000000)]",
+        };
+        for (auto query : queries) {
+            json::JsonPath path(query);
+            size_t matches = 0;
+            m = measure(doc, [&] {
+                matches = 0;
+                ok = path.try_match(doc.data(), doc.size(), [&](json::JsonValue) { matches++; });
+            });
+            if (ok) {
+                printf("    %-36s %8.3f GB/s %12zu matches\n", query, m.gbps, matches);
+            }
+            else {
+                printf("    %-36s   FAILED\n", query);
+            }
+        }
+        json::JsonValue parsed;
+        ok = parsed.try_deserialize_from_utf8(doc.data(), doc.size());
+        // Relative to the size of the input, which the output roughly matches
+        report("serialize", measure(doc, [&] { parsed.serialize_into_utf8(); }), ok);
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t iterations = 20000;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--fuzz" && i + 1 < argc) {
+            iterations = std::stoul(argv[++i]);
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+    size_t mismatches = fuzz(iterations) + check_error_positions() + check_paths(iterations) +
+        check_key_round_trip(100000) + check_integers() + check_parallel();
+
+    {
+        Rng rng(4);
+        std::vector<std::string> keys, decimals;
+        for (size_t i = 0; i < 1000000; i++) {
+            keys.push_back(std::to_string(rng() >> (12 + random_below(rng, 40))));
+            decimals.push_back(std::format("{}", std::uniform_real_distribution<double>(-1e3, 1e3)(rng)));
+        }
+        printf("%-20s %9s %10s %10s\n", "numbers", "size(MB)", "parse(M/s)", "print(M/s)");
+        bench_numbers("b-tree keys", keys);
+        bench_numbers("decimals", decimals);
+    }
+    if (files.empty()) {
+        bench("generated b-tree", btree_document(8 << 20));
+        bench("generated station", station_document(8 << 20));
+        bench_parallel("generated event array", "[" + station_events(8 << 20, ",\n") + "]", false);
+        bench_parallel("generated event lines", station_events(8 << 20, "\n"), true);
+        bench_footprint("generated b-tree", btree_document(8 << 20));
+        Rng rng(6);
+        std::string numbers = "[";
+        for (size_t i = 0; numbers.size() < (8 << 20); i++) {
+            numbers += std::format("{}{}", i ? "," : "", i % 2 ? std::format("{}", rng() >> 12) :
+                std::format("{}", std::uniform_real_distribution<double>(-1e3, 1e3)(rng)));
+        }
+        numbers += ']';
+        bench_footprint("generated numbers", numbers);
+    }
+    for (auto path : files) {
+        bench(path, read_file(path));
+    }
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -142,12 +142,12 @@ struct BTree {
         }
         return jo;
     }
-    static BTree from_json(const json::JsonObject& jo) {
+    static BTree from_json(json::JsonLazyObject jo) {
         auto order = jo.at("order").get_value<size_t>();
         BTree result(order);
-        const auto& jv_root = jo.at("root");
+        auto jv_root = jo.at("root");
         if (!jv_root.is_null()) {
-            result.m_root = new BTreeNode(BTreeNode::from_json(jv_root.get<json::JsonObject>(), order));
+            result.m_root = new BTreeNode(BTreeNode::from_json(jv_root.get_object(), order));
         }
         return result;
     }
@@ -177,13 +177,13 @@ private:
             jo["children"] = std::move(ja_children);
             return jo;
         }
-        static BTreeNode from_json(const json::JsonObject& jo, size_t order) {
+        static BTreeNode from_json(json::JsonLazyObject jo, size_t order) {
             BTreeNode result(order);
-            for (const auto& i : jo.at("keys").get<json::JsonArray>()) {
+            for (auto i : jo.at("keys").get_array()) {
                 result.keys.push_back(i.get_value<Key>());
             }
-            for (const auto& i : jo.at("children").get<json::JsonArray>()) {
-                result.children.push_back(from_json(i.get<json::JsonObject>(), order));
+            for (auto i : jo.at("children").get_array()) {
+                result.children.push_back(from_json(i.get_object(), order));
             }
             return result;
         }
@@ -512,12 +512,21 @@ double parse_f64_from_str(std::string_view str) {
     }
     return jv_order.get_value<double>();
 }
+// Integers are exact, as JSON keeps them
 uint64_t parse_u64_from_str(std::string_view str) {
-    auto val = parse_f64_from_str(str);
+    json::JsonValue jv_val;
+    if (!jv_val.try_deserialize_from_utf8(str.data(), str.size()) || !jv_val.is_number()) {
+        throw std::runtime_error("Cannot parse u64 from string");
+    }
+    auto val = jv_val.get_value<double>();
     if (val < 0 || val != std::rint(val)) {
         throw std::runtime_error("Cannot parse u64 from string");
     }
-    return static_cast<uint64_t>(val);
+    // Only a number written as a double can be equal to 2^64 or more
+    if (val >= 0x1p64 && jv_val == json::JsonValue{ val }) {
+        throw std::runtime_error("Cannot parse u64 from string");
+    }
+    return jv_val.get_value<uint64_t>();
 }
 
 // Creates a new B-tree in memory
@@ -546,12 +555,20 @@ void sub_load(AppEnv& env, std::span<std::string> params) {
     std::ifstream fs(params[2]);
     fs.exceptions(std::ios::failbit);
     std::vector<char> data{ std::istreambuf_iterator(fs), std::istreambuf_iterator<char>() };
-    auto jv = json::JsonValue();
-    if (!jv.try_deserialize_from_utf8(data) || !jv.is_object()) {
+    // Read on demand, without building the whole JSON tree first
+    json::JsonLazyDocument doc;
+    if (!doc.try_parse(std::move(data)) || !doc.root().is_object()) {
         throw std::runtime_error("无法从文件中加载 B-树数据");
     }
     using BTreeType = decltype(env.btrees)::value_type::second_type::second_type;
-    env.btrees.insert({ params[1], { params[2], BTreeType::from_json(jv.get<json::JsonObject>()) } });
+    try {
+        auto btree = BTreeType::from_json(doc.root().get_object());
+        doc.finish();
+        env.btrees.insert({ params[1], { params[2], std::move(btree) } });
+    }
+    catch (const std::runtime_error&) {
+        throw std::runtime_error("无法从文件中加载 B-树数据");
+    }
 }
 // Unloads active B-tree in memory
 // Params: None
@@ -25,6 +25,14 @@ target("19-B-树应用")
     add_deps("json")
     add_deps("hashmap")
 
+-- Checks the JSON parsers against each other and measures their throughput
+target("json_bench")
+    set_kind("binary")
+    add_files("json_bench.cpp")
+    set_default(false)
+    add_deps("json")
+    add_deps("hashmap")
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --
@@ -0,0 +1,719 @@
+#include "pch.h"
+
+#include "AotTranslator.hpp"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace CTinyC {
+    namespace {
+        // Support code of the translated program. Expects RT_MEM_SIZE, RT_HEAP_BEGIN,
+        // RT_HEAP_END, RT_SYSCALL_OPCODE and RT_THREADS to be defined before it.
+        constexpr std::string_view RUNTIME = R"RT(#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if RT_THREADS
+#include <threads.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* VM memory; dword aligned, so that atomics can operate on it directly */
+static uint32_t rt_mem_dwords[RT_MEM_SIZE / 4];
+#define rt_mem ((uint8_t*)rt_mem_dwords)
+
+typedef struct vm_thread {
+    uint32_t id;
+    uint32_t display[32];
+} vm_thread;
+
+static inline uint32_t call_indirect(vm_thread* t, uint32_t func, uint32_t sp);
+
+#if RT_THREADS
+static mtx_t rt_mutex;
+#define RT_LOCK() mtx_lock(&rt_mutex)
+#define RT_UNLOCK() mtx_unlock(&rt_mutex)
+#else
+#define RT_LOCK() ((void)0)
+#define RT_UNLOCK() ((void)0)
+#endif
+
+static _Noreturn void vm_panic(char const* msg) {
+    fflush(stdout);
+    fprintf(stderr, "VM PANIC: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+static _Noreturn void rt_halt(void) {
+    fflush(stdout);
+    exit(EXIT_SUCCESS);
+}
+
+static inline uint32_t rd(uint32_t addr) {
+    uint32_t v;
+    if (addr > RT_MEM_SIZE - 4) { vm_panic("VM memory access out of bounds"); }
+    memcpy(&v, rt_mem + addr, 4);
+    return v;
+}
+static inline void wr(uint32_t addr, uint32_t v) {
+    if (addr > RT_MEM_SIZE - 4) { vm_panic("VM memory access out of bounds"); }
+    memcpy(rt_mem + addr, &v, 4);
+}
+/* Checks a range of `count` dwords */
+static inline uint8_t* rt_range(uint32_t addr, uint32_t count) {
+    if (addr > RT_MEM_SIZE || count > (RT_MEM_SIZE - addr) / 4) { vm_panic("VM memory range out of bounds"); }
+    return rt_mem + addr;
+}
+static inline void rt_zero(uint32_t addr, uint32_t bytes) {
+    if (addr > RT_MEM_SIZE || bytes > RT_MEM_SIZE - addr) { vm_panic("VM memory access out of bounds"); }
+    memset(rt_mem + addr, 0, bytes);
+}
+
+/* I/O */
+static int rt_pushback = -1;
+
+static inline int rt_next_char(void) {
+    int ch = rt_pushback >= 0 ? rt_pushback : getchar();
+    rt_pushback = -1;
+    return ch;
+}
+static inline uint32_t rt_getchar(void) {
+    int ch;
+    RT_LOCK();
+    ch = rt_next_char();
+    RT_UNLOCK();
+    return (uint32_t)ch;
+}
+/* Same as scanf("%d"), yields 0 if no integer could be read */
+static inline uint32_t rt_input(void) {
+    uint32_t v = 0;
+    int has_digit = 0, negative, ch;
+    RT_LOCK();
+    ch = rt_next_char();
+    while (ch >= 0 && isspace(ch)) { ch = rt_next_char(); }
+    negative = ch == '-';
+    if (ch == '-' || ch == '+') { ch = rt_next_char(); }
+    while (ch >= '0' && ch <= '9') {
+        v = v * 10 + (uint32_t)(ch - '0');
+        has_digit = 1;
+        ch = rt_next_char();
+    }
+    rt_pushback = ch;
+    RT_UNLOCK();
+    return !has_digit ? 0 : negative ? 0u - v : v;
+}
+static inline void rt_putchar(uint32_t ch) {
+    putchar((unsigned char)ch);
+}
+static inline void rt_output(uint32_t v) {
+    printf("%d ", (int)(int32_t)v);
+}
+
+/* Heap: 8-aligned payloads behind an 8-byte header (payload size, state). Freed blocks
+   are recycled through exact-size lists up to 256 bytes and a first-fit list above. */
+#define RT_LIVE 0x4556494cu
+#define RT_FREE 0x45455246u
+static uint32_t rt_heap_top = (RT_HEAP_BEGIN + 7u) & ~7u;
+static uint32_t rt_small_free[33], rt_large_free;
+
+static inline uint32_t rt_malloc_locked(uint32_t size) {
+    uint32_t block_size, p = 0, prev = 0, it;
+    if (size > RT_HEAP_END - RT_HEAP_BEGIN) { return 0; }
+    block_size = size == 0 ? 8 : (size + 7u) & ~7u;
+    if (block_size <= 256) {
+        if ((p = rt_small_free[block_size / 8]) != 0) { rt_small_free[block_size / 8] = rd(p); }
+    }
+    else {
+        for (it = rt_large_free; it != 0; prev = it, it = rd(it)) {
+            if (rd(it - 8) >= block_size) {
+                if (prev) { wr(prev, rd(it)); } else { rt_large_free = rd(it); }
+                p = it;
+                break;
+            }
+        }
+    }
+    if (p == 0) {
+        if (rt_heap_top > RT_HEAP_END || RT_HEAP_END - rt_heap_top < block_size + 8) { return 0; }
+        p = rt_heap_top + 8;
+        wr(p - 8, block_size);
+        rt_heap_top += block_size + 8;
+    }
+    wr(p - 4, RT_LIVE);
+    return p;
+}
+/* Returns the payload size */
+static inline uint32_t rt_checked_block(uint32_t p) {
+    if (p < RT_HEAP_BEGIN + 8 || p >= rt_heap_top || p % 8 != 0) { vm_panic("free of a pointer not returned by malloc"); }
+    if (rd(p - 4) != RT_LIVE) { vm_panic("double free or free of a released block"); }
+    return rd(p - 8);
+}
+static inline void rt_free_locked(uint32_t p) {
+    uint32_t size = rt_checked_block(p);
+    wr(p - 4, RT_FREE);
+    if (size <= 256) {
+        wr(p, rt_small_free[size / 8]);
+        rt_small_free[size / 8] = p;
+    }
+    else {
+        wr(p, rt_large_free);
+        rt_large_free = p;
+    }
+}
+static inline uint32_t rt_malloc(uint32_t size) {
+    uint32_t p;
+    RT_LOCK();
+    p = rt_malloc_locked(size);
+    RT_UNLOCK();
+    return p;
+}
+static inline void rt_free(uint32_t p) {
+    if (p == 0) { return; }
+    RT_LOCK();
+    rt_free_locked(p);
+    RT_UNLOCK();
+}
+static inline uint32_t rt_realloc(uint32_t p, uint32_t size) {
+    uint32_t old_size, q;
+    if (p == 0) { return rt_malloc(size); }
+    if (size == 0) {
+        rt_free(p);
+        return 0;
+    }
+    RT_LOCK();
+    old_size = rt_checked_block(p);
+    if (size <= old_size) {
+        RT_UNLOCK();
+        return p;
+    }
+    q = rt_malloc_locked(size);
+    if (q != 0) {
+        memcpy(rt_mem + q, rt_mem + p, old_size);
+        rt_free_locked(p);
+    }
+    RT_UNLOCK();
+    return q;
+}
+
+/* Bulk operations */
+static inline void rt_memset(uint32_t dst, uint32_t value, uint32_t count) {
+    uint8_t* p = rt_range(dst, count);
+    uint32_t i;
+    for (i = 0; i < count; i++) { memcpy(p + (size_t)i * 4, &value, 4); }
+}
+static inline void rt_memcopy(uint32_t dst, uint32_t src, uint32_t count) {
+    uint8_t* d = rt_range(dst, count);
+    memmove(d, rt_range(src, count), (size_t)count * 4);
+}
+static inline uint32_t rt_memcompare(uint32_t a, uint32_t b, uint32_t count) {
+    uint8_t const* pa = rt_range(a, count);
+    uint8_t const* pb = rt_range(b, count);
+    uint32_t i;
+    int32_t x, y;
+    for (i = 0; i < count; i++) {
+        memcpy(&x, pa + (size_t)i * 4, 4);
+        memcpy(&y, pb + (size_t)i * 4, 4);
+        if (x != y) { return x < y ? (uint32_t)-1 : 1; }
+    }
+    return 0;
+}
+static inline uint32_t rt_reduce(uint32_t addr, uint32_t count, int op) {
+    uint8_t const* p = rt_range(addr, count);
+    uint32_t i, sum = 0;
+    int32_t v, result = 0;
+    for (i = 0; i < count; i++) {
+        memcpy(&v, p + (size_t)i * 4, 4);
+        if (op == 0) { sum += (uint32_t)v; }
+        else if (i == 0 || (op < 0 ? v < result : v > result)) { result = v; }
+    }
+    return op == 0 ? sum : (uint32_t)result;
+}
+
+/* Atomics */
+static inline uint32_t volatile* rt_atomic_ptr(uint32_t addr) {
+    if (addr > RT_MEM_SIZE - 4) { vm_panic("VM memory access out of bounds"); }
+    if (addr % 4 != 0) { vm_panic("unaligned atomic access"); }
+    return &rt_mem_dwords[addr / 4];
+}
+#if defined(_MSC_VER)
+static inline uint32_t rt_atomic_add(uint32_t addr, uint32_t delta) {
+    return (uint32_t)_InterlockedExchangeAdd((long volatile*)rt_atomic_ptr(addr), (long)delta);
+}
+static inline uint32_t rt_atomic_cas(uint32_t addr, uint32_t expected, uint32_t desired) {
+    return (uint32_t)_InterlockedCompareExchange((long volatile*)rt_atomic_ptr(addr), (long)desired, (long)expected);
+}
+#else
+static inline uint32_t rt_atomic_add(uint32_t addr, uint32_t delta) {
+    return __atomic_fetch_add(rt_atomic_ptr(addr), delta, __ATOMIC_SEQ_CST);
+}
+static inline uint32_t rt_atomic_cas(uint32_t addr, uint32_t expected, uint32_t desired) {
+    __atomic_compare_exchange_n(rt_atomic_ptr(addr), &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+#endif
+
+/* Threads, laid out in VM memory like Executor does */
+#if RT_THREADS
+#define RT_STACK_SIZE (64 * 1024)
+#define RT_MAX_THREADS 256
+
+typedef struct rt_thread {
+    vm_thread t;
+    uint32_t func, stack, sp, result;
+    thrd_t host;
+} rt_thread;
+
+static rt_thread** rt_threads;
+static uint32_t rt_thread_cnt, rt_unjoined_cnt;
+
+static int rt_thread_main(void* arg) {
+    rt_thread* th = (rt_thread*)arg;
+    uint32_t sp = call_indirect(&th->t, th->func, th->sp);
+    /* The result replaced the argument, unless the function returns void */
+    th->result = sp == th->sp + 4 ? rd(sp) : 0;
+    return 0;
+}
+static inline uint32_t rt_spawn(vm_thread* t, uint32_t func, uint32_t arg) {
+    rt_thread* th;
+    uint32_t exit_stub;
+    RT_LOCK();
+    if (rt_unjoined_cnt >= RT_MAX_THREADS) { vm_panic("too many threads"); }
+    th = (rt_thread*)calloc(1, sizeof *th);
+    rt_threads = (rt_thread**)realloc(rt_threads, (rt_thread_cnt + 1) * sizeof *rt_threads);
+    if (th == NULL || rt_threads == NULL) { vm_panic("out of host memory"); }
+    th->stack = rt_malloc_locked(RT_STACK_SIZE);
+    if (th->stack == 0) { vm_panic("out of memory for a thread stack"); }
+    /* Nested functions reach the frames of the spawning thread through the display */
+    th->t = *t;
+    th->t.id = ++rt_thread_cnt;
+    th->func = func;
+    exit_stub = th->stack + RT_STACK_SIZE - 8;
+    rt_mem[exit_stub] = RT_SYSCALL_OPCODE;
+    wr(exit_stub + 1, 12);
+    wr(exit_stub - 4, arg);
+    wr(exit_stub - 8, exit_stub);
+    th->sp = exit_stub - 8;
+    rt_threads[th->t.id - 1] = th;
+    rt_unjoined_cnt++;
+    if (thrd_create(&th->host, rt_thread_main, th) != thrd_success) { vm_panic("cannot start a thread"); }
+    RT_UNLOCK();
+    return th->t.id;
+}
+static inline uint32_t rt_join(vm_thread* t, uint32_t id) {
+    rt_thread* th;
+    uint32_t result;
+    RT_LOCK();
+    if (id == 0 || id > rt_thread_cnt || id == t->id || rt_threads[id - 1] == NULL) { vm_panic("invalid thread id"); }
+    th = rt_threads[id - 1];
+    rt_threads[id - 1] = NULL;
+    RT_UNLOCK();
+    thrd_join(th->host, NULL);
+    RT_LOCK();
+    rt_free_locked(th->stack);
+    rt_unjoined_cnt--;
+    RT_UNLOCK();
+    result = th->result;
+    free(th);
+    return result;
+}
+#else
+static inline uint32_t rt_spawn(vm_thread* t, uint32_t func, uint32_t arg) {
+    (void)t; (void)func; (void)arg;
+    vm_panic("threads are not supported");
+}
+static inline uint32_t rt_join(vm_thread* t, uint32_t id) {
+    (void)t; (void)id;
+    vm_panic("threads are not supported");
+}
+#endif
+)RT";
+
+        // Emits the C function bodies; see translate_to_c
+        struct CTranslator {
+            CTranslator(ExecutorImage const& image, CodeMetadata const& metadata, size_t start_offset) :
+                m_image(image), m_code_begin((uint32_t)start_offset),
+                m_code_end((uint32_t)(start_offset + metadata.code_size)) {
+                if (image.memory.size() > UINT32_MAX || image.memory.size() % 4 != 0 ||
+                    m_code_end > image.memory.size()
+                ) {
+                    throw std::invalid_argument("image cannot be translated");
+                }
+                for (auto const& func : metadata.func_meta) {
+                    m_func_names.emplace((uint32_t)(start_offset + func.offset), func.name);
+                }
+                for (auto const& import : metadata.ffi_imports) {
+                    m_ffi_names.push_back(import.name);
+                }
+            }
+
+            std::string translate() {
+                auto entry = (uint32_t)m_image.ip;
+                discover(entry);
+
+                std::string out = "/* Generated by the TinyC ahead-of-time translator */\n";
+                out += std::format("#define RT_MEM_SIZE {}u\n", m_image.memory.size());
+                out += std::format("#define RT_HEAP_BEGIN {}u\n", m_image.heap_begin);
+                out += std::format("#define RT_HEAP_END {}u\n", m_image.heap_end);
+                out += std::format("#define RT_SYSCALL_OPCODE {}\n", (int)ByteCodeType::SysCall);
+                out += std::format("#define RT_THREADS {}\n", m_uses_threads ? 1 : 0);
+                out += RUNTIME;
+
+                out += "\n/* Translated code */\n";
+                for (auto const& [addr, func] : m_funcs) {
+                    out += std::format("static uint32_t {}(vm_thread* t, uint32_t sp);\n", func_name(addr));
+                }
+                out += "\nstatic inline uint32_t call_indirect(vm_thread* t, uint32_t func, uint32_t sp) {\n"
+                    "    switch (func) {\n";
+                for (auto const& [addr, func] : m_funcs) {
+                    out += std::format("    case {}u: return {}(t, sp);\n", addr, func_name(addr));
+                }
+                out += "    default: vm_panic(\"call of an address that is not a function\");\n"
+                    "    }\n}\n";
+                for (auto const& [addr, func] : m_funcs) {
+                    emit_function(out, func);
+                }
+
+                emit_main(out, entry);
+                return out;
+            }
+
+        private:
+            struct Function {
+                uint32_t entry{};
+                // Reachable instructions, in address order
+                std::set<uint32_t> insts;
+                std::set<uint32_t> labels;
+            };
+
+            ByteCodeType opcode_at(uint32_t addr) const {
+                if (addr < m_code_begin || addr >= m_code_end) {
+                    throw std::runtime_error(std::format("jump to {} outside of the code", addr));
+                }
+                auto op = static_cast<ByteCodeType>(m_image.memory[addr]);
+                if (op > ByteCodeType::ReduceMax || addr + instruction_size(op) > m_code_end) {
+                    throw std::runtime_error(std::format("unrecognized bytecode at {}", addr));
+                }
+                return op;
+            }
+            uint32_t operand(uint32_t addr, size_t index) const {
+                uint32_t v;
+                std::memcpy(&v, m_image.memory.data() + addr + 1 + index * 4, 4);
+                return v;
+            }
+            bool is_function(uint32_t addr) const {
+                return m_funcs.contains(addr) || m_func_names.contains(addr);
+            }
+            std::string func_name(uint32_t addr) const {
+                return std::format("f_{}", addr);
+            }
+
+            // Walks the control flow of every function reachable from `entry`
+            void discover(uint32_t entry) {
+                std::vector<uint32_t> pending_funcs{ entry };
+                while (!pending_funcs.empty()) {
+                    auto func_addr = pending_funcs.back();
+                    pending_funcs.pop_back();
+                    if (m_funcs.contains(func_addr)) { continue; }
+                    auto& func = m_funcs[func_addr];
+                    func.entry = func_addr;
+
+                    std::vector<uint32_t> pending{ func_addr };
+                    while (!pending.empty()) {
+                        auto addr = pending.back();
+                        pending.pop_back();
+                        if (!func.insts.insert(addr).second) { continue; }
+                        auto op = opcode_at(addr);
+                        auto next = addr + (uint32_t)instruction_size(op);
+                        switch (op) {
+                        case ByteCodeType::Jump:
+                            func.labels.insert(operand(addr, 0));
+                            pending.push_back(operand(addr, 0));
+                            break;
+                        case ByteCodeType::JumpCond:
+                            func.labels.insert(operand(addr, 0));
+                            pending.push_back(operand(addr, 0));
+                            pending.push_back(next);
+                            break;
+                        case ByteCodeType::Ret: case ByteCodeType::RetDword:
+                        case ByteCodeType::Leave: case ByteCodeType::LeaveDword:
+                        case ByteCodeType::DebugInterrupt: case ByteCodeType::FfiCall:
+                            break;
+                        case ByteCodeType::TailCall:
+                            // A self call becomes a jump back to the entry
+                            func.labels.insert(func_addr);
+                            break;
+                        case ByteCodeType::SysCall: {
+                            auto id = operand(addr, 0);
+                            m_uses_threads |= id == 8 || id == 9;
+                            if (id != 0 && id <= 11) { pending.push_back(next); }
+                            break;
+                        }
+                        case ByteCodeType::Call:
+                            pending_funcs.push_back(operand(addr, 0));
+                            pending.push_back(next);
+                            break;
+                        case ByteCodeType::PushDword:
+                            // Function addresses are taken by indirect calls and spawn
+                            if (m_func_names.contains(operand(addr, 0))) {
+                                pending_funcs.push_back(operand(addr, 0));
+                            }
+                            pending.push_back(next);
+                            break;
+                        default:
+                            pending.push_back(next);
+                            break;
+                        }
+                    }
+                }
+
+                // Falling through to an instruction that is not emitted right after
+                for (auto& [addr, func] : m_funcs) {
+                    for (auto it = func.insts.begin(); it != func.insts.end(); ++it) {
+                        auto op = opcode_at(*it);
+                        auto next = *it + (uint32_t)instruction_size(op);
+                        auto next_it = std::next(it);
+                        if (falls_through(*it) && (next_it == func.insts.end() || *next_it != next)) {
+                            func.labels.insert(next);
+                        }
+                    }
+                }
+            }
+            bool falls_through(uint32_t addr) const {
+                switch (opcode_at(addr)) {
+                case ByteCodeType::Jump: case ByteCodeType::Ret: case ByteCodeType::RetDword:
+                case ByteCodeType::Leave: case ByteCodeType::LeaveDword: case ByteCodeType::TailCall:
+                case ByteCodeType::DebugInterrupt: case ByteCodeType::FfiCall:
+                    return false;
+                case ByteCodeType::SysCall:
+                    return operand(addr, 0) != 0 && operand(addr, 0) <= 11;
+                default:
+                    return true;
+                }
+            }
+
+            uint32_t checked_display(uint32_t depth) const {
+                if (depth >= DISPLAY_DEPTH) {
+                    throw std::runtime_error("VM display depth out of bounds");
+                }
+                return depth;
+            }
+
+            void emit_function(std::string& out, Function const& func) {
+                auto name_it = m_func_names.find(func.entry);
+                out += std::format("\n/* {} */\nstatic uint32_t {}(vm_thread* t, uint32_t sp) {{\n",
+                    name_it != m_func_names.end() ? name_it->second : "(unnamed)", func_name(func.entry));
+                out += "    (void)t;\n";
+                for (auto it = func.insts.begin(); it != func.insts.end(); ++it) {
+                    auto addr = *it;
+                    if (func.labels.contains(addr)) {
+                        out += std::format("L_{}:;\n", addr);
+                    }
+                    // `PushDword f; CallIndirect` is a direct call of f
+                    auto next_it = std::next(it);
+                    auto op = opcode_at(addr);
+                    if (op == ByteCodeType::PushDword && next_it != func.insts.end() && *next_it == addr + 5 &&
+                        opcode_at(*next_it) == ByteCodeType::CallIndirect && !func.labels.contains(*next_it) &&
+                        m_funcs.contains(operand(addr, 0))
+                    ) {
+                        out += std::format("    sp -= 4; wr(sp, {}u); sp = {}(t, sp);\n",
+                            addr + 6, func_name(operand(addr, 0)));
+                        ++it;
+                        continue;
+                    }
+                    emit_instruction(out, func, addr);
+                }
+                out += "}\n";
+            }
+
+            void emit_instruction(std::string& out, Function const& func, uint32_t addr) {
+                auto op = opcode_at(addr);
+                auto next = addr + (uint32_t)instruction_size(op);
+                auto binary = [&](std::string_view expr) {
+                    out += std::format("    {{ uint32_t b = rd(sp); sp += 4; uint32_t a = rd(sp); wr(sp, {}); }}\n", expr);
+                };
+                switch (op) {
+                case ByteCodeType::DebugInterrupt:
+                    out += "    vm_panic(\"breakpoints are not supported in translated code\");\n";
+                    break;
+                case ByteCodeType::PushDword:
+                    out += std::format("    sp -= 4; wr(sp, {}u);\n", operand(addr, 0));
+                    break;
+                case ByteCodeType::PopDword:
+                    out += "    sp += 4;\n";
+                    break;
+                case ByteCodeType::DuplicateDword:
+                    out += "    sp -= 4; wr(sp, rd(sp + 4));\n";
+                    break;
+                case ByteCodeType::PushStackRef:
+                    out += "    sp -= 4; wr(sp, sp + 4);\n";
+                    break;
+                case ByteCodeType::AdjustStackRefConst:
+                    out += std::format("    sp += {}u;\n", operand(addr, 0));
+                    break;
+                case ByteCodeType::ReadRefDword:
+                    out += "    wr(sp, rd(rd(sp)));\n";
+                    break;
+                case ByteCodeType::WriteRefDword:
+                    out += "    { uint32_t v = rd(sp); uint32_t p = rd(sp + 4); sp += 8; wr(p, v); }\n";
+                    break;
+                case ByteCodeType::Call:
+                    out += std::format("    sp -= 4; wr(sp, {}u); sp = {}(t, sp);\n", next, func_name(operand(addr, 0)));
+                    break;
+                case ByteCodeType::CallIndirect:
+                    out += std::format("    {{ uint32_t f = rd(sp); wr(sp, {}u); sp = call_indirect(t, f, sp); }}\n", next);
+                    break;
+                case ByteCodeType::Ret:
+                    out += std::format("    return sp + {}u;\n", 4 + operand(addr, 0));
+                    break;
+                case ByteCodeType::RetDword:
+                    out += std::format("    {{ uint32_t v = rd(sp); sp += {}u; wr(sp, v); return sp; }}\n", 4 + operand(addr, 0));
+                    break;
+                case ByteCodeType::Jump:
+                    out += std::format("    goto L_{};\n", operand(addr, 0));
+                    break;
+                case ByteCodeType::JumpCond:
+                    out += std::format("    sp += 4; if (rd(sp - 4) != 0) {{ goto L_{}; }}\n", operand(addr, 0));
+                    break;
+                case ByteCodeType::Add: binary("a + b"); break;
+                case ByteCodeType::Sub: binary("a - b"); break;
+                case ByteCodeType::Mul: binary("a * b"); break;
+                case ByteCodeType::Div:
+                    out += "    { uint32_t b = rd(sp); sp += 4; if (b == 0) { vm_panic(\"division by zero\"); } wr(sp, rd(sp) / b); }\n";
+                    break;
+                case ByteCodeType::CmpG: binary("(int32_t)a > (int32_t)b"); break;
+                case ByteCodeType::CmpGe: binary("(int32_t)a >= (int32_t)b"); break;
+                case ByteCodeType::CmpE: binary("a == b"); break;
+                case ByteCodeType::CmpNe: binary("a != b"); break;
+                case ByteCodeType::CmpL: binary("(int32_t)a < (int32_t)b"); break;
+                case ByteCodeType::CmpLe: binary("(int32_t)a <= (int32_t)b"); break;
+                case ByteCodeType::PushDisplay:
+                    out += std::format("    sp -= 4; wr(sp, t->display[{}]);\n", checked_display(operand(addr, 0)));
+                    break;
+                case ByteCodeType::Enter: {
+                    auto depth = checked_display(operand(addr, 0));
+                    out += std::format("    sp -= 4; wr(sp, t->display[{0}]); t->display[{0}] = sp + 4;", depth);
+                    if (auto frame_size = operand(addr, 1)) {
+                        out += std::format(" sp -= {0}u; rt_zero(sp, {0}u);", frame_size);
+                    }
+                    out += "\n";
+                    break;
+                }
+                case ByteCodeType::Leave:
+                case ByteCodeType::LeaveDword: {
+                    auto depth = checked_display(operand(addr, 0));
+                    auto release = 4 + operand(addr, 1);
+                    if (op == ByteCodeType::Leave) {
+                        out += std::format("    sp = t->display[{0}]; t->display[{0}] = rd(sp - 4); return sp + {1}u;\n",
+                            depth, release);
+                    }
+                    else {
+                        out += std::format("    {{ uint32_t v = rd(sp); sp = t->display[{0}]; t->display[{0}] = rd(sp - 4); "
+                            "sp += {1}u; wr(sp, v); return sp; }}\n", depth, release - 4);
+                    }
+                    break;
+                }
+                case ByteCodeType::TailCall: {
+                    auto depth = checked_display(operand(addr, 0));
+                    auto cur_size = operand(addr, 1), new_size = operand(addr, 2);
+                    // Moves the new arguments over the old ones, the destination is always higher
+                    out += std::format(
+                        "    {{ uint32_t f = rd(sp); uint32_t base = t->display[{0}]; uint32_t ret = rd(base); uint32_t dst;\n"
+                        "      t->display[{0}] = rd(base - 4); dst = base + {1}u;\n"
+                        "      rt_memcopy(dst, sp + 4, {2}u); sp = dst - 4; wr(sp, ret);\n"
+                        "      if (f == {3}u) {{ goto L_{3}; }} return call_indirect(t, f, sp); }}\n",
+                        depth, 4 + cur_size - new_size, new_size / 4, func.entry);
+                    break;
+                }
+                case ByteCodeType::FfiCall: {
+                    auto index = operand(addr, 0);
+                    auto name = index < m_ffi_names.size() ? m_ffi_names[index] : "?";
+                    out += std::format("    vm_panic(\"host function `{}` is not available\");\n", name);
+                    break;
+                }
+                case ByteCodeType::SysCall:
+                    switch (operand(addr, 0)) {
+                    case 0: out += "    rt_halt();\n"; break;
+                    case 1: out += "    rt_putchar(rd(sp)); sp += 4;\n"; break;
+                    case 2: out += "    sp -= 4; wr(sp, rt_getchar());\n"; break;
+                    case 3: out += "    sp -= 4; wr(sp, rt_input());\n"; break;
+                    case 4: out += "    rt_output(rd(sp)); sp += 4;\n"; break;
+                    case 5: out += "    wr(sp, rt_malloc(rd(sp)));\n"; break;
+                    case 6: out += "    rt_free(rd(sp)); sp += 4;\n"; break;
+                    case 7: out += "    { uint32_t p = rd(sp); sp += 4; wr(sp, rt_realloc(p, rd(sp))); }\n"; break;
+                    case 8: out += "    { uint32_t f = rd(sp); sp += 4; wr(sp, rt_spawn(t, f, rd(sp))); }\n"; break;
+                    case 9: out += "    wr(sp, rt_join(t, rd(sp)));\n"; break;
+                    case 10: out += "    { uint32_t p = rd(sp); sp += 4; wr(sp, rt_atomic_add(p, rd(sp))); }\n"; break;
+                    case 11:
+                        out += "    { uint32_t p = rd(sp); uint32_t e = rd(sp + 4); sp += 8; wr(sp, rt_atomic_cas(p, e, rd(sp))); }\n";
+                        break;
+                    default: out += "    vm_panic(\"unrecognized syscall\");\n"; break;
+                    }
+                    break;
+                case ByteCodeType::MemSet:
+                    out += "    { uint32_t d = rd(sp); uint32_t v = rd(sp + 4); uint32_t n = rd(sp + 8); sp += 12; rt_memset(d, v, n); }\n";
+                    break;
+                case ByteCodeType::MemCopy:
+                    out += "    { uint32_t d = rd(sp); uint32_t s = rd(sp + 4); uint32_t n = rd(sp + 8); sp += 12; rt_memcopy(d, s, n); }\n";
+                    break;
+                case ByteCodeType::MemCompare:
+                    out += "    { uint32_t a = rd(sp); uint32_t b = rd(sp + 4); uint32_t n = rd(sp + 8); sp += 8; wr(sp, rt_memcompare(a, b, n)); }\n";
+                    break;
+                case ByteCodeType::ReduceSum:
+                case ByteCodeType::ReduceMin:
+                case ByteCodeType::ReduceMax:
+                    out += std::format("    {{ uint32_t p = rd(sp); sp += 4; wr(sp, rt_reduce(p, rd(sp), {})); }}\n",
+                        op == ByteCodeType::ReduceSum ? 0 : op == ByteCodeType::ReduceMin ? -1 : 1);
+                    break;
+                default:
+                    throw std::runtime_error(std::format("unrecognized bytecode at {}", addr));
+                }
+                if (falls_through(addr) && func.labels.contains(next)) {
+                    out += std::format("    goto L_{};\n", next);
+                }
+            }
+
+            void emit_main(std::string& out, uint32_t entry) {
+                auto emit_bytes = [&](std::string_view name, size_t begin, size_t end) {
+                    out += std::format("\nstatic const unsigned char {}[{}] = {{", name, std::max<size_t>(end - begin, 1));
+                    for (size_t i = begin; i < end; i++) {
+                        out += std::format("{}{},", (i - begin) % 24 == 0 ? "\n    " : "", m_image.memory[i]);
+                    }
+                    out += begin == end ? "0 };\n" : "\n};\n";
+                };
+                // Code and initialized data; the rest of the memory starts zeroed
+                size_t image_end = m_image.heap_begin;
+                while (image_end > m_code_begin && m_image.memory[image_end - 1] == 0) { image_end--; }
+                emit_bytes("rt_image", m_code_begin, image_end);
+                // Return address of the entry function, see Executor::make_image
+                auto stack_top = m_image.memory.size();
+                emit_bytes("rt_stack_top", m_image.sp, stack_top);
+
+                out += std::format(
+                    "\nint main(void) {{\n"
+                    "    static vm_thread t;\n"
+                    "#if RT_THREADS\n"
+                    "    mtx_init(&rt_mutex, mtx_plain);\n"
+                    "#endif\n"
+                    "    memcpy(rt_mem + {0}u, rt_image, {1}u);\n"
+                    "    memcpy(rt_mem + {2}u, rt_stack_top, {3}u);\n"
+                    "    {4}(&t, {2}u);\n"
+                    "    rt_halt();\n"
+                    "}}\n", (uint32_t)m_code_begin, image_end - m_code_begin, m_image.sp, stack_top - m_image.sp,
+                    func_name(entry));
+            }
+
+            ExecutorImage const& m_image;
+            uint32_t m_code_begin, m_code_end;
+            std::unordered_map<uint32_t, std::string> m_func_names;
+            std::vector<std::string> m_ffi_names;
+            std::map<uint32_t, Function> m_funcs;
+            bool m_uses_threads{};
+        };
+    }
+
+    std::string translate_to_c(ExecutorImage const& image, CodeMetadata const& metadata, size_t start_offset) {
+        return CTranslator(image, metadata, start_offset).translate();
+    }
+}
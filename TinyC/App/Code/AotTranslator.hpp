@@ -0,0 +1,18 @@
+#pragma once
+
+#include "CodeGen.hpp"
+#include "Executor.hpp"
+
+#include <string>
+
+namespace CTinyC {
+    // Translates a program ahead of time into a standalone C source file, which any C11
+    // compiler turns into a native executable with the same output as Executor.
+    //
+    // Every function reachable from the entry point (image.ip) becomes a C function and
+    // jumps become gotos; the VM memory stays a byte array laid out exactly like the
+    // image, stack included, since programs take addresses of locals. The syscalls and
+    // bulk operations go to a small runtime emitted along with the code. Host functions
+    // are not available: calling one is a runtime error, like breakpoints are.
+    std::string translate_to_c(ExecutorImage const& image, CodeMetadata const& metadata, size_t start_offset);
+}
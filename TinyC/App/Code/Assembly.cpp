@@ -0,0 +1,376 @@
+#include "pch.h"
+
+#include "Assembly.hpp"
+
+#include <charconv>
+#include <unordered_map>
+
+namespace CTinyC {
+    namespace {
+        constexpr std::string_view OPCODE_NAMES[] = {
+            "DebugInterrupt", "PushDword", "PopDword", "DuplicateDword", "PushStackRef",
+            "AdjustStackRefConst", "ReadRefDword", "WriteRefDword", "Call", "CallIndirect",
+            "Ret", "RetDword", "Jump", "JumpCond", "Add", "Sub", "Mul", "Div",
+            "CmpG", "CmpGe", "CmpE", "CmpNe", "CmpL", "CmpLe",
+            "PushDisplay", "Enter", "Leave", "LeaveDword", "TailCall", "FfiCall", "SysCall",
+            "MemSet", "MemCopy", "MemCompare", "ReduceSum", "ReduceMin", "ReduceMax",
+        };
+        static_assert(std::size(OPCODE_NAMES) == ByteCodeType::ReduceMax + 1);
+
+        constexpr std::string_view SYSCALL_NAMES[] = {
+            "halt", "putchar", "getchar", "input", "output", "malloc", "free", "realloc",
+            "spawn", "join", "atomic_add", "atomic_cas", "thread_exit",
+        };
+
+        // Instructions are dumped one per line, comments start at this column
+        constexpr size_t COMMENT_COLUMN = 36;
+
+        uint32_t load_dword(uint8_t const* p) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+        void append_int(std::string& out, int64_t v) {
+            char buf[24];
+            out.append(buf, std::to_chars(buf, buf + sizeof buf, v).ptr);
+        }
+        bool has_address_operand(ByteCodeType type) {
+            return type == ByteCodeType::Call || type == ByteCodeType::Jump || type == ByteCodeType::JumpCond;
+        }
+        // Length of the valid instruction at `pos`, 0 if there is none
+        size_t decode(std::span<uint8_t const> code, size_t pos) {
+            auto type = static_cast<ByteCodeType>(code[pos]);
+            if (opcode_name(type).empty()) { return 0; }
+            auto len = instruction_size(type);
+            return pos + len <= code.size() ? len : 0;
+        }
+    }
+
+    std::string_view opcode_name(ByteCodeType type) {
+        return type < std::size(OPCODE_NAMES) ? OPCODE_NAMES[type] : std::string_view{};
+    }
+
+    std::string disassemble(std::span<uint8_t const> image, CodeMetadata const& metadata, int start_offset,
+        DisassemblyOptions const& options
+    ) {
+        auto base = (uint32_t)start_offset;
+        auto code = image.first(std::min(metadata.code_size, image.size()));
+
+        // Labels by code offset: functions, then jump targets at instruction boundaries
+        constexpr int32_t NO_LABEL = -1, JUMP_LABEL = -2;
+        std::vector<int32_t> label_at(code.size(), NO_LABEL);
+        std::vector<std::string> func_labels;
+        std::unordered_map<std::string_view, size_t> name_cnt;
+        for (auto const& func : metadata.func_meta) {
+            name_cnt[func.name]++;
+        }
+        for (auto const& func : metadata.func_meta) {
+            if (func.offset < code.size()) {
+                label_at[func.offset] = (int32_t)size(func_labels);
+            }
+            func_labels.push_back(name_cnt[func.name] > 1 ? std::format("{}@{}", func.name, base + func.offset) : func.name);
+        }
+        std::vector<bool> is_boundary(code.size());
+        for (size_t pos = 0; pos < code.size();) {
+            is_boundary[pos] = true;
+            pos += std::max<size_t>(decode(code, pos), 1);
+        }
+        for (size_t pos = 0; pos < code.size();) {
+            auto len = decode(code, pos);
+            if (len && has_address_operand(static_cast<ByteCodeType>(code[pos]))) {
+                auto target = load_dword(&code[pos + 1]) - base;
+                if (target < code.size() && is_boundary[target] && label_at[target] == NO_LABEL) {
+                    label_at[target] = JUMP_LABEL;
+                }
+            }
+            pos += std::max<size_t>(len, 1);
+        }
+        auto label_index = [&](uint32_t addr) {
+            return addr - base < code.size() ? label_at[addr - base] : NO_LABEL;
+        };
+        auto append_label = [&](std::string& out, uint32_t addr) {
+            auto index = label_index(addr);
+            if (index == JUMP_LABEL) {
+                out += 'L';
+                append_int(out, addr);
+            }
+            else {
+                out += func_labels[index];
+            }
+        };
+
+        std::string out;
+        out.reserve(code.size() * 10 + (image.size() - code.size()) * 4 + 256);
+        out += std::format("; {} bytes of code and {} of data at {}\n",
+            code.size(), metadata.data_size, start_offset);
+        for (auto const& import : metadata.ffi_imports) {
+            out += std::format(".import {} {} {}\n", import.name, import.param_cnt, import.returns_int ? "int" : "void");
+        }
+
+        std::string_view comment;
+        for (size_t pos = 0; pos < code.size();) {
+            auto addr = base + (uint32_t)pos;
+            if (auto index = label_at[pos]; index >= 0) {
+                auto const& func = metadata.func_meta[index];
+                out += "\n.func ";
+                out += func.name;
+                if (func_labels[index] != func.name) {
+                    out += ' ';
+                    out += func_labels[index];
+                }
+                out += '\n';
+            }
+            else if (index == JUMP_LABEL) {
+                append_label(out, addr);
+                out += ":\n";
+            }
+
+            auto line_begin = size(out);
+            comment = {};
+            auto len = decode(code, pos);
+            if (len == 0) {
+                out += "    .byte ";
+                append_int(out, code[pos]);
+                len = 1;
+            }
+            else {
+                auto type = static_cast<ByteCodeType>(code[pos]);
+                out += "    ";
+                out += opcode_name(type);
+                for (size_t i = 0; i < (len - 1) / 4; i++) {
+                    auto v = load_dword(&code[pos + 1 + i * 4]);
+                    auto index = label_index(v);
+                    out += ' ';
+                    // Function values are labels when they are called right away
+                    bool is_called = type == ByteCodeType::PushDword && index >= 0 && pos + len < code.size() &&
+                        code[pos + len] == ByteCodeType::CallIndirect;
+                    if (index != NO_LABEL && (has_address_operand(type) || is_called)) {
+                        append_label(out, v);
+                    }
+                    else {
+                        append_int(out, (int32_t)v);
+                    }
+                    if (type == ByteCodeType::PushDword && !is_called && index >= 0) {
+                        comment = metadata.func_meta[index].name;
+                    }
+                    if (type == ByteCodeType::SysCall && v < std::size(SYSCALL_NAMES)) {
+                        comment = SYSCALL_NAMES[v];
+                    }
+                    if (type == ByteCodeType::FfiCall && v < size(metadata.ffi_imports)) {
+                        comment = metadata.ffi_imports[v].name;
+                    }
+                }
+            }
+            if (options.addresses || !comment.empty()) {
+                out.append(std::max<size_t>(line_begin + COMMENT_COLUMN, size(out) + 1) - size(out), ' ');
+                out += "; ";
+                if (options.addresses) {
+                    append_int(out, addr);
+                    if (!comment.empty()) { out += ' '; }
+                }
+                out += comment;
+            }
+            out += '\n';
+            pos += len;
+        }
+
+        if (code.size() < image.size()) {
+            out += "\n.data\n";
+            auto pos = code.size();
+            // Code is padded with zeros up to a dword boundary
+            auto aligned = std::min(image.size(), pos + (4 - (base + pos) % 4) % 4);
+            if (aligned > pos && std::all_of(image.data() + pos, image.data() + aligned, [](uint8_t b) { return b == 0; })) {
+                out += "    .align 4\n";
+                pos = aligned;
+            }
+            for (size_t i = 0; pos + 4 <= image.size(); pos += 4, i++) {
+                out += i % 8 == 0 ? "    .dword " : ", ";
+                append_int(out, (int32_t)load_dword(&image[pos]));
+                if (i % 8 == 7 || pos + 8 > image.size()) { out += '\n'; }
+            }
+            if (pos < image.size()) {
+                out += "    .byte ";
+                for (; pos < image.size(); pos++) {
+                    append_int(out, image[pos]);
+                    out += pos + 1 < image.size() ? ", " : "\n";
+                }
+            }
+        }
+        if (metadata.bss_size) {
+            out += std::format("\n.bss {}\n", metadata.bss_size);
+        }
+        return out;
+    }
+
+    std::pair<std::vector<uint8_t>, CodeMetadata> assemble(std::string_view text, int start_offset) {
+        static auto const opcodes = [] {
+            std::unordered_map<std::string_view, ByteCodeType> result;
+            for (size_t i = 0; i < std::size(OPCODE_NAMES); i++) {
+                result.emplace(OPCODE_NAMES[i], static_cast<ByteCodeType>(i));
+            }
+            return result;
+        }();
+        struct Fixup {
+            size_t pos;
+            std::string_view label;
+            size_t line;
+        };
+
+        auto base = (uint32_t)start_offset;
+        std::vector<uint8_t> image;
+        CodeMetadata metadata;
+        std::unordered_map<std::string_view, uint32_t> labels;
+        std::vector<Fixup> fixups;
+        std::vector<std::string_view> tokens;
+        bool in_data{};
+        size_t line_no{};
+
+        auto error = [&](std::string_view msg) {
+            return std::runtime_error(std::format("line {}: {}", line_no, msg));
+        };
+        auto define_label = [&](std::string_view name) {
+            if (!labels.emplace(name, base + (uint32_t)size(image)).second) {
+                throw error(std::format("duplicate label `{}`", name));
+            }
+        };
+        auto parse_int = [&](std::string_view token, int64_t min, int64_t max) {
+            bool negative = token.starts_with('-');
+            if (negative) { token.remove_prefix(1); }
+            int radix = 10;
+            if (token.starts_with("0x") || token.starts_with("0X")) {
+                token.remove_prefix(2);
+                radix = 16;
+            }
+            int64_t v{};
+            auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), v, radix);
+            if (token.empty() || ec != std::errc{} || ptr != token.data() + token.size()) {
+                throw error(std::format("invalid number `{}`", token));
+            }
+            if (negative) { v = -v; }
+            if (v < min || v > max) {
+                throw error(std::format("{} is out of range", v));
+            }
+            return v;
+        };
+        // A number or a label
+        auto append_dword = [&](std::string_view token) {
+            uint32_t v{};
+            if (isdigit(static_cast<uint8_t>(token[0])) || token[0] == '-') {
+                v = (uint32_t)parse_int(token, INT32_MIN, UINT32_MAX);
+            }
+            else {
+                fixups.push_back({ size(image), token, line_no });
+            }
+            for (size_t i = 0; i < 4; i++) {
+                image.push_back((v >> (i * 8)) & 0xff);
+            }
+        };
+
+        while (!text.empty()) {
+            line_no++;
+            auto eol = text.find('\n');
+            auto line = text.substr(0, eol);
+            text.remove_prefix(eol == std::string_view::npos ? size(text) : eol + 1);
+            line = line.substr(0, line.find(';'));
+
+            tokens.clear();
+            for (size_t i = 0; i < size(line);) {
+                auto is_separator = [](char ch) { return ch == ' ' || ch == '\t' || ch == ',' || ch == '\r'; };
+                if (is_separator(line[i])) {
+                    i++;
+                    continue;
+                }
+                auto start = i;
+                while (i < size(line) && !is_separator(line[i])) { i++; }
+                tokens.push_back(line.substr(start, i - start));
+            }
+            if (tokens.empty()) { continue; }
+
+            auto op = tokens[0];
+            auto args = std::span(tokens).subspan(1);
+            auto expect_args = [&](size_t min, size_t max) {
+                if (size(args) < min || size(args) > max) {
+                    throw error(std::format("wrong number of operands for `{}`", op));
+                }
+            };
+            if (op.ends_with(':')) {
+                expect_args(0, 0);
+                define_label(op.substr(0, size(op) - 1));
+            }
+            else if (op == ".import") {
+                expect_args(3, 3);
+                if (args[2] != "int" && args[2] != "void") {
+                    throw error("expected `int` or `void`");
+                }
+                metadata.ffi_imports.push_back({ std::string(args[0]), (uint32_t)parse_int(args[1], 0, 256),
+                    args[2] == "int" });
+            }
+            else if (op == ".func") {
+                expect_args(1, 2);
+                if (in_data) {
+                    throw error("function in the data section");
+                }
+                define_label(args.back());
+                metadata.func_meta.push_back({ std::string(args[0]), size(image) });
+            }
+            else if (op == ".data") {
+                expect_args(0, 0);
+                if (in_data) {
+                    throw error("duplicate .data");
+                }
+                in_data = true;
+                metadata.code_size = size(image);
+            }
+            else if (op == ".align") {
+                expect_args(1, 1);
+                auto alignment = parse_int(args[0], 1, 4096);
+                if ((alignment & (alignment - 1)) != 0) {
+                    throw error("alignment is not a power of two");
+                }
+                while ((base + size(image)) % alignment != 0) {
+                    image.push_back(0);
+                }
+            }
+            else if (op == ".dword") {
+                expect_args(1, SIZE_MAX);
+                for (auto arg : args) { append_dword(arg); }
+            }
+            else if (op == ".byte") {
+                expect_args(1, SIZE_MAX);
+                for (auto arg : args) { image.push_back((uint8_t)parse_int(arg, INT8_MIN, UINT8_MAX)); }
+            }
+            else if (op == ".bss") {
+                expect_args(1, 1);
+                metadata.bss_size = (size_t)parse_int(args[0], 0, UINT32_MAX);
+            }
+            else if (auto it = opcodes.find(op); it != end(opcodes)) {
+                if (in_data) {
+                    throw error("instruction in the data section");
+                }
+                auto operand_cnt = (instruction_size(it->second) - 1) / 4;
+                expect_args(operand_cnt, operand_cnt);
+                image.push_back(it->second);
+                for (auto arg : args) { append_dword(arg); }
+            }
+            else {
+                throw error(std::format("unknown instruction `{}`", op));
+            }
+        }
+
+        for (auto const& fixup : fixups) {
+            auto it = labels.find(fixup.label);
+            if (it == end(labels)) {
+                line_no = fixup.line;
+                throw error(std::format("undefined label `{}`", fixup.label));
+            }
+            std::memcpy(&image[fixup.pos], &it->second, 4);
+        }
+        if (!in_data) {
+            metadata.code_size = size(image);
+        }
+        // Static data starts at the first dword boundary after the code
+        auto data_begin = std::min(size(image), metadata.code_size + (4 - (base + metadata.code_size) % 4) % 4);
+        metadata.data_size = size(image) - data_begin;
+        return { std::move(image), std::move(metadata) };
+    }
+}
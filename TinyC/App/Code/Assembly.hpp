@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CodeGen.hpp"
+#include "Executor.hpp"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace CTinyC {
+    // Text form of a code image, which assemble reads back into the same bytes:
+    //
+    //     .import gcd 2 int            ; host function imports, in FfiCall order
+    //     .func main                   ; function entry; `.func name label` if the
+    //         Enter 1 8                ; name is not unique
+    //     L1024:                       ; jump target
+    //         PushDisplay 1
+    //         JumpCond L1024           ; address operands may be labels
+    //         SysCall 0                ; halt
+    //     .data                        ; static data follows the code
+    //         .align 4
+    //         .dword 1, -2, 3
+    //         .byte 7
+    //     .bss 40                      ; zeroed data after the image
+    //
+    // Operands are separated by spaces or commas; `;` starts a comment.
+
+    // Name of an opcode as written in assembly, empty for invalid ones
+    std::string_view opcode_name(ByteCodeType type);
+
+    struct DisassemblyOptions {
+        // Annotate every instruction with its address; leave out to diff codegen changes
+        bool addresses{ true };
+    };
+
+    // `image` is the output of CodeGenerator::ast_to_code for `start_offset`
+    std::string disassemble(std::span<uint8_t const> image, CodeMetadata const& metadata, int start_offset,
+        DisassemblyOptions const& options = {});
+
+    // Throws runtime_error with the line number on malformed input. Of the metadata,
+    // only the functions, imports and segment sizes are filled in.
+    std::pair<std::vector<uint8_t>, CodeMetadata> assemble(std::string_view text, int start_offset);
+}
@@ -0,0 +1,142 @@
+#include "pch.h"
+
+#include "AsyncLogger.hpp"
+
+namespace CTinyC {
+    AsyncLogger::AsyncLogger(Sink sink, AsyncLoggerOptions const& options) :
+        m_sink(std::move(sink)), m_options(options), m_queue(options.queue_capacity) {
+        m_consumer = std::thread([this] { consumer_main(); });
+    }
+    AsyncLogger::~AsyncLogger() {
+        {
+            std::scoped_lock guard{ m_mutex };
+            m_stopping = true;
+        }
+        m_consumer_cv.notify_one();
+        m_consumer.join();
+    }
+
+    void AsyncLogger::log(Severity severity, ::winrt::hstring const& str) {
+        push({ severity, str });
+    }
+    void AsyncLogger::log_lazy(Severity severity, LazyMessage const& msg) {
+        push({ severity, msg });
+    }
+
+    void AsyncLogger::flush() {
+        std::unique_lock lock{ m_mutex };
+        auto target = m_queue.push_count();
+        m_flush_target = std::max(m_flush_target, target);
+        m_consumer_cv.notify_one();
+        m_flush_cv.wait(lock, [&] { return m_delivered_cnt >= target; });
+    }
+
+    void AsyncLogger::push(Record&& record) {
+        auto half_capacity = m_queue.capacity() / 2;
+        while (!m_queue.try_push(std::move(record))) {
+            if (m_options.overflow_policy == LogOverflowPolicy::Drop) {
+                if (m_dropped_cnt.fetch_add(1, std::memory_order_relaxed) % half_capacity == 0) {
+                    wake_consumer();
+                }
+                return;
+            }
+            wake_consumer();
+            std::this_thread::yield();
+        }
+        // Wake the consumer before the queue fills up, instead of at the end of the interval
+        if (m_queue.push_count() % half_capacity == 0) {
+            wake_consumer();
+        }
+    }
+    void AsyncLogger::wake_consumer() {
+        {
+            std::scoped_lock guard{ m_mutex };
+            m_wake = true;
+        }
+        m_consumer_cv.notify_one();
+    }
+
+    void AsyncLogger::consumer_main() {
+        std::unique_lock lock{ m_mutex };
+        while (true) {
+            m_consumer_cv.wait_for(lock, m_options.flush_interval, [&] {
+                return m_wake || m_stopping || m_flush_target > m_delivered_cnt;
+            });
+            m_wake = false;
+            bool stopping = m_stopping;
+            auto target = stopping ? m_queue.push_count() : m_flush_target;
+            lock.unlock();
+
+            drain();
+            // Records counted by push_count() may still be being published
+            while (m_taken_cnt < target) {
+                if (drain() == 0) { std::this_thread::yield(); }
+            }
+            auto now = std::chrono::steady_clock::now();
+            bool is_due = now - m_last_delivery >= m_options.flush_interval;
+            bool delivered = is_due || target > m_delivered_cnt;
+            if (delivered) {
+                deliver();
+                m_last_delivery = now;
+            }
+
+            lock.lock();
+            if (delivered) {
+                m_delivered_cnt = m_taken_cnt;
+                m_flush_cv.notify_all();
+            }
+            if (stopping) { break; }
+        }
+    }
+    size_t AsyncLogger::drain() {
+        // Bounded, so that producers which never stop cannot hold back delivery
+        size_t cnt{};
+        Record record;
+        while (cnt < m_queue.capacity() && m_queue.try_pop(record)) {
+            if (auto msg = std::get_if<LazyMessage>(&record.msg)) {
+                add_line(record.severity, msg->format());
+            }
+            else {
+                add_line(record.severity, std::move(std::get<::winrt::hstring>(record.msg)));
+            }
+            cnt++;
+        }
+        m_taken_cnt += cnt;
+        return cnt;
+    }
+    void AsyncLogger::add_line(Severity severity, ::winrt::hstring text) {
+        if (!m_pending.empty() && m_pending.back().severity == severity && m_pending.back().text == text) {
+            m_pending.back().repeat_cnt++;
+            return;
+        }
+        // Warnings and errors always get through
+        if (m_options.max_lines_per_flush && severity < Severity::Warn &&
+            size(m_pending) >= m_options.max_lines_per_flush
+        ) {
+            m_suppressed_cnt++;
+            return;
+        }
+        m_pending.push_back({ severity, std::move(text), 1 });
+    }
+    void AsyncLogger::deliver() {
+        if (m_suppressed_cnt > 0) {
+            m_pending.push_back({ Severity::Info,
+                ::winrt::hstring(std::format(L"... {} more message(s) not shown", m_suppressed_cnt)), 1 });
+            m_suppressed_cnt = 0;
+        }
+        auto dropped_cnt = m_dropped_cnt.load(std::memory_order_relaxed);
+        if (dropped_cnt != m_reported_dropped_cnt) {
+            m_pending.push_back({ Severity::Warn, ::winrt::hstring(std::format(
+                L"{} log message(s) dropped, the log queue was full", dropped_cnt - m_reported_dropped_cnt)), 1 });
+            m_reported_dropped_cnt = dropped_cnt;
+        }
+        if (m_pending.empty()) { return; }
+        try {
+            m_sink(m_pending);
+        }
+        catch (...) {
+            // The batch is lost, but the consumer has to keep running
+        }
+        m_pending.clear();
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Logger.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <variant>
+
+namespace CTinyC {
+    // Bounded lock-free queue for many producers (Vyukov). Every cell carries a sequence
+    // number telling whose turn it is, so a push is one CAS on the enqueue position plus
+    // a release store; producers never wait for each other.
+    template<typename T>
+    struct BoundedQueue {
+        // `capacity` is rounded up to a power of 2
+        explicit BoundedQueue(size_t capacity) {
+            size_t cap = 2;
+            while (cap < capacity) { cap *= 2; }
+            m_cells = std::make_unique<Cell[]>(cap);
+            for (size_t i = 0; i < cap; i++) {
+                m_cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+            m_mask = cap - 1;
+        }
+
+        // Returns false if the queue is full
+        bool try_push(T&& value) {
+            auto pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = m_cells[pos & m_mask];
+                auto seq = cell.seq.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        // Returns false if the queue is empty, or the next value is not published yet
+        bool try_pop(T& value) {
+            auto pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = m_cells[pos & m_mask];
+                auto seq = cell.seq.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        value = std::move(cell.value);
+                        cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        size_t capacity() const { return m_mask + 1; }
+        // Number of pushes so far, including ones still being published
+        size_t push_count() const { return m_enqueue_pos.load(std::memory_order_acquire); }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+        alignas(64) std::atomic<size_t> m_enqueue_pos{};
+        alignas(64) std::atomic<size_t> m_dequeue_pos{};
+    };
+
+    enum class LogOverflowPolicy {
+        // Discard the message; the number of lost messages is reported later
+        Drop,
+        // Wait for the consumer to make room
+        Block,
+    };
+
+    struct AsyncLoggerOptions {
+        size_t queue_capacity = 1 << 14;
+        LogOverflowPolicy overflow_policy = LogOverflowPolicy::Drop;
+        // The sink is called at most once per interval, except by flush()
+        std::chrono::milliseconds flush_interval{ 50 };
+        // Lines below Warn beyond this many per call of the sink are summarized in one
+        // line; 0 is unlimited
+        size_t max_lines_per_flush{};
+    };
+
+    struct LogLine {
+        Logger::Severity severity;
+        ::winrt::hstring text;
+        // Identical messages in a row become one line
+        size_t repeat_cnt;
+    };
+
+    // Logger for threads which must not wait on whoever displays the messages. Messages
+    // go into a bounded queue, still unformatted if they were logged with logf(); a
+    // consumer thread formats them and hands them to the sink in batches.
+    struct AsyncLogger : Logger {
+        // Called on the consumer thread
+        using Sink = std::function<void(std::span<LogLine const> lines)>;
+
+        explicit AsyncLogger(Sink sink, AsyncLoggerOptions const& options = {});
+        // Delivers the remaining messages
+        ~AsyncLogger();
+
+        void log(Severity severity, ::winrt::hstring const& str) override;
+        void log_lazy(Severity severity, LazyMessage const& msg) override;
+
+        // Blocks until every message logged before the call has reached the sink
+        void flush();
+        size_t dropped_count() const { return m_dropped_cnt.load(std::memory_order_relaxed); }
+
+    private:
+        struct Record {
+            Severity severity{};
+            std::variant<::winrt::hstring, LazyMessage> msg;
+        };
+
+        void push(Record&& record);
+        void wake_consumer();
+        void consumer_main();
+        // Moves up to one queue worth of records into m_pending, returns number taken
+        size_t drain();
+        void add_line(Severity severity, ::winrt::hstring text);
+        void deliver();
+
+        Sink m_sink;
+        AsyncLoggerOptions m_options;
+        BoundedQueue<Record> m_queue;
+        std::atomic<size_t> m_dropped_cnt{};
+
+        // Consumer thread only
+        std::vector<LogLine> m_pending;
+        size_t m_suppressed_cnt{};
+        size_t m_reported_dropped_cnt{};
+        size_t m_taken_cnt{};
+        std::chrono::steady_clock::time_point m_last_delivery{};
+
+        std::mutex m_mutex;
+        std::condition_variable m_consumer_cv, m_flush_cv;
+        bool m_wake{}, m_stopping{};
+        // Records (by push count) that must be delivered before flush() returns
+        size_t m_flush_target{};
+        size_t m_delivered_cnt{};
+
+        std::thread m_consumer;
+    };
+}
@@ -6,6 +6,8 @@
 #include "Executor.hpp"
 
 #include <ranges>
+#include <unordered_map>
+#include <unordered_set>
 
 #define slogsrc(token, ...) logsrc(L"<source>", (token).line, (token).column, __VA_ARGS__)
 
@@ -19,12 +21,26 @@ namespace CTinyC {
         std::vector<ASTData_Param> const* params;
         int code_offset;
         BlockFrame* associated_frame{};
+        // Number of enclosing functions, i.e. the display slot of this function
+        int depth{};
+        // Builtins are replaced by a user function and shadowed by a variable of the same name
+        bool is_builtin{};
+        // Counts as a call to a user function for loop optimizations (see BuiltinFunc)
+        bool is_opaque{};
+        // Index into the functions of the debug info
+        size_t debug_index{};
+    };
+    enum class IdStorage {
+        Stack,
+        Data,       // Initialized global, offset into data segment
+        Bss,        // Zero-initialized global, offset into bss segment
     };
     struct IdEntry {
         std::string name;
         ASTData_Type const* type;
         int offset;
         bool is_param_arr{};
+        IdStorage storage{ IdStorage::Stack };
     };
     struct BlockFrame {
         BlockFrame* parent{};
@@ -32,12 +48,169 @@ namespace CTinyC {
         int cur_sp{};
         FuncEntry* func_ctx{};
     };
+    // Hidden stack slot created by loop optimizations
+    struct LoopTemp {
+        BlockFrame* frame;
+        IdEntry* entry;
+    };
 
     static ASTData_Type g_type_int{ ASTData_Type_Int{} };
     static ASTData_Type g_type_void{ ASTData_Type_Void{} };
+    // Parameter lists of builtins and host functions, indexed by their number of int parameters
+    static auto const g_int_params = [] {
+        std::array<std::vector<ASTData_Param>, FFI_MAX_PARAMS + 1> lists;
+        for (size_t n = 0; n < size(lists); n++) {
+            for (size_t i = 0; i < n; i++) {
+                lists[n].push_back({ { ASTData_Type_Int{} }, { TokenType::Identifier, std::format("arg{}", i), 0, 0 }, false });
+            }
+        }
+        return lists;
+    }();
+
+    // Builtin functions. Each is a thin wrapper around one instruction (with a syscall ID
+    // for SysCall), which finds the arguments on the stack with the first one on top.
+    struct BuiltinFunc {
+        char const* name;
+        bool returns_int;
+        uint32_t param_cnt;
+        ByteCodeType opcode;
+        uint32_t syscall_id{};
+        // Other threads may have written any variable once it returns
+        bool is_opaque{};
+    };
+    constexpr BuiltinFunc g_builtin_funcs[] = {
+        { "input", true, 0, ByteCodeType::SysCall, 3 },
+        { "output", false, 1, ByteCodeType::SysCall, 4 },
+        { "malloc", true, 1, ByteCodeType::SysCall, 5 },
+        { "free", false, 1, ByteCodeType::SysCall, 6 },
+        { "realloc", true, 2, ByteCodeType::SysCall, 7 },
+        // Dword access to heap memory: peek(addr), poke(addr, value)
+        { "peek", true, 1, ByteCodeType::ReadRefDword },
+        { "poke", false, 2, ByteCodeType::WriteRefDword },
+        // Bulk operations on `n` ints starting at an address (an array name or a pointer):
+        // memset(dst, value, n), memcpy(dst, src, n), memcmp(a, b, n), sum / min / max(arr, n)
+        { "memset", false, 3, ByteCodeType::MemSet },
+        { "memcpy", false, 3, ByteCodeType::MemCopy },
+        { "memcmp", true, 3, ByteCodeType::MemCompare },
+        { "sum", true, 2, ByteCodeType::ReduceSum },
+        { "min", true, 2, ByteCodeType::ReduceMin },
+        { "max", true, 2, ByteCodeType::ReduceMax },
+        // Threads: spawn(func, arg) runs func(arg) on a new thread and returns its id,
+        // join(id) waits for it to end and returns its result
+        { "spawn", true, 2, ByteCodeType::SysCall, 8, true },
+        { "join", true, 1, ByteCodeType::SysCall, 9, true },
+        // atomic_add(addr, delta), atomic_cas(addr, expected, desired); both return the old value
+        { "atomic_add", true, 2, ByteCodeType::SysCall, 10 },
+        { "atomic_cas", true, 3, ByteCodeType::SysCall, 11 },
+    };
+
+    // Collects what a while loop reads and writes, so that the code generator can
+    // tell which expressions stay the same across iterations. Everything recorded
+    // here is name-based and deliberately conservative.
+    struct LoopScanVisitor : ASTN_DeclVisitor, ASTN_ExprVisitor, ASTN_StmtVisitor {
+        explicit LoopScanVisitor(std::list<FuncEntry> const& funcs) : m_funcs(funcs) {}
+
+        void add_root(ASTN_Expr const& expr) {
+            // Expressions inside nested function bodies are not evaluated by the loop itself
+            if (m_nested_func_depth == 0) {
+                roots.push_back(&expr);
+            }
+            expr.accept(*this);
+        }
+
+        void visit_var_decl(ASTN_VarDecl const& v) override {
+            declared.insert(v.id.str);
+        }
+        void visit_func_decl(ASTN_FuncDecl const& v) override {
+            declared.insert(v.id.str);
+            for (auto const& param : v.params) {
+                declared.insert(param.param.str);
+            }
+            if (v.body) {
+                m_nested_func_depth++;
+                v.body->accept(*this);
+                m_nested_func_depth--;
+            }
+        }
+        void visit_expr_stmt(ASTN_ExprStmt const& v) override {
+            add_root(*v.expr);
+        }
+        void visit_if_stmt(ASTN_IfStmt const& v) override {
+            add_root(*v.cond);
+            v.body->accept(*this);
+            if (v.else_body) {
+                v.else_body->accept(*this);
+            }
+        }
+        void visit_while_stmt(ASTN_WhileStmt const& v) override {
+            add_root(*v.cond);
+            v.body->accept(*this);
+        }
+        void visit_return_stmt(ASTN_ReturnStmt const& v) override {
+            if (v.expr) {
+                add_root(*v.expr);
+            }
+        }
+        void visit_compound_stmt(ASTN_CompoundStmt const& v) override {
+            for (auto const& decl : v.decls) {
+                decl->accept(*this);
+            }
+            for (auto const& stmt : v.stmts) {
+                stmt->accept(*this);
+            }
+        }
+        void visit_id_expr(ASTN_IdExpr const& v) override {
+            if (!v.arridxs.empty() && m_nested_func_depth == 0) {
+                array_accesses.push_back(&v);
+            }
+            for (auto const& idx : v.arridxs) {
+                idx->accept(*this);
+            }
+        }
+        void visit_binary_expr(ASTN_BinaryExpr const& v) override {
+            if (v.op.type == TokenType::Assign) {
+                // Element writes are not tracked: array elements are never treated
+                // as invariant, since array parameters may alias any array
+                auto id = dynamic_cast<ASTN_IdExpr const*>(v.left.get());
+                if (id && id->arridxs.empty()) {
+                    write_cnt[id->id.str]++;
+                }
+            }
+            v.left->accept(*this);
+            v.right->accept(*this);
+        }
+        void visit_unary_expr(ASTN_UnaryExpr const& v) override {
+            v.right->accept(*this);
+        }
+        void visit_call_expr(ASTN_CallExpr const& v) override {
+            auto callee = dynamic_cast<ASTN_IdExpr const*>(v.callee.get());
+            // Builtins only write array elements and heap memory, never scalar
+            // variables; anything else may write through the display or array parameters
+            auto func = callee ? std::ranges::find(m_funcs, callee->id.str, &FuncEntry::name) : end(m_funcs);
+            if (func == end(m_funcs) || !func->is_builtin || func->is_opaque) {
+                has_user_call = true;
+            }
+            v.callee->accept(*this);
+            for (auto const& arg : v.args) {
+                arg->accept(*this);
+            }
+        }
+        void visit_literal_expr(ASTN_LiteralExpr const& v) override {}
+
+        std::unordered_set<std::string> declared;
+        std::unordered_map<std::string, int> write_cnt;
+        std::vector<ASTN_Expr const*> roots;
+        std::vector<ASTN_IdExpr const*> array_accesses;
+        bool has_user_call{};
+
+    private:
+        std::list<FuncEntry> const& m_funcs;
+        int m_nested_func_depth{};
+    };
 
     struct CodeGenAstVisitor : ASTN_Visitor, ASTN_DeclVisitor, ASTN_ExprVisitor, ASTN_StmtVisitor {
-        CodeGenAstVisitor(Logger* logger, int start_offset) : m_logger(logger), m_start_offset(start_offset) {
+        CodeGenAstVisitor(Logger* logger, int start_offset, FfiRegistry const* ffi_registry) :
+            m_logger(logger), m_start_offset(start_offset), m_ffi_registry(ffi_registry) {
             m_frames.push_back({});
 
             m_bytes.reserve(1024 * 64);
@@ -45,27 +218,66 @@ namespace CTinyC {
 
         void start(ASTN const& root_node) {
             // Add builtin functions
-            {
-                m_funcs.push_back({ "input", &g_type_int, nullptr, (int)size(m_bytes) });
-                append_byte(ByteCodeType::DuplicateDword);
-                append_byte(ByteCodeType::PopDword);
-                append_byte(ByteCodeType::PopDword);
-                append_byte(ByteCodeType::SysCall);
-                append_dword(3);
-                append_byte(ByteCodeType::AdjustStackRefConst);
-                append_dword(-4);
-                append_byte(ByteCodeType::Ret);
-                m_funcs.push_back({ "output", &g_type_void, nullptr, (int)size(m_bytes) });
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(8);
-                append_byte(ByteCodeType::ReadRefDword);
-                append_byte(ByteCodeType::SysCall);
-                append_dword(4);
-                append_byte(ByteCodeType::Ret);
+            for (auto const& builtin : g_builtin_funcs) {
+                m_funcs.push_back({ builtin.name, builtin.returns_int ? &g_type_int : &g_type_void,
+                    &g_int_params[builtin.param_cnt], (int)size(m_bytes) });
+                m_funcs.back().is_builtin = true;
+                m_funcs.back().is_opaque = builtin.is_opaque;
+                auto args_size = (int32_t)builtin.param_cnt * 4;
+                if (builtin.opcode == ByteCodeType::WriteRefDword) {
+                    // poke: address, then value on top
+                    append_byte(ByteCodeType::PushStackRef);
+                    macro_add_imm(4);
+                    append_byte(ByteCodeType::ReadRefDword);
+                    append_byte(ByteCodeType::PushStackRef);
+                    macro_add_imm(12);
+                    append_byte(ByteCodeType::ReadRefDword);
+                    append_byte(ByteCodeType::WriteRefDword);
+                }
+                else {
+                    // Pushing the arguments last to first keeps each at the same distance from sp
+                    for (uint32_t i = 0; i < builtin.param_cnt; i++) {
+                        append_byte(ByteCodeType::PushStackRef);
+                        macro_add_imm(args_size);
+                        append_byte(ByteCodeType::ReadRefDword);
+                    }
+                    append_byte(builtin.opcode);
+                    if (builtin.opcode == ByteCodeType::SysCall) {
+                        append_dword(builtin.syscall_id);
+                    }
+                }
+                append_byte(builtin.returns_int ? ByteCodeType::RetDword : ByteCodeType::Ret);
+                append_dword(args_size);
+            }
+            // Host functions, each behind a stub importing it; they act like builtins
+            for (auto const& func : m_ffi_registry ? m_ffi_registry->functions() : std::span<FfiFunction const>{}) {
+                if (global_find_func(func.name)) { continue; }
+                m_funcs.push_back({ func.name, func.returns_int ? &g_type_int : &g_type_void,
+                    &g_int_params[func.param_cnt], (int)size(m_bytes) });
+                m_funcs.back().is_builtin = true;
+                append_byte(ByteCodeType::FfiCall);
+                append_dword((uint32_t)size(m_code_meta.ffi_imports));
+                append_byte(func.returns_int ? ByteCodeType::RetDword : ByteCodeType::Ret);
+                append_dword(func.param_cnt * 4);
+                m_code_meta.ffi_imports.push_back({ func.name, func.param_cnt, func.returns_int });
             }
 
             root_node.accept(*this);
 
+            // Link static data after code, dword aligned for the atomic builtins
+            m_code_meta.code_size = size(m_bytes);
+            while (get_cur_code_pos() % 4 != 0) {
+                append_byte(ByteCodeType::DebugInterrupt);
+            }
+            m_code_meta.data_size = size(m_data);
+            m_code_meta.bss_size = m_bss_size;
+            auto data_base = get_cur_code_pos();
+            for (auto const& [pos, storage] : m_static_fixups) {
+                auto seg_base = data_base + (storage == IdStorage::Bss ? (uint32_t)size(m_data) : 0);
+                write_dword(pos, read_dword(pos) + seg_base);
+            }
+            m_bytes.insert(end(m_bytes), begin(m_data), end(m_data));
+
             // Write metadata
             for (auto const& func_info : m_funcs) {
                 if (func_info.code_offset < 0) { continue; }
@@ -76,6 +288,9 @@ namespace CTinyC {
 
         std::vector<uint8_t> m_bytes;
         CodeMetadata m_code_meta;
+        // Set by CodeGenerator before start()
+        CancellationToken m_cancellation;
+        CompileProgressFn m_on_progress;
 
     private:
         IdEntry* frame_find_id(BlockFrame& frame, std::string_view name) {
@@ -92,6 +307,14 @@ namespace CTinyC {
             }
             return &*it;
         }
+        // The function an identifier refers to, if it is not a variable shadowing a builtin
+        FuncEntry* find_func(std::string_view name) {
+            auto entry = global_find_func(name);
+            if (entry && entry->is_builtin && find_id(name).first) {
+                return nullptr;
+            }
+            return entry;
+        }
         uint32_t get_cur_code_pos() const {
             return static_cast<uint32_t>(size(m_bytes) + m_start_offset);
         }
@@ -183,6 +406,13 @@ namespace CTinyC {
             }
             return write_start;
         }
+        int32_t read_dword(size_t pos) const {
+            uint32_t v{};
+            for (int i = 3; i >= 0; i--) {
+                v = (v << 8) | m_bytes[pos + i];
+            }
+            return static_cast<int32_t>(v);
+        }
         void write_dword(size_t pos, int32_t v) {
             for (int i = 0; i < 4; i++) {
                 m_bytes[pos] = static_cast<uint8_t>(v);
@@ -196,14 +426,388 @@ namespace CTinyC {
             append_dword(imm);
             append_byte(ByteCodeType::Add);
         }
+        static int32_t func_args_size(FuncEntry const& func) {
+            return 4 * (int32_t)func.params->size();
+        }
         void macro_adjust_sp(int32_t imm) {
             append_byte(ByteCodeType::AdjustStackRefConst);
             append_dword(imm);
         }
 
+        // Pushes the base address of `target` (plus `extra`), which must be the current
+        // frame or one of its ancestors. Blocks of the same function sit at distances
+        // known at compile time; frames of enclosing functions are found through the
+        // display, which holds the active frame of every nesting depth.
+        void macro_push_frame_base(BlockFrame const* target, int32_t extra = 0) {
+            BlockFrame const* fp = &m_frames.back();
+            int32_t imm = fp->cur_sp;
+            for (; fp != target && !fp->func_ctx; fp = fp->parent) {
+                if (!fp->parent) {
+                    throw std::runtime_error("frame is not accessible from current scope");
+                }
+                imm += fp->parent->cur_sp;
+            }
+            if (fp == target) {
+                append_byte(ByteCodeType::PushStackRef);
+                if (imm + extra != 0) {
+                    macro_add_imm(imm + extra);
+                }
+                return;
+            }
+
+            // Locate the function frame owning `target`
+            imm = 0;
+            for (fp = target; !fp->func_ctx; fp = fp->parent) {
+                if (!fp->parent) {
+                    throw std::runtime_error("frame is not accessible from current scope");
+                }
+                imm -= fp->parent->cur_sp;
+            }
+            if (!is_frame_visible(fp)) {
+                throw std::runtime_error("frame is not accessible from current scope");
+            }
+            append_byte(ByteCodeType::PushDisplay);
+            append_dword(fp->func_ctx->depth);
+            if (imm + extra != 0) {
+                macro_add_imm(imm + extra);
+            }
+        }
+        // Records that the code from here on belongs to `line`
+        void mark_line(int line) {
+            auto& lines = m_code_meta.debug_info.lines;
+            auto addr = get_cur_code_pos();
+            if (!lines.empty() && lines.back().addr == addr) {
+                lines.back().line = line;
+                return;
+            }
+            lines.push_back({ addr, line });
+        }
+        DebugInfo::Function& debug_func_of(BlockFrame const& frame) {
+            auto fp = &frame;
+            while (!fp->func_ctx) { fp = fp->parent; }
+            return m_code_meta.debug_info.funcs[fp->func_ctx->debug_index];
+        }
+        // Describes a stack variable declared in `frame`; its scope is set once the block ends
+        void add_debug_var(BlockFrame const& frame, IdEntry const& entry, int32_t count) {
+            // Same walk as macro_push_frame_base: blocks sit below their parent's locals
+            auto frame_offset = entry.offset;
+            for (auto fp = &frame; !fp->func_ctx; fp = fp->parent) {
+                frame_offset += fp->parent->cur_sp;
+            }
+            debug_func_of(frame).vars.push_back({ entry.name, frame_offset, (uint32_t)count,
+                PENDING_FIXUP, PENDING_FIXUP });
+        }
+        bool is_frame_visible(BlockFrame const* target) const {
+            for (auto const& frame : m_frames) {
+                if (&frame == target) { return true; }
+            }
+            return false;
+        }
+        int cur_func_depth() const {
+            int depth{};
+            for (auto const& frame : m_frames) {
+                if (frame.func_ctx) { depth++; }
+            }
+            return depth;
+        }
+        std::pair<IdEntry*, BlockFrame*> find_id(std::string_view name) {
+            for (auto& frame : m_frames | std::views::reverse) {
+                if (auto id_entry = frame_find_id(frame, name)) {
+                    return { id_entry, &frame };
+                }
+            }
+            return {};
+        }
+        // Pushes the address of a variable (plus `extra`) declared in `frame`
+        void macro_push_id_addr(BlockFrame const* frame, IdEntry const& entry, int32_t extra = 0) {
+            if (entry.storage == IdStorage::Stack) {
+                macro_push_frame_base(frame, extra - entry.offset);
+                return;
+            }
+            // Segment offset for now, relocated once code size is known
+            append_byte(ByteCodeType::PushDword);
+            m_static_fixups.emplace_back(append_dword(entry.offset + extra), entry.storage);
+        }
+        void macro_load_loop_temp(LoopTemp const& temp) {
+            macro_push_frame_base(temp.frame, -temp.entry->offset);
+            append_byte(ByteCodeType::ReadRefDword);
+            m_frames.back().cur_sp += 4;
+        }
+
+        // Loop optimizations work on the AST right before a while loop is emitted:
+        // * invariant arithmetic is evaluated once into hidden stack slots;
+        // * array indices affine in an induction variable `i = i +/- c` are kept
+        //   pre-scaled by the element size and bumped after each increment.
+        // Only scalar variables count as invariant; array elements never do, since
+        // any element write (or array parameter) may alias them.
+        struct LoopTempMark {
+            int32_t cur_sp;
+            size_t ids_cnt;
+            std::vector<ASTN_Expr const*> exprs{};
+            std::vector<ASTN_Stmt const*> stmts{};
+        };
+        bool is_loop_invariant_var(LoopScanVisitor const& scan, ASTN_IdExpr const& v) {
+            if (!v.arridxs.empty() || scan.has_user_call) { return false; }
+            auto const& name = v.id.str;
+            if (scan.declared.contains(name) || scan.write_cnt.contains(name)) { return false; }
+            if (find_func(name)) { return false; }
+            auto id_entry = find_id(name).first;
+            return id_entry && !std::get_if<ASTData_Type_Array>(&id_entry->type->t);
+        }
+        // Returns c such that expr == c * iv + (loop invariant), if any. Pass an empty
+        // `iv` to test plain invariance (result 0). Arithmetic wraps like the VM does.
+        std::optional<uint32_t> affine_coef(LoopScanVisitor const& scan, ASTN_Expr const& expr, std::string_view iv) {
+            if (auto v = dynamic_cast<ASTN_LiteralExpr const*>(&expr)) {
+                if (v->value.type != TokenType::IntLiteral) { return std::nullopt; }
+                return 0;
+            }
+            if (auto v = dynamic_cast<ASTN_IdExpr const*>(&expr)) {
+                if (v->arridxs.empty() && !iv.empty() && v->id.str == iv) { return 1; }
+                if (is_loop_invariant_var(scan, *v)) { return 0; }
+                return std::nullopt;
+            }
+            auto v = dynamic_cast<ASTN_BinaryExpr const*>(&expr);
+            if (!v) { return std::nullopt; }
+            auto l = affine_coef(scan, *v->left, iv);
+            auto r = affine_coef(scan, *v->right, iv);
+            if (!l || !r) { return std::nullopt; }
+            auto literal_of = [](ASTN_Expr const& e) -> std::optional<uint32_t> {
+                auto lit = dynamic_cast<ASTN_LiteralExpr const*>(&e);
+                if (!lit) { return std::nullopt; }
+                return static_cast<uint32_t>(std::atoll(lit->value.str.c_str()));
+            };
+            switch (v->op.type) {
+            case TokenType::Plus:
+                return *l + *r;
+            case TokenType::Minus:
+                return *l - *r;
+            case TokenType::Star:
+                if (*l == 0 && *r == 0) { return 0; }
+                if (auto c = literal_of(*v->left)) { return *c * *r; }
+                if (auto c = literal_of(*v->right)) { return *l * *c; }
+                return std::nullopt;
+            case TokenType::LessEqual:
+            case TokenType::GreaterEqual:
+            case TokenType::LChevron:
+            case TokenType::RChevron:
+            case TokenType::Equal:
+            case TokenType::NotEqual:
+                if (*l == 0 && *r == 0) { return 0; }
+                return std::nullopt;
+            default:
+                // Division may trap, so it is never moved out of its original place
+                return std::nullopt;
+            }
+        }
+        // Textual key of a side-effect-free expression, used to merge identical ones
+        static std::optional<std::string> pure_expr_key(ASTN_Expr const& expr) {
+            if (auto v = dynamic_cast<ASTN_LiteralExpr const*>(&expr)) {
+                return v->value.str;
+            }
+            if (auto v = dynamic_cast<ASTN_IdExpr const*>(&expr)) {
+                std::string key = v->id.str;
+                for (auto const& idx : v->arridxs) {
+                    auto idx_key = pure_expr_key(*idx);
+                    if (!idx_key) { return std::nullopt; }
+                    key += "[" + *idx_key + "]";
+                }
+                return key;
+            }
+            if (auto v = dynamic_cast<ASTN_BinaryExpr const*>(&expr)) {
+                if (v->op.type == TokenType::Assign) { return std::nullopt; }
+                auto l = pure_expr_key(*v->left);
+                auto r = pure_expr_key(*v->right);
+                if (!l || !r) { return std::nullopt; }
+                return "(" + *l + v->op.str + *r + ")";
+            }
+            return std::nullopt;
+        }
+        // Rough instruction count of evaluating a pure expression
+        static int expr_cost(ASTN_Expr const& expr) {
+            if (auto v = dynamic_cast<ASTN_BinaryExpr const*>(&expr)) {
+                return expr_cost(*v->left) + expr_cost(*v->right) + 1;
+            }
+            if (dynamic_cast<ASTN_IdExpr const*>(&expr)) {
+                return 4;
+            }
+            return 1;
+        }
+        void collect_invariant_exprs(LoopScanVisitor const& scan, ASTN_Expr const& expr,
+            std::vector<std::pair<std::string, std::vector<ASTN_Expr const*>>>& out)
+        {
+            if (m_loop_temps.contains(&expr) || m_scaled_idx_temps.contains(&expr)) { return; }
+            if (auto v = dynamic_cast<ASTN_BinaryExpr const*>(&expr)) {
+                if (v->op.type != TokenType::Assign && expr_cost(expr) > 4 &&
+                    affine_coef(scan, expr, {}) == 0u)
+                {
+                    auto key = *pure_expr_key(expr);
+                    auto it = std::ranges::find(out, key, [](auto const& p) { return p.first; });
+                    if (it == end(out)) {
+                        out.push_back({ key, {} });
+                        it = std::prev(end(out));
+                    }
+                    it->second.push_back(&expr);
+                    return;
+                }
+                collect_invariant_exprs(scan, *v->left, out);
+                collect_invariant_exprs(scan, *v->right, out);
+            }
+            else if (auto v = dynamic_cast<ASTN_IdExpr const*>(&expr)) {
+                for (auto const& idx : v->arridxs) {
+                    collect_invariant_exprs(scan, *idx, out);
+                }
+            }
+            else if (auto v = dynamic_cast<ASTN_CallExpr const*>(&expr)) {
+                for (auto const& arg : v->args) {
+                    collect_invariant_exprs(scan, *arg, out);
+                }
+            }
+            else if (auto v = dynamic_cast<ASTN_UnaryExpr const*>(&expr)) {
+                collect_invariant_exprs(scan, *v->right, out);
+            }
+        }
+        LoopTempMark optimize_loop(ASTN_WhileStmt const& v) {
+            auto& cur_frame = m_frames.back();
+            LoopTempMark mark{ cur_frame.cur_sp, cur_frame.ids.size() };
+
+            LoopScanVisitor scan{ m_funcs };
+            scan.add_root(*v.cond);
+            v.body->accept(scan);
+
+            auto push_temp = [&](ASTN_Expr const& expr, bool scale) {
+                expr.accept(*this);
+                convert_id_expr_to_rvalue();
+                if (scale) {
+                    append_byte(ByteCodeType::PushDword);
+                    append_dword(4);
+                    append_byte(ByteCodeType::Mul);
+                }
+                cur_frame.ids.push_back({ "", &g_type_int, cur_frame.cur_sp });
+                return LoopTemp{ &cur_frame, &cur_frame.ids.back() };
+            };
+
+            // Find basic induction variables among top-level statements
+            struct InductionVar {
+                ASTN_Stmt const* stmt;
+                uint32_t step;
+            };
+            std::unordered_map<std::string, InductionVar> ivs;
+            std::vector<ASTN_Stmt const*> top_stmts{ v.body.get() };
+            if (auto body = dynamic_cast<ASTN_CompoundStmt const*>(v.body.get())) {
+                top_stmts.clear();
+                for (auto const& stmt : body->stmts) {
+                    top_stmts.push_back(stmt.get());
+                }
+            }
+            for (auto stmt : top_stmts) {
+                auto expr_stmt = dynamic_cast<ASTN_ExprStmt const*>(stmt);
+                if (!expr_stmt) { continue; }
+                auto assign = dynamic_cast<ASTN_BinaryExpr const*>(expr_stmt->expr.get());
+                if (!assign || assign->op.type != TokenType::Assign) { continue; }
+                auto lhs = dynamic_cast<ASTN_IdExpr const*>(assign->left.get());
+                if (!lhs || !lhs->arridxs.empty() || scan.has_user_call) { continue; }
+                auto const& name = lhs->id.str;
+                if (scan.declared.contains(name) || scan.write_cnt[name] != 1 || find_func(name)) { continue; }
+                auto id_entry = find_id(name).first;
+                if (!id_entry || id_entry->is_param_arr || !std::get_if<ASTData_Type_Int>(&id_entry->type->t)) { continue; }
+                // Only `i = i + c`, `i = c + i` and `i = i - c`
+                auto rhs = dynamic_cast<ASTN_BinaryExpr const*>(assign->right.get());
+                if (!rhs || (rhs->op.type != TokenType::Plus && rhs->op.type != TokenType::Minus)) { continue; }
+                auto is_self = [&](ASTN_Expr const& e) {
+                    auto id = dynamic_cast<ASTN_IdExpr const*>(&e);
+                    return id && id->arridxs.empty() && id->id.str == name;
+                };
+                auto literal_of = [](ASTN_Expr const& e) -> std::optional<uint32_t> {
+                    auto lit = dynamic_cast<ASTN_LiteralExpr const*>(&e);
+                    if (!lit || lit->value.type != TokenType::IntLiteral) { return std::nullopt; }
+                    return static_cast<uint32_t>(std::atoll(lit->value.str.c_str()));
+                };
+                std::optional<uint32_t> step;
+                if (is_self(*rhs->left)) {
+                    step = literal_of(*rhs->right);
+                    if (step && rhs->op.type == TokenType::Minus) { *step = 0u - *step; }
+                }
+                else if (rhs->op.type == TokenType::Plus && is_self(*rhs->right)) {
+                    step = literal_of(*rhs->left);
+                }
+                if (step) {
+                    ivs.emplace(name, InductionVar{ stmt, *step });
+                }
+            }
+
+            // Strength-reduce scaled array indices; a pre-scaled slot costs one load
+            // per use plus one update per iteration
+            const int SR_UPDATE_COST = 8;
+            struct ScaledIndex {
+                std::vector<ASTN_Expr const*> uses;
+                InductionVar const* iv;
+                uint32_t coef;
+            };
+            std::vector<std::pair<std::string, ScaledIndex>> scaled_idxs;
+            for (auto access : scan.array_accesses) {
+                if (access->arridxs.size() != 1) { continue; }
+                auto const& idx = *access->arridxs[0];
+                for (auto const& [iv_name, iv] : ivs) {
+                    auto coef = affine_coef(scan, idx, iv_name);
+                    if (!coef || *coef == 0) { continue; }
+                    auto key = *pure_expr_key(idx);
+                    auto it = std::ranges::find(scaled_idxs, key, [](auto const& p) { return p.first; });
+                    if (it == end(scaled_idxs)) {
+                        scaled_idxs.push_back({ key, { {}, &iv, *coef } });
+                        it = std::prev(end(scaled_idxs));
+                    }
+                    it->second.uses.push_back(&idx);
+                    break;
+                }
+            }
+            for (auto const& [key, scaled] : scaled_idxs) {
+                auto saving = (int)size(scaled.uses) * (expr_cost(*scaled.uses[0]) - 2);
+                if (saving <= SR_UPDATE_COST) { continue; }
+                auto temp = push_temp(*scaled.uses[0], true);
+                for (auto use : scaled.uses) {
+                    m_scaled_idx_temps[use] = temp;
+                    mark.exprs.push_back(use);
+                }
+                m_iv_updates[scaled.iv->stmt].push_back({ temp, 4 * scaled.coef * scaled.iv->step });
+                mark.stmts.push_back(scaled.iv->stmt);
+            }
+
+            // Hoist maximal invariant subexpressions worth more than a slot load
+            std::vector<std::pair<std::string, std::vector<ASTN_Expr const*>>> hoisted;
+            for (auto root : scan.roots) {
+                collect_invariant_exprs(scan, *root, hoisted);
+            }
+            for (auto const& [key, exprs] : hoisted) {
+                auto temp = push_temp(*exprs[0], false);
+                for (auto expr : exprs) {
+                    m_loop_temps[expr] = temp;
+                    mark.exprs.push_back(expr);
+                }
+            }
+
+            return mark;
+        }
+        void release_loop_temps(LoopTempMark const& mark) {
+            auto& cur_frame = m_frames.back();
+            for (auto expr : mark.exprs) {
+                m_loop_temps.erase(expr);
+                m_scaled_idx_temps.erase(expr);
+            }
+            for (auto stmt : mark.stmts) {
+                m_iv_updates.erase(stmt);
+            }
+            while (cur_frame.cur_sp > mark.cur_sp) {
+                append_byte(ByteCodeType::PopDword);
+                cur_frame.cur_sp -= 4;
+            }
+            cur_frame.ids.resize(mark.ids_cnt);
+        }
+
         void visit_decl_list(ASTN_DeclList const& v) override {
-            for (auto const& decl : v.decls) {
-                decl->accept(*this);
+            for (size_t i = 0; i < size(v.decls); i++) {
+                m_cancellation.throw_if_cancelled();
+                v.decls[i]->accept(*this);
+                if (m_on_progress) { m_on_progress(CompilePhase::CodeGen, (double)(i + 1) / size(v.decls)); }
             }
         }
         void visit_var_decl(ASTN_VarDecl const& v) override {
@@ -214,23 +818,63 @@ namespace CTinyC {
             if (std::get_if<ASTData_Type_Void>(&v.type.t)) {
                 throw std::runtime_error("invalid variable type");
             }
+            if (!cur_frame.parent) {
+                // Global variables live in the static data segments
+                int32_t count{ 1 };
+                if (auto t = std::get_if<ASTData_Type_Array>(&v.type.t)) {
+                    if (!std::get_if<ASTData_Type_Int>(&t->inner->t)) {
+                        throw std::runtime_error("array element must be of type int");
+                    }
+                    count = evaluate_constant_expr(*t->dimension);
+                }
+                if (count <= 0) {
+                    throw std::runtime_error("array size must be positive");
+                }
+                if ((int32_t)v.init_values.size() > count) {
+                    throw std::runtime_error("too many initializers");
+                }
+                if (v.init_values.empty()) {
+                    cur_frame.ids.push_back({ v.id.str, &v.type, m_bss_size, false, IdStorage::Bss });
+                    m_bss_size += 4 * count;
+                    return;
+                }
+                cur_frame.ids.push_back({ v.id.str, &v.type, (int)size(m_data), false, IdStorage::Data });
+                for (int32_t i = 0; i < count; i++) {
+                    uint32_t value = i < (int32_t)v.init_values.size() ?
+                        evaluate_constant_expr(*v.init_values[i]) : 0;
+                    for (int j = 0; j < 4; j++) {
+                        m_data.push_back(static_cast<uint8_t>(value));
+                        value >>= 8;
+                    }
+                }
+                return;
+            }
+            if (!v.init_values.empty()) {
+                throw std::runtime_error("initializers are only supported for global variables");
+            }
             if (auto t = std::get_if<ASTData_Type_Array>(&v.type.t)) {
                 if (!std::get_if<ASTData_Type_Int>(&t->inner->t)) {
                     throw std::runtime_error("array element must be of type int");
                 }
-                cur_frame.cur_sp += 4 * evaluate_constant_expr(*t->dimension);
+                auto count = evaluate_constant_expr(*t->dimension);
+                cur_frame.cur_sp += 4 * count;
                 cur_frame.ids.push_back({ v.id.str, &v.type, cur_frame.cur_sp });
+                add_debug_var(cur_frame, cur_frame.ids.back(), count);
             }
             else {
                 // Assume int
                 cur_frame.cur_sp += 4;
                 cur_frame.ids.push_back({ v.id.str, &v.type, cur_frame.cur_sp });
+                add_debug_var(cur_frame, cur_frame.ids.back(), 0);
             }
         }
         void visit_func_decl(ASTN_FuncDecl const& v) override {
             if (std::get_if<ASTData_Type_Array>(&v.ret_type.t)) {
                 throw std::runtime_error("invalid function return type");
             }
+            if (auto entry = global_find_func(v.id.str); entry && entry->is_builtin) {
+                m_funcs.remove_if([&](FuncEntry const& f) { return &f == entry; });
+            }
             if (auto entry = global_find_func(v.id.str)) {
                 if (*entry->ret_type != v.ret_type || *entry->params != v.params) {
                     throw std::runtime_error("function signature mismatch");
@@ -249,29 +893,58 @@ namespace CTinyC {
             m_funcs.push_back({ v.id.str, &v.ret_type, &v.params, code_offset });
             auto& cur_func = m_funcs.back();
             if (v.body) {
+                cur_func.associated_frame = &m_frames.back();
+                cur_func.depth = cur_func_depth();
+                if (cur_func.depth >= (int)DISPLAY_DEPTH) {
+                    throw std::runtime_error("functions are nested too deeply");
+                }
+
                 // For nested functions, add jumps and fix pos
                 append_byte(ByteCodeType::Jump);
                 auto fixup_pos = append_dword(PENDING_FIXUP);
                 cur_func.code_offset = (int)size(m_bytes);
+                auto& debug_funcs = m_code_meta.debug_info.funcs;
+                cur_func.debug_index = size(debug_funcs);
+                debug_funcs.push_back({ v.id.str, get_cur_code_pos(), 0, cur_func.depth, {} });
                 v.body->accept(*this);
+                debug_funcs[cur_func.debug_index].end = get_cur_code_pos();
                 write_dword(fixup_pos, get_cur_code_pos());
-
-                cur_func.associated_frame = &m_frames.back();
             }
         }
         void visit_expr_stmt(ASTN_ExprStmt const& v) override {
             auto& cur_frame = m_frames.back();
             auto old_sp = cur_frame.cur_sp;
-            v.expr->accept(*this);
-            bool is_void{};
+            mark_line(v.line);
+            auto assign = dynamic_cast<ASTN_BinaryExpr const*>(v.expr.get());
+            if (assign && assign->op.type == TokenType::Assign) {
+                // Value of the assignment is discarded, so don't read it back
+                emit_assign(*assign, false);
+            }
+            else {
+                v.expr->accept(*this);
+            }
             while (cur_frame.cur_sp > old_sp) {
                 append_byte(ByteCodeType::PopDword);
                 cur_frame.cur_sp -= 4;
             }
+
+            // Keep strength-reduced indices in sync with their induction variable
+            if (auto it = m_iv_updates.find(&v); it != end(m_iv_updates)) {
+                for (auto const& [temp, delta] : it->second) {
+                    macro_push_frame_base(temp.frame, -temp.entry->offset);
+                    append_byte(ByteCodeType::DuplicateDword);
+                    append_byte(ByteCodeType::ReadRefDword);
+                    macro_add_imm(delta);
+                    append_byte(ByteCodeType::WriteRefDword);
+                }
+            }
         }
         void visit_while_stmt(ASTN_WhileStmt const& v) override {
             auto& cur_frame = m_frames.back();
+            auto temps_mark = optimize_loop(v);
             uint32_t restart_pos = get_cur_code_pos();
+            // The condition is where every iteration starts
+            mark_line(v.line);
             v.cond->accept(*this);
             if (m_expr_is_void) {
                 throw std::runtime_error("expression shall not evaluate to void");
@@ -287,9 +960,11 @@ namespace CTinyC {
             append_byte(ByteCodeType::Jump);
             append_dword(restart_pos);
             write_dword(fixup_pos, get_cur_code_pos());
+            release_loop_temps(temps_mark);
         }
         void visit_if_stmt(ASTN_IfStmt const& v) override {
             auto& cur_frame = m_frames.back();
+            mark_line(v.line);
             v.cond->accept(*this);
             if (m_expr_is_void) {
                 throw std::runtime_error("expression shall not evaluate to void");
@@ -320,10 +995,9 @@ namespace CTinyC {
         void visit_return_stmt(ASTN_ReturnStmt const& v) override {
             auto& cur_frame = m_frames.back();
             auto old_sp = cur_frame.cur_sp;
+            mark_line(v.line);
             FuncEntry* func_ctx = nullptr;
-            uint32_t total_sp{};
             for (auto const& frame : m_frames | std::views::reverse) {
-                total_sp += frame.cur_sp;
                 if (frame.func_ctx) {
                     func_ctx = frame.func_ctx;
                     break;
@@ -333,6 +1007,24 @@ namespace CTinyC {
                 throw std::runtime_error("return statement shall not appear here");
             }
             bool returns_void = std::get_if<ASTData_Type_Void>(&func_ctx->ret_type->t);
+
+            // `return f(...)` replaces the current frame instead of nesting a new one,
+            // unless f is nested in the current function and may still need the frame
+            if (auto call = dynamic_cast<ASTN_CallExpr const*>(v.expr.get())) {
+                auto callee = dynamic_cast<ASTN_IdExpr const*>(call->callee.get());
+                auto callee_func = callee ? find_func(callee->id.str) : nullptr;
+                if (callee_func && callee_func->depth <= func_ctx->depth && returns_void ==
+                    (bool)std::get_if<ASTData_Type_Void>(&callee_func->ret_type->t)) {
+                    emit_call_operands(*call);
+                    append_byte(ByteCodeType::TailCall);
+                    append_dword(func_ctx->depth);
+                    append_dword(func_args_size(*func_ctx));
+                    append_dword(func_args_size(*callee_func));
+                    cur_frame.cur_sp = old_sp;
+                    return;
+                }
+            }
+
             if (returns_void) {
                 if (v.expr) {
                     v.expr->accept(*this);
@@ -340,12 +1032,7 @@ namespace CTinyC {
                         throw std::runtime_error("cannot return non-void value in void function");
                     }
                 }
-
-                while (total_sp > 0) {
-                    append_byte(ByteCodeType::PopDword);
-                    total_sp -= 4;
-                }
-                append_byte(ByteCodeType::Ret);
+                append_byte(ByteCodeType::Leave);
             }
             else {
                 if (!v.expr) {
@@ -356,94 +1043,95 @@ namespace CTinyC {
                 if (m_expr_is_void) {
                     throw std::runtime_error("cannot return void value in non-void function");
                 }
-                total_sp += 4;
                 convert_id_expr_to_rvalue();
-
-                while (total_sp < 12) {
-                    append_byte(ByteCodeType::DuplicateDword);
-                    total_sp += 4;
-                }
-                macro_adjust_sp(total_sp);
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(-(int32_t)total_sp);
-                append_byte(ByteCodeType::ReadRefDword);
-                append_byte(ByteCodeType::RetDword);
+                append_byte(ByteCodeType::LeaveDword);
             }
+            append_dword(func_ctx->depth);
+            append_dword(func_args_size(*func_ctx));
 
             cur_frame.cur_sp = old_sp;
         }
         void visit_compound_stmt(ASTN_CompoundStmt const& v) override {
             bool m_is_func_body = std::exchange(m_next_is_func_body, false);
-            // NOTE: Compound stmts have one hidden arg: previous stack pointer
+            // NOTE: Function frames start with the saved display slot, followed by the
+            //       locals which Enter reserves in one go. Other blocks sit at a fixed
+            //       distance from their parent and push their own locals.
             m_frames.push_back(BlockFrame{ .parent = &m_frames.back() });
             auto& cur_frame = m_frames.back();
+            auto block_begin = get_cur_code_pos();
 
-            // Push previous stack pointer into stack
+            size_t frame_size_fixup_pos{};
             if (m_is_func_body) {
                 // Function block
                 cur_frame.func_ctx = &m_funcs.back();
-                int args_size = 4 * cur_frame.func_ctx->params->size();
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(4);
-                append_byte(ByteCodeType::ReadRefDword);
+                append_byte(ByteCodeType::Enter);
+                append_dword(cur_frame.func_ctx->depth);
+                frame_size_fixup_pos = append_dword(PENDING_FIXUP);
                 cur_frame.cur_sp += 4;
+            }
+            auto first_debug_var = size(debug_func_of(cur_frame).vars);
+            if (m_is_func_body) {
                 // Add arguments into table
                 for (int i = 0; i < (int)cur_frame.func_ctx->params->size(); i++) {
                     auto const& param = (*cur_frame.func_ctx->params)[i];
-                    cur_frame.ids.push_back({ param.param.str, &param.type, -4 * (i + 2), param.is_arr });
+                    cur_frame.ids.push_back({ param.param.str, &param.type, -4 * (i + 1), param.is_arr });
+                    add_debug_var(cur_frame, cur_frame.ids.back(), 0);
                 }
             }
-            else {
-                // Normal block
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(cur_frame.parent->cur_sp);
-                cur_frame.cur_sp += 4;
-            }
 
             auto last_sp = cur_frame.cur_sp;
             for (auto const& decl : v.decls) {
                 decl->accept(*this);
             }
-            while (last_sp < cur_frame.cur_sp) {
-                append_byte(ByteCodeType::PushDword);
-                append_dword(0);
-                last_sp += 4;
+            if (m_is_func_body) {
+                write_dword(frame_size_fixup_pos, cur_frame.cur_sp - last_sp);
+            }
+            else {
+                while (last_sp < cur_frame.cur_sp) {
+                    append_byte(ByteCodeType::PushDword);
+                    append_dword(0);
+                    last_sp += 4;
+                }
             }
             for (auto const& stmt : v.stmts) {
+                m_cancellation.throw_if_cancelled();
                 stmt->accept(*this);
             }
 
-            while (cur_frame.cur_sp > 0) {
-                append_byte(ByteCodeType::PopDword);
-                cur_frame.cur_sp -= 4;
-            }
-
             if (m_is_func_body) {
                 // Generate (fallback) return instruction
                 if (std::get_if<ASTData_Type_Void>(&cur_frame.func_ctx->ret_type->t)) {
-                    append_byte(ByteCodeType::Ret);
+                    append_byte(ByteCodeType::Leave);
                 }
                 else {
-                    // Insert after return address
-                    append_byte(ByteCodeType::DuplicateDword);
-                    append_byte(ByteCodeType::PushStackRef);
-                    append_byte(ByteCodeType::PushDword);
-                    append_dword(4);
-                    append_byte(ByteCodeType::Add);
                     append_byte(ByteCodeType::PushDword);
                     append_dword(0);        // Default return value
-                    append_byte(ByteCodeType::WriteRefDword);
-                    append_byte(ByteCodeType::Ret);
+                    append_byte(ByteCodeType::LeaveDword);
+                }
+                append_dword(cur_frame.func_ctx->depth);
+                append_dword(func_args_size(*cur_frame.func_ctx));
+            }
+            else {
+                while (cur_frame.cur_sp > 0) {
+                    append_byte(ByteCodeType::PopDword);
+                    cur_frame.cur_sp -= 4;
                 }
             }
 
+            // Variables of nested blocks already have their scope
+            auto& debug_vars = debug_func_of(cur_frame).vars;
+            for (auto i = first_debug_var; i < size(debug_vars); i++) {
+                if (debug_vars[i].scope_end == PENDING_FIXUP) {
+                    debug_vars[i].scope_begin = block_begin;
+                    debug_vars[i].scope_end = get_cur_code_pos();
+                }
+            }
             m_frames.pop_back();
         }
         void visit_id_expr(ASTN_IdExpr const& v) override {
             auto& cur_frame = m_frames.back();
-            auto* cur_frame_ptr = &cur_frame;
 
-            if (auto func_entry = global_find_func(v.id.str)) {
+            if (auto func_entry = find_func(v.id.str)) {
                 if (!v.arridxs.empty()) {
                     throw std::runtime_error("function cannot be used for array access");
                 }
@@ -452,22 +1140,19 @@ namespace CTinyC {
                 if (func_entry->code_offset == -1) {
                     throw std::runtime_error("function is used before definition");
                 }
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(cur_frame.cur_sp);
-                if (func_entry->associated_frame) {
-                    for (auto fp = &cur_frame; fp != func_entry->associated_frame; fp = fp->parent) {
-                        macro_add_imm(-4);
-                        append_byte(ByteCodeType::ReadRefDword);
-                    }
+                // Callee reaches outer frames through the display, so only check
+                // that it is in scope (builtins have no defining frame)
+                if (func_entry->associated_frame && !is_frame_visible(func_entry->associated_frame)) {
+                    throw std::runtime_error("function is not accessible from current scope");
                 }
                 append_byte(ByteCodeType::PushDword);
                 append_dword(func_entry->code_offset + m_start_offset);
 
-                cur_frame.cur_sp += 8;
+                cur_frame.cur_sp += 4;
 
                 m_expr_is_void = false;
                 m_expr_is_id = false;
-                m_expr_is_void_fun = std::get_if<ASTData_Type_Void>(&func_entry->ret_type->t);
+                m_expr_callee = func_entry;
 
                 return;
             }
@@ -482,13 +1167,7 @@ namespace CTinyC {
                 }
             }
 
-            IdEntry* id_entry{};
-            int layers_cnt{};
-            for (auto& frame : m_frames | std::views::reverse) {
-                id_entry = frame_find_id(frame, v.id.str);
-                if (id_entry) { break; }
-                layers_cnt++;
-            }
+            auto [id_entry, id_frame] = find_id(v.id.str);
             if (!id_entry) {
                 m_logger->error(slogsrc(v.id, L"identifier `{}` not declared", winrt::to_hstring(v.id.str)));
                 throw std::runtime_error("identifier not found");
@@ -503,14 +1182,7 @@ namespace CTinyC {
             }
 
             // Resolve to variable address
-            append_byte(ByteCodeType::PushStackRef);
-            macro_add_imm(cur_frame.cur_sp);
-            for (int i = 0; i < layers_cnt; i++) {
-                cur_frame_ptr = cur_frame_ptr->parent;
-                macro_add_imm(-4);
-                append_byte(ByteCodeType::ReadRefDword);
-            }
-            macro_add_imm(-id_entry->offset);
+            macro_push_id_addr(id_frame, *id_entry);
             cur_frame.cur_sp += 4;
 
             if (is_array_access) {
@@ -520,14 +1192,20 @@ namespace CTinyC {
                     convert_id_expr_to_rvalue();
                 }
 
-                v.arridxs[0]->accept(*this);
-                if (m_expr_is_void) {
-                    throw std::runtime_error("void cannot be used as array index");
+                if (auto it = m_scaled_idx_temps.find(v.arridxs[0].get()); it != end(m_scaled_idx_temps)) {
+                    // Index is kept pre-scaled by the loop optimizer
+                    macro_load_loop_temp(it->second);
+                }
+                else {
+                    v.arridxs[0]->accept(*this);
+                    if (m_expr_is_void) {
+                        throw std::runtime_error("void cannot be used as array index");
+                    }
+                    convert_id_expr_to_rvalue();
+                    append_byte(ByteCodeType::PushDword);
+                    append_dword(4);
+                    append_byte(ByteCodeType::Mul);
                 }
-                convert_id_expr_to_rvalue();
-                append_byte(ByteCodeType::PushDword);
-                append_dword(4);
-                append_byte(ByteCodeType::Mul);
                 append_byte(ByteCodeType::Add);
                 cur_frame.cur_sp -= 4;
             }
@@ -545,42 +1223,8 @@ namespace CTinyC {
                 append_byte(ByteCodeType::ReadRefDword);
             }
         }
-        void visit_binary_expr(ASTN_BinaryExpr const& v) override {
-            auto& cur_frame = m_frames.back();
-            bool coerce_id_expr{};
-            bool is_assign{};
-
-            if (v.op.type == TokenType::Assign) {
-                is_assign = true;
-            }
-            else {
-                coerce_id_expr = true;
-            }
-
-            v.left->accept(*this);
-            if (m_expr_is_void) {
-                throw std::runtime_error("void cannot participate in arithmetic");
-            }
-            if (is_assign && !m_expr_is_id) {
-                throw std::runtime_error("cannot write to non l-value");
-            }
-            if (coerce_id_expr) {
-                convert_id_expr_to_rvalue();
-            }
-            v.right->accept(*this);
-            if (m_expr_is_void) {
-                throw std::runtime_error("void cannot participate in arithmetic");
-            }
-            convert_id_expr_to_rvalue();
-            switch (v.op.type) {
-            case TokenType::Assign:
-                append_byte(ByteCodeType::DuplicateDword);
-                append_byte(ByteCodeType::PopDword);
-                append_byte(ByteCodeType::WriteRefDword);
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(-12);
-                append_byte(ByteCodeType::ReadRefDword);
-                break;
+        void emit_binary_op(TokenType op) {
+            switch (op) {
             case TokenType::LessEqual:
                 append_byte(ByteCodeType::CmpLe);
                 break;
@@ -614,6 +1258,94 @@ namespace CTinyC {
             default:
                 throw std::runtime_error("unsupported binary operator");
             }
+        }
+        void emit_assign(ASTN_BinaryExpr const& v, bool keep_value) {
+            auto& cur_frame = m_frames.back();
+
+            v.left->accept(*this);
+            if (m_expr_is_void) {
+                throw std::runtime_error("void cannot participate in arithmetic");
+            }
+            if (!m_expr_is_id) {
+                throw std::runtime_error("cannot write to non l-value");
+            }
+
+            // For `x = x op y`, reuse the address of x instead of resolving it again
+            auto rhs = dynamic_cast<ASTN_BinaryExpr const*>(v.right.get());
+            if (rhs && rhs->op.type != TokenType::Assign && !m_loop_temps.contains(rhs)) {
+                auto lhs_key = pure_expr_key(*v.left);
+                if (!lhs_key || lhs_key != pure_expr_key(*rhs->left)) {
+                    rhs = nullptr;
+                }
+            }
+            else {
+                rhs = nullptr;
+            }
+            if (rhs) {
+                append_byte(ByteCodeType::DuplicateDword);
+                append_byte(ByteCodeType::ReadRefDword);
+                cur_frame.cur_sp += 4;
+                m_expr_is_id = false;
+                rhs->right->accept(*this);
+                if (m_expr_is_void) {
+                    throw std::runtime_error("void cannot participate in arithmetic");
+                }
+                convert_id_expr_to_rvalue();
+                emit_binary_op(rhs->op.type);
+                cur_frame.cur_sp -= 4;
+            }
+            else {
+                v.right->accept(*this);
+                if (m_expr_is_void) {
+                    throw std::runtime_error("void cannot participate in arithmetic");
+                }
+                convert_id_expr_to_rvalue();
+            }
+
+            if (keep_value) {
+                append_byte(ByteCodeType::DuplicateDword);
+                append_byte(ByteCodeType::PopDword);
+                append_byte(ByteCodeType::WriteRefDword);
+                append_byte(ByteCodeType::PushStackRef);
+                macro_add_imm(-12);
+                append_byte(ByteCodeType::ReadRefDword);
+                cur_frame.cur_sp -= 4;
+            }
+            else {
+                append_byte(ByteCodeType::WriteRefDword);
+                cur_frame.cur_sp -= 8;
+            }
+
+            m_expr_is_void = false;
+            m_expr_is_id = false;
+        }
+        void visit_binary_expr(ASTN_BinaryExpr const& v) override {
+            auto& cur_frame = m_frames.back();
+
+            if (v.op.type == TokenType::Assign) {
+                emit_assign(v, true);
+                return;
+            }
+
+            if (auto it = m_loop_temps.find(&v); it != end(m_loop_temps)) {
+                // Hoisted out of the enclosing loop
+                macro_load_loop_temp(it->second);
+                m_expr_is_void = false;
+                m_expr_is_id = false;
+                return;
+            }
+
+            v.left->accept(*this);
+            if (m_expr_is_void) {
+                throw std::runtime_error("void cannot participate in arithmetic");
+            }
+            convert_id_expr_to_rvalue();
+            v.right->accept(*this);
+            if (m_expr_is_void) {
+                throw std::runtime_error("void cannot participate in arithmetic");
+            }
+            convert_id_expr_to_rvalue();
+            emit_binary_op(v.op.type);
 
             cur_frame.cur_sp -= 4;
 
@@ -626,42 +1358,37 @@ namespace CTinyC {
             m_expr_is_void = false;
             m_expr_is_id = false;
         }
-        void visit_call_expr(ASTN_CallExpr const& v) {
-            auto& cur_frame = m_frames.back();
-            auto old_sp = cur_frame.cur_sp;
-
+        // Pushes arguments and callee address, returns the callee
+        FuncEntry const* emit_call_operands(ASTN_CallExpr const& v) {
             for (auto const& arg : v.args | std::views::reverse) {
                 arg->accept(*this);
+                if (m_expr_is_void) {
+                    throw std::runtime_error("void cannot be used as an argument");
+                }
                 convert_id_expr_to_rvalue();
             }
-            m_expr_is_void_fun = {};
+            m_expr_callee = {};
             v.callee->accept(*this);
-            convert_id_expr_to_rvalue();
+            auto callee = std::exchange(m_expr_callee, nullptr);
+            if (!callee) {
+                throw std::runtime_error("expression is not callable");
+            }
+            // Callee releases its arguments, so the count must match exactly
+            if (v.args.size() != callee->params->size()) {
+                throw std::runtime_error("wrong number of arguments");
+            }
+            return callee;
+        }
+        void visit_call_expr(ASTN_CallExpr const& v) {
+            auto& cur_frame = m_frames.back();
+            auto old_sp = cur_frame.cur_sp;
 
+            auto callee = emit_call_operands(v);
             append_byte(ByteCodeType::CallIndirect);
 
-            bool is_void{ m_expr_is_void_fun };
-
-            if (is_void) {
-                cur_frame.cur_sp -= 4;
-                while (cur_frame.cur_sp > old_sp) {
-                    append_byte(ByteCodeType::PopDword);
-                    cur_frame.cur_sp -= 4;
-                }
-            }
-            else {
-                auto stack_delta = cur_frame.cur_sp - old_sp;
-                while (stack_delta < 12) {
-                    append_byte(ByteCodeType::DuplicateDword);
-                    stack_delta += 4;
-                }
-                // Move return value
-                macro_adjust_sp(stack_delta);
-                append_byte(ByteCodeType::PushStackRef);
-                macro_add_imm(-stack_delta);
-                append_byte(ByteCodeType::ReadRefDword);
-                cur_frame.cur_sp = old_sp + 4;
-            }
+            // Arguments are gone and return value (if any) replaced the return address
+            bool is_void = std::get_if<ASTData_Type_Void>(&callee->ret_type->t);
+            cur_frame.cur_sp = is_void ? old_sp : old_sp + 4;
 
             m_expr_is_void = is_void;
             m_expr_is_id = false;
@@ -681,19 +1408,30 @@ namespace CTinyC {
 
         Logger* m_logger;
         int m_start_offset;
+        FfiRegistry const* m_ffi_registry;
         std::list<BlockFrame> m_frames;
         //BlockFrame* m_cur_frame;
         std::list<FuncEntry> m_funcs;
         bool m_next_is_func_body{};
         bool m_expr_is_id{};
         bool m_expr_is_void{};
-        bool m_expr_is_void_fun{};
+        FuncEntry const* m_expr_callee{};
+        // Static data segments, and code positions of addresses into them
+        std::vector<uint8_t> m_data;
+        int m_bss_size{};
+        std::vector<std::pair<size_t, IdStorage>> m_static_fixups;
         // Used to fix global variable references
         std::vector<int> m_global_fixups;
+        // State of loop optimizations, see optimize_loop()
+        std::unordered_map<ASTN_Expr const*, LoopTemp> m_loop_temps;
+        std::unordered_map<ASTN_Expr const*, LoopTemp> m_scaled_idx_temps;
+        std::unordered_map<ASTN_Stmt const*, std::vector<std::pair<LoopTemp, uint32_t>>> m_iv_updates;
     };
 
     std::pair<std::vector<uint8_t>, CodeMetadata> CodeGenerator::ast_to_code(ASTN const& root_node, int start_offset) try {
-        CodeGenAstVisitor visitor(m_logger, start_offset);
+        CodeGenAstVisitor visitor(m_logger, start_offset, m_ffi_registry);
+        visitor.m_cancellation = m_cancellation;
+        visitor.m_on_progress = m_on_progress;
         visitor.start(root_node);
         return { std::move(visitor.m_bytes), std::move(visitor.m_code_meta) };
     }
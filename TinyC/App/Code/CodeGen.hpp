@@ -1,5 +1,8 @@
 #pragma once
 
+#include "CompileControl.hpp"
+#include "DebugInfo.hpp"
+#include "Ffi.hpp"
 #include "Logger.hpp"
 #include "Parser.hpp"
 
@@ -11,14 +14,32 @@ namespace CTinyC {
         };
 
         std::vector<FuncMetadata> func_meta;
+        // Host functions the code calls through FfiCall, indexed by its operand
+        std::vector<FfiImport> ffi_imports;
+        // Image layout: code, padding up to a dword boundary, then initialized data.
+        // Zero-initialized data (bss) follows right after the image and is not stored in it.
+        size_t code_size{};
+        size_t data_size{};
+        size_t bss_size{};
+        DebugInfo debug_info;
     };
 
     struct CodeGenerator {
-        CodeGenerator(Logger* logger) : m_logger(logger) {}
+        // Functions of `ffi_registry`, if any, can be called like builtins
+        CodeGenerator(Logger* logger, FfiRegistry const* ffi_registry = nullptr) :
+            m_logger(logger), m_ffi_registry(ffi_registry) {}
 
         std::pair<std::vector<uint8_t>, CodeMetadata> ast_to_code(ASTN const& root_node, int start_offset);
 
+        // Checked before every top-level declaration and statement
+        void set_cancellation(CancellationToken token) { m_cancellation = std::move(token); }
+        // Reported after every top-level declaration
+        void set_progress(CompileProgressFn fn) { m_on_progress = std::move(fn); }
+
     private:
         Logger* m_logger;
+        FfiRegistry const* m_ffi_registry;
+        CancellationToken m_cancellation;
+        CompileProgressFn m_on_progress;
     };
 }
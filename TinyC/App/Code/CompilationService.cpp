@@ -0,0 +1,118 @@
+#include "pch.h"
+
+#include "CompilationService.hpp"
+
+namespace CTinyC {
+    CompilationService::CompilationService(Logger* logger, CompilationServiceOptions const& options,
+        ProgressFn on_progress, CompleteFn on_complete
+    ) : m_logger(logger), m_options(options), m_on_progress(std::move(on_progress)),
+        m_on_complete(std::move(on_complete)) {
+        m_worker = std::thread([this] { worker_main(); });
+    }
+    CompilationService::~CompilationService() {
+        {
+            std::scoped_lock guard{ m_mutex };
+            m_stopping = true;
+            m_running_token.cancel();
+        }
+        m_worker_cv.notify_one();
+        m_worker.join();
+    }
+
+    uint64_t CompilationService::submit(std::string source) {
+        std::scoped_lock guard{ m_mutex };
+        m_pending_source = std::move(source);
+        m_submit_time = std::chrono::steady_clock::now();
+        m_running_token.cancel();
+        m_worker_cv.notify_one();
+        return ++m_latest_version;
+    }
+    void CompilationService::cancel() {
+        std::scoped_lock guard{ m_mutex };
+        m_cancelled_version = m_latest_version;
+        m_running_token.cancel();
+        m_worker_cv.notify_one();
+    }
+    void CompilationService::wait_idle() {
+        std::unique_lock lock{ m_mutex };
+        m_idle_cv.wait(lock, [&] { return m_completed_version == m_latest_version; });
+    }
+
+    void CompilationService::worker_main() {
+        std::unique_lock lock{ m_mutex };
+        while (true) {
+            m_worker_cv.wait(lock, [&] { return m_stopping || m_latest_version > m_taken_version; });
+            // Let a burst of edits settle
+            while (!m_stopping && m_latest_version > m_cancelled_version &&
+                std::chrono::steady_clock::now() < m_submit_time + m_options.debounce
+            ) {
+                m_worker_cv.wait_until(lock, m_submit_time + m_options.debounce);
+            }
+            if (m_stopping) { break; }
+
+            auto first_version = m_taken_version + 1;
+            auto version = m_latest_version;
+            auto source = std::move(m_pending_source);
+            bool is_cancelled = version <= m_cancelled_version;
+            auto token = CancellationToken::create();
+            m_taken_version = version;
+            m_running_token = token;
+            lock.unlock();
+
+            // Superseded before they started
+            for (auto v = first_version; v < version; v++) {
+                m_on_complete({ .version = v, .status = CompileStatus::Cancelled });
+            }
+            if (is_cancelled) {
+                m_on_complete({ .version = version, .status = CompileStatus::Cancelled });
+            }
+            else {
+                m_on_complete(compile(version, source, token));
+            }
+
+            lock.lock();
+            m_running_token = {};
+            m_completed_version = version;
+            m_idle_cv.notify_all();
+        }
+    }
+
+    CompileResult CompilationService::compile(uint64_t version, std::string const& source,
+        CancellationToken const& token
+    ) {
+        auto t0 = std::chrono::steady_clock::now();
+        CompileResult result{ .version = version };
+        auto on_progress = [&](CompilePhase phase, double fraction) {
+            if (m_on_progress) { m_on_progress(version, phase, fraction); }
+        };
+        try {
+            on_progress(CompilePhase::Parse, 0);
+            Lexer lexer(m_logger);
+            Parser parser(m_logger);
+            lexer.init(source);
+            lexer.set_cancellation(token);
+            parser.set_cancellation(token);
+            parser.set_progress(on_progress);
+            auto ast_root = parser.parse(&lexer);
+            if (!ast_root) {
+                throw std::runtime_error("compilation failed");
+            }
+            on_progress(CompilePhase::CodeGen, 0);
+            CodeGenerator code_gen(m_logger, m_options.ffi_registry);
+            code_gen.set_cancellation(token);
+            code_gen.set_progress(on_progress);
+            std::tie(result.image, result.metadata) = code_gen.ast_to_code(*ast_root, m_options.start_offset);
+            result.status = CompileStatus::Succeeded;
+        }
+        catch (compilation_cancelled const&) {
+            result.status = CompileStatus::Cancelled;
+        }
+        catch (std::exception const& e) {
+            // Errors of a superseded source are moot
+            result.status = token.is_cancelled() ? CompileStatus::Cancelled : CompileStatus::Failed;
+            result.message = e.what();
+        }
+        result.elapsed = std::chrono::steady_clock::now() - t0;
+        return result;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "CodeGen.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace CTinyC {
+    enum class CompileStatus {
+        Succeeded,
+        Failed,
+        // Superseded by a newer source, or cancel() was called
+        Cancelled,
+    };
+
+    struct CompileResult {
+        // Returned by the submit() call the result belongs to
+        uint64_t version{};
+        CompileStatus status{};
+        std::vector<uint8_t> image{};
+        CodeMetadata metadata{};
+        // Reason of a failure; the diagnostics went to the logger
+        std::string message{};
+        std::chrono::nanoseconds elapsed{};
+    };
+
+    struct CompilationServiceOptions {
+        int start_offset{};
+        FfiRegistry const* ffi_registry{};
+        // A submitted source is compiled once no newer one came for this long
+        std::chrono::milliseconds debounce{};
+    };
+
+    // Compiles sources on a worker thread, one at a time. A newer source supersedes the
+    // previous one: if that one has not started yet it is skipped, otherwise it is
+    // cancelled at the next check of the compiler phases. Every version gets exactly one
+    // result, in submission order. Callbacks run on the worker thread and must not throw.
+    struct CompilationService {
+        using ProgressFn = std::function<void(uint64_t version, CompilePhase phase, double fraction)>;
+        using CompleteFn = std::function<void(CompileResult result)>;
+
+        CompilationService(Logger* logger, CompilationServiceOptions const& options,
+            ProgressFn on_progress, CompleteFn on_complete);
+        // Cancels the running compile; pending sources get no result
+        ~CompilationService();
+
+        // Returns the version of the result that will be reported for `source`
+        uint64_t submit(std::string source);
+        // Cancels the running compile and everything submitted so far
+        void cancel();
+        // Blocks until every submitted source has its result
+        void wait_idle();
+
+    private:
+        void worker_main();
+        CompileResult compile(uint64_t version, std::string const& source, CancellationToken const& token);
+
+        Logger* m_logger;
+        CompilationServiceOptions m_options;
+        ProgressFn m_on_progress;
+        CompleteFn m_on_complete;
+
+        std::mutex m_mutex;
+        std::condition_variable m_worker_cv, m_idle_cv;
+        std::string m_pending_source;
+        std::chrono::steady_clock::time_point m_submit_time;
+        uint64_t m_latest_version{};
+        // Versions up to this one have been taken by the worker
+        uint64_t m_taken_version{};
+        // Versions up to this one are cancelled without being compiled
+        uint64_t m_cancelled_version{};
+        uint64_t m_completed_version{};
+        CancellationToken m_running_token;
+        bool m_stopping{};
+
+        std::thread m_worker;
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+
+namespace CTinyC {
+    // Thrown by the compiler phases once their CancellationToken is cancelled. Not a
+    // runtime_error, so it passes through their error handling without being reported.
+    struct compilation_cancelled : std::exception {
+        char const* what() const noexcept override { return "compilation cancelled"; }
+    };
+
+    // Cancellation flag shared by all copies. The compiler phases check it cooperatively;
+    // a default-constructed token is never cancelled.
+    struct CancellationToken {
+        static CancellationToken create() {
+            CancellationToken token;
+            token.m_flag = std::make_shared<std::atomic_bool>(false);
+            return token;
+        }
+
+        void cancel() const {
+            if (m_flag) { m_flag->store(true, std::memory_order_relaxed); }
+        }
+        bool is_cancelled() const {
+            return m_flag && m_flag->load(std::memory_order_relaxed);
+        }
+        void throw_if_cancelled() const {
+            if (is_cancelled()) { throw compilation_cancelled(); }
+        }
+
+    private:
+        std::shared_ptr<std::atomic_bool> m_flag;
+    };
+
+    enum class CompilePhase {
+        // Lexing and parsing, which run interleaved
+        Parse,
+        CodeGen,
+    };
+    // `fraction` of the phase is done, in [0, 1]
+    using CompileProgressFn = std::function<void(CompilePhase phase, double fraction)>;
+}
@@ -0,0 +1,29 @@
+#include "pch.h"
+
+#include "DebugInfo.hpp"
+
+namespace CTinyC {
+    int DebugInfo::line_at(uint32_t addr) const {
+        auto it = std::ranges::upper_bound(lines, addr, {}, &LineEntry::addr);
+        return it == begin(lines) ? 0 : std::prev(it)->line;
+    }
+    std::vector<uint32_t> DebugInfo::line_addrs(int line) const {
+        std::vector<uint32_t> result;
+        for (size_t i = 0; i < size(lines); i++) {
+            // Consecutive statements of one line form a single run
+            if (lines[i].line == line && (i == 0 || lines[i - 1].line != line)) {
+                result.push_back(lines[i].addr);
+            }
+        }
+        return result;
+    }
+    DebugInfo::Function const* DebugInfo::func_at(uint32_t addr) const {
+        Function const* result{};
+        for (auto const& func : funcs) {
+            if (addr >= func.begin && addr < func.end && (!result || func.depth > result->depth)) {
+                result = &func;
+            }
+        }
+        return result;
+    }
+}
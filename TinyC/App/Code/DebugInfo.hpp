@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CTinyC {
+    // Source-level view of a compiled image, for the debugger. All addresses are VM
+    // addresses of the loaded image.
+    struct DebugInfo {
+        // Start of the code of a statement
+        struct LineEntry {
+            uint32_t addr;
+            int line;
+        };
+        struct Variable {
+            std::string name;
+            // Lives at (frame base - frame_offset); parameters have negative offsets
+            int32_t frame_offset;
+            // Elements of a local array, 0 for scalars and array parameters (pointers)
+            uint32_t count;
+            // Code range of the enclosing block
+            uint32_t scope_begin, scope_end;
+        };
+        struct Function {
+            std::string name;
+            // [begin, end) includes the code of nested functions
+            uint32_t begin, end;
+            // Display slot holding the frame base
+            int depth;
+            std::vector<Variable> vars;
+        };
+
+        // Sorted by address
+        std::vector<LineEntry> lines;
+        std::vector<Function> funcs;
+
+        // Line of the statement `addr` belongs to, 0 if unknown
+        int line_at(uint32_t addr) const;
+        // Where each run of code of `line` starts
+        std::vector<uint32_t> line_addrs(int line) const;
+        // Innermost function containing `addr`
+        Function const* func_at(uint32_t addr) const;
+    };
+
+    struct DebugLocal {
+        std::string name;
+        // One value per element for arrays
+        std::vector<int32_t> values;
+    };
+}
@@ -2,46 +2,194 @@
 
 #include "Executor.hpp"
 
+#include <bit>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CTINYC_HAS_SSE2 1
+#endif
+
 //#include <ffi.h>
 
 namespace CTinyC {
     const size_t STACK_SIZE = 1024ull * 1024 * 4;
 
-    void Executor::load(void* bytecode, size_t len, size_t memory_size, size_t start_offset) {
-        if (len + start_offset + STACK_SIZE > memory_size) {
+    // Threads spawned by a program. Their ids are 1-based indices into `threads` and are
+    // never reused; the main thread is 0.
+    struct Executor::ThreadGroup {
+        struct Thread {
+            Thread(std::unique_ptr<Executor> executor, uint32_t stack) :
+                executor(std::move(executor)), stack(stack) {}
+
+            // Dropped by join
+            std::unique_ptr<Executor> executor;
+            // VM heap block of its stack
+            uint32_t stack;
+            // Parallel scheduling only; joined by the main thread
+            std::thread host;
+            bool finished{};
+            bool joined{};
+        };
+
+        // Body of the host thread of a spawned thread
+        void run_thread(Thread& thread);
+
+        ExecutorThreadOptions options;
+        // Guards the fields below, as well as the heap and I/O of the main thread
+        std::mutex mutex;
+        // Notified when a thread finishes or the group is stopping
+        std::condition_variable cv;
+        std::deque<Thread> threads;
+        size_t unjoined_cnt{};
+        // First error of a spawned thread, rethrown by the main thread
+        std::exception_ptr error;
+        // Interrupt flag of the spawned threads; nothing is spawned once it is set
+        std::atomic_bool stopping{};
+        // Instructions executed by finished threads
+        std::atomic_size_t finished_executed_cnt{};
+    };
+
+    Executor::Executor(Logger* logger, ExecutorIo* io) : m_logger(logger),
+        m_io(io ? io : StdExecutorIo::instance()), m_halted(true) {}
+    Executor::~Executor() {
+        stop_threads();
+    }
+
+    ExecutorImage Executor::make_image(void const* bytecode, size_t len, size_t memory_size,
+        size_t start_offset, size_t bss_size, std::span<FfiImport const> ffi_imports
+    ) {
+        if (len + bss_size + start_offset + STACK_SIZE > memory_size) {
             throw std::invalid_argument("VM memory too small");
         }
-        m_memory.clear();
-        m_memory.resize(memory_size, 0x0);
-        std::memcpy(m_memory.data() + start_offset, bytecode, len);
+        ExecutorImage image;
+        image.memory.resize(memory_size, 0x0);
+        std::memcpy(image.memory.data() + start_offset, bytecode, len);
+        image.ip = start_offset;
+        image.sp = memory_size - 20;
+        image.heap_begin = start_offset + len + bss_size;
+        image.heap_end = memory_size - STACK_SIZE;
+        image.ffi_imports.assign(begin(ffi_imports), end(ffi_imports));
+        // Return address of the entry function points at a `SysCall 0` (halt)
+        auto write_dword = [&](size_t ptr, uint32_t v) {
+            for (size_t i = 0; i < 4; i++) {
+                image.memory[ptr + i] = (v >> (i * 8)) & 0xff;
+            }
+        };
+        write_dword(image.sp + 9, 0);
+        image.memory[image.sp + 8] = ByteCodeType::SysCall;
+        write_dword(image.sp + 4, 0);
+        write_dword(image.sp, (uint32_t)(image.sp + 8));
+        return image;
+    }
+    void Executor::load(void* bytecode, size_t len, size_t memory_size, size_t start_offset, size_t bss_size,
+        std::span<FfiImport const> ffi_imports
+    ) {
+        auto image = make_image(bytecode, len, memory_size, start_offset, bss_size, ffi_imports);
+        stop_threads();
+        m_memory_storage = std::move(image.memory);
+        m_memory = m_memory_storage;
+        reset(image);
+    }
+    void Executor::load(ExecutorImage const& image) {
+        stop_threads();
+        // Reuses the current allocation when reloading an image of the same size
+        m_memory_storage.assign(begin(image.memory), end(image.memory));
+        m_memory = m_memory_storage;
+        reset(image);
+    }
+    void Executor::reset(ExecutorImage const& image) {
+        if (image.heap_begin > image.heap_end || image.heap_end > size(m_memory)) {
+            throw std::invalid_argument("VM heap range is invalid");
+        }
         m_halted = false;
-        m_ip = start_offset;
-        m_sp = size(m_memory) - 20;
-        checked_write_vm_mem_dword(m_sp + 9, 0);
-        checked_write_vm_mem_byte(m_sp + 8, ByteCodeType::SysCall);
-        checked_write_vm_mem_dword(m_sp + 4, 0);
-        checked_write_vm_mem_dword(m_sp, (uint32_t)(m_sp + 8));
-    }
-    bool Executor::execute(size_t max_count, std::atomic_bool const& interrupt_flag) try {
+        m_io_pushback = -1;
+        m_ip = checked_get_vm_mem_ptr(image.ip);
+        m_sp = checked_get_vm_mem_ptr(image.sp);
+        // The heap lies right below the stack
+        m_stack_base = size(m_memory);
+        m_stack_limit = image.heap_end;
+        m_display.fill(0);
+        m_executed_cnt = 0;
+        m_threads.reset();
+        m_join_target = 0;
+        // Patched code went away with the old memory
+        m_breakpoints.clear();
+        m_at_breakpoint = false;
+        m_heap.reset(m_memory.data(), (uint32_t)image.heap_begin, (uint32_t)image.heap_end, m_heap_checked);
+        // Bind imports once, so that calls need no lookup
+        m_ffi_bindings.clear();
+        for (auto const& import : image.ffi_imports) {
+            auto func = m_ffi_registry ? m_ffi_registry->find(import.name) : nullptr;
+            if (!func) {
+                throw std::runtime_error(std::format("host function `{}` is not available", import.name));
+            }
+            if (func->param_cnt != import.param_cnt || func->returns_int != import.returns_int) {
+                throw std::runtime_error(std::format("host function `{}` has a different signature", import.name));
+            }
+            m_ffi_bindings.push_back({ func->thunk, func->param_cnt, func->returns_int });
+        }
+    }
+    bool Executor::execute(size_t max_count, std::atomic_bool const& interrupt_flag) {
+        if (m_halted || max_count == 0) { return !m_halted; }
+        // Resuming from a breakpoint: the instruction under it runs first
+        if (!m_breakpoints.empty() && m_breakpoints.contains(m_ip)) {
+            if (!step() || m_at_breakpoint) { return !m_halted; }
+            max_count--;
+        }
+        if (m_thread_options.scheduling == ThreadScheduling::Deterministic) {
+            return run_scheduled(max_count, interrupt_flag);
+        }
+        bool running = run(max_count, interrupt_flag);
+        if (m_threads) {
+            rethrow_thread_error();
+            if (running && m_join_target) {
+                // Waits a little at a time, so that the caller can still interrupt
+                std::unique_lock lock{ m_threads->mutex };
+                m_threads->cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                    return m_threads->threads[m_join_target - 1].finished || m_threads->error;
+                });
+            }
+        }
+        return running;
+    }
+    size_t Executor::executed_count() const {
+        return m_executed_cnt + (m_threads ? m_threads->finished_executed_cnt.load(std::memory_order_relaxed) : 0);
+    }
+    bool Executor::run(size_t max_count, std::atomic_bool const& interrupt_flag) try {
         if (m_halted) { return false; }
+        m_at_breakpoint = false;
         size_t exec_inst_cnt{};
         while (exec_inst_cnt++ < max_count && !interrupt_flag.load(std::memory_order_relaxed)) {
             auto bytecode_type = static_cast<ByteCodeType>(checked_read_vm_mem_byte(m_ip));
             m_ip = checked_get_vm_mem_ptr(m_ip, 1);
-            uint32_t tmp_dw1, tmp_dw2;
+            m_executed_cnt++;
+            uint32_t tmp_dw1, tmp_dw2, tmp_dw3;
 
-            m_logger->debug(std::format(L"Decoding instruction {} at {}(0x{:08x}), sp = {}",
-                (uint32_t)bytecode_type, m_ip - 1, m_ip - 1, m_sp));
+            m_logger->debugf(L"Decoding instruction {} at {}(0x{:08x}), sp = {}",
+                (uint32_t)bytecode_type, m_ip - 1, m_ip - 1, m_sp);
 
             switch (bytecode_type) {
             case ByteCodeType::DebugInterrupt:
                 m_logger->debug(L"DebugInterrupt");
+                if (m_owner) {
+                    throw std::runtime_error("breakpoints are only supported in the main thread");
+                }
+                if (m_breakpoints.contains(m_ip - 1)) {
+                    // Not executed: resuming runs the original instruction at this address
+                    m_ip--;
+                    m_executed_cnt--;
+                    m_at_breakpoint = true;
+                }
                 goto end_loop;
             case ByteCodeType::PushDword:
                 tmp_dw1 = checked_read_vm_mem_dword(m_ip);
                 m_ip = checked_get_vm_mem_ptr(m_ip, 4);
-                m_logger->debug(std::format(L"PushDword {}", tmp_dw1));
-                m_sp = checked_get_vm_mem_ptr(m_sp, -4);
+                m_logger->debugf(L"PushDword {}", tmp_dw1);
+                m_sp = checked_stack_push(4);
                 checked_write_vm_mem_dword(m_sp, tmp_dw1);
                 break;
             case ByteCodeType::PopDword:
@@ -51,25 +199,25 @@ namespace CTinyC {
             case ByteCodeType::DuplicateDword:
                 m_logger->debug(L"DuplicateDword");
                 tmp_dw1 = checked_read_vm_mem_dword(m_sp);
-                m_sp = checked_get_vm_mem_ptr(m_sp, -4);
+                m_sp = checked_stack_push(4);
                 checked_write_vm_mem_dword(m_sp, tmp_dw1);
                 break;
             case ByteCodeType::PushStackRef:
                 m_logger->debug(L"PushStackRef");
                 tmp_dw1 = m_sp;
-                m_sp = checked_get_vm_mem_ptr(m_sp, -4);
+                m_sp = checked_stack_push(4);
                 checked_write_vm_mem_dword(m_sp, tmp_dw1);
                 break;
             case ByteCodeType::AdjustStackRefConst:
                 tmp_dw1 = checked_read_vm_mem_dword(m_ip);
                 m_ip = checked_get_vm_mem_ptr(m_ip, 4);
-                m_logger->debug(std::format(L"AdjustStackRefConst {}", tmp_dw1));
-                m_sp = checked_get_vm_mem_ptr(m_sp, tmp_dw1);
+                m_logger->debugf(L"AdjustStackRefConst {}", tmp_dw1);
+                m_sp = (int32_t)tmp_dw1 < 0 ? checked_stack_push(0 - tmp_dw1) : checked_get_vm_mem_ptr(m_sp, tmp_dw1);
                 break;
             case ByteCodeType::ReadRefDword:
                 tmp_dw1 = checked_read_vm_mem_dword(m_sp);
                 tmp_dw2 = checked_read_vm_mem_dword(tmp_dw1);
-                m_logger->debug(std::format(L"ReadRefDword ({} -> {})", tmp_dw1, tmp_dw2));
+                m_logger->debugf(L"ReadRefDword ({} -> {})", tmp_dw1, tmp_dw2);
                 checked_write_vm_mem_dword(m_sp, tmp_dw2);
                 break;
             case ByteCodeType::WriteRefDword:
@@ -77,49 +225,52 @@ namespace CTinyC {
                 m_sp = checked_get_vm_mem_ptr(m_sp, 4);
                 tmp_dw2 = checked_read_vm_mem_dword(m_sp);
                 m_sp = checked_get_vm_mem_ptr(m_sp, 4);
-                m_logger->debug(std::format(L"WriteRefDword ({} -> {})", tmp_dw1, tmp_dw2));
+                m_logger->debugf(L"WriteRefDword ({} -> {})", tmp_dw1, tmp_dw2);
                 checked_write_vm_mem_dword(tmp_dw2, tmp_dw1);
                 break;
 
             case ByteCodeType::Call:
                 tmp_dw1 = checked_read_vm_mem_dword(m_ip);  // ȡõַָ
-                m_logger->debug(std::format(L"Call {}", tmp_dw1));
+                m_logger->debugf(L"Call {}", tmp_dw1);
                 m_ip = checked_get_vm_mem_ptr(m_ip, 4);  // ָָ
-                m_sp = checked_get_vm_mem_ptr(m_sp, -4);  // ݼջָ洢úλ
+                m_sp = checked_stack_push(4);  // ݼջָ洢úλ
                 checked_write_vm_mem_dword(m_sp, m_ip);  // дصúַָ
                 m_ip = tmp_dw1;  // תָλ
                 break;
             case ByteCodeType::CallIndirect:
                 tmp_dw1 = checked_read_vm_mem_dword(m_sp);
-                m_logger->debug(std::format(L"CallIndirect ({})", tmp_dw1));
+                m_logger->debugf(L"CallIndirect ({})", tmp_dw1);
                 checked_write_vm_mem_dword(m_sp, m_ip);  // дصúַָ
                 m_ip = tmp_dw1;  // תָλ
                 break;
             case ByteCodeType::Ret:
+                tmp_dw2 = fetch_code_dword();
                 tmp_dw1 = checked_read_vm_mem_dword(m_sp);
-                m_logger->debug(std::format(L"Ret ({})", tmp_dw1));
-                m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+                m_logger->debugf(L"Ret {} ({})", tmp_dw2, tmp_dw1);
+                m_sp = checked_get_vm_mem_ptr(m_sp, 4 + tmp_dw2);
                 m_ip = tmp_dw1;
                 break;
             case ByteCodeType::RetDword:
+                tmp_dw3 = fetch_code_dword();
                 tmp_dw1 = checked_read_vm_mem_dword(m_sp);
                 m_sp = checked_get_vm_mem_ptr(m_sp, 4);
                 tmp_dw2 = checked_read_vm_mem_dword(m_sp);
+                m_sp = checked_get_vm_mem_ptr(m_sp, tmp_dw3);
                 checked_write_vm_mem_dword(m_sp, tmp_dw1);
-                m_logger->debug(std::format(L"RetDword (v={}, retaddr={})",
-                    tmp_dw1, tmp_dw2));
+                m_logger->debugf(L"RetDword {} (v={}, retaddr={})",
+                    tmp_dw3, tmp_dw1, tmp_dw2);
                 m_ip = tmp_dw2;
                 break;
 
             case ByteCodeType::Jump:
                 tmp_dw1 = checked_read_vm_mem_dword(m_ip);
-                m_logger->debug(std::format(L"Jump {}", tmp_dw1));
+                m_logger->debugf(L"Jump {}", tmp_dw1);
                 m_ip = checked_get_vm_mem_ptr(tmp_dw1);  // תָֽʾλ
                 break;
 
             case ByteCodeType::JumpCond:
                 tmp_dw1 = checked_read_vm_mem_dword(m_ip);  // ȡתַ
-                m_logger->debug(std::format(L"JumpCond {}", tmp_dw1));
+                m_logger->debugf(L"JumpCond {}", tmp_dw1);
                 m_ip = checked_get_vm_mem_ptr(m_ip, 4);  // ָָ
                 tmp_dw2 = checked_read_vm_mem_dword(m_sp);  // ȡ
                 m_sp = checked_get_vm_mem_ptr(m_sp, 4);  // Ӷջָ
@@ -189,11 +340,92 @@ namespace CTinyC {
                 checked_write_vm_mem_dword(m_sp, tmp_dw1);  // дջ
                 break;
 
-            case ByteCodeType::FfiCall:
-                m_logger->debug(L"FfiCall");
-                throw std::runtime_error("FfiCall is not supported");
+            case ByteCodeType::PushDisplay:
+                tmp_dw1 = fetch_code_dword();
+                tmp_dw2 = checked_display_slot(tmp_dw1);
+                m_logger->debugf(L"PushDisplay {} ({})", tmp_dw1, tmp_dw2);
+                m_sp = checked_stack_push(4);
+                checked_write_vm_mem_dword(m_sp, tmp_dw2);
+                break;
+            case ByteCodeType::Enter:
+                tmp_dw1 = fetch_code_dword();
+                tmp_dw2 = fetch_code_dword();
+                m_logger->debugf(L"Enter {} {} (base={})", tmp_dw1, tmp_dw2, m_sp);
+                tmp_dw3 = (uint32_t)m_sp;
+                m_sp = checked_stack_push(4);
+                checked_write_vm_mem_dword(m_sp, checked_display_slot(tmp_dw1));
+                checked_display_slot(tmp_dw1) = tmp_dw3;
+                m_sp = checked_stack_push(tmp_dw2);
+                std::fill_n(m_memory.begin() + m_sp, tmp_dw2, 0);
+                break;
+            case ByteCodeType::Leave:
+            case ByteCodeType::LeaveDword:
+                tmp_dw1 = fetch_code_dword();
+                tmp_dw2 = fetch_code_dword();
+                tmp_dw3 = checked_read_vm_mem_dword(m_sp);  // Return value, if any
+                m_sp = checked_display_slot(tmp_dw1);
+                checked_display_slot(tmp_dw1) = checked_read_vm_mem_dword(checked_get_vm_mem_ptr(m_sp, -4));
+                m_ip = checked_read_vm_mem_dword(m_sp);
+                m_sp = checked_get_vm_mem_ptr(m_sp, 4 + tmp_dw2);
+                if (bytecode_type == ByteCodeType::LeaveDword) {
+                    m_logger->debugf(L"LeaveDword {} {} (v={}, retaddr={})",
+                        tmp_dw1, tmp_dw2, tmp_dw3, m_ip);
+                    m_sp = checked_stack_push(4);
+                    checked_write_vm_mem_dword(m_sp, tmp_dw3);
+                }
+                else {
+                    m_logger->debugf(L"Leave {} {} (retaddr={})", tmp_dw1, tmp_dw2, m_ip);
+                }
+                break;
+            case ByteCodeType::TailCall: {
+                tmp_dw1 = fetch_code_dword();
+                tmp_dw2 = fetch_code_dword();
+                tmp_dw3 = fetch_code_dword();
+                auto callee = checked_read_vm_mem_dword(m_sp);
+                auto src = checked_get_vm_mem_ptr(m_sp, 4);
+                auto base = checked_display_slot(tmp_dw1);
+                checked_display_slot(tmp_dw1) = checked_read_vm_mem_dword(checked_get_vm_mem_ptr(base, -4));
+                auto retaddr = checked_read_vm_mem_dword(base);
+                m_logger->debugf(L"TailCall {} {} {} ({}, retaddr={})",
+                    tmp_dw1, tmp_dw2, tmp_dw3, callee, retaddr);
+                // Move new arguments over the old ones; destination is always higher
+                auto dst = checked_get_vm_mem_ptr(base, 4 + tmp_dw2 - tmp_dw3);
+                for (size_t i = tmp_dw3; i >= 4; i -= 4) {
+                    checked_write_vm_mem_dword(dst + i - 4, checked_read_vm_mem_dword(src + i - 4));
+                }
+                m_sp = checked_get_vm_mem_ptr(dst, -4);
+                checked_write_vm_mem_dword(m_sp, retaddr);
+                m_ip = callee;
+                break;
+            }
+
+            case ByteCodeType::FfiCall: {
+                tmp_dw1 = fetch_code_dword();
+                m_logger->debugf(L"FfiCall {}", tmp_dw1);
+                if (tmp_dw1 >= size(m_ffi_bindings)) {
+                    throw std::runtime_error("host function import out of range");
+                }
+                auto const& binding = m_ffi_bindings[tmp_dw1];
+                auto args = checked_vm_mem_range(checked_get_vm_mem_ptr(m_sp, 4), binding.param_cnt);
+                tmp_dw2 = binding.thunk({ args, { m_memory } });
+                if (binding.returns_int) {
+                    m_sp = checked_stack_push(4);
+                    checked_write_vm_mem_dword(m_sp, tmp_dw2);
+                }
+                break;
+            }
             case ByteCodeType::SysCall:
                 execute_syscall();
+                // Waiting in join, the scheduler resumes this thread later
+                if (m_join_target) { goto end_loop; }
+                break;
+            case ByteCodeType::MemSet:
+            case ByteCodeType::MemCopy:
+            case ByteCodeType::MemCompare:
+            case ByteCodeType::ReduceSum:
+            case ByteCodeType::ReduceMin:
+            case ByteCodeType::ReduceMax:
+                execute_bulk_op(bytecode_type);
                 break;
             default:
                 throw std::runtime_error("unrecognized bytecode");
@@ -215,36 +447,556 @@ end_loop:
     }
     void Executor::execute_syscall() {
         auto call_num = checked_read_vm_mem_dword(m_ip);
-        m_logger->debug(std::format(L"Syscall, id = {}", call_num));
+        m_logger->debugf(L"Syscall, id = {}", call_num);
         m_ip = checked_get_vm_mem_ptr(m_ip, 4);
         uint32_t tmp_dw1, tmp_dw2;
+        char buf[16];
 
         switch (call_num) {
         case 0:
             m_halted = true;
+            // Like returning from main in C, this ends the other threads as well
+            stop_threads();
+            if (m_heap_checked) {
+                m_heap.check();
+                if (auto cnt = m_heap.live_count()) {
+                    m_logger->warn(std::format(L"{} heap block(s) were never freed", cnt));
+                }
+            }
             return;
-        case 1:
+        case 1: {
             tmp_dw1 = checked_read_vm_mem_dword(m_sp);
             m_sp = checked_get_vm_mem_ptr(m_sp, 4);
-            putchar(tmp_dw1);
+            buf[0] = static_cast<char>(tmp_dw1);
+            auto lock = lock_shared();
+            m_io->write({ buf, 1 });
             return;
-        case 2:
-            tmp_dw1 = getchar();
-            m_sp = checked_get_vm_mem_ptr(m_sp, -4);
+        }
+        case 2: {
+            auto& main = main_thread();
+            auto lock = lock_shared();
+            if (main.m_io_pushback >= 0) {
+                tmp_dw1 = std::exchange(main.m_io_pushback, -1);
+            }
+            else {
+                tmp_dw1 = m_io->read_char();
+            }
+            m_sp = checked_stack_push(4);
             checked_write_vm_mem_dword(m_sp, tmp_dw1);
             return;
-        case 3:     // input
-            scanf("%d", &tmp_dw1);
-            m_sp = checked_get_vm_mem_ptr(m_sp, -4);
+        }
+        case 3: {   // input
+            auto lock = lock_shared();
+            tmp_dw1 = main_thread().read_int();
+            m_sp = checked_stack_push(4);
             checked_write_vm_mem_dword(m_sp, tmp_dw1);
             return;
-        case 4:     // output
+        }
+        case 4: {   // output
+            tmp_dw1 = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            auto end = std::to_chars(buf, buf + sizeof buf - 1, (int32_t)tmp_dw1).ptr;
+            *end++ = ' ';
+            auto lock = lock_shared();
+            m_io->write({ buf, size_t(end - buf) });
+            return;
+        }
+        case 5: {   // malloc
+            tmp_dw1 = checked_read_vm_mem_dword(m_sp);
+            auto lock = lock_shared();
+            checked_write_vm_mem_dword(m_sp, main_thread().m_heap.allocate(tmp_dw1));
+            return;
+        }
+        case 6: {   // free
+            tmp_dw1 = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            auto lock = lock_shared();
+            main_thread().m_heap.release(tmp_dw1);
+            return;
+        }
+        case 7: {   // realloc
+            tmp_dw1 = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            tmp_dw2 = checked_read_vm_mem_dword(m_sp);
+            auto lock = lock_shared();
+            checked_write_vm_mem_dword(m_sp, main_thread().m_heap.reallocate(tmp_dw1, tmp_dw2));
+            return;
+        }
+        case 8:
+            spawn_thread();
+            return;
+        case 9:
+            join_thread();
+            return;
+        case 10:    // atomic_add(addr, delta) => old value
+            tmp_dw1 = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            tmp_dw2 = checked_read_vm_mem_dword(m_sp);
+            checked_write_vm_mem_dword(m_sp, checked_atomic_vm_mem_dword(tmp_dw1).fetch_add(tmp_dw2));
+            return;
+        case 11:    // atomic_cas(addr, expected, desired) => old value
             tmp_dw1 = checked_read_vm_mem_dword(m_sp);
             m_sp = checked_get_vm_mem_ptr(m_sp, 4);
-            printf("%d ", tmp_dw1);
+            tmp_dw2 = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            // On failure `tmp_dw2` receives the old value, on success it already is
+            checked_atomic_vm_mem_dword(tmp_dw1).compare_exchange_strong(tmp_dw2, checked_read_vm_mem_dword(m_sp));
+            checked_write_vm_mem_dword(m_sp, tmp_dw2);
             return;
+        case 12: {  // end of a spawned thread, its entry function returned here
+            if (!m_owner) {
+                throw std::runtime_error("unrecognized syscall");
+            }
+            // The result replaced the argument, unless the function returns void
+            auto exit_stub = m_ip - 5;
+            m_thread_result = m_sp + 4 == exit_stub ? checked_read_vm_mem_dword(m_sp) : 0;
+            m_halted = true;
+            return;
+        }
         default:
             throw std::runtime_error("unrecognized syscall");
         }
     }
+
+    std::unique_lock<std::mutex> Executor::lock_shared() {
+        auto& main = main_thread();
+        return main.m_threads ? std::unique_lock{ main.m_threads->mutex } : std::unique_lock<std::mutex>{};
+    }
+    Executor::ThreadGroup& Executor::thread_group() {
+        auto& main = main_thread();
+        // Only the main thread gets here without a group, as spawned threads imply one
+        if (!main.m_threads) {
+            main.m_threads = std::make_unique<ThreadGroup>();
+            main.m_threads->options = main.m_thread_options;
+        }
+        return *main.m_threads;
+    }
+    void Executor::spawn_thread() {
+        auto func = checked_read_vm_mem_dword(m_sp);
+        m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+        auto arg = checked_read_vm_mem_dword(m_sp);
+        auto& main = main_thread();
+        auto& group = thread_group();
+        std::scoped_lock guard{ group.mutex };
+        if (group.stopping) {
+            // The program is ending anyway
+            checked_write_vm_mem_dword(m_sp, 0);
+            return;
+        }
+        if (group.unjoined_cnt >= group.options.max_threads) {
+            throw std::runtime_error("too many threads");
+        }
+        auto stack_size = std::max(group.options.stack_size, 64u) & ~7u;
+        auto stack = main.m_heap.allocate(stack_size);
+        if (stack == 0) {
+            throw std::runtime_error("out of memory for a thread stack");
+        }
+        auto id = (uint32_t)size(group.threads) + 1;
+        auto executor = std::make_unique<Executor>(m_logger, m_io);
+        executor->m_owner = &main;
+        executor->m_memory = main.m_memory;
+        executor->m_ffi_bindings = main.m_ffi_bindings;
+        // Nested functions reach the frames of the spawning thread through the display
+        executor->m_display = m_display;
+        executor->m_thread_id = id;
+        executor->m_halted = false;
+        // The entry function is called with `arg` and returns into an exit syscall at
+        // the top of the stack
+        auto exit_stub = stack + stack_size - 8;
+        checked_write_vm_mem_byte(exit_stub, ByteCodeType::SysCall);
+        checked_write_vm_mem_dword(exit_stub + 1, 12);
+        checked_write_vm_mem_dword(exit_stub - 4, arg);
+        checked_write_vm_mem_dword(exit_stub - 8, exit_stub);
+        executor->m_sp = exit_stub - 8;
+        executor->m_stack_base = stack + stack_size;
+        executor->m_stack_limit = stack;
+        executor->set_ip(func);
+
+        auto& thread = group.threads.emplace_back(std::move(executor), stack);
+        group.unjoined_cnt++;
+        if (group.options.scheduling == ThreadScheduling::Parallel) {
+            thread.host = std::thread([&group, &thread] { group.run_thread(thread); });
+        }
+        checked_write_vm_mem_dword(m_sp, id);
+    }
+    void Executor::join_thread() {
+        auto id = checked_read_vm_mem_dword(m_sp);
+        auto& main = main_thread();
+        auto& group = thread_group();
+        std::scoped_lock guard{ group.mutex };
+        if (id == 0 || id > size(group.threads) || id == m_thread_id || group.threads[id - 1].joined) {
+            throw std::runtime_error("invalid thread id");
+        }
+        auto& thread = group.threads[id - 1];
+        // A thread stopped by an error elsewhere has no result; the main thread reports the error
+        if (!thread.finished || group.stopping) {
+            // Not executed yet: the syscall runs again when this thread is resumed
+            m_join_target = id;
+            m_ip = checked_get_vm_mem_ptr(m_ip, -5);
+            m_executed_cnt--;
+            return;
+        }
+        m_join_target = 0;
+        thread.joined = true;
+        group.unjoined_cnt--;
+        // It has finished, so this does not block; host threads are only ever joined
+        // on the thread of the main thread
+        if (!m_owner && thread.host.joinable()) {
+            thread.host.join();
+        }
+        main.m_heap.release(thread.stack);
+        checked_write_vm_mem_dword(m_sp, thread.executor->m_thread_result);
+        thread.executor.reset();
+    }
+    void Executor::ThreadGroup::run_thread(Thread& thread) {
+        auto& executor = *thread.executor;
+        try {
+            while (executor.run(SIZE_MAX, stopping) && !stopping.load(std::memory_order_relaxed)) {
+                // Blocked in join
+                std::unique_lock lock{ mutex };
+                cv.wait(lock, [&] { return stopping || threads[executor.m_join_target - 1].finished; });
+            }
+        }
+        catch (...) {
+            std::scoped_lock guard{ mutex };
+            if (!error) { error = std::current_exception(); }
+            stopping = true;
+        }
+        std::scoped_lock guard{ mutex };
+        thread.finished = true;
+        finished_executed_cnt += executor.m_executed_cnt;
+        cv.notify_all();
+    }
+    bool Executor::run_scheduled(size_t max_count, std::atomic_bool const& interrupt_flag) {
+        auto quantum = std::max<size_t>(m_thread_options.quantum, 1);
+        size_t executed_cnt{};
+        // Returns whether the thread got anything done
+        auto take_turn = [&](Executor& thread) {
+            auto before = thread.m_executed_cnt;
+            thread.run(std::min(quantum, max_count - executed_cnt), interrupt_flag);
+            executed_cnt += thread.m_executed_cnt - before;
+            return thread.m_executed_cnt != before;
+        };
+        try {
+            while (executed_cnt < max_count && !interrupt_flag.load(std::memory_order_relaxed)) {
+                bool progressed = take_turn(*this);
+                if (m_halted || m_at_breakpoint) { break; }
+                // Threads spawned during a round get their first turn in it
+                for (size_t i = 0; m_threads && i < size(m_threads->threads) && executed_cnt < max_count; i++) {
+                    auto& thread = m_threads->threads[i];
+                    if (thread.finished) { continue; }
+                    progressed |= take_turn(*thread.executor);
+                    if (thread.executor->m_halted) {
+                        thread.finished = true;
+                        m_threads->finished_executed_cnt += thread.executor->m_executed_cnt;
+                    }
+                }
+                if (!progressed && !interrupt_flag.load(std::memory_order_relaxed)) {
+                    throw std::runtime_error("deadlock: every thread is waiting in join");
+                }
+            }
+        }
+        catch (...) {
+            m_halted = true;
+            throw;
+        }
+        return !m_halted;
+    }
+    void Executor::stop_threads() {
+        if (!m_threads) { return; }
+        {
+            std::scoped_lock guard{ m_threads->mutex };
+            m_threads->stopping = true;
+        }
+        m_threads->cv.notify_all();
+        // The list no longer changes once stopping is set
+        for (auto& thread : m_threads->threads) {
+            if (thread.host.joinable()) { thread.host.join(); }
+        }
+    }
+    void Executor::rethrow_thread_error() {
+        std::exception_ptr error;
+        {
+            std::scoped_lock guard{ m_threads->mutex };
+            error = m_threads->error;
+        }
+        if (error) {
+            m_halted = true;
+            stop_threads();
+            std::rethrow_exception(error);
+        }
+    }
+
+    void Executor::set_breakpoint(size_t addr) {
+        if (addr >= size(m_memory)) {
+            throw std::runtime_error("breakpoint address out of bounds");
+        }
+        if (m_breakpoints.try_emplace(addr, m_memory[addr]).second) {
+            m_memory[addr] = ByteCodeType::DebugInterrupt;
+        }
+    }
+    void Executor::clear_breakpoint(size_t addr) {
+        if (auto it = m_breakpoints.find(addr); it != end(m_breakpoints)) {
+            m_memory[addr] = it->second;
+            m_breakpoints.erase(it);
+        }
+    }
+    void Executor::clear_all_breakpoints() {
+        for (auto const& [addr, byte] : m_breakpoints) {
+            m_memory[addr] = byte;
+        }
+        m_breakpoints.clear();
+    }
+    size_t Executor::set_line_breakpoint(int line) {
+        if (!m_debug_info) {
+            throw std::runtime_error("no debug info");
+        }
+        auto addrs = m_debug_info->line_addrs(line);
+        if (addrs.empty()) {
+            throw std::runtime_error(std::format("no code at line {}", line));
+        }
+        for (auto addr : addrs) {
+            set_breakpoint(addr);
+        }
+        return size(addrs);
+    }
+    void Executor::clear_line_breakpoint(int line) {
+        if (!m_debug_info) { return; }
+        for (auto addr : m_debug_info->line_addrs(line)) {
+            clear_breakpoint(addr);
+        }
+    }
+    bool Executor::step() {
+        static std::atomic_bool const no_interrupt{};
+        auto it = m_breakpoints.find(m_ip);
+        if (m_halted || it == end(m_breakpoints)) {
+            return run(1, no_interrupt);
+        }
+        // Put the original instruction back for the duration of the step
+        auto addr = m_ip;
+        m_memory[addr] = it->second;
+        bool running{};
+        try {
+            running = run(1, no_interrupt);
+        }
+        catch (...) {
+            m_memory[addr] = ByteCodeType::DebugInterrupt;
+            throw;
+        }
+        m_memory[addr] = ByteCodeType::DebugInterrupt;
+        return running;
+    }
+    bool Executor::step_over(size_t max_count, std::atomic_bool const& interrupt_flag) {
+        if (m_halted) { return false; }
+        auto op = original_opcode(m_ip);
+        if (op != ByteCodeType::Call && op != ByteCodeType::CallIndirect) {
+            return step();
+        }
+        // A temporary breakpoint after the call; it also triggers in deeper recursive
+        // activations, which are told apart by their lower stack pointer
+        auto return_addr = m_ip + instruction_size(op);
+        auto call_sp = m_sp;
+        bool is_user_breakpoint = m_breakpoints.contains(return_addr);
+        set_breakpoint(return_addr);
+        bool running{};
+        try {
+            running = execute(max_count, interrupt_flag);
+            while (running && m_at_breakpoint && m_ip == return_addr && m_sp + 4 < call_sp && !is_user_breakpoint) {
+                running = execute(max_count, interrupt_flag);
+            }
+        }
+        catch (...) {
+            if (!is_user_breakpoint) { clear_breakpoint(return_addr); }
+            throw;
+        }
+        if (!is_user_breakpoint) {
+            clear_breakpoint(return_addr);
+            if (m_ip == return_addr) { m_at_breakpoint = false; }
+        }
+        return running;
+    }
+    int Executor::current_line() const {
+        return m_debug_info ? m_debug_info->line_at((uint32_t)m_ip) : 0;
+    }
+    std::vector<DebugLocal> Executor::read_locals() {
+        std::vector<DebugLocal> result;
+        auto func = m_debug_info ? m_debug_info->func_at((uint32_t)m_ip) : nullptr;
+        // Until its Enter has run, the display slot belongs to another activation
+        if (!func || m_ip == func->begin) { return result; }
+        auto base = checked_display_slot(func->depth);
+        for (auto const& var : func->vars) {
+            if (m_ip < var.scope_begin || m_ip >= var.scope_end) { continue; }
+            DebugLocal local{ var.name };
+            auto addr = checked_get_vm_mem_ptr(base, -var.frame_offset);
+            for (uint32_t i = 0; i < std::max(var.count, 1u); i++) {
+                local.values.push_back((int32_t)checked_read_vm_mem_dword(addr + i * 4));
+            }
+            result.push_back(std::move(local));
+        }
+        return result;
+    }
+    ByteCodeType Executor::original_opcode(size_t addr) const {
+        if (auto it = m_breakpoints.find(addr); it != end(m_breakpoints)) {
+            return static_cast<ByteCodeType>(it->second);
+        }
+        if (addr >= size(m_memory)) {
+            throw std::runtime_error("VM memory read out of bounds");
+        }
+        return static_cast<ByteCodeType>(m_memory[addr]);
+    }
+
+    // Kernels of the bulk opcodes. VM memory is little-endian and unaligned, so dwords
+    // are moved with memcpy (a plain load / store once compiled).
+    static_assert(std::endian::native == std::endian::little);
+    static int32_t load_dword(uint8_t const* p) {
+        int32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+    static void fill_dwords(uint8_t* dst, uint32_t value, size_t count) {
+        size_t i{};
+#ifdef CTINYC_HAS_SSE2
+        auto v = _mm_set1_epi32((int)value);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+        }
+#endif
+        for (; i < count; i++) {
+            std::memcpy(dst + i * 4, &value, 4);
+        }
+    }
+    static int32_t compare_dwords(uint8_t const* a, uint8_t const* b, size_t count) {
+        size_t i{};
+#ifdef CTINYC_HAS_SSE2
+        // Skip equal blocks, the scalar loop finds the differing dword
+        for (; i + 4 <= count; i += 4) {
+            auto eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i * 4)),
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i * 4)));
+            if (_mm_movemask_epi8(eq) != 0xffff) { break; }
+        }
+#endif
+        for (; i < count; i++) {
+            auto x = load_dword(a + i * 4), y = load_dword(b + i * 4);
+            if (x != y) { return x < y ? -1 : 1; }
+        }
+        return 0;
+    }
+    // Wraps around like the Add instruction
+    static uint32_t sum_dwords(uint8_t const* p, size_t count) {
+        uint32_t sum{};
+        size_t i{};
+#ifdef CTINYC_HAS_SSE2
+        auto acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8) {
+            acc0 = _mm_add_epi32(acc0, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i * 4)));
+            acc1 = _mm_add_epi32(acc1, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i * 4 + 16)));
+        }
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi32(acc0, acc1));
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+        for (; i < count; i++) {
+            sum += (uint32_t)load_dword(p + i * 4);
+        }
+        return sum;
+    }
+    template<bool IsMax>
+    static int32_t extremum_dwords(uint8_t const* p, size_t count) {
+        if (count == 0) { return 0; }
+        auto better = [](int32_t x, int32_t y) { return IsMax ? x > y : x < y; };
+        auto result = load_dword(p);
+        size_t i{ 1 };
+#ifdef CTINYC_HAS_SSE2
+        if (count >= 4) {
+            // SSE2 has no pminsd / pmaxsd, select through a comparison mask instead
+            auto acc = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+            for (i = 4; i + 4 <= count; i += 4) {
+                auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i * 4));
+                auto take = IsMax ? _mm_cmpgt_epi32(v, acc) : _mm_cmplt_epi32(v, acc);
+                acc = _mm_or_si128(_mm_and_si128(take, v), _mm_andnot_si128(take, acc));
+            }
+            alignas(16) int32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            for (auto lane : lanes) {
+                if (better(lane, result)) { result = lane; }
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            if (auto v = load_dword(p + i * 4); better(v, result)) { result = v; }
+        }
+        return result;
+    }
+
+    void Executor::execute_bulk_op(ByteCodeType op) {
+        auto pop = [&] {
+            auto v = checked_read_vm_mem_dword(m_sp);
+            m_sp = checked_get_vm_mem_ptr(m_sp, 4);
+            return v;
+        };
+        auto addr = pop();
+        uint32_t result{};
+        switch (op) {
+        case ByteCodeType::MemSet: {
+            auto value = pop();
+            auto count = pop();
+            m_logger->debugf(L"MemSet ({}, {}, {})", addr, value, count);
+            fill_dwords(checked_vm_mem_range(addr, count), value, count);
+            return;
+        }
+        case ByteCodeType::MemCopy: {
+            auto src = pop();
+            auto count = pop();
+            m_logger->debugf(L"MemCopy ({}, {}, {})", addr, src, count);
+            auto dst_ptr = checked_vm_mem_range(addr, count);
+            auto src_ptr = checked_vm_mem_range(src, count);
+            std::memmove(dst_ptr, src_ptr, size_t(count) * 4);
+            return;
+        }
+        case ByteCodeType::MemCompare: {
+            auto other = pop();
+            auto count = pop();
+            m_logger->debugf(L"MemCompare ({}, {}, {})", addr, other, count);
+            result = compare_dwords(checked_vm_mem_range(addr, count), checked_vm_mem_range(other, count), count);
+            break;
+        }
+        case ByteCodeType::ReduceSum:
+        case ByteCodeType::ReduceMin:
+        case ByteCodeType::ReduceMax: {
+            auto count = pop();
+            if (m_logger->is_enabled(Logger::Severity::Debug)) {
+                m_logger->debug(std::format(L"Reduce{} ({}, {})", op == ByteCodeType::ReduceSum ? L"Sum" :
+                    op == ByteCodeType::ReduceMin ? L"Min" : L"Max", addr, count));
+            }
+            auto ptr = checked_vm_mem_range(addr, count);
+            result = op == ByteCodeType::ReduceSum ? sum_dwords(ptr, count) :
+                op == ByteCodeType::ReduceMin ? extremum_dwords<false>(ptr, count) : extremum_dwords<true>(ptr, count);
+            break;
+        }
+        default:
+            throw std::runtime_error("unrecognized bytecode");
+        }
+        m_sp = checked_stack_push(4);
+        checked_write_vm_mem_dword(m_sp, result);
+    }
+    // Same as scanf("%d"), yields 0 if no integer could be read
+    int32_t Executor::read_int() {
+        auto next = [&] {
+            return m_io_pushback >= 0 ? std::exchange(m_io_pushback, -1) : m_io->read_char();
+        };
+        int ch = next();
+        while (ch >= 0 && isspace(ch)) { ch = next(); }
+        bool negative = ch == '-';
+        if (ch == '-' || ch == '+') { ch = next(); }
+        uint32_t v{};
+        bool has_digit{};
+        while (ch >= '0' && ch <= '9') {
+            v = v * 10 + (ch - '0');
+            has_digit = true;
+            ch = next();
+        }
+        m_io_pushback = ch;
+        if (!has_digit) { return 0; }
+        return static_cast<int32_t>(negative ? 0u - v : v);
+    }
 }
@@ -1,11 +1,21 @@
 #pragma once
 
+#include "DebugInfo.hpp"
+#include "Ffi.hpp"
 #include "Logger.hpp"
+#include "VmHeap.hpp"
 #include <vector>
+#include <array>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 
 namespace CTinyC {
     enum ByteCodeType : uint8_t {
+        // Stops execution; patched over the first byte of an instruction for breakpoints
         DebugInterrupt = 0,
         PushDword,
         PopDword,
@@ -17,6 +27,7 @@ namespace CTinyC {
         WriteRefDword,
         Call,
         CallIndirect,
+        // Require a dword specifying argument size to release after popping retaddr
         Ret,
         RetDword,
         Jump,
@@ -32,27 +43,178 @@ namespace CTinyC {
         CmpL,
         CmpLe,
 
-        // Requires a packed dword describing callee ABI
-        // 0: EOF, 1: u32, 2: u64, 3: uintptr_t, 4: f64
-        // At most 32 / 4 = 8 arguments
+        // Require a dword specifying display depth d
+        // PushDisplay: push display[d]
+        PushDisplay,
+        // Requires dwords d and frame size; pushes display[d], sets display[d] to the
+        // frame base (old sp) and reserves zeroed locals
+        Enter,
+        // Require dwords d and argument size; restore display[d], pop the frame,
+        // return and release arguments (LeaveDword keeps the value on top)
+        Leave,
+        LeaveDword,
+        // Requires dwords d, current and new argument size; replaces the current
+        // frame with a call to the function on top, whose arguments lie below it
+        TailCall,
+
+        // Requires a dword indexing the program's host function imports. Used as the
+        // body of a stub function: arguments are read in place right above the return
+        // address, and the result (if any) is pushed
         FfiCall,
         // Requires a dword specifying syscall ID
-        // 0 => halt, 1 => putchar, 2 => getchar, 3 => input, 4 => output
+        // 0 => halt, 1 => putchar, 2 => getchar, 3 => input, 4 => output,
+        // 5 => malloc, 6 => free, 7 => realloc, 8 => spawn, 9 => join, 10 => atomic_add,
+        // 11 => atomic_cas, 12 => end of a spawned thread (arguments popped first to last)
         SysCall,
+
+        // Bulk operations on a range of `count` dwords, operands popped first to last.
+        // Bounds are checked once for the whole range.
+        // MemSet: dst, value, count
+        // MemCopy: dst, src, count (ranges may overlap)
+        MemSet,
+        MemCopy,
+        // Push a result: MemCompare: a, b, count => -1, 0 or 1 (signed comparison of
+        // the first differing dword); ReduceXxx: addr, count => sum / min / max, 0 if empty
+        MemCompare,
+        ReduceSum,
+        ReduceMin,
+        ReduceMax,
+    };
+
+    // Maximum nesting depth of functions
+    constexpr size_t DISPLAY_DEPTH = 32;
+
+    // Length of an instruction in bytes, including its operands
+    constexpr size_t instruction_size(ByteCodeType type) {
+        switch (type) {
+        case PushDword: case AdjustStackRefConst: case Call: case Ret: case RetDword:
+        case Jump: case JumpCond: case PushDisplay: case FfiCall: case SysCall:
+            return 5;
+        case Enter: case Leave: case LeaveDword:
+            return 9;
+        case TailCall:
+            return 13;
+        default:
+            return 1;
+        }
+    }
+
+    // Byte streams behind the I/O syscalls
+    struct ExecutorIo {
+        // Returns -1 at end of input
+        virtual int read_char() = 0;
+        virtual void write(std::string_view bytes) = 0;
+    };
+    struct StdExecutorIo : ExecutorIo {
+        int read_char() override { return getchar(); }
+        void write(std::string_view bytes) override { fwrite(bytes.data(), 1, bytes.size(), stdout); }
+
+        static StdExecutorIo* instance() {
+            static StdExecutorIo io;
+            return &io;
+        }
+    };
+
+    // Initial VM memory and registers of a program. Built once, it can be loaded into
+    // any number of executors.
+    struct ExecutorImage {
+        std::vector<uint8_t> memory;
+        size_t ip{}, sp{};
+        // Range handed to the heap allocator, between static data and the stack
+        size_t heap_begin{}, heap_end{};
+        // Host functions called by the program, resolved when the image is loaded
+        std::vector<FfiImport> ffi_imports;
+    };
+
+    // How the threads a program spawns are run
+    enum class ThreadScheduling {
+        // Every spawned thread runs on a host thread of its own
+        Parallel,
+        // All threads take turns on the thread calling execute, `quantum` instructions
+        // at a time, so that a run is reproducible
+        Deterministic,
+    };
+    struct ExecutorThreadOptions {
+        ThreadScheduling scheduling{ ThreadScheduling::Parallel };
+        size_t quantum{ 1000 };
+        // Stack of a spawned thread, allocated from the VM heap
+        uint32_t stack_size{ 64 * 1024 };
+        // Spawned threads that have not been joined yet
+        size_t max_threads{ 256 };
     };
 
     // NOTE: Stack type is full-descending
     struct Executor {
-        Executor(Logger* logger) : m_logger(logger), m_halted(true) {}
+        Executor(Logger* logger, ExecutorIo* io = nullptr);
+        // Stops the threads the program spawned
+        ~Executor();
 
-        void load(void* bytecode, size_t len, size_t memory_size, size_t start_offset);
+        // `bss_size` bytes right after the image are left zeroed for static data
+        void load(void* bytecode, size_t len, size_t memory_size, size_t start_offset, size_t bss_size = 0,
+            std::span<FfiImport const> ffi_imports = {});
+        void load(ExecutorImage const& image);
+        static ExecutorImage make_image(void const* bytecode, size_t len, size_t memory_size,
+            size_t start_offset, size_t bss_size = 0, std::span<FfiImport const> ffi_imports = {});
         void set_ip(size_t ip) {
             m_ip = checked_get_vm_mem_ptr(ip);
         }
-        // Returns whether VM can continue running (i.e. not halted)
+        // Returns whether VM can continue running (i.e. not halted). Stops early at a breakpoint.
         bool execute(size_t max_count, std::atomic_bool const& interrupt_flag);
+        // Total number of instructions executed since load, including those of spawned
+        // threads once they have finished
+        size_t executed_count() const;
+        // Guard heap blocks with canaries (checked on free and at exit); applies from the next load
+        void set_heap_checked(bool checked) { m_heap_checked = checked; }
+        // Where host function imports are looked up; applies from the next load
+        void set_ffi_registry(FfiRegistry const* registry) { m_ffi_registry = registry; }
+        // Applies from the next load
+        void set_thread_options(ExecutorThreadOptions const& options) { m_thread_options = options; }
+
+        // Debugging. Breakpoints patch DebugInterrupt over the code, so a program runs
+        // at full speed until it reaches one; they are dropped by load. Only the main
+        // thread of a program can be debugged.
+        void set_breakpoint(size_t addr);
+        void clear_breakpoint(size_t addr);
+        void clear_all_breakpoints();
+        // Line based variants need debug info (set_debug_info); returns the number of
+        // locations, throws if the line has no code
+        size_t set_line_breakpoint(int line);
+        void clear_line_breakpoint(int line);
+        // Whether the last execute / step stopped at a breakpoint (ip is at its address)
+        bool at_breakpoint() const { return m_at_breakpoint; }
+        // Executes a single instruction
+        bool step();
+        // Like step, but runs a called function until it returns, a breakpoint is hit
+        // or `max_count` instructions have been executed
+        bool step_over(size_t max_count, std::atomic_bool const& interrupt_flag);
+        size_t ip() const { return m_ip; }
+        void set_debug_info(DebugInfo const* debug_info) { m_debug_info = debug_info; }
+        // Current source line, 0 if unknown
+        int current_line() const;
+        // Parameters and locals of the current function that are in scope
+        std::vector<DebugLocal> read_locals();
 
     private:
+        struct ThreadGroup;
+
+        // The instruction loop
+        bool run(size_t max_count, std::atomic_bool const& interrupt_flag);
+        // Deterministic scheduling: runs the main thread and the spawned ones in turn
+        bool run_scheduled(size_t max_count, std::atomic_bool const& interrupt_flag);
+        // Main thread of the program, which owns the memory, heap and I/O
+        Executor& main_thread() { return m_owner ? *m_owner : *this; }
+        // Serializes access to what the threads share (heap and I/O); a no-op before the first spawn
+        std::unique_lock<std::mutex> lock_shared();
+        ThreadGroup& thread_group();
+        // Stops every spawned thread and waits for their host threads
+        void stop_threads();
+        // Throws the error of a spawned thread that failed, if any
+        void rethrow_thread_error();
+        void spawn_thread();
+        void join_thread();
+        // Opcode at `addr`, as it was before any breakpoint was patched in
+        ByteCodeType original_opcode(size_t addr) const;
+
         size_t checked_get_vm_mem_ptr(size_t ptr, int32_t offset = 0) {
             if (offset > 0 && static_cast<size_t>(offset) > size(m_memory)) {
                 throw std::runtime_error("VM memory pointer out of bounds");
@@ -96,6 +258,16 @@ namespace CTinyC {
             }
             return m_memory[ptr];
         }
+        // Dword for the atomic syscalls, which have to be aligned
+        std::atomic_ref<uint32_t> checked_atomic_vm_mem_dword(size_t ptr) {
+            if (ptr >= size(m_memory) - 3) {
+                throw std::runtime_error("VM memory access out of bounds");
+            }
+            if (ptr % 4 != 0) {
+                throw std::runtime_error("unaligned atomic access");
+            }
+            return std::atomic_ref(*reinterpret_cast<uint32_t*>(m_memory.data() + ptr));
+        }
         void checked_write_vm_mem_byte(size_t ptr, uint8_t v) {
             if (ptr >= size(m_memory)) {
                 throw std::runtime_error("VM memory write out of bounds");
@@ -103,11 +275,76 @@ namespace CTinyC {
             m_memory[ptr] = v;
         }
 
+        // sp after pushing `bytes`; the stack must not grow into what lies below it
+        size_t checked_stack_push(size_t bytes) {
+            if (m_sp < m_stack_limit + bytes) {
+                throw std::runtime_error("stack overflow");
+            }
+            return m_sp - bytes;
+        }
+
+        uint32_t fetch_code_dword() {
+            auto v = checked_read_vm_mem_dword(m_ip);
+            m_ip = checked_get_vm_mem_ptr(m_ip, 4);
+            return v;
+        }
+        uint32_t& checked_display_slot(uint32_t depth) {
+            if (depth >= DISPLAY_DEPTH) {
+                throw std::runtime_error("VM display depth out of bounds");
+            }
+            return m_display[depth];
+        }
+
+        // Validates [ptr, ptr + count dwords) and returns its host address
+        uint8_t* checked_vm_mem_range(size_t ptr, uint32_t count) {
+            if (ptr > size(m_memory) || count > (size(m_memory) - ptr) / 4) {
+                throw std::runtime_error("VM memory range out of bounds");
+            }
+            return m_memory.data() + ptr;
+        }
+
+        void reset(ExecutorImage const& image);
         void execute_syscall();
+        void execute_bulk_op(ByteCodeType op);
+        int32_t read_int();
 
         Logger* m_logger;
+        ExecutorIo* m_io;
+        int m_io_pushback{ -1 };
         bool m_halted;
         size_t m_ip{}, m_sp{};
-        std::vector<uint8_t> m_memory;
+        // Stack of this thread, [m_stack_limit, m_stack_base): above the heap for the
+        // main thread, a heap block for a spawned one
+        size_t m_stack_base{}, m_stack_limit{};
+        size_t m_executed_cnt{};
+        // Spawned threads view the memory of the main thread
+        std::vector<uint8_t> m_memory_storage;
+        std::span<uint8_t> m_memory;
+        // Frame bases of the innermost active function at each nesting depth
+        std::array<uint32_t, DISPLAY_DEPTH> m_display{};
+        VmHeap m_heap;
+        bool m_heap_checked{};
+        FfiRegistry const* m_ffi_registry{};
+        // Thunks of the image's imports, in import order
+        struct FfiBinding {
+            FfiThunk thunk;
+            uint32_t param_cnt;
+            bool returns_int;
+        };
+        std::vector<FfiBinding> m_ffi_bindings;
+        // Original first byte of every patched instruction
+        std::unordered_map<size_t, uint8_t> m_breakpoints;
+        bool m_at_breakpoint{};
+        DebugInfo const* m_debug_info{};
+
+        ExecutorThreadOptions m_thread_options;
+        // Created by the first spawn, only in the main thread
+        std::unique_ptr<ThreadGroup> m_threads;
+        // Set in spawned threads
+        Executor* m_owner{};
+        uint32_t m_thread_id{};
+        uint32_t m_thread_result{};
+        // Thread a join is waiting for; the join syscall runs again once it is resumed
+        uint32_t m_join_target{};
     };
 }
@@ -0,0 +1,26 @@
+#include "pch.h"
+
+#include "Ffi.hpp"
+
+namespace CTinyC {
+    uint8_t* FfiMemory::checked_range(uint32_t addr, uint32_t count) const {
+        if (addr > size(bytes) || count > (size(bytes) - addr) / 4) {
+            throw std::runtime_error("VM memory range out of bounds");
+        }
+        return bytes.data() + addr;
+    }
+
+    void FfiRegistry::add(FfiFunction func) {
+        if (func.param_cnt > FFI_MAX_PARAMS) {
+            throw std::invalid_argument("host function has too many parameters");
+        }
+        if (find(func.name)) {
+            throw std::invalid_argument(std::format("host function `{}` is already registered", func.name));
+        }
+        m_funcs.push_back(std::move(func));
+    }
+    FfiFunction const* FfiRegistry::find(std::string_view name) const {
+        auto it = std::ranges::find(m_funcs, name, &FfiFunction::name);
+        return it == end(m_funcs) ? nullptr : &*it;
+    }
+}
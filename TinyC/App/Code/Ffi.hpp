@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace CTinyC {
+    // Maximum number of parameters of a host function
+    constexpr uint32_t FFI_MAX_PARAMS = 8;
+
+    // VM memory as seen by a host function, for array and pointer arguments
+    struct FfiMemory {
+        std::span<uint8_t> bytes;
+
+        // Validates [addr, addr + count dwords) and returns its host address
+        uint8_t* checked_range(uint32_t addr, uint32_t count) const;
+        int32_t read_dword(uint32_t addr) const {
+            int32_t v;
+            std::memcpy(&v, checked_range(addr, 1), 4);
+            return v;
+        }
+        void write_dword(uint32_t addr, int32_t v) const { std::memcpy(checked_range(addr, 1), &v, 4); }
+    };
+
+    // Arguments of a call, read in place from the VM stack (first argument at `stack`)
+    struct FfiArgs {
+        uint8_t const* stack;
+        FfiMemory memory;
+
+        int32_t operator[](size_t i) const {
+            int32_t v;
+            std::memcpy(&v, stack + i * 4, 4);
+            return v;
+        }
+    };
+
+    // Returns the result dword (ignored for void functions). Host functions report
+    // errors by throwing std::runtime_error, which stops the VM like any other fault.
+    using FfiThunk = uint32_t(*)(FfiArgs const& args);
+
+    // A host function as TinyC sees it: int parameters, int or void result
+    struct FfiFunction {
+        std::string name;
+        uint32_t param_cnt{};
+        bool returns_int{};
+        FfiThunk thunk{};
+    };
+
+    // What a program imports; images refer to host functions by index into a list of these
+    struct FfiImport {
+        std::string name;
+        uint32_t param_cnt{};
+        bool returns_int{};
+    };
+
+    namespace detail {
+        template<typename... Args>
+        struct FfiTakesMemory : std::false_type {};
+        template<typename... Args>
+        struct FfiTakesMemory<FfiMemory, Args...> : std::true_type {};
+
+        template<typename F>
+        struct FfiSignature;
+        template<typename R, typename... Args>
+        struct FfiSignature<R(*)(Args...)> {
+            static constexpr bool takes_memory = FfiTakesMemory<Args...>::value;
+            static constexpr uint32_t param_cnt = sizeof...(Args) - (takes_memory ? 1 : 0);
+            static constexpr bool returns_int = !std::is_void_v<R>;
+            static constexpr bool valid = (std::is_void_v<R> || std::is_same_v<R, int32_t>) &&
+                (std::is_same_v<Args, int32_t> + ... + 0) == param_cnt && param_cnt <= FFI_MAX_PARAMS;
+        };
+
+        template<auto Fn, typename R, typename... Args>
+        uint32_t ffi_invoke(FfiArgs const& args, R(*)(Args...)) {
+            // Host functions may take the VM memory as their first parameter
+            constexpr size_t first_int = FfiSignature<R(*)(Args...)>::takes_memory ? 1 : 0;
+            auto get = [&]<typename T>(size_t i) -> T {
+                if constexpr (std::is_same_v<T, FfiMemory>) { return args.memory; }
+                else { return args[i - first_int]; }
+            };
+            return [&]<size_t... I>(std::index_sequence<I...>) -> uint32_t {
+                if constexpr (std::is_void_v<R>) {
+                    Fn(get.template operator()<Args>(I)...);
+                    return 0;
+                }
+                else {
+                    return static_cast<uint32_t>(Fn(get.template operator()<Args>(I)...));
+                }
+            }(std::index_sequence_for<Args...>{});
+        }
+        template<auto Fn>
+        uint32_t ffi_thunk(FfiArgs const& args) {
+            return ffi_invoke<Fn>(args, Fn);
+        }
+    }
+
+    // Host functions available to programs, looked up by name at compile and load time
+    struct FfiRegistry {
+        // `Fn` has the form `int32_t / void fn([FfiMemory,] int32_t...)`
+        template<auto Fn>
+        void add(std::string name) {
+            using Signature = detail::FfiSignature<decltype(Fn)>;
+            static_assert(Signature::valid, "host function must take and return int32_t only");
+            add({ std::move(name), Signature::param_cnt, Signature::returns_int, &detail::ffi_thunk<Fn> });
+        }
+        void add(FfiFunction func);
+        FfiFunction const* find(std::string_view name) const;
+        std::span<FfiFunction const> functions() const { return m_funcs; }
+
+    private:
+        std::vector<FfiFunction> m_funcs;
+    };
+}
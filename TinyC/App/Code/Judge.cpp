@@ -0,0 +1,179 @@
+#include "pch.h"
+
+#include "Judge.hpp"
+
+#include <thread>
+
+namespace CTinyC {
+    // Instructions executed between two checks of the time budget
+    constexpr size_t JUDGE_CHUNK = 64 * 1024;
+
+    // Program output is never logged, and a case is judged on its verdict alone
+    struct NullLogger : Logger {
+        NullLogger() { set_min_severity(Severity::Off); }
+        void log(Severity, ::winrt::hstring const&) override {}
+    };
+
+    // Feeds the case input and matches the output against the expected one as it is
+    // written. On the first mismatch the interrupt flag stops the executor.
+    struct JudgeIo : ExecutorIo {
+        void reset(JudgeCase const& judge_case) {
+            m_input = judge_case.input;
+            m_expected = judge_case.expected_output;
+            m_input_pos = m_expected_pos = 0;
+            m_in_token = false;
+            m_mismatch.clear();
+            m_interrupt_flag.store(false, std::memory_order_relaxed);
+        }
+
+        int read_char() override {
+            if (m_input_pos == m_input.size()) { return -1; }
+            return static_cast<uint8_t>(m_input[m_input_pos++]);
+        }
+        void write(std::string_view bytes) override {
+            if (!m_mismatch.empty()) { return; }
+            for (auto c : bytes) {
+                if (isspace(static_cast<uint8_t>(c))) {
+                    if (m_in_token && !at_token_end()) {
+                        return fail("output token is shorter than expected");
+                    }
+                    m_in_token = false;
+                    continue;
+                }
+                if (!m_in_token) {
+                    skip_expected_space();
+                    m_in_token = true;
+                }
+                if (m_expected_pos == m_expected.size()) {
+                    return fail("output is longer than expected");
+                }
+                if (m_expected[m_expected_pos] != c) {
+                    return fail(std::format("output differs from expected at byte {}", m_expected_pos));
+                }
+                m_expected_pos++;
+            }
+        }
+        // Called once the program halted
+        void finish() {
+            if (!m_mismatch.empty()) { return; }
+            if (m_in_token && !at_token_end()) {
+                return fail("output token is shorter than expected");
+            }
+            skip_expected_space();
+            if (m_expected_pos != m_expected.size()) {
+                return fail("output is shorter than expected");
+            }
+        }
+
+        std::string const& mismatch() const { return m_mismatch; }
+        std::atomic_bool const& interrupt_flag() const { return m_interrupt_flag; }
+
+    private:
+        bool at_token_end() const {
+            return m_expected_pos == m_expected.size() ||
+                isspace(static_cast<uint8_t>(m_expected[m_expected_pos]));
+        }
+        void skip_expected_space() {
+            while (m_expected_pos < m_expected.size() &&
+                isspace(static_cast<uint8_t>(m_expected[m_expected_pos]))) {
+                m_expected_pos++;
+            }
+        }
+        void fail(std::string message) {
+            m_mismatch = std::move(message);
+            m_interrupt_flag.store(true, std::memory_order_relaxed);
+        }
+
+        std::string_view m_input, m_expected;
+        size_t m_input_pos{}, m_expected_pos{};
+        bool m_in_token{};
+        std::string m_mismatch;
+        std::atomic_bool m_interrupt_flag{};
+    };
+
+    char const* to_string(JudgeVerdict verdict) {
+        switch (verdict) {
+        case JudgeVerdict::Accepted: return "Accepted";
+        case JudgeVerdict::WrongAnswer: return "Wrong Answer";
+        case JudgeVerdict::TimeLimitExceeded: return "Time Limit Exceeded";
+        case JudgeVerdict::RuntimeError: return "Runtime Error";
+        }
+        return "Unknown";
+    }
+
+    JudgeResult Judge::run_case(JudgeCase const& judge_case) const {
+        NullLogger logger;
+        JudgeIo io;
+        Executor executor(&logger, &io);
+        return run_case(executor, io, judge_case);
+    }
+    JudgeResult Judge::run_case(Executor& executor, JudgeIo& io, JudgeCase const& judge_case) const {
+        using clock = std::chrono::steady_clock;
+
+        JudgeResult result;
+        auto t0 = clock::now();
+        io.reset(judge_case);
+        try {
+            executor.set_ffi_registry(m_ffi_registry);
+            executor.load(m_image);
+            while (true) {
+                auto chunk = JUDGE_CHUNK;
+                if (m_limits.max_insts) {
+                    chunk = std::min(chunk, m_limits.max_insts + 1 - executor.executed_count());
+                }
+                bool running = executor.execute(chunk, io.interrupt_flag());
+                result.executed_count = executor.executed_count();
+                result.elapsed = clock::now() - t0;
+                if (!io.mismatch().empty()) {
+                    result.verdict = JudgeVerdict::WrongAnswer;
+                    result.message = io.mismatch();
+                    break;
+                }
+                if (!running) {
+                    io.finish();
+                    result.verdict = io.mismatch().empty() ? JudgeVerdict::Accepted : JudgeVerdict::WrongAnswer;
+                    result.message = io.mismatch();
+                    break;
+                }
+                if ((m_limits.max_insts && result.executed_count > m_limits.max_insts) ||
+                    (m_limits.max_time.count() && result.elapsed > m_limits.max_time)) {
+                    result.verdict = JudgeVerdict::TimeLimitExceeded;
+                    break;
+                }
+            }
+        }
+        catch (std::exception const& e) {
+            result.verdict = JudgeVerdict::RuntimeError;
+            result.message = e.what();
+            result.executed_count = executor.executed_count();
+            result.elapsed = clock::now() - t0;
+        }
+        return result;
+    }
+    std::vector<JudgeResult> Judge::run_all(std::span<JudgeCase const> cases, size_t thread_count) const {
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min(thread_count, cases.size());
+
+        std::vector<JudgeResult> results(cases.size());
+        std::atomic_size_t next_case{};
+        auto worker = [&] {
+            // One executor per worker; reloading the image reuses its memory
+            NullLogger logger;
+            JudgeIo io;
+            Executor executor(&logger, &io);
+            for (size_t i; (i = next_case.fetch_add(1, std::memory_order_relaxed)) < cases.size();) {
+                results[i] = run_case(executor, io, cases[i]);
+            }
+        };
+        {
+            std::vector<std::jthread> threads;
+            for (size_t i = 1; i < thread_count; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();
+        }
+        return results;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Executor.hpp"
+#include <chrono>
+#include <span>
+#include <string>
+
+namespace CTinyC {
+    struct JudgeCase {
+        std::string input;
+        std::string expected_output;
+    };
+
+    enum class JudgeVerdict {
+        Accepted,
+        WrongAnswer,
+        TimeLimitExceeded,
+        RuntimeError,
+    };
+    char const* to_string(JudgeVerdict verdict);
+
+    struct JudgeResult {
+        JudgeVerdict verdict{};
+        size_t executed_count{};
+        std::chrono::nanoseconds elapsed{};
+        // Reason of a runtime error or of a wrong answer
+        std::string message;
+    };
+
+    // Budget of a single case; a zero limit is unlimited
+    struct JudgeLimits {
+        size_t max_insts{};
+        std::chrono::milliseconds max_time{};
+    };
+
+    struct JudgeIo;
+
+    // Runs one loaded program against many input cases. Every case starts from a fresh
+    // copy of the image, and its output is compared token by token (whitespace is not
+    // significant) while it is being produced, so a wrong answer stops the case early.
+    struct Judge {
+        // Host functions imported by the image are resolved in `ffi_registry`
+        Judge(ExecutorImage const& image, JudgeLimits limits, FfiRegistry const* ffi_registry = nullptr) :
+            m_image(image), m_limits(limits), m_ffi_registry(ffi_registry) {}
+
+        JudgeResult run_case(JudgeCase const& judge_case) const;
+        // Cases are distributed over `thread_count` workers (0 = one per hardware thread);
+        // results are in the order of `cases`
+        std::vector<JudgeResult> run_all(std::span<JudgeCase const> cases, size_t thread_count = 0) const;
+
+    private:
+        JudgeResult run_case(Executor& executor, JudgeIo& io, JudgeCase const& judge_case) const;
+
+        ExecutorImage const& m_image;
+        JudgeLimits m_limits;
+        FfiRegistry const* m_ffi_registry;
+    };
+}
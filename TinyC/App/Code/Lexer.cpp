@@ -47,6 +47,7 @@ namespace CTinyC {
     }
 
     std::optional<Token> Lexer::next_token() {
+        m_cancellation.throw_if_cancelled();
         skip_space();
         if (is_at_end()) { return std::nullopt; }
         int last_line = m_line, last_column = m_column;
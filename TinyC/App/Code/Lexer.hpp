@@ -1,5 +1,6 @@
 #pragma once
 
+#include "CompileControl.hpp"
 #include "Logger.hpp"
 #include <string_view>
 
@@ -60,15 +61,24 @@ namespace CTinyC {
 
         void init(std::string_view str) {
             m_str = str;
+            m_total_size = str.size();
             m_line = 1;
             m_column = 1;
         }
+        // Checked before every token
+        void set_cancellation(CancellationToken token) {
+            m_cancellation = std::move(token);
+        }
         std::optional<Token> next_token();
         std::optional<Token> peek_next_token();
 
         TokenPosition get_current_position() const {
             return { m_line, m_column };
         }
+        // Fraction of the source consumed
+        double progress() const {
+            return m_total_size ? 1.0 - (double)m_str.size() / m_total_size : 1.0;
+        }
 
     private:
         bool is_at_end() const {
@@ -115,6 +125,8 @@ namespace CTinyC {
 
         Logger* m_logger;
         std::string_view m_str;
+        size_t m_total_size{};
         int m_line, m_column;
+        CancellationToken m_cancellation;
     };
 }
@@ -3,5 +3,25 @@
 #include "Logger.hpp"
 
 namespace CTinyC {
-    // Nothing here
+    namespace {
+        template<size_t N>
+        std::wstring format_n(std::wstring_view fmt, std::array<int64_t, LazyMessage::MAX_ARGS> const& args) {
+            return [&]<size_t... I>(std::index_sequence<I...>) {
+                return std::vformat(fmt, std::make_wformat_args(args[I]...));
+            }(std::make_index_sequence<N>{});
+        }
+    }
+
+    ::winrt::hstring LazyMessage::format() const {
+        switch (arg_cnt) {
+        case 0: return ::winrt::hstring(format_n<0>(fmt, args));
+        case 1: return ::winrt::hstring(format_n<1>(fmt, args));
+        case 2: return ::winrt::hstring(format_n<2>(fmt, args));
+        case 3: return ::winrt::hstring(format_n<3>(fmt, args));
+        case 4: return ::winrt::hstring(format_n<4>(fmt, args));
+        case 5: return ::winrt::hstring(format_n<5>(fmt, args));
+        case 6: return ::winrt::hstring(format_n<6>(fmt, args));
+        default: throw std::logic_error("too many arguments for a lazy message");
+        }
+    }
 }
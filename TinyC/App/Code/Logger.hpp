@@ -1,6 +1,23 @@
 #pragma once
 
+#include <array>
+#include <concepts>
+#include <format>
+#include <string_view>
+
 namespace CTinyC {
+    // A message formatted only when (and where) it is displayed. The format string is
+    // kept by reference, so it must be a literal; arguments are limited to integers.
+    struct LazyMessage {
+        static constexpr size_t MAX_ARGS = 6;
+
+        std::wstring_view fmt;
+        std::array<int64_t, MAX_ARGS> args;
+        uint8_t arg_cnt;
+
+        ::winrt::hstring format() const;
+    };
+
     struct Logger {
         enum class Severity {
             Trace,
@@ -8,14 +25,41 @@ namespace CTinyC {
             Info,
             Warn,
             Error,
+            // Above every message, for set_min_severity
+            Off,
         };
 
         virtual void log(Severity severity, ::winrt::hstring const& str) = 0;
+        // Loggers which hand messages to another thread override this to defer formatting
+        virtual void log_lazy(Severity severity, LazyMessage const& msg) { log(severity, msg.format()); }
+
+        // Messages below `severity` are dropped before anything is formatted
+        void set_min_severity(Severity severity) { m_min_severity = severity; }
+        bool is_enabled(Severity severity) const { return severity >= m_min_severity; }
+
+        void trace(::winrt::param::hstring const& str) { if (is_enabled(Severity::Trace)) { log(Severity::Trace, str); } }
+        void debug(::winrt::param::hstring const& str) { if (is_enabled(Severity::Debug)) { log(Severity::Debug, str); } }
+        void info(::winrt::param::hstring const& str) { if (is_enabled(Severity::Info)) { log(Severity::Info, str); } }
+        void warn(::winrt::param::hstring const& str) { if (is_enabled(Severity::Warn)) { log(Severity::Warn, str); } }
+        void error(::winrt::param::hstring const& str) { if (is_enabled(Severity::Error)) { log(Severity::Error, str); } }
+
+        // Same as std::format, but costs next to nothing when the severity is disabled
+        template<std::integral... Args>
+        void logf(Severity severity, std::wformat_string<std::type_identity_t<Args>...> fmt, Args... args) {
+            static_assert(sizeof...(Args) <= LazyMessage::MAX_ARGS, "too many arguments for a lazy message");
+            if (!is_enabled(severity)) { return; }
+            log_lazy(severity, { fmt.get(), { static_cast<int64_t>(args)... }, sizeof...(Args) });
+        }
+        template<std::integral... Args>
+        void tracef(std::wformat_string<std::type_identity_t<Args>...> fmt, Args... args) {
+            logf(Severity::Trace, fmt, args...);
+        }
+        template<std::integral... Args>
+        void debugf(std::wformat_string<std::type_identity_t<Args>...> fmt, Args... args) {
+            logf(Severity::Debug, fmt, args...);
+        }
 
-        void trace(::winrt::param::hstring const& str) { return log(Severity::Trace, str); }
-        void debug(::winrt::param::hstring const& str) { return log(Severity::Debug, str); }
-        void info(::winrt::param::hstring const& str) { return log(Severity::Info, str); }
-        void warn(::winrt::param::hstring const& str) { return log(Severity::Warn, str); }
-        void error(::winrt::param::hstring const& str) { return log(Severity::Error, str); }
+    private:
+        Severity m_min_severity{ Severity::Trace };
     };
 }
@@ -22,7 +22,9 @@ namespace CTinyC {
     }
 
     struct ParserCore {
-        ParserCore(Logger* logger, Lexer* lexer) : m_logger(logger), m_lexer(lexer) {}
+        ParserCore(Logger* logger, Lexer* lexer, CancellationToken const& cancellation,
+            CompileProgressFn const& on_progress
+        ) : m_logger(logger), m_lexer(lexer), m_cancellation(cancellation), m_on_progress(on_progress) {}
 
         std::unique_ptr<ASTN> do_parse() try {
             auto decl_list = declaration_list();
@@ -113,10 +115,11 @@ namespace CTinyC {
         }
         std::vector<std::unique_ptr<ASTN_Decl>> declaration_list() {
             std::vector<std::unique_ptr<ASTN_Decl>> result;
-            result.push_back(declaration());
-            while (!is_at_end()) {
+            do {
+                m_cancellation.throw_if_cancelled();
                 result.push_back(declaration());
-            }
+                if (m_on_progress) { m_on_progress(CompilePhase::Parse, m_lexer->progress()); }
+            } while (!is_at_end());
             return result;
         }
         std::unique_ptr<ASTN_Decl> declaration() {
@@ -146,9 +149,26 @@ namespace CTinyC {
                 ret_type = { ASTData_Type_Array{ expression(), std::make_unique<ASTData_Type>(std::move(ret_type)) } };
                 consume(TokenType::RSquareBracket);
             }
-            // TODO: init value
+            std::vector<std::unique_ptr<ASTN_Expr>> init_values;
+            if (matches(TokenType::Assign)) {
+                consume(TokenType::Assign);
+                if (std::get_if<ASTData_Type_Array>(&ret_type.t)) {
+                    consume(TokenType::LCurlyBracket);
+                    if (!matches(TokenType::RCurlyBracket)) {
+                        init_values.push_back(expression());
+                        while (matches(TokenType::Comma)) {
+                            next_token();
+                            init_values.push_back(expression());
+                        }
+                    }
+                    consume(TokenType::RCurlyBracket);
+                }
+                else {
+                    init_values.push_back(expression());
+                }
+            }
             consume(TokenType::Semicolon);
-            return std::make_unique<ASTN_VarDecl>(std::move(ret_type), std::move(id));
+            return std::make_unique<ASTN_VarDecl>(std::move(ret_type), std::move(id), std::move(init_values));
         }
         //void var_declaration() {
         //    // TODO...
@@ -223,19 +243,26 @@ namespace CTinyC {
             return stmts;
         }
         std::unique_ptr<ASTN_Stmt> statement() try {
+            m_cancellation.throw_if_cancelled();
+            auto token = look_ahead();
+            std::unique_ptr<ASTN_Stmt> stmt;
             if (matches(TokenType::LCurlyBracket)) {
-                return compound_stmt();
+                stmt = compound_stmt();
             }
-            if (matches(TokenType::KwIf)) {
-                return selection_stmt();
+            else if (matches(TokenType::KwIf)) {
+                stmt = selection_stmt();
             }
-            if (matches(TokenType::KwWhile)) {
-                return iteration_stmt();
+            else if (matches(TokenType::KwWhile)) {
+                stmt = iteration_stmt();
             }
-            if (matches(TokenType::KwReturn)) {
-                return return_stmt();
+            else if (matches(TokenType::KwReturn)) {
+                stmt = return_stmt();
+            }
+            else {
+                stmt = expression_stmt();
             }
-            return expression_stmt();
+            stmt->line = token ? token->line : 0;
+            return stmt;
         }
         catch (parse_error const& e) {
             // Recover from error
@@ -398,11 +425,13 @@ namespace CTinyC {
 
         Logger* m_logger;
         Lexer* m_lexer;
+        CancellationToken const& m_cancellation;
+        CompileProgressFn const& m_on_progress;
         bool m_has_error{};
     };
 
     std::unique_ptr<ASTN> Parser::parse(Lexer* lexer) {
-        ParserCore parser_core(m_logger, lexer);
+        ParserCore parser_core(m_logger, lexer, m_cancellation, m_on_progress);
         return parser_core.do_parse();
     }
 }
@@ -118,6 +118,9 @@ namespace CTinyC {
     struct ASTN_Stmt {
         virtual void accept(ASTN_StmtVisitor& visitor) const = 0;
         virtual ~ASTN_Stmt() {}
+
+        // Source line of the first token, for debug info
+        int line{};
     };
     struct ASTN_ExprStmt;
     struct ASTN_IfStmt;
@@ -186,13 +189,15 @@ namespace CTinyC {
         virtual void visit_func_decl(ASTN_FuncDecl const& v) = 0;
     };
     struct ASTN_VarDecl : ASTN_Decl {
-        ASTN_VarDecl(ASTData_Type type, Token id) : type(std::move(type)), id(std::move(id)) {}
+        ASTN_VarDecl(ASTData_Type type, Token id, std::vector<std::unique_ptr<ASTN_Expr>> init_values = {}) :
+            type(std::move(type)), id(std::move(id)), init_values(std::move(init_values)) {}
         void accept(ASTN_DeclVisitor& visitor) const override {
             visitor.visit_var_decl(*this);
         }
         ASTData_Type type;
         Token id;
-        //std::unique_ptr<ASTN_Expr> init_value;
+        // Empty if not initialized; arrays take a braced list
+        std::vector<std::unique_ptr<ASTN_Expr>> init_values;
     };
     struct ASTN_FuncDecl : ASTN_Decl {
         ASTN_FuncDecl(ASTData_Type ret_type, Token id, std::vector<ASTData_Param> params, std::unique_ptr<ASTN_Stmt> body) :
@@ -229,8 +234,15 @@ namespace CTinyC {
         // NOTE: This method throws exceptions on failure
         std::unique_ptr<ASTN> parse(Lexer* lexer);
 
+        // Checked before every declaration and statement
+        void set_cancellation(CancellationToken token) { m_cancellation = std::move(token); }
+        // Reported after every declaration, as the fraction of the source parsed
+        void set_progress(CompileProgressFn fn) { m_on_progress = std::move(fn); }
+
     private:
         Logger* m_logger;
+        CancellationToken m_cancellation;
+        CompileProgressFn m_on_progress;
     };
 
 
@@ -0,0 +1,241 @@
+#include "pch.h"
+
+#include "SharedRing.hpp"
+
+#ifndef _WIN32
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CTinyC {
+    // How often a blocked side checks whether its peer is gone
+    constexpr uint32_t PEER_POLL_INTERVAL_MS = 100;
+
+    void SharedRing::write_bytes(void const* buf, size_t len) {
+        auto& h = *m_header;
+        auto src = static_cast<uint8_t const*>(buf);
+        uint64_t tail = h.tail.load(std::memory_order_relaxed);
+        while (len > 0) {
+            uint64_t head = h.head.load(std::memory_order_acquire);
+            size_t free_size = h.capacity - (tail - head);
+            if (free_size == 0) {
+                auto seq = h.space_seq.load(std::memory_order_acquire);
+                h.producer_waiting.store(1);
+                if (h.head.load() == head) {
+                    wait(h.space_seq, seq, h.space_event);
+                }
+                h.producer_waiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            if (h.closed.load(std::memory_order_relaxed)) {
+                throw std::runtime_error("shared channel is closed");
+            }
+            auto n = std::min(len, free_size);
+            auto pos = static_cast<size_t>(tail & (h.capacity - 1));
+            auto first = std::min(n, h.capacity - pos);
+            std::memcpy(m_data + pos, src, first);
+            std::memcpy(m_data, src + first, n - first);
+            src += n;
+            len -= n;
+            tail += n;
+            h.tail.store(tail);
+            if (h.consumer_waiting.load()) {
+                h.data_seq.fetch_add(1, std::memory_order_release);
+                wake(h.data_seq, h.data_event);
+            }
+        }
+    }
+    void SharedRing::read_bytes(void* buf, size_t len) {
+        auto& h = *m_header;
+        auto dst = static_cast<uint8_t*>(buf);
+        uint64_t head = h.head.load(std::memory_order_relaxed);
+        while (len > 0) {
+            uint64_t tail = h.tail.load(std::memory_order_acquire);
+            size_t avail_size = tail - head;
+            if (avail_size == 0) {
+                auto seq = h.data_seq.load(std::memory_order_acquire);
+                h.consumer_waiting.store(1);
+                if (h.tail.load() == head) {
+                    wait(h.data_seq, seq, h.data_event);
+                }
+                h.consumer_waiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            auto n = std::min(len, avail_size);
+            auto pos = static_cast<size_t>(head & (h.capacity - 1));
+            auto first = std::min(n, h.capacity - pos);
+            std::memcpy(dst, m_data + pos, first);
+            std::memcpy(dst + first, m_data, n - first);
+            dst += n;
+            len -= n;
+            head += n;
+            h.head.store(head);
+            if (h.producer_waiting.load()) {
+                h.space_seq.fetch_add(1, std::memory_order_release);
+                wake(h.space_seq, h.space_event);
+            }
+        }
+    }
+    void SharedRing::check_peer() {
+        if (m_header->closed.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("shared channel is closed");
+        }
+        if (m_peer_alive && !m_peer_alive()) {
+            throw std::runtime_error("shared channel peer has exited");
+        }
+    }
+
+#ifdef _WIN32
+    void SharedRing::wait(std::atomic<uint32_t>& word, uint32_t expected, uint64_t event) {
+        check_peer();
+        if (word.load(std::memory_order_acquire) != expected) { return; }
+        // Events may carry a stale signal, callers re-check their condition anyway
+        WaitForSingleObject(reinterpret_cast<HANDLE>(event), PEER_POLL_INTERVAL_MS);
+    }
+    void SharedRing::wake(std::atomic<uint32_t>& word, uint64_t event) {
+        SetEvent(reinterpret_cast<HANDLE>(event));
+    }
+
+    SharedChannel SharedChannel::create(uint32_t capacity) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("ring capacity must be a power of 2");
+        }
+        SECURITY_ATTRIBUTES sa{ .nLength = sizeof sa, .bInheritHandle = true };
+        SharedChannel channel;
+        channel.m_view_size = region_size(capacity);
+        channel.m_handle = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE,
+            static_cast<DWORD>(channel.m_view_size >> 32), static_cast<DWORD>(channel.m_view_size), nullptr);
+        ::winrt::check_bool(channel.m_handle != nullptr);
+        channel.m_view = MapViewOfFile(channel.m_handle, FILE_MAP_ALL_ACCESS, 0, 0, channel.m_view_size);
+        ::winrt::check_bool(channel.m_view != nullptr);
+        // Fresh memory is zeroed, which is a valid empty state apart from these
+        auto base = static_cast<uint8_t*>(channel.m_view);
+        for (auto offset : { size_t{}, sizeof(SharedRingHeader) + capacity }) {
+            auto header = reinterpret_cast<SharedRingHeader*>(base + offset);
+            header->capacity = capacity;
+            header->data_event = reinterpret_cast<uint64_t>(CreateEventW(&sa, false, false, nullptr));
+            header->space_event = reinterpret_cast<uint64_t>(CreateEventW(&sa, false, false, nullptr));
+            ::winrt::check_bool(header->data_event && header->space_event);
+        }
+        channel.map(true);
+        return channel;
+    }
+    SharedChannel SharedChannel::open(NativeHandle handle) {
+        SharedChannel channel;
+        channel.m_handle = handle;
+        channel.m_view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        ::winrt::check_bool(channel.m_view != nullptr);
+        auto capacity = static_cast<SharedRingHeader*>(channel.m_view)->capacity;
+        channel.m_view_size = region_size(capacity);
+        channel.map(false);
+        return channel;
+    }
+    SharedChannel::~SharedChannel() {
+        if (m_view) {
+            for (auto ring : { &m_tx, &m_rx }) {
+                CloseHandle(reinterpret_cast<HANDLE>(ring->m_header->data_event));
+                CloseHandle(reinterpret_cast<HANDLE>(ring->m_header->space_event));
+            }
+            UnmapViewOfFile(m_view);
+        }
+        if (m_handle) {
+            CloseHandle(m_handle);
+        }
+    }
+#else
+    void SharedRing::wait(std::atomic<uint32_t>& word, uint32_t expected, uint64_t) {
+        check_peer();
+        timespec timeout{ .tv_sec = 0, .tv_nsec = PEER_POLL_INTERVAL_MS * 1000 * 1000 };
+        // Returns immediately if the word already changed
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+    void SharedRing::wake(std::atomic<uint32_t>& word, uint64_t) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    SharedChannel SharedChannel::create(uint32_t capacity) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("ring capacity must be a power of 2");
+        }
+        SharedChannel channel;
+        // Not close-on-exec, so that the child can inherit the descriptor
+        channel.m_handle = memfd_create("tinyc-channel", 0);
+        if (channel.m_handle < 0 || ftruncate(channel.m_handle, region_size(capacity)) != 0) {
+            throw std::runtime_error("cannot create shared memory region");
+        }
+        // Fresh memory is zeroed, which is a valid empty state apart from capacity
+        channel.m_view_size = region_size(capacity);
+        auto base = static_cast<uint8_t*>(mmap(nullptr, channel.m_view_size,
+            PROT_READ | PROT_WRITE, MAP_SHARED, channel.m_handle, 0));
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("cannot map shared memory region");
+        }
+        reinterpret_cast<SharedRingHeader*>(base)->capacity = capacity;
+        reinterpret_cast<SharedRingHeader*>(base + sizeof(SharedRingHeader) + capacity)->capacity = capacity;
+        channel.m_view = base;
+        channel.map(true);
+        return channel;
+    }
+    SharedChannel SharedChannel::open(NativeHandle handle) {
+        SharedChannel channel;
+        channel.m_handle = handle;
+        struct stat st;
+        if (fstat(handle, &st) != 0) {
+            throw std::runtime_error("invalid shared memory handle");
+        }
+        channel.m_view_size = static_cast<size_t>(st.st_size);
+        auto base = mmap(nullptr, channel.m_view_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("cannot map shared memory region");
+        }
+        channel.m_view = base;
+        if (region_size(static_cast<SharedRingHeader*>(base)->capacity) != channel.m_view_size) {
+            throw std::runtime_error("shared memory region is corrupted");
+        }
+        channel.map(false);
+        return channel;
+    }
+    SharedChannel::~SharedChannel() {
+        if (m_view) {
+            munmap(m_view, m_view_size);
+        }
+        if (m_handle >= 0) {
+            ::close(m_handle);
+        }
+    }
+#endif
+
+    SharedChannel& SharedChannel::operator=(SharedChannel&& other) noexcept {
+        std::swap(m_handle, other.m_handle);
+        std::swap(m_view, other.m_view);
+        std::swap(m_view_size, other.m_view_size);
+        std::swap(m_tx, other.m_tx);
+        std::swap(m_rx, other.m_rx);
+        return *this;
+    }
+    size_t SharedChannel::region_size(uint32_t capacity) {
+        return 2 * (sizeof(SharedRingHeader) + capacity);
+    }
+    void SharedChannel::map(bool is_parent) {
+        auto base = static_cast<uint8_t*>(m_view);
+        auto capacity = reinterpret_cast<SharedRingHeader*>(base)->capacity;
+        SharedRing first{ reinterpret_cast<SharedRingHeader*>(base), base + sizeof(SharedRingHeader) };
+        base += sizeof(SharedRingHeader) + capacity;
+        SharedRing second{ reinterpret_cast<SharedRingHeader*>(base), base + sizeof(SharedRingHeader) };
+        m_tx = is_parent ? first : second;
+        m_rx = is_parent ? second : first;
+    }
+    void SharedChannel::close() {
+        for (auto ring : { &m_tx, &m_rx }) {
+            auto& h = *ring->m_header;
+            h.closed.store(1);
+            h.data_seq.fetch_add(1);
+            h.space_seq.fetch_add(1);
+            ring->wake(h.data_seq, h.data_event);
+            ring->wake(h.space_seq, h.space_event);
+        }
+    }
+}
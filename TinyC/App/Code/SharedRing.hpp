@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace CTinyC {
+    // Single-producer / single-consumer byte ring in memory shared between two processes.
+    // Positions are published with plain atomic stores; a side only enters the kernel
+    // (futex on Linux, event on Windows) when it has to sleep, or when the other side
+    // announced that it sleeps. Bursts of small records therefore cost no syscalls.
+    struct SharedRingHeader {
+        alignas(64) std::atomic<uint64_t> head;         // Consumer position
+        alignas(64) std::atomic<uint64_t> tail;         // Producer position
+        // Wait words, bumped whenever a sleeping peer must be woken
+        alignas(64) std::atomic<uint32_t> data_seq;
+        std::atomic<uint32_t> space_seq;
+        std::atomic<uint32_t> consumer_waiting;
+        std::atomic<uint32_t> producer_waiting;
+        std::atomic<uint32_t> closed;
+        uint32_t capacity;
+        // Windows: inherited event handles backing data_seq / space_seq
+        uint64_t data_event, space_event;
+    };
+
+    struct SharedRing {
+        SharedRing() = default;
+        SharedRing(SharedRingHeader* header, uint8_t* data) : m_header(header), m_data(data) {}
+
+        // Blocking; throws if the peer went away
+        void write_bytes(void const* buf, size_t len);
+        void write_u32(uint32_t v) { write_bytes(&v, sizeof v); }
+        void read_bytes(void* buf, size_t len);
+        uint32_t read_u32() {
+            uint32_t v;
+            read_bytes(&v, sizeof v);
+            return v;
+        }
+
+    private:
+        friend struct SharedChannel;
+
+        void wait(std::atomic<uint32_t>& word, uint32_t expected, uint64_t event);
+        void wake(std::atomic<uint32_t>& word, uint64_t event);
+        void check_peer();
+
+        SharedRingHeader* m_header{};
+        uint8_t* m_data{};
+        std::function<bool()> m_peer_alive;
+    };
+
+    // Pair of rings in one shared memory region: the parent writes to the first ring
+    // and reads from the second, the child does the opposite.
+    struct SharedChannel {
+#ifdef _WIN32
+        using NativeHandle = HANDLE;
+        static constexpr NativeHandle INVALID_NATIVE_HANDLE = nullptr;
+#else
+        using NativeHandle = int;
+        static constexpr NativeHandle INVALID_NATIVE_HANDLE = -1;
+#endif
+
+        // Creates an inheritable region with rings of `capacity` bytes (a power of 2)
+        static SharedChannel create(uint32_t capacity);
+        // Maps the region inherited from the parent
+        static SharedChannel open(NativeHandle handle);
+
+        SharedChannel() = default;
+        SharedChannel(SharedChannel&& other) noexcept { *this = std::move(other); }
+        SharedChannel& operator=(SharedChannel&& other) noexcept;
+        ~SharedChannel();
+
+        NativeHandle native_handle() const { return m_handle; }
+        SharedRing& tx() { return m_tx; }
+        SharedRing& rx() { return m_rx; }
+        // Polled while blocked, returns whether the peer process is still alive
+        void set_peer_alive(std::function<bool()> fn) {
+            m_tx.m_peer_alive = fn;
+            m_rx.m_peer_alive = std::move(fn);
+        }
+        // Marks both rings closed so that a blocked peer gives up
+        void close();
+
+    private:
+        static size_t region_size(uint32_t capacity);
+        void map(bool is_parent);
+
+        NativeHandle m_handle{ INVALID_NATIVE_HANDLE };
+        void* m_view{};
+        size_t m_view_size{};
+        SharedRing m_tx, m_rx;
+    };
+}
@@ -0,0 +1,307 @@
+#include "pch.h"
+
+#include "VmHeap.hpp"
+
+#include <bit>
+
+namespace CTinyC {
+    // Written around payloads in checked mode
+    constexpr uint32_t HEAP_CANARY = 0xfdfdfdfd;
+
+    void VmHeap::reset(uint8_t* memory, uint32_t begin, uint32_t end, bool checked) {
+        m_memory = memory;
+        // Headers sit 4 bytes before 8-aligned payloads
+        m_first = std::min((begin + 3) / 8 * 8 + 4, end);
+        m_top = m_first;
+        m_end = end;
+        m_checked = checked;
+        m_live_cnt = 0;
+        m_small_lists.fill(0);
+        m_bins.fill(0);
+        m_bin_map = 0;
+    }
+
+    uint32_t VmHeap::allocate(uint32_t size) {
+        if (size > m_end - m_first) { return 0; }
+        auto block_size = block_size_for(size);
+        uint32_t block{};
+        if (block_size <= SMALL_BLOCK_MAX && m_small_lists[block_size / 8]) {
+            auto& head = m_small_lists[block_size / 8];
+            block = head;
+            auto header = read_dword(block);
+            if ((header & ~PREV_FREE) != (block_size | CACHED)) {
+                throw std::runtime_error("VM heap corrupted");
+            }
+            head = checked_link(read_dword(block + 4));
+            write_dword(block, (header & PREV_FREE) | block_size | IN_USE);
+        }
+        else {
+            block = allocate_block(block_size);
+            // Small blocks parked in free lists may be what keeps the space fragmented
+            if (!block && consolidate()) {
+                block = allocate_block(block_size);
+            }
+            if (!block) { return 0; }
+        }
+        m_live_cnt++;
+        set_payload_size(block, size);
+        return block + payload_offset();
+    }
+    void VmHeap::release(uint32_t ptr) {
+        if (ptr == 0) { return; }
+        auto block = checked_live_block(ptr);
+        if (m_checked) { check_canaries(block); }
+        m_live_cnt--;
+        auto header = read_dword(block);
+        auto size = header & ~FLAGS_MASK;
+        if (size <= SMALL_BLOCK_MAX) {
+            auto& head = m_small_lists[size / 8];
+            write_dword(block, (header & PREV_FREE) | size | CACHED);
+            write_dword(block + 4, head);
+            head = block;
+            return;
+        }
+        free_block(block, size);
+    }
+    uint32_t VmHeap::reallocate(uint32_t ptr, uint32_t size) {
+        if (ptr == 0) { return allocate(size); }
+        if (size == 0) {
+            release(ptr);
+            return 0;
+        }
+        auto block = checked_live_block(ptr);
+        if (m_checked) { check_canaries(block); }
+        if (size > m_end - m_first) { return 0; }
+        auto header = read_dword(block);
+        auto old_block_size = header & ~FLAGS_MASK;
+        auto block_size = block_size_for(size);
+        if (block_size > old_block_size) {
+            // Grow in place if the space right after the block is free
+            auto next = block + old_block_size;
+            auto next_is_free = next < m_top && !(read_dword(next) & (IN_USE | CACHED));
+            auto next_size = next_is_free ? checked_free_size(next) : 0;
+            if (next == m_top && block_size - old_block_size <= m_end - m_top) {
+                m_top = block + block_size;
+            }
+            else if (next_is_free && old_block_size + next_size >= block_size) {
+                unlink_free_block(next, next_size);
+                auto total_size = old_block_size + next_size;
+                if (total_size - block_size >= MIN_BLOCK) {
+                    insert_free_block(block + block_size, total_size - block_size);
+                }
+                else {
+                    block_size = total_size;
+                    clear_prev_free(block + block_size);
+                }
+            }
+            else {
+                auto copy_size = std::min(payload_size(block), size);
+                auto new_ptr = allocate(size);
+                if (!new_ptr) { return 0; }
+                std::memcpy(m_memory + new_ptr, m_memory + ptr, copy_size);
+                release(ptr);
+                return new_ptr;
+            }
+            write_dword(block, (header & PREV_FREE) | block_size | IN_USE);
+        }
+        set_payload_size(block, size);
+        return ptr;
+    }
+    void VmHeap::check() const {
+        for (auto block = m_first; block < m_top;) {
+            auto size = read_dword(block) & ~FLAGS_MASK;
+            if (size < MIN_BLOCK || size % 8 != 0 || size > m_top - block) {
+                throw std::runtime_error(std::format("VM heap block header at {} is corrupted", block));
+            }
+            auto header = read_dword(block);
+            if (m_checked && (header & IN_USE)) {
+                check_canaries(block);
+            }
+            if (!(header & (IN_USE | CACHED))) {
+                checked_free_size(block);
+            }
+            block += size;
+        }
+    }
+
+    // Little-endian like the VM; compilers fold these into plain loads and stores
+    uint32_t VmHeap::read_dword(uint32_t addr) const {
+        auto p = m_memory + addr;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    void VmHeap::write_dword(uint32_t addr, uint32_t v) {
+        auto p = m_memory + addr;
+        p[0] = v & 0xff;
+        p[1] = (v >> 8) & 0xff;
+        p[2] = (v >> 16) & 0xff;
+        p[3] = v >> 24;
+    }
+    uint32_t VmHeap::block_size_for(uint32_t size) const {
+        // Header, plus requested size and both canaries in checked mode
+        uint32_t overhead = m_checked ? 16 : 4;
+        return std::max((size + overhead + 7) / 8 * 8, MIN_BLOCK);
+    }
+    uint32_t VmHeap::payload_size(uint32_t block) const {
+        return m_checked ? read_dword(block + 4) : (read_dword(block) & ~FLAGS_MASK) - 4;
+    }
+    uint32_t VmHeap::checked_live_block(uint32_t ptr) const {
+        auto block = ptr - payload_offset();
+        if (ptr < payload_offset() || block < m_first || block >= m_top || block % 8 != 4) {
+            throw std::runtime_error("free of a pointer not returned by malloc");
+        }
+        auto header = read_dword(block);
+        if (!(header & IN_USE)) {
+            throw std::runtime_error("double free or free of a released block");
+        }
+        auto size = header & ~FLAGS_MASK;
+        if (size < MIN_BLOCK || size % 8 != 0 || size > m_top - block) {
+            throw std::runtime_error(std::format("VM heap block header at {} is corrupted", block));
+        }
+        return block;
+    }
+    void VmHeap::set_payload_size(uint32_t block, uint32_t size) {
+        if (!m_checked) { return; }
+        write_dword(block + 4, size);
+        write_dword(block + 8, HEAP_CANARY);
+        write_dword(block + 12 + size, HEAP_CANARY);
+    }
+    void VmHeap::check_canaries(uint32_t block) const {
+        auto size = read_dword(block + 4);
+        auto block_size = read_dword(block) & ~FLAGS_MASK;
+        if (size > block_size - 16 || read_dword(block + 8) != HEAP_CANARY ||
+            read_dword(block + 12 + size) != HEAP_CANARY) {
+            throw std::runtime_error(std::format("VM heap overflow detected around block at {}", block + 12));
+        }
+    }
+    void VmHeap::free_block(uint32_t block, uint32_t size) {
+        if (read_dword(block) & PREV_FREE) {
+            auto prev_size = read_dword(block - 4);
+            if (prev_size > block - m_first || checked_free_size(block - prev_size) != prev_size) {
+                throw std::runtime_error("VM heap corrupted");
+            }
+            unlink_free_block(block - prev_size, prev_size);
+            block -= prev_size;
+            size += prev_size;
+        }
+        auto next = block + size;
+        if (next < m_top && !(read_dword(next) & (IN_USE | CACHED))) {
+            auto next_size = checked_free_size(next);
+            unlink_free_block(next, next_size);
+            size += next_size;
+            next += next_size;
+        }
+        if (next == m_top) {
+            // Give the space back to the untouched top
+            m_top = block;
+            return;
+        }
+        insert_free_block(block, size);
+    }
+    bool VmHeap::consolidate() {
+        bool any{};
+        for (auto& head : m_small_lists) {
+            for (auto block = std::exchange(head, 0); block;) {
+                auto next = checked_link(read_dword(block + 4));
+                free_block(block, read_dword(block) & ~FLAGS_MASK);
+                block = next;
+                any = true;
+            }
+        }
+        return any;
+    }
+    uint32_t VmHeap::checked_free_size(uint32_t block) const {
+        auto header = read_dword(block);
+        auto size = header & ~FLAGS_MASK;
+        if ((header & (IN_USE | CACHED)) || size < MIN_BLOCK || size % 8 != 0 ||
+            size > m_top - block || read_dword(block + size - 4) != size) {
+            throw std::runtime_error("VM heap corrupted");
+        }
+        return size;
+    }
+    uint32_t VmHeap::checked_link(uint32_t block) const {
+        if (block && (block < m_first || block >= m_top || block % 8 != 4)) {
+            throw std::runtime_error("VM heap corrupted");
+        }
+        return block;
+    }
+    uint32_t VmHeap::allocate_block(uint32_t size) {
+        // Bins hold sizes in [2^bin, 2^(bin+1)): search a few entries of the own bin
+        // first fit, then any block of a larger bin fits
+        constexpr int MAX_BIN_SCAN = 16;
+        auto bin = std::bit_width(size) - 1;
+        uint32_t block{}, free_size{};
+        int scan_cnt{};
+        for (auto it = m_bins[bin]; it && scan_cnt < MAX_BIN_SCAN; it = checked_link(read_dword(it + 4)), scan_cnt++) {
+            if (auto it_size = checked_free_size(it); it_size >= size) {
+                block = it;
+                free_size = it_size;
+                break;
+            }
+        }
+        if (!block) {
+            if (auto larger = m_bin_map & ~((2u << bin) - 1)) {
+                block = m_bins[std::countr_zero(larger)];
+                free_size = checked_free_size(block);
+            }
+        }
+        if (block) {
+            unlink_free_block(block, free_size);
+            if (free_size - size >= MIN_BLOCK) {
+                insert_free_block(block + size, free_size - size);
+            }
+            else {
+                size = free_size;
+                clear_prev_free(block + size);
+            }
+            // Neighbours of a free block are never free themselves
+            write_dword(block, size | IN_USE);
+            return block;
+        }
+        if (size > m_end - m_top) { return 0; }
+        block = m_top;
+        m_top += size;
+        write_dword(block, size | IN_USE);
+        return block;
+    }
+    void VmHeap::insert_free_block(uint32_t block, uint32_t size) {
+        auto bin = std::bit_width(size) - 1;
+        auto next = m_bins[bin];
+        write_dword(block, size);
+        write_dword(block + 4, next);
+        write_dword(block + 8, 0);
+        write_dword(block + size - 4, size);
+        if (next) {
+            write_dword(next + 8, block);
+        }
+        m_bins[bin] = block;
+        m_bin_map |= 1u << bin;
+        if (block + size < m_top) {
+            write_dword(block + size, read_dword(block + size) | PREV_FREE);
+        }
+    }
+    void VmHeap::unlink_free_block(uint32_t block, uint32_t size) {
+        auto bin = std::bit_width(size) - 1;
+        auto next = checked_link(read_dword(block + 4));
+        auto prev = checked_link(read_dword(block + 8));
+        if (prev) {
+            write_dword(prev + 4, next);
+        }
+        else {
+            if (m_bins[bin] != block) {
+                throw std::runtime_error("VM heap corrupted");
+            }
+            m_bins[bin] = next;
+            if (!next) {
+                m_bin_map &= ~(1u << bin);
+            }
+        }
+        if (next) {
+            write_dword(next + 8, prev);
+        }
+    }
+    void VmHeap::clear_prev_free(uint32_t block) {
+        if (block < m_top) {
+            write_dword(block, read_dword(block) & ~PREV_FREE);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace CTinyC {
+    // Allocator behind the malloc / free / realloc syscalls. It manages a range of VM
+    // memory between the static data and the stack.
+    //
+    // Every block starts with a dword header (size | flags) right before its 8-aligned
+    // payload. Blocks of at most SMALL_BLOCK_MAX bytes are recycled through exact-size
+    // free lists, and only merged when the heap runs out of space. Larger blocks are
+    // merged with free neighbours right away (boundary tags: a free block repeats its
+    // size in its last dword) and binned by power-of-two size class. All lists are threaded through the free blocks
+    // themselves; every link is validated before use, so a program that scribbles over
+    // the heap gets a VM error instead of sending the allocator outside its range.
+    //
+    // In checked mode, every payload is surrounded by canaries. They are verified on
+    // free / realloc and by check(), which reports out-of-bounds writes.
+    struct VmHeap {
+        static constexpr uint32_t SMALL_BLOCK_MAX = 256;
+
+        // Takes over [begin, end) of `memory`, dropping all previous allocations
+        void reset(uint8_t* memory, uint32_t begin, uint32_t end, bool checked = false);
+
+        // Returns the VM address of the payload, or 0 if the heap is exhausted
+        uint32_t allocate(uint32_t size);
+        // Throws for pointers that are not live allocations, such as double frees
+        void release(uint32_t ptr);
+        // Same as C realloc; on failure returns 0 and leaves the block untouched
+        uint32_t reallocate(uint32_t ptr, uint32_t size);
+        // Walks every block, throws on a damaged header or canary
+        void check() const;
+
+        size_t live_count() const { return m_live_cnt; }
+
+    private:
+        static constexpr uint32_t IN_USE = 1;
+        // The previous block is free and coalescable, its size is in the dword before us
+        static constexpr uint32_t PREV_FREE = 2;
+        // Free, but parked in a small free list
+        static constexpr uint32_t CACHED = 4;
+        static constexpr uint32_t FLAGS_MASK = 7;
+        // Room for header, both links and footer of a free block
+        static constexpr uint32_t MIN_BLOCK = 16;
+        static constexpr size_t BIN_CNT = 32;
+
+        uint32_t read_dword(uint32_t addr) const;
+        void write_dword(uint32_t addr, uint32_t v);
+        uint32_t payload_offset() const { return m_checked ? 12 : 4; }
+        uint32_t block_size_for(uint32_t size) const;
+        uint32_t payload_size(uint32_t block) const;
+        // Validates that `ptr` is the payload of a live block, returns the block address
+        uint32_t checked_live_block(uint32_t ptr) const;
+        // Returns the size of the free coalescable block at `block`, throws if it is not one
+        uint32_t checked_free_size(uint32_t block) const;
+        uint32_t checked_link(uint32_t block) const;
+        void set_payload_size(uint32_t block, uint32_t size);
+        void check_canaries(uint32_t block) const;
+        // From the size-class bins, else from the untouched top of the heap
+        uint32_t allocate_block(uint32_t size);
+        // Coalesces a block that is no longer in use and files it in a bin
+        void free_block(uint32_t block, uint32_t size);
+        // Turns every block of the small free lists into a coalesced free block;
+        // returns whether there were any
+        bool consolidate();
+        void insert_free_block(uint32_t block, uint32_t size);
+        void unlink_free_block(uint32_t block, uint32_t size);
+        // Clears PREV_FREE of the block starting at `block`, if there is one
+        void clear_prev_free(uint32_t block);
+
+        uint8_t* m_memory{};
+        uint32_t m_first{}, m_top{}, m_end{};
+        bool m_checked{};
+        size_t m_live_cnt{};
+        // Heads of the small free lists, indexed by block size / 8
+        std::array<uint32_t, SMALL_BLOCK_MAX / 8 + 1> m_small_lists{};
+        // Heads of the free block bins, indexed by floor(log2(size)), and which are non-empty
+        std::array<uint32_t, BIN_CNT> m_bins{};
+        uint32_t m_bin_map{};
+    };
+}
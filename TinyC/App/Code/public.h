@@ -9,34 +9,12 @@ namespace CTinyC {
             std::format(fmt, std::forward<Ts>(ts)...) };
     }
 
-    inline uint32_t read_u32(HANDLE h) {
-        uint32_t buf;
-        DWORD cnt;
-        ::winrt::check_bool(ReadFile(h, &buf, sizeof buf, &cnt, nullptr));
-        if (cnt != sizeof buf) {
-            throw ::winrt::hresult_error(E_FAIL, L"read size is not 4");
-        }
-        return buf;
-    }
-    inline void read_bytes(HANDLE h, void* buf, size_t len) {
-        DWORD cnt;
-        ::winrt::check_bool(ReadFile(h, buf, len, &cnt, nullptr));
-        if (cnt != len) {
-            throw ::winrt::hresult_error(E_FAIL, L"read is not complete");
-        }
-    }
-    inline void write_u32(HANDLE h, uint32_t dw) {
-        DWORD cnt;
-        ::winrt::check_bool(WriteFile(h, &dw, sizeof dw, &cnt, nullptr));
-        if (cnt != sizeof dw) {
-            throw ::winrt::hresult_error(E_FAIL, L"write size is not 4");
-        }
-    }
-    inline void write_bytes(HANDLE h, const void* buf, size_t len) {
-        DWORD cnt;
-        ::winrt::check_bool(WriteFile(h, buf, len, &cnt, nullptr));
-        if (cnt != len) {
-            throw ::winrt::hresult_error(E_FAIL, L"write is not complete");
-        }
-    }
+    // Records sent from the VM process to its parent over a SharedChannel. Every record is
+    // its type and body size as u32, followed by the body.
+    enum class SlaveMsgType : uint32_t {
+        Log = 0,            // u32 severity, message text
+        Result = 1,         // u32 is_success
+        Output = 2,         // Program output bytes
+        InputRequest = 3,   // Empty; parent replies with u32 size and up to size bytes, 0 at EOF
+    };
 }
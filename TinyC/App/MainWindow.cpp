@@ -9,6 +9,7 @@
 #include "Code/Parser.hpp"
 #include "Code/CodeGen.hpp"
 #include "Code/Executor.hpp"
+#include "Code/SharedRing.hpp"
 
 using namespace std::literals;
 using namespace winrt;
@@ -64,8 +65,6 @@ namespace winrt::TinyC::App::implementation {
         cec.HighlightingLanguage(L"cpp");
         cec.Editor().UseTabs(false);
 
-        m_compilation_logger.init(this);
-
         GridSizeBar().PointerEntered([](auto&& sender, PointerRoutedEventArgs const& e) {
             e.Handled(true);
             CoreWindow::GetForCurrentThread().PointerCursor(CoreCursor(CoreCursorType::SizeNorthSouth, 0));
@@ -189,53 +188,50 @@ namespace winrt::TinyC::App::implementation {
         CodeEditCtrl().Editor().Redo();
     }
     void MainWindow::MenuBuildCompileItem_Click(IInspectable const&, RoutedEventArgs const&) {
-        auto dispatcher = Window::Current().Dispatcher();
-
         this->ClearCompilationOutput();
         auto ts = std::chrono::system_clock::now();
         std::chrono::zoned_time zoned_ts{ std::chrono::current_zone(),
             std::chrono::time_point_cast<std::chrono::seconds>(ts) };
-        this->AddCompilationOutput(hstring(std::format(L"Build started at {:%F %T}...", zoned_ts)));
+        m_compilation_logger.info(hstring(std::format(L"Build started at {:%F %T}...", zoned_ts)));
 
+        // Compiled in the background; a build started before this one finished is cancelled
         auto buf = DuplicateEditorBuffer();
-        auto code_str = std::string_view{ reinterpret_cast<char*>(buf.data()), buf.Length() };
-        try {
-            CTinyC::Lexer lexer(&m_compilation_logger);
-            lexer.init(code_str);
-            /*while (auto otoken = lexer.next_token()) {
-                this->AddCompilationOutput(hstring(std::format(L"[DEBUG] Got token `{}` at ({},{})",
-                    to_hstring(otoken->str), otoken->line, otoken->column)));
-            }*/
-
-            this->AddCompilationOutput(L"Compiling <source>...");
-
-            CTinyC::Parser parser(&m_compilation_logger);
-            auto ast_root = parser.parse(&lexer);
-            if (!ast_root) {
-                throw std::runtime_error("compilation failed");
-            }
-
-            this->AddCompilationOutput(L"Generating code...");
-            CTinyC::CodeGenerator code_gen(&m_compilation_logger);
-            auto code_info = code_gen.ast_to_code(*ast_root, 0x100);
-
-            this->AddCompilationOutput(L"Build result: PASSED");
+        m_compilation_service.submit(std::string{ reinterpret_cast<char*>(buf.data()), buf.Length() });
+    }
+    void MainWindow::OnCompileProgress(CTinyC::CompilePhase phase, double fraction) {
+        // Phases report 0 once, when they start
+        if (fraction != 0) { return; }
+        if (phase == CTinyC::CompilePhase::Parse) {
+            m_compilation_logger.info(L"Compiling <source>...");
         }
-        catch (...) {
-            this->AddCompilationOutput(L"Build result: FAILED");
+        else {
+            m_compilation_logger.info(L"Generating code...");
         }
-        auto ts2 = std::chrono::system_clock::now();
-        std::chrono::zoned_time zoned_ts2{ std::chrono::current_zone(),
-            std::chrono::time_point_cast<std::chrono::seconds>(ts2) };
-        this->AddCompilationOutput(hstring(std::format(L"Build completed at {:%F %T} and took {:%S} seconds.",
-            zoned_ts, ts2 - ts)));
+    }
+    void MainWindow::OnCompileComplete(CTinyC::CompileResult const& result) {
+        switch (result.status) {
+        case CTinyC::CompileStatus::Succeeded:
+            m_compilation_logger.info(L"Build result: PASSED");
+            break;
+        case CTinyC::CompileStatus::Failed:
+            m_compilation_logger.info(L"Build result: FAILED");
+            break;
+        case CTinyC::CompileStatus::Cancelled:
+            m_compilation_logger.info(L"Build result: CANCELLED");
+            return;
+        }
+        auto ts = std::chrono::system_clock::now();
+        std::chrono::zoned_time zoned_ts{ std::chrono::current_zone(),
+            std::chrono::time_point_cast<std::chrono::seconds>(ts) };
+        m_compilation_logger.info(hstring(std::format(L"Build completed at {:%F %T} and took {:%S} seconds.",
+            zoned_ts, std::chrono::duration_cast<std::chrono::milliseconds>(result.elapsed))));
     }
     void MainWindow::MenuBuildRunItem_Click(IInspectable const&, RoutedEventArgs const&) {
         this->ClearCompilationOutput();
         auto ts = std::chrono::system_clock::now();
         std::chrono::zoned_time zoned_ts{ std::chrono::current_zone(),
             std::chrono::time_point_cast<std::chrono::seconds>(ts) };
-        this->AddCompilationOutput(hstring(std::format(L"Build started at {:%F %T}...", zoned_ts)));
+        m_compilation_logger.info(hstring(std::format(L"Build started at {:%F %T}...", zoned_ts)));
 
         auto buf = DuplicateEditorBuffer();
         auto code_str = std::string_view{ reinterpret_cast<char*>(buf.data()), buf.Length() };
@@ -248,26 +244,26 @@ namespace winrt::TinyC::App::implementation {
         try {
             lexer.init(code_str);
 
-            this->AddCompilationOutput(L"Compiling <source>...");
+            m_compilation_logger.info(L"Compiling <source>...");
 
             auto ast_root = parser.parse(&lexer);
             if (!ast_root) {
                 throw std::runtime_error("compilation failed");
             }
 
-            this->AddCompilationOutput(L"Generating code...");
+            m_compilation_logger.info(L"Generating code...");
             CTinyC::CodeGenerator code_gen(&m_compilation_logger);
             std::tie(code, metadata) = code_gen.ast_to_code(*ast_root, 1000);
 
-            this->AddCompilationOutput(L"Build result: PASSED");
+            m_compilation_logger.info(L"Build result: PASSED");
         }
         catch (...) {
-            this->AddCompilationOutput(L"Build result: FAILED");
+            m_compilation_logger.info(L"Build result: FAILED");
             failed = true;
         }
         if (!failed) {
             try {
-                this->AddCompilationOutput(L"Running code...");
+                m_compilation_logger.info(L"Running code...");
 
                 if (auto h = std::exchange(m_sub_exec_proc_handle, {})) {
                     TerminateProcess(h, EXIT_FAILURE);
@@ -278,7 +274,7 @@ namespace winrt::TinyC::App::implementation {
                     [](CTinyC::CodeMetadata::FuncMetadata& v) { return v.name; }
                 );
                 if (main_func_it == end(metadata.func_meta)) {
-                    this->AddCompilationOutput(L"Error: function main not found");
+                    m_compilation_logger.error(L"Error: function main not found");
                     throw std::runtime_error("function main not found");
                 }
 
@@ -294,26 +290,14 @@ namespace winrt::TinyC::App::implementation {
                         auto main_function_offset = main_func_it->offset;
 
                         SECURITY_ATTRIBUTES sa{ .nLength = sizeof sa, .bInheritHandle = true };
-                        HANDLE pipein1, pipeout1;
-                        check_bool(CreatePipe(&pipein1, &pipeout1, &sa, 0));
-                        auto se_1 = util::misc::scope_exit([&] {
-                            CloseHandle(pipein1);
-                            CloseHandle(pipeout1);
-                        });
-                        HANDLE pipein2, pipeout2;
-                        check_bool(CreatePipe(&pipein2, &pipeout2, &sa, 0));
-                        auto se_2 = util::misc::scope_exit([&] {
-                            CloseHandle(pipein2);
-                            CloseHandle(pipeout2);
-                        });
+                        auto channel = SharedChannel::create(1024 * 1024);
 
                         // Start a sub process and communicate
                         wchar_t buf[MAX_PATH + 32];
                         GetModuleFileNameW(nullptr, buf, MAX_PATH);
                         wcscat(buf, L" code-exec");
                         char envblock[128];
-                        auto cnt = sprintf(envblock, "pipein=%08x", (uint32_t)pipein1) + 1;
-                        cnt += sprintf(envblock + cnt, "pipeout=%08x", (uint32_t)pipeout2) + 1;
+                        auto cnt = sprintf(envblock, "shmchan=%08x", (uint32_t)(uintptr_t)channel.native_handle()) + 1;
                         envblock[cnt] = '\0';
                         STARTUPINFOW si{ .cb = sizeof si, .dwFlags = STARTF_FORCEOFFFEEDBACK };
                         PROCESS_INFORMATION pi;
@@ -323,41 +307,50 @@ namespace winrt::TinyC::App::implementation {
                         CloseHandle(pi.hThread);
                         //CloseHandle(pi.hProcess);
                         m_sub_exec_proc_handle = pi.hProcess;
+                        // Stop waiting on the channel once the child is gone
+                        channel.set_peer_alive([h = pi.hProcess] {
+                            return WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+                        });
+                        auto& tx = channel.tx();
+                        auto& rx = channel.rx();
 
                         // Code size
-                        write_u32(pipeout1, code.size());
+                        tx.write_u32(code.size());
                         // Code
-                        write_bytes(pipeout1, code.data(), code.size());
+                        tx.write_bytes(code.data(), code.size());
                         // Start ip
-                        write_u32(pipeout1, 1000 + main_function_offset);
+                        tx.write_u32(1000 + main_function_offset);
+                        // Zero-initialized data size
+                        tx.write_u32(metadata.bss_size);
 
-                        while (true) {
+                        for (bool finished = false; !finished;) {
                             co_await resume_background();
 
-                            auto add_log_fn = [&](hstring const& s) {
-                                    auto that = weak_this.get();
+                            auto add_log_fn = [&](CTinyC::Logger::Severity severity, hstring const& s) {
+                                auto that = weak_this.get();
                                 if (!that) { return false; }
-                                that->AddCompilationOutput(s);
+                                that->m_compilation_logger.log(severity, s);
                                 return true;
                             };
 
-                            auto msg_type = read_u32(pipein2);
-                            if (msg_type == 0) {
-                                auto body_size = read_u32(pipein2);
+                            auto msg_type = (SlaveMsgType)rx.read_u32();
+                            if (msg_type == SlaveMsgType::Log) {
+                                auto body_size = rx.read_u32();
                                 auto buf_size = (body_size - 4) / 2;
-                                auto severity = (CTinyC::Logger::Severity)read_u32(pipein2);
+                                auto severity = (CTinyC::Logger::Severity)rx.read_u32();
                                 std::vector<wchar_t> buf(buf_size);
-                                read_bytes(pipein2, buf.data(), body_size - 4);
-                                add_log_fn({ buf.data(), buf_size });
+                                rx.read_bytes(buf.data(), body_size - 4);
+                                add_log_fn(severity, { buf.data(), buf_size });
                             }
-                            else if (msg_type == 1) {
-                                auto body_size = read_u32(pipein2);
-                                auto is_success = read_u32(pipein2);
+                            else if (msg_type == SlaveMsgType::Result) {
+                                auto body_size = rx.read_u32();
+                                auto is_success = rx.read_u32();
+                                finished = true;
                                 if (is_success) {
-                                    add_log_fn(L"Run result: SUCCESS");
+                                    add_log_fn(CTinyC::Logger::Severity::Info, L"Run result: SUCCESS");
                                 }
                                 else {
-                                    add_log_fn(L"Run result: FAILED");
+                                    add_log_fn(CTinyC::Logger::Severity::Info, L"Run result: FAILED");
                                 }
                             }
                             else {
@@ -371,13 +364,13 @@ namespace winrt::TinyC::App::implementation {
                 }();
                 }
             catch (...) {
-                this->AddCompilationOutput(L"Run result: FAILED");
+                m_compilation_logger.info(L"Run result: FAILED");
             }
         }
         auto ts2 = std::chrono::system_clock::now();
         std::chrono::zoned_time zoned_ts2{ std::chrono::current_zone(),
             std::chrono::time_point_cast<std::chrono::seconds>(ts2) };
-        this->AddCompilationOutput(hstring(std::format(L"Build completed at {:%F %T} and took {:%S} seconds.",
+        m_compilation_logger.info(hstring(std::format(L"Build completed at {:%F %T} and took {:%S} seconds.",
             zoned_ts, ts2 - ts)));
     }
     void MainWindow::MenuHelpViewHelpItem_Click(IInspectable const& sender, RoutedEventArgs const& args) {
@@ -389,6 +382,10 @@ namespace winrt::TinyC::App::implementation {
             "Available built-in functions:\n"
             "* int input(void);\n"
             "* void output(int value);\n"
+            "* int malloc(int size); void free(int p); int realloc(int p, int size);\n"
+            "* int peek(int addr); void poke(int addr, int value); (dword access to heap memory)\n"
+            "* void memset(int dst[], int value, int n); void memcpy(int dst[], int src[], int n);\n"
+            "  int memcmp(int a[], int b[], int n); int sum / min / max(int a[], int n); (n ints each)\n"
             "Signature of main must be: void main();"
         ));
         cd.CloseButtonText(L"OK");
@@ -2,7 +2,8 @@
 
 #include <mutex>
 #include <winrt/MicaEditor.h>
-#include "Code/Logger.hpp"
+#include "Code/AsyncLogger.hpp"
+#include "Code/CompilationService.hpp"
 
 #include "MainWindow.g.h"
 
@@ -26,13 +27,27 @@ namespace winrt::TinyC::App::implementation {
 
     private:
         void ClearCompilationOutput() {
+            // Lines still on their way belong to the previous build
+            m_compilation_logger.flush();
             CompilationOutputText().Inlines().Clear();
             CompilationOutputTextScroller().ScrollToVerticalOffset(0);
             m_compilation_output_str = {};
         }
-        void AddCompilationOutput(hstring const& str) {
+        // Called on the worker thread of m_compilation_service
+        void OnCompileProgress(CTinyC::CompilePhase phase, double fraction);
+        void OnCompileComplete(CTinyC::CompileResult const& result);
+        // Called by the consumer thread of m_compilation_logger, one batch at a time
+        void AddCompilationOutput(std::span<CTinyC::LogLine const> lines) {
+            std::wstring text;
+            for (auto const& line : lines) {
+                text += line.text;
+                if (line.repeat_cnt > 1) {
+                    text += std::format(L" (repeated {} times)", line.repeat_cnt);
+                }
+                text += L'\n';
+            }
             std::scoped_lock guard{ m_mutex_compilation_output };
-            m_compilation_output_str = m_compilation_output_str + str + L"\n";
+            m_compilation_output_str = m_compilation_output_str + hstring(text);
 
             if (!m_compilation_output_is_pending_update) {
                 m_compilation_output_is_pending_update = true;
@@ -52,25 +67,6 @@ namespace winrt::TinyC::App::implementation {
             return buffer;
         }
 
-        struct CompilationOutputLogger : CTinyC::Logger {
-            CompilationOutputLogger() : m_parent(nullptr) {}
-
-            void init(MainWindow* parent) {
-                m_parent = parent;
-            }
-
-            void log(Severity severity, hstring const& str) {
-                if (!m_parent) {
-                    throw hresult_illegal_method_call(L"CompilationOutputLogger not inited");
-                }
-                m_parent->AddCompilationOutput(str);
-            }
-        private:
-            MainWindow* m_parent;
-        };
-
-        CompilationOutputLogger m_compilation_logger;
-
         bool m_is_dragging{};
         Windows::Foundation::Point m_last_drag_pt{};
         double m_last_scroller_height{};
@@ -79,6 +75,15 @@ namespace winrt::TinyC::App::implementation {
         hstring m_compilation_output_str;
 
         HANDLE m_sub_exec_proc_handle{};
+
+        // Declared last, so that its consumer thread is stopped before the members it uses
+        CTinyC::AsyncLogger m_compilation_logger{
+            [this](std::span<CTinyC::LogLine const> lines) { AddCompilationOutput(lines); },
+            { .max_lines_per_flush = 2000 } };
+        // Reports to the logger, so it has to go first
+        CTinyC::CompilationService m_compilation_service{ &m_compilation_logger, { .start_offset = 0x100 },
+            [this](uint64_t, CTinyC::CompilePhase phase, double fraction) { OnCompileProgress(phase, fraction); },
+            [this](CTinyC::CompileResult result) { OnCompileComplete(result); } };
     };
 }
 
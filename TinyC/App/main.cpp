@@ -7,6 +7,7 @@
 
 #include "Code/public.h"
 #include "Code/Executor.hpp"
+#include "Code/SharedRing.hpp"
 
 #include "appmodel.h"
 
@@ -23,42 +24,42 @@ uint32_t read_hex_u32_from_env_var(const wchar_t* name) {
     return static_cast<uint32_t>(value);
 }
 
-// Used to execute code from parent pipe
+// Used to execute code sent over the shared channel of the parent
 int slave_exec_main() try {
     using namespace CTinyC;
 
-    auto pipein = (HANDLE)read_hex_u32_from_env_var(L"pipein");
-    auto pipeout = (HANDLE)read_hex_u32_from_env_var(L"pipeout");
+    auto channel = SharedChannel::open((HANDLE)read_hex_u32_from_env_var(L"shmchan"));
+    auto& rx = channel.rx();
+    auto& tx = channel.tx();
 
     struct SlaveLogger : CTinyC::Logger {
-        SlaveLogger(HANDLE pipein, HANDLE pipeout) : m_pipein(pipein), m_pipeout(pipeout) {}
+        SlaveLogger(SharedRing& tx) : m_tx(tx) {}
 
         void log(Severity severity, hstring const& str) override {
-            // Msg type
-            write_u32(m_pipeout, 0);
-            // Msg body size
-            write_u32(m_pipeout, 4 + str.size() * 2);
-            // Severity
-            write_u32(m_pipeout, (uint32_t)severity);
-            write_bytes(m_pipeout, str.data(), str.size() * 2);
+            // Records only touch shared memory, so a burst of them costs no syscalls
+            m_tx.write_u32((uint32_t)SlaveMsgType::Log);
+            m_tx.write_u32(4 + str.size() * 2);
+            m_tx.write_u32((uint32_t)severity);
+            m_tx.write_bytes(str.data(), str.size() * 2);
         }
 
     private:
-        HANDLE m_pipein, m_pipeout;
+        SharedRing& m_tx;
     };
 
-    SlaveLogger logger(pipein, pipeout);
+    SlaveLogger logger(tx);
     CTinyC::Executor executor(&logger);
 
     std::vector<uint8_t> buf;
-    auto code_size = read_u32(pipein);
+    auto code_size = rx.read_u32();
     buf.resize(code_size);
-    read_bytes(pipein, buf.data(), code_size);
-    auto ip = read_u32(pipein);
+    rx.read_bytes(buf.data(), code_size);
+    auto ip = rx.read_u32();
+    auto bss_size = rx.read_u32();
     auto mem_size = 1024 * 1024 * 16;
     auto start_offset = 1000;
 
-    executor.load(buf.data(), code_size, mem_size, start_offset);
+    executor.load(buf.data(), code_size, mem_size, start_offset, bss_size);
     executor.set_ip(ip);
 
     std::atomic_bool interrupt_flag{};
@@ -66,12 +67,9 @@ int slave_exec_main() try {
 
     printf("\n\n---------- End of Execution ----------\n");
 
-    // Msg type
-    write_u32(pipeout, 1);
-    // Msg body size
-    write_u32(pipeout, 4);
-    // Is success?
-    write_u32(pipeout, is_success);
+    tx.write_u32((uint32_t)SlaveMsgType::Result);
+    tx.write_u32(4);
+    tx.write_u32(is_success);
 
     return 0;
 }
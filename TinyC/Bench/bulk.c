@@ -0,0 +1,27 @@
+/* Array clearing, copying and reductions through the bulk builtins; bulk_loop.c does the same with loops */
+int a[20000];
+int b[20000];
+
+void main(void) {
+    int n;
+    int round;
+    int i;
+    int total;
+    n = 20000;
+    i = 0;
+    while (i < n) {
+        a[i] = i - i / 1000 * 1000 - 500;
+        i = i + 1;
+    }
+    total = 0;
+    round = 0;
+    while (round < 5) {
+        memset(b, round, n);
+        total = total + sum(b, n);
+        memcpy(b, a, n);
+        b[round * 100] = round;
+        total = total + memcmp(a, b, n) + sum(b, n) + min(b, n) + max(b, n);
+        round = round + 1;
+    }
+    output(total);
+}
@@ -0,0 +1,71 @@
+/* Same work as bulk.c, written as plain loops */
+int a[20000];
+int b[20000];
+
+void main(void) {
+    int n;
+    int round;
+    int i;
+    int total;
+    int acc;
+    int lo;
+    int hi;
+    int cmp;
+    n = 20000;
+    i = 0;
+    while (i < n) {
+        a[i] = i - i / 1000 * 1000 - 500;
+        i = i + 1;
+    }
+    total = 0;
+    round = 0;
+    while (round < 5) {
+        i = 0;
+        while (i < n) {
+            b[i] = round;
+            i = i + 1;
+        }
+        acc = 0;
+        i = 0;
+        while (i < n) {
+            acc = acc + b[i];
+            i = i + 1;
+        }
+        total = total + acc;
+        i = 0;
+        while (i < n) {
+            b[i] = a[i];
+            i = i + 1;
+        }
+        b[round * 100] = round;
+        cmp = 0;
+        i = 0;
+        while (i < n) {
+            if (a[i] != b[i]) {
+                cmp = 1;
+                if (a[i] < b[i]) {
+                    cmp = 0 - 1;
+                }
+                i = n;
+            }
+            i = i + 1;
+        }
+        acc = 0;
+        lo = b[0];
+        hi = b[0];
+        i = 0;
+        while (i < n) {
+            acc = acc + b[i];
+            if (b[i] < lo) {
+                lo = b[i];
+            }
+            if (b[i] > hi) {
+                hi = b[i];
+            }
+            i = i + 1;
+        }
+        total = total + cmp + acc + lo + hi;
+        round = round + 1;
+    }
+    output(total);
+}
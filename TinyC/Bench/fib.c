@@ -0,0 +1,11 @@
+/* Naive recursion: fib(22) */
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+void main(void) {
+    output(fib(22));
+}
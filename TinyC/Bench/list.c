@@ -0,0 +1,57 @@
+/* Heap workload: linked lists built and torn down, plus a vector grown by realloc */
+int push(int head, int value) {
+    int node;
+    node = malloc(8);
+    poke(node, value);
+    poke(node + 4, head);
+    return node;
+}
+
+void main(void) {
+    int round;
+    int head;
+    int next;
+    int i;
+    int sum;
+    int vec;
+    int cap;
+
+    round = 0;
+    while (round < 10) {
+        head = 0;
+        i = 0;
+        while (i < 300) {
+            head = push(head, i * round);
+            i = i + 1;
+        }
+        sum = 0;
+        while (head != 0) {
+            sum = sum + peek(head);
+            next = peek(head + 4);
+            free(head);
+            head = next;
+        }
+        output(sum);
+        round = round + 1;
+    }
+
+    cap = 4;
+    vec = malloc(cap * 4);
+    i = 0;
+    while (i < 2000) {
+        if (i == cap) {
+            cap = cap * 2;
+            vec = realloc(vec, cap * 4);
+        }
+        poke(vec + i * 4, i);
+        i = i + 1;
+    }
+    sum = 0;
+    i = 0;
+    while (i < 2000) {
+        sum = sum + peek(vec + i * 4);
+        i = i + 1;
+    }
+    free(vec);
+    output(sum);
+}
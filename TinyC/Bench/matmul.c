@@ -0,0 +1,43 @@
+/* Nested loops: 32x32 integer matrix product */
+int a[1024];
+int b[1024];
+int c[1024];
+
+void main(void) {
+    int n;
+    int i;
+    int j;
+    int k;
+    int s;
+    n = 32;
+    i = 0;
+    while (i < n * n) {
+        a[i] = i - i / 7 * 7;
+        b[i] = i - i / 5 * 5 + 1;
+        i = i + 1;
+    }
+    i = 0;
+    while (i < n) {
+        j = 0;
+        while (j < n) {
+            s = 0;
+            k = 0;
+            while (k < n) {
+                s = s + a[i * n + k] * b[k * n + j];
+                k = k + 1;
+            }
+            c[i * n + j] = s;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    s = 0;
+    i = 0;
+    while (i < n * n) {
+        s = s + c[i] * (i - i / 13 * 13);
+        i = i + 1;
+    }
+    output(c[0]);
+    output(c[n * n - 1]);
+    output(s);
+}
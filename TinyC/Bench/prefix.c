@@ -0,0 +1,30 @@
+/* Prefix sums, recomputed over a sliding update */
+int values[20000];
+int sums[20000];
+
+void main(void) {
+    int n;
+    int round;
+    int i;
+    int acc;
+    n = 20000;
+    i = 0;
+    while (i < n) {
+        values[i] = i - i / 100 * 100;
+        i = i + 1;
+    }
+    round = 0;
+    while (round < 5) {
+        acc = 0;
+        i = 0;
+        while (i < n) {
+            acc = acc + values[i];
+            sums[i] = acc;
+            i = i + 1;
+        }
+        values[round * 1000] = values[round * 1000] + round;
+        round = round + 1;
+    }
+    output(sums[n - 1]);
+    output(sums[n / 2]);
+}
@@ -0,0 +1,24 @@
+/* Sieve of Eratosthenes: number of primes below 50000 */
+int composite[50000];
+
+void main(void) {
+    int n;
+    int i;
+    int j;
+    int count;
+    n = 50000;
+    count = 0;
+    i = 2;
+    while (i < n) {
+        if (composite[i] == 0) {
+            count = count + 1;
+            j = i * 2;
+            while (j < n) {
+                composite[j] = 1;
+                j = j + i;
+            }
+        }
+        i = i + 1;
+    }
+    output(count);
+}
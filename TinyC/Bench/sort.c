@@ -0,0 +1,63 @@
+/* Array sorting: quicksort of 5000 pseudo-random numbers */
+int data[5000];
+
+void quicksort(int lo, int hi) {
+    int pivot;
+    int i;
+    int j;
+    int t;
+    while (lo < hi) {
+        pivot = data[(lo + hi) / 2];
+        i = lo;
+        j = hi;
+        while (i <= j) {
+            while (data[i] < pivot) {
+                i = i + 1;
+            }
+            while (data[j] > pivot) {
+                j = j - 1;
+            }
+            if (i <= j) {
+                t = data[i];
+                data[i] = data[j];
+                data[j] = t;
+                i = i + 1;
+                j = j - 1;
+            }
+        }
+        quicksort(lo, j);
+        lo = i;
+    }
+}
+
+void main(void) {
+    int n;
+    int i;
+    int x;
+    int sorted;
+    int check;
+    n = 5000;
+    x = 12345;
+    i = 0;
+    while (i < n) {
+        x = x * 75 + 74;
+        x = x - x / 65537 * 65537;
+        data[i] = x;
+        i = i + 1;
+    }
+    quicksort(0, n - 1);
+    sorted = 1;
+    check = 0;
+    i = 1;
+    while (i < n) {
+        if (data[i - 1] > data[i]) {
+            sorted = 0;
+        }
+        check = check + data[i] * (i - i / 17 * 17);
+        i = i + 1;
+    }
+    output(sorted);
+    output(data[0]);
+    output(data[n - 1]);
+    output(check);
+}
@@ -0,0 +1,19 @@
+/* Tail recursion, deep enough to need constant stack */
+int sum(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return sum(n - 1, acc + n);
+}
+
+int gcd(int a, int b) {
+    if (b == 0) {
+        return a;
+    }
+    return gcd(b, a - a / b * b);
+}
+
+void main(void) {
+    output(sum(500000, 0));
+    output(gcd(1134903170, 701408733));
+}
@@ -0,0 +1,66 @@
+/* Primes below 30000 by trial division, on 4 threads taking blocks of numbers through atomic_add */
+int next_block[1];
+int total[1];
+int largest[1];
+
+int is_prime(int x) {
+    int d;
+    if (x < 2) {
+        return 0;
+    }
+    d = 2;
+    while (d * d <= x) {
+        if (x - x / d * d == 0) {
+            return 0;
+        }
+        d = d + 1;
+    }
+    return 1;
+}
+
+int worker(int id) {
+    int block;
+    int x;
+    int end;
+    int count;
+    int seen;
+    count = 0;
+    block = atomic_add(next_block, 1);
+    while (block < 30) {
+        x = block * 1000;
+        end = x + 1000;
+        while (x < end) {
+            if (is_prime(x)) {
+                count = count + 1;
+                seen = atomic_add(largest, 0);
+                while (seen < x) {
+                    seen = atomic_cas(largest, seen, x);
+                }
+            }
+            x = x + 1;
+        }
+        block = atomic_add(next_block, 1);
+    }
+    atomic_add(total, count);
+    return count;
+}
+
+void main(void) {
+    int threads[4];
+    int i;
+    int count;
+    i = 0;
+    while (i < 4) {
+        threads[i] = spawn(worker, i);
+        i = i + 1;
+    }
+    count = 0;
+    i = 0;
+    while (i < 4) {
+        count = count + join(threads[i]);
+        i = i + 1;
+    }
+    output(count);
+    output(total[0]);
+    output(largest[0]);
+}
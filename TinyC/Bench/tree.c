@@ -0,0 +1,71 @@
+/* Heap workload: binary search trees of pseudo-random keys */
+int seed;
+
+int next_key(void) {
+    seed = seed * 75 + 74;
+    seed = seed - seed / 65537 * 65537;
+    return seed;
+}
+
+int insert(int root, int key) {
+    int node;
+    if (root == 0) {
+        node = malloc(12);
+        poke(node, key);
+        poke(node + 4, 0);
+        poke(node + 8, 0);
+        return node;
+    }
+    if (key < peek(root)) {
+        poke(root + 4, insert(peek(root + 4), key));
+    }
+    else {
+        poke(root + 8, insert(peek(root + 8), key));
+    }
+    return root;
+}
+
+int height(int root) {
+    int l;
+    int r;
+    if (root == 0) {
+        return 0;
+    }
+    l = height(peek(root + 4));
+    r = height(peek(root + 8));
+    if (l > r) {
+        return l + 1;
+    }
+    return r + 1;
+}
+
+/* Frees the tree, returns the sum of its keys */
+int destroy(int root) {
+    int sum;
+    if (root == 0) {
+        return 0;
+    }
+    sum = peek(root) + destroy(peek(root + 4)) + destroy(peek(root + 8));
+    free(root);
+    return sum;
+}
+
+void main(void) {
+    int round;
+    int root;
+    int i;
+
+    seed = 1;
+    round = 0;
+    while (round < 5) {
+        root = 0;
+        i = 0;
+        while (i < 400) {
+            root = insert(root, next_key());
+            i = i + 1;
+        }
+        output(height(root));
+        output(destroy(root));
+        round = round + 1;
+    }
+}
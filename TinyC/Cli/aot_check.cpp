@@ -0,0 +1,118 @@
+#include "pch.h"
+
+#include "Code/AotTranslator.hpp"
+#include "tool_support.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+// Differential check of the ahead-of-time translator:
+//
+//     tinyc_aot_check <file.c>...
+//
+// Runs every program in the VM, then translates it to C, builds that with $CC (default:
+// cc) and runs the executable. Both outputs have to be the same, and match
+// <file>.expected if present. Reports the run time of both; programs get no input.
+
+namespace {
+    struct RunResult {
+        std::string output;
+        double ms{};
+    };
+
+    RunResult run_vm(CTinyC::ExecutorImage const& image) {
+        NullLogger logger;
+        CaptureIo io;
+        CTinyC::Executor executor(&logger, &io);
+        executor.load(image);
+        std::atomic_bool interrupt_flag{};
+        auto t0 = std::chrono::steady_clock::now();
+        while (executor.execute(SIZE_MAX, interrupt_flag)) {}
+        return { std::move(io.output),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() };
+    }
+
+    RunResult run_native(std::filesystem::path const& exe_path) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto pipe = popen(std::format("\"{}\" </dev/null", exe_path.string()).c_str(), "r");
+        if (!pipe) {
+            throw std::runtime_error("cannot run the translated program");
+        }
+        RunResult result;
+        char buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof buf, pipe)) > 0;) {
+            result.output.append(buf, n);
+        }
+        if (pclose(pipe) != 0) {
+            throw std::runtime_error("translated program failed");
+        }
+        result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        return result;
+    }
+
+    // Returns the status column
+    std::string check(std::filesystem::path const& path, std::filesystem::path const& work_dir,
+        double& vm_ms, double& native_ms
+    ) {
+        NullLogger logger;
+        auto program = compile(read_file(path), &logger);
+        auto image = make_image(program);
+
+        auto c_path = work_dir / path.filename();
+        auto exe_path = work_dir / path.stem();
+        {
+            std::ofstream out(c_path, std::ios::binary);
+            out << CTinyC::translate_to_c(image, program.metadata, VM_START_OFFSET);
+        }
+        auto cc = getenv("CC");
+        auto command = std::format("{} -O2 -pthread -o \"{}\" \"{}\"", cc && *cc ? cc : "cc",
+            exe_path.string(), c_path.string());
+        if (std::system(command.c_str()) != 0) {
+            throw std::runtime_error("C compilation failed");
+        }
+
+        auto vm = run_vm(image);
+        auto native = run_native(exe_path);
+        vm_ms = vm.ms;
+        native_ms = native.ms;
+        if (native.output != vm.output) {
+            return "MISMATCH (vm)";
+        }
+        auto expected_path = std::filesystem::path(path).replace_extension(".expected");
+        if (!std::filesystem::exists(expected_path)) {
+            return "ok (unchecked)";
+        }
+        return trim_right(native.output) == trim_right(read_file(expected_path)) ? "ok" : "MISMATCH (expected)";
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    if (argc < 2) {
+        fprintf(stderr, "usage: tinyc_aot_check <file.c>...\n");
+        return EXIT_FAILURE;
+    }
+    auto work_dir = std::filesystem::temp_directory_path() / "tinyc_aot";
+    std::filesystem::create_directories(work_dir);
+
+    bool all_passed = true;
+    printf("%-16s %10s %12s %8s  %s\n", "program", "vm(ms)", "native(ms)", "speedup", "result");
+    for (int i = 1; i < argc; i++) {
+        std::filesystem::path path = argv[i];
+        std::string status;
+        double vm_ms{}, native_ms{};
+        try {
+            status = check(path, work_dir, vm_ms, native_ms);
+        }
+        catch (std::exception const& e) {
+            status = std::format("FAILED: {}", e.what());
+        }
+        if (!status.starts_with("ok")) { all_passed = false; }
+        printf("%-16s %10.3f %12.3f %7.1fx  %s\n", path.filename().string().c_str(), vm_ms, native_ms,
+            native_ms > 0 ? vm_ms / native_ms : 0.0, status.c_str());
+    }
+    return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
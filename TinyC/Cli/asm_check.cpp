@@ -0,0 +1,125 @@
+#include "pch.h"
+
+#include "Code/Assembly.hpp"
+#include "tool_support.hpp"
+
+#include <filesystem>
+
+// Round trip of the bytecode disassembler and assembler:
+//
+//     tinyc_asm_check [--functions N] [file.c...]
+//
+// Compiles every program, disassembles it, assembles the text again and checks that
+// the image and the metadata the assembler fills in come out identical. A generated
+// program of N functions (default 2000, a few megabytes of code) measures the
+// throughput of both directions.
+
+namespace {
+    // Loops, calls, nested functions and static data; each function has a few kilobytes of code
+    std::string make_source(size_t functions) {
+        std::string source = "int table[4] = { 1, 2, 3, 4 };\nint f0(int x) { return x; }\n";
+        for (size_t i = 1; i < functions; i++) {
+            source += std::format(
+                "int f{0}(int x) {{\n"
+                "    int y;\n"
+                "    int a[4];\n"
+                "    int g{0}(int z) {{ return z + y; }}\n"
+                "    y = x * {1} + table[{2}];\n", i, i % 97, i % 4);
+            for (size_t j = 0; j < 16; j++) {
+                source += std::format(
+                    "    while (y > {0}) {{\n"
+                    "        y = y / 2 - a[{1}];\n"
+                    "    }}\n"
+                    "    a[{1}] = g{2}(y) + {0};\n", 1000 + j, j % 4, i);
+            }
+            source += std::format(
+                "    if (y < {1}) {{\n"
+                "        return a[0] + f{0}(y);\n"
+                "    }}\n"
+                "    return f{0}(a[0] - 1);\n"
+                "}}\n", i - 1, i % 97);
+        }
+        source += std::format("void main(void) {{\n    output(f{}(1));\n}}\n", functions - 1);
+        return source;
+    }
+
+    // Returns the status column
+    std::string round_trip(std::string const& source, size_t& code_size, double& disasm_ms, double& asm_ms) {
+        using ms = std::chrono::duration<double, std::milli>;
+
+        NullLogger logger;
+        auto program = compile(source, &logger);
+        auto const& image = program.image;
+        auto const& metadata = program.metadata;
+        auto t0 = std::chrono::steady_clock::now();
+        auto text = CTinyC::disassemble(image, metadata, VM_START_OFFSET);
+        auto t1 = std::chrono::steady_clock::now();
+        auto [image2, metadata2] = CTinyC::assemble(text, VM_START_OFFSET);
+        auto t2 = std::chrono::steady_clock::now();
+        code_size = size(image);
+        disasm_ms = ms(t1 - t0).count();
+        asm_ms = ms(t2 - t1).count();
+
+        // Without addresses, the text has to survive a round trip as well
+        auto plain = CTinyC::disassemble(image, metadata, VM_START_OFFSET, { .addresses = false });
+        auto [image3, metadata3] = CTinyC::assemble(plain, VM_START_OFFSET);
+
+        auto by_offset = [](CTinyC::CodeMetadata const& m) {
+            std::vector<std::pair<size_t, std::string>> funcs;
+            for (auto const& f : m.func_meta) { funcs.emplace_back(f.offset, f.name); }
+            std::ranges::sort(funcs);
+            return funcs;
+        };
+        if (image2 != image || image3 != image) {
+            auto mismatch = std::ranges::mismatch(image, image2);
+            return std::format("MISMATCH at {}", VM_START_OFFSET + (mismatch.in1 - begin(image)));
+        }
+        if (by_offset(metadata2) != by_offset(metadata) || metadata2.code_size != metadata.code_size ||
+            metadata2.data_size != metadata.data_size || metadata2.bss_size != metadata.bss_size ||
+            size(metadata2.ffi_imports) != size(metadata.ffi_imports)
+        ) {
+            return "MISMATCH (metadata)";
+        }
+        return "ok";
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t functions = 2000;
+    std::vector<std::filesystem::path> paths;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] == std::string_view("--functions") && i + 1 < argc) {
+            functions = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            paths.emplace_back(argv[i]);
+        }
+    }
+
+    bool all_passed = true;
+    printf("%-16s %12s %12s %10s  %s\n", "program", "image(KiB)", "disasm(ms)", "asm(ms)", "result");
+    auto check = [&](std::string const& name, auto&& get_source) {
+        std::string status;
+        size_t code_size{};
+        double disasm_ms{}, asm_ms{};
+        try {
+            status = round_trip(get_source(), code_size, disasm_ms, asm_ms);
+        }
+        catch (std::exception const& e) {
+            status = std::format("FAILED: {}", e.what());
+        }
+        if (status != "ok") { all_passed = false; }
+        printf("%-16s %12.1f %12.3f %10.3f  %s\n", name.c_str(), code_size / 1024.0, disasm_ms, asm_ms, status.c_str());
+    };
+    for (auto const& path : paths) {
+        check(path.filename().string(), [&] { return read_file(path); });
+    }
+    if (functions > 0) {
+        check(std::format("{} functions", functions), [&] { return make_source(functions); });
+    }
+    return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+#include "pch.h"
+
+#include "Code/CompilationService.hpp"
+#include "tool_support.hpp"
+
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// Stress test of the background compilation service:
+//
+//     tinyc_compile_stress [rounds] [functions]
+//
+// Each round submits a burst of edits of a large generated program at random intervals,
+// and checks that every version gets exactly one result, in order, that progress never
+// goes backwards, and that the last version compiles to the same image as a compile on
+// the calling thread. It also measures how long a running compile takes to notice that
+// it was superseded.
+
+namespace {
+    // `functions` functions calling each other; `seed` changes constants only
+    std::string make_source(size_t functions, uint32_t seed) {
+        std::string source = "int f0(int x) { return x; }\n";
+        for (size_t i = 1; i < functions; i++) {
+            source += std::format(
+                "int f{0}(int x) {{\n"
+                "    int y;\n"
+                "    int a[4];\n"
+                "    y = x * {1} + {2};\n"
+                "    while (y > 1000) {{\n"
+                "        y = y / 2;\n"
+                "    }}\n"
+                "    a[0] = y;\n"
+                "    if (y < {1}) {{\n"
+                "        return a[0] + f{3}(y);\n"
+                "    }}\n"
+                "    return f{3}(a[0] - 1);\n"
+                "}}\n", i, seed % 97 + i, seed % 13, i - 1);
+        }
+        source += std::format("void main(void) {{\n    output(f{}(1));\n}}\n", functions - 1);
+        return source;
+    }
+
+    std::vector<uint8_t> compile_here(std::string const& source) {
+        NullLogger logger;
+        return compile(source, &logger).image;
+    }
+
+    struct Observer {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<CTinyC::CompileResult> results;
+        // Last progress seen per version
+        std::map<uint64_t, std::pair<CTinyC::CompilePhase, double>> progress;
+        size_t violations{};
+        // Set once the given version got this far into code generation
+        uint64_t watch_version{};
+        bool watch_reached{};
+
+        void on_progress(uint64_t version, CTinyC::CompilePhase phase, double fraction) {
+            std::scoped_lock guard{ mutex };
+            auto [it, is_new] = progress.try_emplace(version, phase, fraction);
+            if (!is_new) {
+                if (std::pair(phase, fraction) < it->second) {
+                    fprintf(stderr, "progress of version %llu went backwards\n", (unsigned long long)version);
+                    violations++;
+                }
+                it->second = { phase, fraction };
+            }
+            if (version == watch_version && phase == CTinyC::CompilePhase::CodeGen && fraction > 0.2) {
+                watch_reached = true;
+                cv.notify_all();
+            }
+        }
+        void on_complete(CTinyC::CompileResult result) {
+            std::scoped_lock guard{ mutex };
+            if (!results.empty() && result.version != results.back().version + 1) {
+                fprintf(stderr, "version %llu completed after %llu\n",
+                    (unsigned long long)result.version, (unsigned long long)results.back().version);
+                violations++;
+            }
+            results.push_back(std::move(result));
+            cv.notify_all();
+        }
+        bool has_result(uint64_t version) const {
+            return !results.empty() && results.back().version >= version;
+        }
+    };
+}
+
+int main(int argc, char* argv[]) try {
+    size_t rounds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20;
+    size_t functions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1500;
+
+    NullLogger logger;
+    Observer observer;
+    CTinyC::CompilationService service(&logger, { .start_offset = static_cast<int>(VM_START_OFFSET) },
+        [&](uint64_t version, CTinyC::CompilePhase phase, double fraction) { observer.on_progress(version, phase, fraction); },
+        [&](CTinyC::CompileResult result) { observer.on_complete(std::move(result)); });
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto reference = make_source(functions, 0);
+    compile_here(reference);
+    auto single_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    printf("source: %zu bytes, %.1f ms per compile\n", reference.size(), single_ms);
+
+    std::mt19937 rng(12345);
+    uint64_t last_version{};
+    std::string last_source;
+    for (size_t round = 0; round < rounds; round++) {
+        auto burst = 2 + rng() % 8;
+        for (size_t i = 0; i < burst; i++) {
+            last_source = make_source(functions, rng());
+            last_version = service.submit(last_source);
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % static_cast<uint32_t>(single_ms * 1500 + 1)));
+        }
+    }
+    service.wait_idle();
+
+    size_t succeeded{}, cancelled{}, failed{};
+    {
+        std::scoped_lock guard{ observer.mutex };
+        if (observer.results.size() != last_version) {
+            fprintf(stderr, "%zu results for %llu versions\n", observer.results.size(), (unsigned long long)last_version);
+            observer.violations++;
+        }
+        for (auto const& r : observer.results) {
+            succeeded += r.status == CTinyC::CompileStatus::Succeeded;
+            cancelled += r.status == CTinyC::CompileStatus::Cancelled;
+            failed += r.status == CTinyC::CompileStatus::Failed;
+        }
+        auto const& last = observer.results.back();
+        if (last.status != CTinyC::CompileStatus::Succeeded || last.image != compile_here(last_source)) {
+            fprintf(stderr, "last version did not produce the expected image\n");
+            observer.violations++;
+        }
+    }
+    printf("%llu versions: %zu succeeded, %zu cancelled, %zu failed\n",
+        (unsigned long long)last_version, succeeded, cancelled, failed);
+
+    // Latency of cancellation: supersede a compile halfway through code generation
+    std::vector<double> latencies;
+    for (size_t i = 0; i < 10; i++) {
+        std::unique_lock lock{ observer.mutex };
+        observer.watch_reached = false;
+        auto version = service.submit(reference);
+        observer.watch_version = version;
+        observer.cv.wait(lock, [&] { return observer.watch_reached || observer.has_result(version); });
+        auto t_submit = std::chrono::steady_clock::now();
+        service.submit("void main(void) { }");
+        observer.cv.wait(lock, [&] { return observer.has_result(version); });
+        if (observer.results.back().status == CTinyC::CompileStatus::Cancelled) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t_submit).count());
+        }
+        lock.unlock();
+        service.wait_idle();
+    }
+    if (!latencies.empty()) {
+        std::ranges::sort(latencies);
+        printf("cancellation latency: median %.1f us, max %.1f us (%zu samples)\n",
+            latencies[size(latencies) / 2], latencies.back(), size(latencies));
+    }
+
+    if (observer.violations) {
+        printf("FAILED: %zu violation(s)\n", observer.violations);
+        return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,91 @@
+#include "pch.h"
+
+#include "tool_support.hpp"
+
+// Per-call overhead of host functions, against calls of TinyC functions doing the same:
+//
+//     tinyc_ffi_bench [calls]
+//
+// Every variant runs the same loop; the time of the empty loop is subtracted, so
+// what remains is the cost of the call itself.
+
+namespace {
+    int32_t host_nop() { return 0; }
+    int32_t host_add3(int32_t a, int32_t b, int32_t c) { return a + b + c; }
+
+    CTinyC::FfiRegistry const& bench_registry() {
+        static auto const registry = [] {
+            CTinyC::FfiRegistry registry;
+            registry.add<host_nop>("host_nop");
+            registry.add<host_add3>("host_add3");
+            return registry;
+        }();
+        return registry;
+    }
+
+    // Seconds taken by a program whose loop body is `body`
+    double time_program(std::string_view decls, std::string_view body, size_t calls) {
+        auto source = std::format(
+            "{}\n"
+            "void main(void) {{\n"
+            "    int i;\n"
+            "    int acc;\n"
+            "    i = 0;\n"
+            "    acc = 0;\n"
+            "    while (i < {}) {{\n"
+            "        {}\n"
+            "        i = i + 1;\n"
+            "    }}\n"
+            "    output(acc);\n"
+            "}}\n", decls, calls, body);
+
+        NullLogger logger;
+        auto program = compile(source, &logger, &bench_registry());
+
+        NullIo io;
+        CTinyC::Executor executor(&logger, &io);
+        executor.set_ffi_registry(&bench_registry());
+        executor.load(make_image(program));
+        std::atomic_bool interrupt_flag{};
+        auto t0 = std::chrono::steady_clock::now();
+        while (executor.execute(SIZE_MAX, interrupt_flag)) {}
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // Host-side cost of dispatching through a cached thunk, without the VM around it
+    double time_thunk(size_t calls) {
+        auto thunk = bench_registry().find("host_add3")->thunk;
+        std::vector<uint8_t> memory(64);
+        CTinyC::FfiArgs args{ memory.data(), { memory } };
+        volatile uint32_t sink{};
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; i++) {
+            memory[0] = static_cast<uint8_t>(i);
+            sink = thunk(args);
+        }
+        (void)sink;
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t calls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+    auto loop = time_program("", "acc = acc + 1;", calls);
+    auto per_call = [&](double seconds) { return std::max(seconds - loop, 0.0) / calls * 1e9; };
+    printf("%-28s %12s\n", "call", "ns/call");
+    printf("%-28s %12.1f\n", "TinyC nop()",
+        per_call(time_program("int nop(void) { return 0; }", "acc = acc + nop();", calls)));
+    printf("%-28s %12.1f\n", "host_nop()",
+        per_call(time_program("", "acc = acc + host_nop();", calls)));
+    printf("%-28s %12.1f\n", "TinyC add3(a, b, c)",
+        per_call(time_program("int add3(int a, int b, int c) { return a + b + c; }", "acc = add3(acc, i, 1);", calls)));
+    printf("%-28s %12.1f\n", "host_add3(a, b, c)",
+        per_call(time_program("", "acc = host_add3(acc, i, 1);", calls)));
+    printf("%-28s %12.1f\n", "thunk only (no VM)", time_thunk(calls * 100) / (calls * 100) * 1e9);
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+#include "pch.h"
+
+#include "Code/VmHeap.hpp"
+
+#include <random>
+
+// Allocation throughput of VmHeap against a naive first-fit allocator, both working
+// on the same kind of memory buffer as the VM:
+//
+//     tinyc_heap_bench [rounds]
+//
+// Workloads follow what TinyC programs do with the heap: linked lists built and torn
+// down, search trees with random deletions, and vectors grown by realloc.
+
+namespace {
+    constexpr uint32_t HEAP_BEGIN = 1024;
+    constexpr uint32_t HEAP_END = 12 * 1024 * 1024;
+
+    // K&R style: one address-ordered free list, first fit, coalescing on free
+    struct FirstFitHeap {
+        void reset(uint8_t* memory, uint32_t begin, uint32_t end) {
+            m_memory = memory;
+            m_head = (begin + 7) / 8 * 8;
+            write_dword(m_head, end - m_head);
+            write_dword(m_head + 4, 0);
+        }
+        uint32_t allocate(uint32_t size) {
+            size = std::max((size + 4 + 7) / 8 * 8, 8u);
+            for (uint32_t prev = 0, block = m_head; block; prev = block, block = read_dword(block + 4)) {
+                auto block_size = read_dword(block);
+                if (block_size < size) { continue; }
+                uint32_t next = read_dword(block + 4);
+                if (block_size - size >= 8) {
+                    next = block + size;
+                    write_dword(next, block_size - size);
+                    write_dword(next + 4, read_dword(block + 4));
+                    write_dword(block, size);
+                }
+                if (prev) { write_dword(prev + 4, next); }
+                else { m_head = next; }
+                return block + 4;
+            }
+            return 0;
+        }
+        void release(uint32_t ptr) {
+            if (!ptr) { return; }
+            auto block = ptr - 4;
+            auto size = read_dword(block);
+            uint32_t prev = 0, next = m_head;
+            while (next && next < block) {
+                prev = next;
+                next = read_dword(next + 4);
+            }
+            if (next && block + size == next) {
+                size += read_dword(next);
+                next = read_dword(next + 4);
+            }
+            write_dword(block, size);
+            write_dword(block + 4, next);
+            if (prev && prev + read_dword(prev) == block) {
+                write_dword(prev, read_dword(prev) + size);
+                write_dword(prev + 4, next);
+            }
+            else if (prev) { write_dword(prev + 4, block); }
+            else { m_head = block; }
+        }
+        uint32_t reallocate(uint32_t ptr, uint32_t size) {
+            auto new_ptr = allocate(size);
+            if (ptr && new_ptr) {
+                std::memcpy(m_memory + new_ptr, m_memory + ptr, std::min(read_dword(ptr - 4) - 4, size));
+                release(ptr);
+            }
+            return new_ptr;
+        }
+
+    private:
+        uint32_t read_dword(uint32_t addr) const {
+            uint32_t v;
+            std::memcpy(&v, m_memory + addr, 4);
+            return v;
+        }
+        void write_dword(uint32_t addr, uint32_t v) { std::memcpy(m_memory + addr, &v, 4); }
+
+        uint8_t* m_memory{};
+        uint32_t m_head{};
+    };
+
+    template<typename Heap>
+    uint32_t checked_allocate(Heap& heap, uint32_t size) {
+        auto ptr = heap.allocate(size);
+        if (!ptr) { throw std::runtime_error("heap exhausted"); }
+        return ptr;
+    }
+
+    // Returns number of allocator calls
+    template<typename Heap>
+    size_t list_workload(Heap& heap, size_t rounds) {
+        size_t ops{};
+        // Several lists grown side by side (think hash buckets), each torn down from its head
+        std::vector<uint32_t> lists[8];
+        for (size_t r = 0; r < rounds; r++) {
+            for (int i = 0; i < 5000; i++) {
+                for (auto& nodes : lists) {
+                    nodes.push_back(checked_allocate(heap, 8));
+                }
+            }
+            for (auto& nodes : lists) {
+                for (auto it = rbegin(nodes); it != rend(nodes); ++it) {
+                    heap.release(*it);
+                }
+                ops += 2 * size(nodes);
+                nodes.clear();
+            }
+        }
+        return ops;
+    }
+    template<typename Heap>
+    size_t tree_workload(Heap& heap, size_t rounds) {
+        size_t ops{};
+        std::mt19937 rng(1);
+        std::vector<uint32_t> nodes;
+        for (size_t r = 0; r < rounds; r++) {
+            // Random inserts and deletes; some nodes carry a payload of variable size
+            for (int i = 0; i < 5000; i++) {
+                if (!nodes.empty() && rng() % 3 == 0) {
+                    auto idx = rng() % size(nodes);
+                    heap.release(nodes[idx]);
+                    nodes[idx] = nodes.back();
+                    nodes.pop_back();
+                }
+                else {
+                    auto size = rng() % 4 == 0 ? 12 + rng() % 1000 : 12;
+                    nodes.push_back(checked_allocate(heap, size));
+                }
+                ops++;
+            }
+            for (auto node : nodes) {
+                heap.release(node);
+            }
+            ops += size(nodes);
+            nodes.clear();
+        }
+        return ops;
+    }
+    template<typename Heap>
+    size_t vector_workload(Heap& heap, size_t rounds) {
+        size_t ops{};
+        for (size_t r = 0; r < rounds; r++) {
+            // Several vectors growing side by side, with short-lived temporaries in between
+            uint32_t vecs[8]{};
+            for (uint32_t cap = 16; cap <= 16384; cap *= 2) {
+                for (auto& vec : vecs) {
+                    vec = heap.reallocate(vec, cap);
+                    heap.release(checked_allocate(heap, 24));
+                    ops += 3;
+                }
+            }
+            for (auto vec : vecs) {
+                heap.release(vec);
+                ops++;
+            }
+        }
+        return ops;
+    }
+
+    template<typename Heap, typename F>
+    double measure(F&& workload, size_t rounds) {
+        using clock = std::chrono::steady_clock;
+        std::vector<uint8_t> memory(HEAP_END);
+        Heap heap;
+        heap.reset(memory.data(), HEAP_BEGIN, HEAP_END);
+        auto t0 = clock::now();
+        auto ops = workload(heap, rounds);
+        auto t1 = clock::now();
+        return ops / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t rounds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20;
+
+    printf("%-10s %18s %18s %10s\n", "workload", "VmHeap(Mops/s)", "first-fit(Mops/s)", "speedup");
+    auto report = [&](char const* name, double fast, double naive) {
+        printf("%-10s %18.2f %18.2f %9.1fx\n", name, fast, naive, fast / naive);
+    };
+    report("list",
+        measure<CTinyC::VmHeap>([](auto& h, size_t n) { return list_workload(h, n); }, rounds),
+        measure<FirstFitHeap>([](auto& h, size_t n) { return list_workload(h, n); }, rounds));
+    report("tree",
+        measure<CTinyC::VmHeap>([](auto& h, size_t n) { return tree_workload(h, n); }, rounds),
+        measure<FirstFitHeap>([](auto& h, size_t n) { return tree_workload(h, n); }, rounds));
+    report("vector",
+        measure<CTinyC::VmHeap>([](auto& h, size_t n) { return vector_workload(h, n); }, rounds),
+        measure<FirstFitHeap>([](auto& h, size_t n) { return vector_workload(h, n); }, rounds));
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,66 @@
+#include "pch.h"
+
+#include "host_functions.hpp"
+
+#include <cmath>
+#include <numeric>
+
+namespace {
+    using CTinyC::FfiMemory;
+
+    int32_t isqrt(int32_t x) {
+        if (x < 0) {
+            throw std::runtime_error("isqrt of a negative number");
+        }
+        // Exact for every int: the double result is off by at most one
+        auto r = static_cast<int32_t>(std::sqrt(static_cast<double>(x)));
+        while (static_cast<int64_t>(r) * r > x) { r--; }
+        while (static_cast<int64_t>(r + 1) * (r + 1) <= x) { r++; }
+        return r;
+    }
+    int32_t ipow(int32_t base, int32_t exp) {
+        if (exp < 0) {
+            throw std::runtime_error("ipow with a negative exponent");
+        }
+        uint32_t result = 1, b = static_cast<uint32_t>(base);
+        for (auto e = static_cast<uint32_t>(exp); e; e >>= 1) {
+            if (e & 1) { result *= b; }
+            b *= b;
+        }
+        return static_cast<int32_t>(result);
+    }
+    int32_t gcd(int32_t a, int32_t b) {
+        return static_cast<int32_t>(std::gcd(static_cast<int64_t>(a), static_cast<int64_t>(b)));
+    }
+    int32_t clock_ms() {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<int32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+    }
+    int32_t str_len(FfiMemory memory, int32_t s) {
+        int32_t len{};
+        while (memory.read_dword(static_cast<uint32_t>(s) + len * 4) != 0) { len++; }
+        return len;
+    }
+    int32_t str_cmp(FfiMemory memory, int32_t a, int32_t b) {
+        for (uint32_t i = 0;; i += 4) {
+            auto x = memory.read_dword(static_cast<uint32_t>(a) + i);
+            auto y = memory.read_dword(static_cast<uint32_t>(b) + i);
+            if (x != y) { return x < y ? -1 : 1; }
+            if (x == 0) { return 0; }
+        }
+    }
+}
+
+CTinyC::FfiRegistry const& host_ffi_registry() {
+    static auto const registry = [] {
+        CTinyC::FfiRegistry registry;
+        registry.add<isqrt>("isqrt");
+        registry.add<ipow>("ipow");
+        registry.add<gcd>("gcd");
+        registry.add<clock_ms>("clock_ms");
+        registry.add<str_len>("str_len");
+        registry.add<str_cmp>("str_cmp");
+        return registry;
+    }();
+    return registry;
+}
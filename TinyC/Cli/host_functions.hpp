@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Code/Ffi.hpp"
+
+// Host functions the command-line driver makes available to TinyC programs:
+//
+//     int isqrt(int x);               floor of the square root, x >= 0
+//     int ipow(int base, int exp);    wraps around like TinyC arithmetic, exp >= 0
+//     int gcd(int a, int b);
+//     int clock_ms(void);             milliseconds of a monotonic clock
+//     int str_len(int s[]);           strings are int arrays ending with 0
+//     int str_cmp(int a[], int b[]);  -1, 0 or 1
+CTinyC::FfiRegistry const& host_ffi_registry();
@@ -0,0 +1,125 @@
+#include "pch.h"
+
+#include "Code/AsyncLogger.hpp"
+
+#include <mutex>
+#include <thread>
+
+// Throughput of the logging backends under a flood of executor-style debug messages:
+//
+//     tinyc_log_bench [messages per thread] [threads]
+//
+// "producer" is how long the logging threads were busy, "total" includes handing every
+// message to the sink. The sink joins the lines into one string, like the IDE does.
+
+namespace {
+    using CTinyC::Logger;
+
+    // What the IDE did before: format on the spot, append under a lock
+    struct SyncLogger : Logger {
+        void log(Severity, winrt::hstring const& str) override {
+            std::scoped_lock guard{ m_mutex };
+            m_text += str;
+            m_text += L'\n';
+            m_line_cnt++;
+        }
+
+        std::mutex m_mutex;
+        std::wstring m_text;
+        size_t m_line_cnt{};
+    };
+
+    struct BenchSink {
+        void operator()(std::span<CTinyC::LogLine const> lines) {
+            for (auto const& line : lines) {
+                text += line.text;
+                if (line.repeat_cnt > 1) {
+                    text += std::format(L" (repeated {} times)", line.repeat_cnt);
+                }
+                text += L'\n';
+                message_cnt += line.repeat_cnt;
+            }
+            line_cnt += size(lines);
+            call_cnt++;
+        }
+
+        std::wstring text;
+        size_t line_cnt{}, message_cnt{}, call_cnt{};
+    };
+
+    // Roughly what Executor logs per instruction
+    void produce(Logger& logger, size_t messages) {
+        for (size_t i = 0; i < messages; i += 2) {
+            logger.debugf(L"Decoding instruction {} at {}(0x{:08x}), sp = {}", i % 40, 1000 + i, 1000 + i, 0xfff000 - i);
+            if (i % 8 == 0) {
+                logger.debugf(L"PushDword {}", i);
+            }
+            else {
+                logger.debug(L"Add");
+            }
+        }
+    }
+
+    struct Timing {
+        double producer_s, total_s;
+    };
+
+    template<typename F>
+    Timing run_producers(Logger& logger, size_t messages, size_t threads, F&& finish) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([&] { produce(logger, messages); });
+        }
+        for (auto& worker : workers) { worker.join(); }
+        auto t1 = std::chrono::steady_clock::now();
+        finish();
+        auto t2 = std::chrono::steady_clock::now();
+        return { std::chrono::duration<double>(t1 - t0).count(), std::chrono::duration<double>(t2 - t0).count() };
+    }
+
+    void print_row(char const* name, Timing timing, size_t total_messages, std::string const& detail) {
+        printf("%-26s %14.2f %10.1f %10.1f  %s\n", name, total_messages / timing.producer_s / 1e6,
+            timing.producer_s * 1e3, timing.total_s * 1e3, detail.c_str());
+    }
+
+    void bench_async(char const* name, CTinyC::LogOverflowPolicy policy, size_t messages, size_t threads) {
+        BenchSink sink;
+        CTinyC::AsyncLoggerOptions options;
+        options.overflow_policy = policy;
+        Timing timing;
+        size_t dropped_cnt{};
+        {
+            CTinyC::AsyncLogger logger([&](std::span<CTinyC::LogLine const> lines) { sink(lines); }, options);
+            timing = run_producers(logger, messages, threads, [&] { logger.flush(); });
+            dropped_cnt = logger.dropped_count();
+        }
+        print_row(name, timing, messages * threads, std::format("{} lines for {} messages in {} batches, {} dropped",
+            sink.line_cnt, sink.message_cnt, sink.call_cnt, dropped_cnt));
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+
+    printf("%-26s %14s %10s %10s  %s\n", "backend", "producer Mmsg/s", "producer(ms)", "total(ms)", "delivered");
+    {
+        SyncLogger logger;
+        auto timing = run_producers(logger, messages, threads, [] {});
+        print_row("sync, locked append", timing, messages * threads, std::format("{} lines", logger.m_line_cnt));
+    }
+    bench_async("async, drop", CTinyC::LogOverflowPolicy::Drop, messages, threads);
+    bench_async("async, block", CTinyC::LogOverflowPolicy::Block, messages, threads);
+    {
+        CTinyC::AsyncLogger logger([](std::span<CTinyC::LogLine const>) {});
+        logger.set_min_severity(Logger::Severity::Info);
+        auto timing = run_producers(logger, messages, threads, [&] { logger.flush(); });
+        print_row("disabled (min Info)", timing, messages * threads, "-");
+    }
+    return EXIT_SUCCESS;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
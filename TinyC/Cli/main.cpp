@@ -0,0 +1,626 @@
+#include "pch.h"
+
+#include "Code/AotTranslator.hpp"
+#include "Code/Assembly.hpp"
+#include "Code/CodeGen.hpp"
+#include "Code/Executor.hpp"
+#include "Code/Judge.hpp"
+#include "Code/SharedRing.hpp"
+#include "Code/public.h"
+#include "host_functions.hpp"
+#include "tool_support.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Headless driver for TinyC: compiles a source file and runs it in the VM, with the
+// input / output syscalls wired to stdin / stdout.
+//
+//     tinyc [--isolated] [--max-insts N] [--heap-check] [--deterministic] <file.c>
+//     tinyc --bench [--max-insts N] [--deterministic] <file.c>...
+//     tinyc --judge [--max-insts N] [--time-limit MS] [--jobs N] <file.c> <case-dir>
+//     tinyc --debug <script> <file.c>
+//     tinyc --emit-c <out.c> <file.c>
+//     tinyc --disasm [--no-addresses] <file.c>
+//
+// Programs ending in .tasm are bytecode assembly (see Code/Assembly.hpp) instead of
+// TinyC source; --disasm prints the assembly of a program.
+//
+// Benchmark mode runs every program with its output captured, compares it against
+// <file>.expected (if present) and reports compile time, instructions executed and
+// instructions per second.
+//
+// --deterministic runs the threads a program spawns in turns on a single host thread,
+// so that a run can be reproduced, instead of in parallel.
+//
+// Isolated mode runs the VM in a child process like the IDE does: the image, program
+// input / output and log records all travel over a SharedChannel.
+//
+// Judge mode compiles the program once and runs it against every <case>.in in the
+// directory, comparing the output with <case>.out. Cases run in parallel.
+//
+// Debug mode runs the program under the commands of a script ("-" for stdin), one per
+// line:
+//
+//     break LINE | break @ADDR    set a breakpoint on a source line / code address
+//     clear LINE | clear @ADDR
+//     continue                    run until a breakpoint or the end of the program
+//     step                        execute one instruction
+//     next                        same, but runs a call to its end
+//     locals                      print the variables of the current function
+//     where                       print the current address, line and function
+//
+// --emit-c translates the program into a standalone C file instead of running it; see
+// AotTranslator.hpp. tinyc_aot_check builds and checks such translations.
+//
+// Programs can call the host functions of host_functions.hpp like builtins.
+
+namespace {
+    constexpr size_t EXECUTE_CHUNK = 1024 * 1024;
+    constexpr uint32_t CHANNEL_CAPACITY = 1024 * 1024;
+    // Program output is sent in records of about this size
+    constexpr size_t OUTPUT_FLUSH_SIZE = 4096;
+
+    struct ConsoleLogger : CTinyC::Logger {
+        ConsoleLogger() { set_min_severity(Severity::Info); }
+        void log(Severity severity, winrt::hstring const& str) override {
+            fprintf(stderr, "%s\n", winrt::to_string(str).c_str());
+        }
+    };
+
+    struct RunOptions {
+        size_t max_insts{};
+        // Guard heap blocks with canaries
+        bool heap_checked{};
+        bool deterministic{};
+    };
+
+    bool is_assembly(std::filesystem::path const& path) {
+        return path.extension() == ".tasm";
+    }
+
+    // Returns number of instructions executed
+    size_t run(CompiledProgram& program, CTinyC::Logger* logger, RunOptions const& options,
+        CTinyC::ExecutorIo* io = nullptr, std::function<void()> const& on_chunk = {}) {
+        CTinyC::Executor executor(logger, io);
+        executor.set_heap_checked(options.heap_checked);
+        executor.set_ffi_registry(&host_ffi_registry());
+        if (options.deterministic) {
+            executor.set_thread_options({ .scheduling = CTinyC::ThreadScheduling::Deterministic });
+        }
+        executor.load(program.image.data(), size(program.image), VM_MEMORY_SIZE,
+            VM_START_OFFSET, program.metadata.bss_size, program.metadata.ffi_imports);
+        executor.set_ip(program.entry);
+        std::atomic_bool interrupt_flag{};
+        while (executor.execute(EXECUTE_CHUNK, interrupt_flag)) {
+            if (on_chunk) { on_chunk(); }
+            if (options.max_insts && executor.executed_count() >= options.max_insts) {
+                throw std::runtime_error("instruction limit exceeded");
+            }
+        }
+        fflush(stdout);
+        return executor.executed_count();
+    }
+
+    // Runs `fn` with stdout redirected into a temporary file, returns what was written
+    template<typename F>
+    std::string capture_stdout(F&& fn) {
+        fflush(stdout);
+        auto tmp = tmpfile();
+        if (!tmp) {
+            throw std::runtime_error("cannot create temporary file");
+        }
+        int saved_fd = dup(STDOUT_FILENO);
+        dup2(fileno(tmp), STDOUT_FILENO);
+        auto restore = [&] {
+            fflush(stdout);
+            dup2(saved_fd, STDOUT_FILENO);
+            close(saved_fd);
+        };
+        try {
+            fn();
+        }
+        catch (...) {
+            restore();
+            fclose(tmp);
+            throw;
+        }
+        restore();
+
+        std::string output;
+        rewind(tmp);
+        char buf[4096];
+        while (auto n = fread(buf, 1, sizeof buf, tmp)) {
+            output.append(buf, n);
+        }
+        fclose(tmp);
+        return output;
+    }
+
+    int run_single(std::filesystem::path const& path, RunOptions const& options) {
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+        run(program, &logger, options);
+        return EXIT_SUCCESS;
+    }
+
+    void write_record(CTinyC::SharedRing& tx, CTinyC::SlaveMsgType type, std::string_view body) {
+        tx.write_u32(static_cast<uint32_t>(type));
+        tx.write_u32(static_cast<uint32_t>(body.size()));
+        tx.write_bytes(body.data(), body.size());
+    }
+
+    // Child side of isolated mode
+    struct ChannelLogger : CTinyC::Logger {
+        explicit ChannelLogger(CTinyC::SharedRing& tx) : m_tx(tx) { set_min_severity(Severity::Info); }
+
+        void log(Severity severity, winrt::hstring const& str) override {
+            auto text = winrt::to_string(str);
+            m_tx.write_u32(static_cast<uint32_t>(CTinyC::SlaveMsgType::Log));
+            m_tx.write_u32(static_cast<uint32_t>(4 + text.size()));
+            m_tx.write_u32(static_cast<uint32_t>(severity));
+            m_tx.write_bytes(text.data(), text.size());
+        }
+
+    private:
+        CTinyC::SharedRing& m_tx;
+    };
+    struct ChannelIo : CTinyC::ExecutorIo {
+        ChannelIo(CTinyC::SharedRing& tx, CTinyC::SharedRing& rx) : m_tx(tx), m_rx(rx) {}
+
+        int read_char() override {
+            if (m_in_pos == m_in.size()) {
+                if (m_in_eof) { return -1; }
+                // Whatever the program printed so far is likely a prompt
+                flush();
+                write_record(m_tx, CTinyC::SlaveMsgType::InputRequest, {});
+                m_in.resize(m_rx.read_u32());
+                m_rx.read_bytes(m_in.data(), m_in.size());
+                m_in_pos = 0;
+                if (m_in.empty()) {
+                    m_in_eof = true;
+                    return -1;
+                }
+            }
+            return static_cast<uint8_t>(m_in[m_in_pos++]);
+        }
+        void write(std::string_view bytes) override {
+            m_out += bytes;
+            if (m_out.size() >= OUTPUT_FLUSH_SIZE) { flush(); }
+        }
+        void flush() {
+            if (m_out.empty()) { return; }
+            write_record(m_tx, CTinyC::SlaveMsgType::Output, m_out);
+            m_out.clear();
+        }
+
+    private:
+        CTinyC::SharedRing& m_tx;
+        CTinyC::SharedRing& m_rx;
+        std::string m_in, m_out;
+        size_t m_in_pos{};
+        bool m_in_eof{};
+    };
+
+    int run_slave(CTinyC::SharedChannel::NativeHandle handle, RunOptions const& options) {
+        auto channel = CTinyC::SharedChannel::open(handle);
+        channel.set_peer_alive([parent = getppid()] { return getppid() == parent; });
+        auto& tx = channel.tx();
+        auto& rx = channel.rx();
+
+        CompiledProgram program;
+        program.image.resize(rx.read_u32());
+        rx.read_bytes(program.image.data(), program.image.size());
+        program.entry = rx.read_u32();
+        program.metadata.bss_size = rx.read_u32();
+        program.metadata.ffi_imports.resize(rx.read_u32());
+        for (auto& import : program.metadata.ffi_imports) {
+            import.name.resize(rx.read_u32());
+            rx.read_bytes(import.name.data(), import.name.size());
+            import.param_cnt = rx.read_u32();
+            import.returns_int = rx.read_u32();
+        }
+
+        ChannelLogger logger(tx);
+        ChannelIo io(tx, rx);
+        uint32_t is_success = 1;
+        try {
+            run(program, &logger, options, &io, [&] { io.flush(); });
+        }
+        catch (std::exception const& e) {
+            logger.log(CTinyC::Logger::Severity::Error, winrt::to_hstring(e.what()));
+            is_success = 0;
+        }
+        io.flush();
+        write_record(tx, CTinyC::SlaveMsgType::Result, { reinterpret_cast<char*>(&is_success), 4 });
+        return is_success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int run_isolated(std::filesystem::path const& path, RunOptions const& options) {
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+
+        auto channel = CTinyC::SharedChannel::create(CHANNEL_CAPACITY);
+        auto handle_arg = std::to_string(channel.native_handle());
+        auto max_insts_arg = std::to_string(options.max_insts);
+        auto pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("cannot fork");
+        }
+        if (pid == 0) {
+            // The region descriptor is inherited across exec
+            std::vector<char const*> args{ "tinyc", "--slave", handle_arg.c_str(), "--max-insts", max_insts_arg.c_str() };
+            if (options.heap_checked) { args.push_back("--heap-check"); }
+            if (options.deterministic) { args.push_back("--deterministic"); }
+            args.push_back(nullptr);
+            execv("/proc/self/exe", const_cast<char* const*>(args.data()));
+            _exit(127);
+        }
+        channel.set_peer_alive([pid] {
+            siginfo_t info{};
+            return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
+        });
+        auto& tx = channel.tx();
+        auto& rx = channel.rx();
+
+        tx.write_u32(static_cast<uint32_t>(size(program.image)));
+        tx.write_bytes(program.image.data(), size(program.image));
+        tx.write_u32(static_cast<uint32_t>(program.entry));
+        tx.write_u32(static_cast<uint32_t>(program.metadata.bss_size));
+        tx.write_u32(static_cast<uint32_t>(size(program.metadata.ffi_imports)));
+        for (auto const& import : program.metadata.ffi_imports) {
+            tx.write_u32(static_cast<uint32_t>(import.name.size()));
+            tx.write_bytes(import.name.data(), import.name.size());
+            tx.write_u32(import.param_cnt);
+            tx.write_u32(import.returns_int);
+        }
+
+        uint32_t is_success{};
+        std::string body;
+        for (bool finished = false; !finished;) {
+            auto msg_type = static_cast<CTinyC::SlaveMsgType>(rx.read_u32());
+            body.resize(rx.read_u32());
+            rx.read_bytes(body.data(), body.size());
+            switch (msg_type) {
+            case CTinyC::SlaveMsgType::Log:
+                fprintf(stderr, "%.*s\n", static_cast<int>(body.size() - 4), body.data() + 4);
+                break;
+            case CTinyC::SlaveMsgType::Result:
+                std::memcpy(&is_success, body.data(), sizeof is_success);
+                finished = true;
+                break;
+            case CTinyC::SlaveMsgType::Output:
+                fwrite(body.data(), 1, body.size(), stdout);
+                fflush(stdout);
+                break;
+            case CTinyC::SlaveMsgType::InputRequest: {
+                char buf[4096];
+                auto n = read(STDIN_FILENO, buf, sizeof buf);
+                n = std::max<ssize_t>(n, 0);
+                tx.write_u32(static_cast<uint32_t>(n));
+                tx.write_bytes(buf, n);
+                break;
+            }
+            default:
+                throw std::runtime_error("unknown message from the VM process");
+            }
+        }
+        waitpid(pid, nullptr, 0);
+        return is_success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int run_bench(std::vector<std::filesystem::path> const& paths, RunOptions const& options) {
+        using clock = std::chrono::steady_clock;
+        using ms = std::chrono::duration<double, std::milli>;
+
+        ConsoleLogger logger;
+        bool all_passed = true;
+        printf("%-16s %12s %14s %12s %10s  %s\n",
+            "program", "compile(ms)", "instructions", "run(ms)", "MIPS", "result");
+        for (auto const& path : paths) {
+            std::string status = "ok";
+            double compile_ms{}, run_ms{};
+            size_t insts{};
+            try {
+                auto source = read_file(path);
+                auto t0 = clock::now();
+                auto program = compile(source, &logger, &host_ffi_registry(), is_assembly(path));
+                auto t1 = clock::now();
+                auto output = capture_stdout([&] { insts = run(program, &logger, options); });
+                auto t2 = clock::now();
+                compile_ms = ms(t1 - t0).count();
+                run_ms = ms(t2 - t1).count();
+
+                auto expected_path = std::filesystem::path(path).replace_extension(".expected");
+                if (std::filesystem::exists(expected_path)) {
+                    if (trim_right(output) != trim_right(read_file(expected_path))) {
+                        status = "MISMATCH";
+                    }
+                }
+                else {
+                    status = "ok (unchecked)";
+                }
+            }
+            catch (std::exception const& e) {
+                status = std::format("FAILED: {}", e.what());
+            }
+            if (!status.starts_with("ok")) { all_passed = false; }
+
+            auto mips = run_ms > 0 ? insts / run_ms / 1000 : 0.0;
+            printf("%-16s %12.3f %14zu %12.3f %10.2f  %s\n", path.filename().string().c_str(),
+                compile_ms, insts, run_ms, mips, status.c_str());
+        }
+        return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int run_debug(std::filesystem::path const& script_path, std::filesystem::path const& path) {
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+        auto const& debug_info = program.metadata.debug_info;
+        CTinyC::Executor executor(&logger);
+        executor.set_ffi_registry(&host_ffi_registry());
+        executor.load(program.image.data(), size(program.image), VM_MEMORY_SIZE,
+            VM_START_OFFSET, program.metadata.bss_size, program.metadata.ffi_imports);
+        executor.set_ip(program.entry);
+        executor.set_debug_info(&debug_info);
+
+        auto script = script_path == "-" ? std::string(std::istreambuf_iterator<char>(std::cin), {}) : read_file(script_path);
+        std::atomic_bool interrupt_flag{};
+        bool running = true;
+        auto print_where = [&] {
+            auto func = debug_info.func_at(static_cast<uint32_t>(executor.ip()));
+            printf("  at 0x%zx line %d in %s\n", executor.ip(), executor.current_line(),
+                func ? func->name.c_str() : "?");
+        };
+        auto print_stop = [&] {
+            fflush(stdout);
+            if (!running) {
+                printf("program exited\n");
+                return;
+            }
+            printf("%s\n", executor.at_breakpoint() ? "breakpoint" : "stopped");
+            print_where();
+        };
+        std::istringstream lines(script);
+        for (std::string line; std::getline(lines, line);) {
+            std::istringstream words(line);
+            std::string cmd, arg;
+            words >> cmd >> arg;
+            if (cmd.empty() || cmd.starts_with("#")) { continue; }
+            printf("(tdb) %s\n", trim_right(line).data());
+            try {
+                if (cmd == "break" || cmd == "clear") {
+                    if (arg.empty()) {
+                        throw std::runtime_error("missing location");
+                    }
+                    bool is_set = cmd == "break";
+                    if (arg.starts_with("@")) {
+                        auto addr = std::stoull(arg.substr(1), nullptr, 0);
+                        is_set ? executor.set_breakpoint(addr) : executor.clear_breakpoint(addr);
+                    }
+                    else if (is_set) {
+                        auto cnt = executor.set_line_breakpoint(std::stoi(arg));
+                        printf("  %zu location(s)\n", cnt);
+                    }
+                    else {
+                        executor.clear_line_breakpoint(std::stoi(arg));
+                    }
+                }
+                else if (cmd == "continue" || cmd == "step" || cmd == "next") {
+                    if (!running) {
+                        throw std::runtime_error("the program is not running");
+                    }
+                    if (cmd == "continue") {
+                        do {
+                            running = executor.execute(EXECUTE_CHUNK, interrupt_flag);
+                        } while (running && !executor.at_breakpoint());
+                    }
+                    else {
+                        running = cmd == "step" ? executor.step() : executor.step_over(SIZE_MAX, interrupt_flag);
+                    }
+                    print_stop();
+                }
+                else if (cmd == "locals") {
+                    for (auto const& local : executor.read_locals()) {
+                        printf("  %s =", local.name.c_str());
+                        for (auto value : local.values) { printf(" %d", value); }
+                        printf("\n");
+                    }
+                }
+                else if (cmd == "where") {
+                    print_where();
+                }
+                else {
+                    throw std::runtime_error(std::format("unknown command `{}`", cmd));
+                }
+            }
+            catch (std::exception const& e) {
+                fflush(stdout);
+                printf("  error: %s\n", e.what());
+                // A fault ends the program
+                if (cmd == "continue" || cmd == "step" || cmd == "next") { running = false; }
+            }
+        }
+        fflush(stdout);
+        return EXIT_SUCCESS;
+    }
+
+    int run_judge(std::filesystem::path const& path, std::filesystem::path const& case_dir,
+        CTinyC::JudgeLimits const& limits, size_t jobs
+    ) {
+        using ms = std::chrono::duration<double, std::milli>;
+
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+        auto image = make_image(program);
+
+        std::vector<std::string> names;
+        std::vector<CTinyC::JudgeCase> cases;
+        for (auto const& entry : std::filesystem::directory_iterator(case_dir)) {
+            if (entry.path().extension() == ".in") {
+                names.push_back(entry.path().stem().string());
+            }
+        }
+        std::ranges::sort(names);
+        for (auto const& name : names) {
+            cases.push_back({ read_file(case_dir / (name + ".in")), read_file(case_dir / (name + ".out")) });
+        }
+        if (cases.empty()) {
+            throw std::runtime_error(std::format("no test cases in `{}`", case_dir.string()));
+        }
+
+        auto results = CTinyC::Judge(image, limits, &host_ffi_registry()).run_all(cases, jobs);
+
+        size_t accepted{};
+        printf("%-16s %-20s %14s %10s  %s\n", "case", "verdict", "instructions", "time(ms)", "detail");
+        for (size_t i = 0; i < size(results); i++) {
+            auto const& r = results[i];
+            if (r.verdict == CTinyC::JudgeVerdict::Accepted) { accepted++; }
+            printf("%-16s %-20s %14zu %10.3f  %s\n", names[i].c_str(), CTinyC::to_string(r.verdict),
+                r.executed_count, ms(r.elapsed).count(), r.message.c_str());
+        }
+        printf("%zu / %zu accepted\n", accepted, size(results));
+        return accepted == size(results) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int run_emit_c(std::filesystem::path const& out_path, std::filesystem::path const& path) {
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+        auto image = make_image(program);
+        auto source = CTinyC::translate_to_c(image, program.metadata, VM_START_OFFSET);
+
+        std::ofstream out(out_path, std::ios::binary);
+        out << source;
+        if (!out.flush()) {
+            throw std::runtime_error(std::format("cannot write `{}`", out_path.string()));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int run_disasm(std::filesystem::path const& path, CTinyC::DisassemblyOptions const& options) {
+        ConsoleLogger logger;
+        auto program = compile(read_file(path), &logger, &host_ffi_registry(), is_assembly(path));
+        auto text = CTinyC::disassemble(program.image, program.metadata, VM_START_OFFSET, options);
+        fwrite(text.data(), 1, text.size(), stdout);
+        return EXIT_SUCCESS;
+    }
+
+    void print_usage() {
+        fprintf(stderr,
+            "usage: tinyc [--isolated] [--max-insts N] [--heap-check] [--deterministic] <file.c>\n"
+            "       tinyc --bench [--max-insts N] [--deterministic] <file.c>...\n"
+            "       tinyc --judge [--max-insts N] [--time-limit MS] [--jobs N] <file.c> <case-dir>\n"
+            "       tinyc --debug <script> <file.c>\n"
+            "       tinyc --emit-c <out.c> <file.c>\n"
+            "       tinyc --disasm [--no-addresses] <file.c>\n");
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    bool bench{}, isolated{}, judge{}, disasm{};
+    CTinyC::DisassemblyOptions disasm_options;
+    std::filesystem::path debug_script, emit_c_path;
+    RunOptions options;
+    size_t time_limit_ms{}, jobs{};
+    int slave_handle{ -1 };
+    std::vector<std::filesystem::path> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--bench") {
+            bench = true;
+        }
+        else if (arg == "--judge") {
+            judge = true;
+        }
+        else if (arg == "--debug" && i + 1 < argc) {
+            debug_script = argv[++i];
+        }
+        else if (arg == "--disasm") {
+            disasm = true;
+        }
+        else if (arg == "--no-addresses") {
+            disasm_options.addresses = false;
+        }
+        else if (arg == "--emit-c" && i + 1 < argc) {
+            emit_c_path = argv[++i];
+        }
+        else if (arg == "--time-limit" && i + 1 < argc) {
+            time_limit_ms = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--isolated") {
+            isolated = true;
+        }
+        // Internal, the child process of isolated mode
+        else if (arg == "--slave" && i + 1 < argc) {
+            slave_handle = std::atoi(argv[++i]);
+        }
+        else if (arg == "--max-insts" && i + 1 < argc) {
+            options.max_insts = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--heap-check") {
+            options.heap_checked = true;
+        }
+        else if (arg == "--deterministic") {
+            options.deterministic = true;
+        }
+        else if (arg.starts_with("-")) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (slave_handle >= 0) {
+        return run_slave(slave_handle, options);
+    }
+    if (judge) {
+        if (paths.size() != 2) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        CTinyC::JudgeLimits limits{ options.max_insts, std::chrono::milliseconds(time_limit_ms) };
+        return run_judge(paths[0], paths[1], limits, jobs);
+    }
+    if (!debug_script.empty()) {
+        if (paths.size() != 1) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        return run_debug(debug_script, paths[0]);
+    }
+    if (disasm) {
+        if (paths.size() != 1) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        return run_disasm(paths[0], disasm_options);
+    }
+    if (!emit_c_path.empty()) {
+        if (paths.size() != 1) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        return run_emit_c(emit_c_path, paths[0]);
+    }
+    if (paths.empty() || (!bench && paths.size() != 1)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (bench) {
+        return run_bench(paths, options);
+    }
+    return isolated ? run_isolated(paths[0], options) : run_single(paths[0], options);
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// Precompiled header for the portable (non-WinRT) build of the TinyC core.
+// The core only needs a wide string type and a few conversion helpers from
+// C++/WinRT, which are provided here on top of the standard library.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <compare>
+#include <format>
+#include <list>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace winrt {
+    using hstring = std::wstring;
+    namespace param {
+        using hstring = ::winrt::hstring;
+    }
+
+    // Decodes UTF-8 (invalid sequences become U+FFFD)
+    inline hstring to_hstring(std::string_view str) {
+        hstring result;
+        result.reserve(str.size());
+        for (size_t i = 0; i < str.size();) {
+            auto ch = static_cast<uint8_t>(str[i]);
+            int len = ch < 0x80 ? 1 : (ch >> 5) == 0x6 ? 2 : (ch >> 4) == 0xe ? 3 : (ch >> 3) == 0x1e ? 4 : 0;
+            if (len == 0 || i + len > str.size()) {
+                result.push_back(L'\xfffd');
+                i++;
+                continue;
+            }
+            char32_t cp = len == 1 ? ch : ch & (0x7f >> len);
+            for (int j = 1; j < len; j++) {
+                cp = (cp << 6) | (static_cast<uint8_t>(str[i + j]) & 0x3f);
+            }
+            if constexpr (sizeof(wchar_t) == 2) {
+                if (cp >= 0x10000) {
+                    cp -= 0x10000;
+                    result.push_back(static_cast<wchar_t>(0xd800 + (cp >> 10)));
+                    result.push_back(static_cast<wchar_t>(0xdc00 + (cp & 0x3ff)));
+                    i += len;
+                    continue;
+                }
+            }
+            result.push_back(static_cast<wchar_t>(cp));
+            i += len;
+        }
+        return result;
+    }
+    inline std::string to_string(std::wstring_view str) {
+        std::string result;
+        result.reserve(str.size());
+        for (size_t i = 0; i < str.size(); i++) {
+            char32_t cp = str[i];
+            if constexpr (sizeof(wchar_t) == 2) {
+                if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < str.size()) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (str[++i] - 0xdc00);
+                }
+            }
+            if (cp < 0x80) {
+                result.push_back(static_cast<char>(cp));
+            }
+            else if (cp < 0x800) {
+                result.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+                result.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+            else if (cp < 0x10000) {
+                result.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+                result.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                result.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+            else {
+                result.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+                result.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+                result.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                result.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,120 @@
+#include "pch.h"
+
+#include "tool_support.hpp"
+
+#include <thread>
+
+// Scaling of spawned VM threads on an embarrassingly parallel program:
+//
+//     tinyc_thread_bench [max-threads] [limit]
+//
+// Counts the primes below `limit` by trial division, split into one contiguous range
+// per thread, for 1, 2, 4, ... up to `max-threads` threads (default: the number of
+// hardware threads, at least 4). Every run has to find the same count. The last row
+// runs the most threads under deterministic scheduling, which uses a single core.
+
+namespace {
+    std::string make_source(size_t threads, size_t limit) {
+        return std::format(
+            "int is_prime(int x) {{\n"
+            "    int d;\n"
+            "    if (x < 2) {{\n"
+            "        return 0;\n"
+            "    }}\n"
+            "    d = 2;\n"
+            "    while (d * d <= x) {{\n"
+            "        if (x - x / d * d == 0) {{\n"
+            "            return 0;\n"
+            "        }}\n"
+            "        d = d + 1;\n"
+            "    }}\n"
+            "    return 1;\n"
+            "}}\n"
+            "int count_range(int part) {{\n"
+            "    int x;\n"
+            "    int end;\n"
+            "    int count;\n"
+            "    x = {1} / {0} * part;\n"
+            "    end = x + {1} / {0};\n"
+            "    if (part == {0} - 1) {{\n"
+            "        end = {1};\n"
+            "    }}\n"
+            "    count = 0;\n"
+            "    while (x < end) {{\n"
+            "        count = count + is_prime(x);\n"
+            "        x = x + 1;\n"
+            "    }}\n"
+            "    return count;\n"
+            "}}\n"
+            "void main(void) {{\n"
+            "    int ids[{0}];\n"
+            "    int i;\n"
+            "    int count;\n"
+            "    i = 0;\n"
+            "    while (i < {0}) {{\n"
+            "        ids[i] = spawn(count_range, i);\n"
+            "        i = i + 1;\n"
+            "    }}\n"
+            "    count = 0;\n"
+            "    i = 0;\n"
+            "    while (i < {0}) {{\n"
+            "        count = count + join(ids[i]);\n"
+            "        i = i + 1;\n"
+            "    }}\n"
+            "    output(count);\n"
+            "}}\n", threads, limit);
+    }
+
+    struct RunResult {
+        std::string output;
+        size_t executed_count{};
+        double seconds{};
+    };
+
+    RunResult run_program(size_t threads, size_t limit, CTinyC::ThreadScheduling scheduling) {
+        NullLogger logger;
+        auto program = compile(make_source(threads, limit), &logger);
+
+        CaptureIo io;
+        CTinyC::Executor executor(&logger, &io);
+        executor.set_thread_options({ .scheduling = scheduling });
+        executor.load(make_image(program));
+        std::atomic_bool interrupt_flag{};
+        auto t0 = std::chrono::steady_clock::now();
+        while (executor.execute(SIZE_MAX, interrupt_flag)) {}
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return { std::move(io.output), executor.executed_count(), seconds };
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    size_t max_threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10) :
+        std::max<size_t>(std::thread::hardware_concurrency(), 4);
+    size_t limit = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    printf("%-24s %14s %10s %8s  %s\n", "threads", "instructions", "time(ms)", "speedup", "primes");
+    std::string expected;
+    double base_seconds{};
+    bool ok = true;
+    auto report = [&](std::string const& name, RunResult const& r) {
+        if (expected.empty()) {
+            expected = r.output;
+            base_seconds = r.seconds;
+        }
+        bool match = r.output == expected;
+        ok &= match;
+        printf("%-24s %14zu %10.1f %7.2fx  %s%s\n", name.c_str(), r.executed_count, r.seconds * 1000,
+            base_seconds / r.seconds, r.output.c_str(), match ? "" : " MISMATCH");
+    };
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        report(std::to_string(threads), run_program(threads, limit, CTinyC::ThreadScheduling::Parallel));
+    }
+    report(std::format("{} (deterministic)", max_threads),
+        run_program(max_threads, limit, CTinyC::ThreadScheduling::Deterministic));
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const& e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return EXIT_FAILURE;
+}
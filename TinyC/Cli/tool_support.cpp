@@ -0,0 +1,60 @@
+#include "pch.h"
+
+#include "tool_support.hpp"
+#include "Code/Assembly.hpp"
+#include "Code/Lexer.hpp"
+#include "Code/Parser.hpp"
+
+#include <fstream>
+#include <sstream>
+
+std::string read_file(std::filesystem::path const& path) {
+    std::ifstream fs(path, std::ios::binary);
+    if (!fs) {
+        throw std::runtime_error(std::format("cannot open `{}`", path.string()));
+    }
+    std::stringstream ss;
+    ss << fs.rdbuf();
+    return ss.str();
+}
+
+std::string_view trim_right(std::string_view str) {
+    while (!str.empty() && isspace(static_cast<uint8_t>(str.back()))) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+CompiledProgram compile(std::string_view source, CTinyC::Logger* logger,
+    CTinyC::FfiRegistry const* ffi_registry, bool assembly
+) {
+    CompiledProgram program;
+    if (assembly) {
+        std::tie(program.image, program.metadata) = CTinyC::assemble(source, VM_START_OFFSET);
+    }
+    else {
+        CTinyC::Lexer lexer(logger);
+        CTinyC::Parser parser(logger);
+        lexer.init(source);
+        auto ast_root = parser.parse(&lexer);
+        if (!ast_root) {
+            throw std::runtime_error("compilation failed");
+        }
+        CTinyC::CodeGenerator code_gen(logger, ffi_registry);
+        std::tie(program.image, program.metadata) = code_gen.ast_to_code(*ast_root, VM_START_OFFSET);
+    }
+    auto main_it = std::ranges::find(program.metadata.func_meta, "main",
+        [](CTinyC::CodeMetadata::FuncMetadata const& v) { return v.name; });
+    if (main_it == end(program.metadata.func_meta)) {
+        throw std::runtime_error("function main not found");
+    }
+    program.entry = VM_START_OFFSET + main_it->offset;
+    return program;
+}
+
+CTinyC::ExecutorImage make_image(CompiledProgram const& program) {
+    auto image = CTinyC::Executor::make_image(program.image.data(), size(program.image), VM_MEMORY_SIZE,
+        VM_START_OFFSET, program.metadata.bss_size, program.metadata.ffi_imports);
+    image.ip = program.entry;
+    return image;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Code/CodeGen.hpp"
+#include "Code/Executor.hpp"
+
+#include <filesystem>
+
+// What the command-line driver and the check / benchmark tools next to it share:
+// the VM layout, quiet loggers and I/O, and compiling a program up to its entry point.
+
+// Same as the slave process
+constexpr size_t VM_MEMORY_SIZE = 1024 * 1024 * 16;
+constexpr size_t VM_START_OFFSET = 1000;
+
+struct NullLogger : CTinyC::Logger {
+    NullLogger() { set_min_severity(Severity::Off); }
+    void log(Severity, winrt::hstring const&) override {}
+};
+// Programs get no input; NullIo drops the output, CaptureIo keeps it
+struct NullIo : CTinyC::ExecutorIo {
+    int read_char() override { return -1; }
+    void write(std::string_view) override {}
+};
+struct CaptureIo : CTinyC::ExecutorIo {
+    int read_char() override { return -1; }
+    void write(std::string_view bytes) override { output += bytes; }
+
+    std::string output;
+};
+
+struct CompiledProgram {
+    std::vector<uint8_t> image;
+    CTinyC::CodeMetadata metadata;
+    // Address of main
+    size_t entry{};
+};
+
+std::string read_file(std::filesystem::path const& path);
+std::string_view trim_right(std::string_view str);
+
+// Compiles TinyC source, or bytecode assembly if `assembly` is set, at VM_START_OFFSET.
+// Throws runtime_error if it does not compile or has no main function.
+CompiledProgram compile(std::string_view source, CTinyC::Logger* logger,
+    CTinyC::FfiRegistry const* ffi_registry = nullptr, bool assembly = false);
+// VM memory with the program loaded, ready to run from main
+CTinyC::ExecutorImage make_image(CompiledProgram const& program);